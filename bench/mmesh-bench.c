@@ -0,0 +1,1034 @@
+/* *****************************************************************************
+ *
+ * Copyright (c) 2007-2023 Alexis Naveros.
+ * Portions developed under contract to the SURVICE Engineering Company.
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ * claim that you wrote the original software. If you use this software
+ * in a product, an acknowledgment in the product documentation would be
+ * appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ * misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ *
+ * *****************************************************************************
+ */
+
+/*
+End-to-end benchmark of mdMeshDecimation() and moOptimizeMesh()
+
+Procedural meshes are generated with fixed seeds, then decimated and optimized over a grid of thread counts
+and decimation flags. Results are written as JSON : triangles per second for each decimation stage and for the
+optimizer, scaling efficiency relative to the lowest thread count, and peak resident memory of each run.
+The mean cost of collapses, relative to the maximum collapse cost, compares the decimation quality of flags
+such as MD_FLAGS_MULTI_QUEUE against the per-thread queues. Memory flags such as MD_FLAGS_HUGE_PAGES are
+measured the same way, against a run without them.
+
+  mmesh-bench -m sphere,heightfield -n 1000000 -t 1,2,4,8 -f 0x0,0x100,0x4000 -o results.json
+  mmesh-bench -m sphere -n 4000000 -t 1,4 -f 0x0,0x8000 -o hugepages.json
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#if defined(_WIN32)
+ #include <windows.h>
+#else
+ #include <time.h>
+ #include <unistd.h>
+ #include <sys/time.h>
+ #include <sys/resource.h>
+#endif
+
+#include "meshdecimation.h"
+#include "meshoptimizer.h"
+
+
+#ifndef M_PI
+ #define M_PI (3.14159265358979323846)
+#endif
+
+
+#define BENCH_THREAD_COUNT_MAX (256)
+#define BENCH_FLAGS_COUNT_MAX (32)
+
+#define BENCH_DEFAULT_TRICOUNT (1000000)
+#define BENCH_DEFAULT_FEATURE_FACTOR (0.01)
+#define BENCH_DEFAULT_REPEAT_COUNT (1)
+
+#define BENCH_VERTEX_CACHE_SIZE (32)
+
+#define BENCH_SEED (0x5ca1ab1e)
+
+
+////
+
+
+typedef struct
+{
+  size_t vertexcount;
+  size_t vertexalloc;
+  float *vertex;
+  size_t tricount;
+  size_t trialloc;
+  uint32_t *indices;
+  /* Grid input for mdOperationGrid(), zero gridwidth for indexed meshes */
+  size_t gridwidth;
+  size_t gridheight;
+  float *gridheights;
+  uint8_t *gridmask;
+} benchMesh;
+
+
+static void benchMeshInit( benchMesh *mesh, size_t vertexalloc, size_t trialloc )
+{
+  mesh->vertexcount = 0;
+  mesh->vertexalloc = ( vertexalloc ? vertexalloc : 1024 );
+  mesh->vertex = malloc( mesh->vertexalloc * 3 * sizeof(float) );
+  mesh->tricount = 0;
+  mesh->trialloc = ( trialloc ? trialloc : 1024 );
+  mesh->indices = malloc( mesh->trialloc * 3 * sizeof(uint32_t) );
+  mesh->gridwidth = 0;
+  mesh->gridheight = 0;
+  mesh->gridheights = 0;
+  mesh->gridmask = 0;
+  return;
+}
+
+static void benchMeshFree( benchMesh *mesh )
+{
+  free( mesh->vertex );
+  free( mesh->indices );
+  free( mesh->gridheights );
+  free( mesh->gridmask );
+  mesh->vertex = 0;
+  mesh->indices = 0;
+  mesh->gridheights = 0;
+  mesh->gridmask = 0;
+  mesh->vertexcount = 0;
+  mesh->tricount = 0;
+  mesh->gridwidth = 0;
+  mesh->gridheight = 0;
+  return;
+}
+
+static uint32_t benchMeshAddVertex( benchMesh *mesh, double x, double y, double z )
+{
+  float *vertex;
+  if( mesh->vertexcount >= mesh->vertexalloc )
+  {
+    mesh->vertexalloc <<= 1;
+    mesh->vertex = realloc( mesh->vertex, mesh->vertexalloc * 3 * sizeof(float) );
+  }
+  vertex = &mesh->vertex[ mesh->vertexcount * 3 ];
+  vertex[0] = (float)x;
+  vertex[1] = (float)y;
+  vertex[2] = (float)z;
+  return (uint32_t)mesh->vertexcount++;
+}
+
+static void benchMeshAddTriangle( benchMesh *mesh, uint32_t v0, uint32_t v1, uint32_t v2 )
+{
+  uint32_t *indices;
+  if( mesh->tricount >= mesh->trialloc )
+  {
+    mesh->trialloc <<= 1;
+    mesh->indices = realloc( mesh->indices, mesh->trialloc * 3 * sizeof(uint32_t) );
+  }
+  indices = &mesh->indices[ mesh->tricount * 3 ];
+  indices[0] = v0;
+  indices[1] = v1;
+  indices[2] = v2;
+  mesh->tricount++;
+  return;
+}
+
+static void benchMeshCopy( benchMesh *dst, benchMesh *src )
+{
+  if( dst->vertexalloc < src->vertexcount )
+  {
+    dst->vertexalloc = src->vertexcount;
+    dst->vertex = realloc( dst->vertex, dst->vertexalloc * 3 * sizeof(float) );
+  }
+  if( dst->trialloc < src->tricount )
+  {
+    dst->trialloc = src->tricount;
+    dst->indices = realloc( dst->indices, dst->trialloc * 3 * sizeof(uint32_t) );
+  }
+  memcpy( dst->vertex, src->vertex, src->vertexcount * 3 * sizeof(float) );
+  memcpy( dst->indices, src->indices, src->tricount * 3 * sizeof(uint32_t) );
+  dst->vertexcount = src->vertexcount;
+  dst->tricount = src->tricount;
+  return;
+}
+
+static double benchMeshDiagonal( benchMesh *mesh )
+{
+  int axis;
+  size_t vertexindex;
+  float *vertex;
+  double min[3], max[3], diagonal;
+
+  for( axis = 0 ; axis < 3 ; axis++ )
+  {
+    min[axis] = 0.0;
+    max[axis] = 0.0;
+  }
+  vertex = mesh->vertex;
+  for( vertexindex = 0 ; vertexindex < mesh->vertexcount ; vertexindex++, vertex += 3 )
+  {
+    for( axis = 0 ; axis < 3 ; axis++ )
+    {
+      if( !( vertexindex ) || ( vertex[axis] < min[axis] ) )
+        min[axis] = vertex[axis];
+      if( !( vertexindex ) || ( vertex[axis] > max[axis] ) )
+        max[axis] = vertex[axis];
+    }
+  }
+  diagonal = 0.0;
+  for( axis = 0 ; axis < 3 ; axis++ )
+    diagonal += ( max[axis] - min[axis] ) * ( max[axis] - min[axis] );
+
+  return sqrt( diagonal );
+}
+
+
+////
+
+
+/* SplitMix64, all generators are seeded with fixed values */
+static inline uint64_t benchRandom( uint64_t *state )
+{
+  uint64_t z;
+  z = ( *state += 0x9e3779b97f4a7c15ULL );
+  z = ( z ^ ( z >> 30 ) ) * 0xbf58476d1ce4e5b9ULL;
+  z = ( z ^ ( z >> 27 ) ) * 0x94d049bb133111ebULL;
+  return z ^ ( z >> 31 );
+}
+
+/* Uniform in [0,1) */
+static inline double benchRandomDouble( uint64_t *state )
+{
+  return (double)( benchRandom( state ) >> 11 ) * ( 1.0 / 9007199254740992.0 );
+}
+
+/* Uniform in [0,range) */
+static inline uint64_t benchRandomRange( uint64_t *state, uint64_t range )
+{
+  return benchRandom( state ) % range;
+}
+
+
+////
+
+
+/* Subdivided sphere, rings of latitude between two poles */
+static void benchGenerateSphere( benchMesh *mesh, size_t targettricount )
+{
+  size_t ringcount, segmentcount, ring, segment, nextsegment;
+  uint32_t northpole, southpole, base, nextbase;
+  double theta, phi;
+
+  ringcount = (size_t)sqrt( (double)targettricount / 4.0 );
+  if( ringcount < 3 )
+    ringcount = 3;
+  segmentcount = ringcount * 2;
+  benchMeshInit( mesh, ( ( ringcount - 1 ) * segmentcount ) + 2, 2 * segmentcount * ( ringcount - 1 ) );
+
+  northpole = benchMeshAddVertex( mesh, 0.0, 0.0, 1.0 );
+  for( ring = 1 ; ring < ringcount ; ring++ )
+  {
+    theta = M_PI * (double)ring / (double)ringcount;
+    for( segment = 0 ; segment < segmentcount ; segment++ )
+    {
+      phi = 2.0 * M_PI * (double)segment / (double)segmentcount;
+      benchMeshAddVertex( mesh, sin( theta ) * cos( phi ), sin( theta ) * sin( phi ), cos( theta ) );
+    }
+  }
+  southpole = benchMeshAddVertex( mesh, 0.0, 0.0, -1.0 );
+
+  for( segment = 0 ; segment < segmentcount ; segment++ )
+  {
+    nextsegment = ( segment + 1 ) % segmentcount;
+    benchMeshAddTriangle( mesh, northpole, 1 + (uint32_t)segment, 1 + (uint32_t)nextsegment );
+  }
+  for( ring = 1 ; ring < ringcount - 1 ; ring++ )
+  {
+    base = 1 + (uint32_t)( ( ring - 1 ) * segmentcount );
+    nextbase = base + (uint32_t)segmentcount;
+    for( segment = 0 ; segment < segmentcount ; segment++ )
+    {
+      nextsegment = ( segment + 1 ) % segmentcount;
+      benchMeshAddTriangle( mesh, base + (uint32_t)segment, nextbase + (uint32_t)segment, nextbase + (uint32_t)nextsegment );
+      benchMeshAddTriangle( mesh, base + (uint32_t)segment, nextbase + (uint32_t)nextsegment, base + (uint32_t)nextsegment );
+    }
+  }
+  base = 1 + (uint32_t)( ( ringcount - 2 ) * segmentcount );
+  for( segment = 0 ; segment < segmentcount ; segment++ )
+  {
+    nextsegment = ( segment + 1 ) % segmentcount;
+    benchMeshAddTriangle( mesh, base + (uint32_t)segment, southpole, base + (uint32_t)nextsegment );
+  }
+
+  return;
+}
+
+
+/* Noisy heightfield over the unit square, low frequency waves plus per-vertex noise */
+static void benchGenerateHeightfieldGrid( benchMesh *mesh, size_t targettricount, uint64_t seed )
+{
+  size_t gridsize, x, y;
+  uint32_t v00, v10, v01, v11;
+  double fx, fy, z;
+  uint64_t randstate;
+
+  gridsize = (size_t)sqrt( (double)targettricount / 2.0 ) + 1;
+  if( gridsize < 2 )
+    gridsize = 2;
+  benchMeshInit( mesh, gridsize * gridsize, 2 * ( gridsize - 1 ) * ( gridsize - 1 ) );
+
+  randstate = seed;
+  for( y = 0 ; y < gridsize ; y++ )
+  {
+    fy = (double)y / (double)( gridsize - 1 );
+    for( x = 0 ; x < gridsize ; x++ )
+    {
+      fx = (double)x / (double)( gridsize - 1 );
+      z = 0.08 * sin( 7.0 * fx ) * cos( 5.0 * fy );
+      z += 0.02 * sin( 31.0 * fx + 3.0 * fy ) * sin( 23.0 * fy );
+      z += 0.002 * ( benchRandomDouble( &randstate ) - 0.5 );
+      benchMeshAddVertex( mesh, fx, fy, z );
+    }
+  }
+  for( y = 0 ; y < gridsize - 1 ; y++ )
+  {
+    for( x = 0 ; x < gridsize - 1 ; x++ )
+    {
+      v00 = (uint32_t)( ( y * gridsize ) + x );
+      v10 = v00 + 1;
+      v01 = v00 + (uint32_t)gridsize;
+      v11 = v01 + 1;
+      benchMeshAddTriangle( mesh, v00, v10, v11 );
+      benchMeshAddTriangle( mesh, v00, v11, v01 );
+    }
+  }
+
+  return;
+}
+
+static void benchGenerateHeightfield( benchMesh *mesh, size_t targettricount )
+{
+  benchGenerateHeightfieldGrid( mesh, targettricount, BENCH_SEED );
+  return;
+}
+
+/* The noisy heightfield as mdOperationGrid() input with no-data holes, decimated with spare vertices for
+ * the clones of MD_FLAGS_CLEANUP_TOPOLOGY and a weld tolerance of one and a half cells for MD_FLAGS_WELD_VERTICES */
+static void benchGenerateGridMask( benchMesh *mesh, size_t targettricount )
+{
+  size_t gridsize, x, y, holecount, holeindex, index;
+  double holex[16], holey[16], holeradius[16], dx, dy;
+  uint64_t randstate;
+
+  benchGenerateHeightfieldGrid( mesh, targettricount, BENCH_SEED ^ 0x6d );
+  gridsize = (size_t)sqrt( (double)mesh->vertexcount );
+  mesh->gridwidth = gridsize;
+  mesh->gridheight = gridsize;
+  mesh->gridheights = malloc( gridsize * gridsize * sizeof(float) );
+  mesh->gridmask = malloc( gridsize * gridsize * sizeof(uint8_t) );
+
+  randstate = BENCH_SEED ^ 0x6d61;
+  holecount = 16;
+  for( holeindex = 0 ; holeindex < holecount ; holeindex++ )
+  {
+    holex[holeindex] = benchRandomDouble( &randstate );
+    holey[holeindex] = benchRandomDouble( &randstate );
+    holeradius[holeindex] = 0.01 + 0.05 * benchRandomDouble( &randstate );
+  }
+  for( y = 0 ; y < gridsize ; y++ )
+  {
+    for( x = 0 ; x < gridsize ; x++ )
+    {
+      index = ( y * gridsize ) + x;
+      mesh->gridheights[index] = mesh->vertex[ ( index * 3 ) + 2 ];
+      mesh->gridmask[index] = 0;
+      for( holeindex = 0 ; holeindex < holecount ; holeindex++ )
+      {
+        dx = mesh->vertex[ ( index * 3 ) + 0 ] - holex[holeindex];
+        dy = mesh->vertex[ ( index * 3 ) + 1 ] - holey[holeindex];
+        if( ( dx * dx ) + ( dy * dy ) < holeradius[holeindex] * holeradius[holeindex] )
+          mesh->gridmask[index] = 1;
+      }
+    }
+  }
+
+  /* Triangle count of the grid for rates, the indexed copy isn't decimated */
+  mesh->tricount = 0;
+  for( y = 0 ; y < gridsize - 1 ; y++ )
+  {
+    for( x = 0 ; x < gridsize - 1 ; x++ )
+    {
+      index = ( y * gridsize ) + x;
+      if( ( mesh->gridmask[index] ) || ( mesh->gridmask[ index + gridsize + 1 ] ) )
+        continue;
+      mesh->tricount += !( mesh->gridmask[ index + 1 ] ) + !( mesh->gridmask[ index + gridsize ] );
+    }
+  }
+
+  return;
+}
+
+
+static void benchAddBox( benchMesh *mesh, double *center, double *size )
+{
+  int corner;
+  uint32_t v[8];
+  static const int boxfaces[6][4] = { { 0, 2, 3, 1 }, { 4, 5, 7, 6 }, { 0, 1, 5, 4 }, { 2, 6, 7, 3 }, { 0, 4, 6, 2 }, { 1, 3, 7, 5 } };
+
+  for( corner = 0 ; corner < 8 ; corner++ )
+    v[corner] = benchMeshAddVertex( mesh, center[0] + ( corner & 1 ? 0.5 : -0.5 ) * size[0], center[1] + ( corner & 2 ? 0.5 : -0.5 ) * size[1], center[2] + ( corner & 4 ? 0.5 : -0.5 ) * size[2] );
+  for( corner = 0 ; corner < 6 ; corner++ )
+  {
+    benchMeshAddTriangle( mesh, v[ boxfaces[corner][0] ], v[ boxfaces[corner][1] ], v[ boxfaces[corner][2] ] );
+    benchMeshAddTriangle( mesh, v[ boxfaces[corner][0] ], v[ boxfaces[corner][2] ], v[ boxfaces[corner][3] ] );
+  }
+
+  return;
+}
+
+static void benchAddCylinder( benchMesh *mesh, double *center, double radius, double height, int segmentcount )
+{
+  int segment, nextsegment;
+  uint32_t bottomcenter, topcenter, base;
+  double phi;
+
+  bottomcenter = benchMeshAddVertex( mesh, center[0], center[1], center[2] - 0.5 * height );
+  topcenter = benchMeshAddVertex( mesh, center[0], center[1], center[2] + 0.5 * height );
+  base = (uint32_t)mesh->vertexcount;
+  for( segment = 0 ; segment < segmentcount ; segment++ )
+  {
+    phi = 2.0 * M_PI * (double)segment / (double)segmentcount;
+    benchMeshAddVertex( mesh, center[0] + radius * cos( phi ), center[1] + radius * sin( phi ), center[2] - 0.5 * height );
+    benchMeshAddVertex( mesh, center[0] + radius * cos( phi ), center[1] + radius * sin( phi ), center[2] + 0.5 * height );
+  }
+  for( segment = 0 ; segment < segmentcount ; segment++ )
+  {
+    nextsegment = ( segment + 1 ) % segmentcount;
+    benchMeshAddTriangle( mesh, bottomcenter, base + 2 * nextsegment, base + 2 * segment );
+    benchMeshAddTriangle( mesh, topcenter, base + 2 * segment + 1, base + 2 * nextsegment + 1 );
+    benchMeshAddTriangle( mesh, base + 2 * segment, base + 2 * nextsegment, base + 2 * nextsegment + 1 );
+    benchMeshAddTriangle( mesh, base + 2 * segment, base + 2 * nextsegment + 1, base + 2 * segment + 1 );
+  }
+
+  return;
+}
+
+/* CAD-like assembly, many small closed parts (boxes and cylinders) scattered through the unit cube */
+static void benchGenerateAssembly( benchMesh *mesh, size_t targettricount )
+{
+  size_t partcount;
+  int axis;
+  double partscale, center[3], size[3];
+  uint64_t randstate;
+
+  /* Average part is about 60 triangles */
+  partcount = ( targettricount / 60 ) + 1;
+  partscale = 1.0 / cbrt( (double)partcount );
+  benchMeshInit( mesh, ( targettricount / 2 ) + 64, targettricount + 256 );
+
+  randstate = BENCH_SEED ^ 0xa55e;
+  while( mesh->tricount < targettricount )
+  {
+    for( axis = 0 ; axis < 3 ; axis++ )
+    {
+      center[axis] = benchRandomDouble( &randstate );
+      size[axis] = partscale * ( 0.2 + 0.6 * benchRandomDouble( &randstate ) );
+    }
+    if( benchRandomRange( &randstate, 3 ) )
+      benchAddCylinder( mesh, center, 0.5 * size[0], size[2], 8 + (int)benchRandomRange( &randstate, 25 ) );
+    else
+      benchAddBox( mesh, center, size );
+  }
+
+  return;
+}
+
+
+/* Non-manifold soup, a heightfield with fins on edges shared by three triangles, duplicated, flipped and
+ * degenerate triangles, loose triangles, all in shuffled order */
+static void benchGenerateSoup( benchMesh *mesh, size_t targettricount )
+{
+  size_t tricount, triindex, swapindex;
+  uint32_t *tri, swap[3], v0, v1, v2;
+  float *p0, *p1;
+  uint64_t randstate, feature;
+
+  benchGenerateHeightfieldGrid( mesh, ( targettricount * 9 ) / 10, BENCH_SEED ^ 0x50f7 );
+  randstate = BENCH_SEED ^ 0x50;
+
+  tricount = mesh->tricount;
+  while( mesh->tricount < targettricount )
+  {
+    triindex = (size_t)benchRandomRange( &randstate, tricount );
+    tri = &mesh->indices[ triindex * 3 ];
+    v0 = tri[0];
+    v1 = tri[1];
+    v2 = tri[2];
+    feature = benchRandomRange( &randstate, 10 );
+    if( feature < 5 )
+    {
+      /* Fin, a third triangle on an existing edge */
+      p0 = &mesh->vertex[ v0 * 3 ];
+      p1 = &mesh->vertex[ v1 * 3 ];
+      v2 = benchMeshAddVertex( mesh, 0.5 * ( p0[0] + p1[0] ), 0.5 * ( p0[1] + p1[1] ), 0.5 * ( p0[2] + p1[2] ) + 0.01 );
+      benchMeshAddTriangle( mesh, v0, v1, v2 );
+    }
+    else if( feature < 6 )
+      benchMeshAddTriangle( mesh, v0, v1, v2 );
+    else if( feature < 7 )
+      benchMeshAddTriangle( mesh, v0, v2, v1 );
+    else if( feature < 8 )
+      benchMeshAddTriangle( mesh, v0, v0, v1 );
+    else
+    {
+      /* Loose triangle near an existing one */
+      p0 = &mesh->vertex[ v0 * 3 ];
+      v0 = benchMeshAddVertex( mesh, p0[0], p0[1], p0[2] + 0.02 );
+      v1 = benchMeshAddVertex( mesh, p0[0] + 0.005, p0[1], p0[2] + 0.02 );
+      v2 = benchMeshAddVertex( mesh, p0[0], p0[1] + 0.005, p0[2] + 0.025 );
+      benchMeshAddTriangle( mesh, v0, v1, v2 );
+    }
+  }
+
+  /* Shuffle triangles, soups have no useful order */
+  for( triindex = mesh->tricount - 1 ; triindex > 0 ; triindex-- )
+  {
+    swapindex = (size_t)benchRandomRange( &randstate, triindex + 1 );
+    memcpy( swap, &mesh->indices[ triindex * 3 ], 3 * sizeof(uint32_t) );
+    memcpy( &mesh->indices[ triindex * 3 ], &mesh->indices[ swapindex * 3 ], 3 * sizeof(uint32_t) );
+    memcpy( &mesh->indices[ swapindex * 3 ], swap, 3 * sizeof(uint32_t) );
+  }
+
+  return;
+}
+
+
+typedef struct
+{
+  const char *name;
+  void (*generate)( benchMesh *mesh, size_t targettricount );
+} benchGenerator;
+
+static const benchGenerator benchGeneratorList[] =
+{
+  { "sphere", benchGenerateSphere },
+  { "heightfield", benchGenerateHeightfield },
+  { "gridmask", benchGenerateGridMask },
+  { "assembly", benchGenerateAssembly },
+  { "soup", benchGenerateSoup }
+};
+
+#define BENCH_GENERATOR_COUNT ( sizeof(benchGeneratorList) / sizeof(benchGenerator) )
+
+
+////
+
+
+static int64_t benchGetMicroseconds()
+{
+#if defined(_WIN32)
+  LARGE_INTEGER frequency, counter;
+  QueryPerformanceFrequency( &frequency );
+  QueryPerformanceCounter( &counter );
+  return (int64_t)( ( (double)counter.QuadPart * 1000000.0 ) / (double)frequency.QuadPart );
+#else
+  struct timespec ts;
+  clock_gettime( CLOCK_MONOTONIC, &ts );
+  return ( (int64_t)ts.tv_sec * 1000000 ) + ( (int64_t)ts.tv_nsec / 1000 );
+#endif
+}
+
+static int benchGetCpuCount()
+{
+#if defined(_WIN32)
+  SYSTEM_INFO sysinfo;
+  GetSystemInfo( &sysinfo );
+  return (int)sysinfo.dwNumberOfProcessors;
+#else
+  long cpucount;
+  cpucount = sysconf( _SC_NPROCESSORS_ONLN );
+  return ( cpucount > 0 ? (int)cpucount : 1 );
+#endif
+}
+
+/* Reset the peak resident set size, returns zero if the peak can only grow over the process lifetime */
+static int benchResetPeakMemory()
+{
+#if defined(__linux__)
+  FILE *file;
+  int resetflag;
+  file = fopen( "/proc/self/clear_refs", "w" );
+  if( !( file ) )
+    return 0;
+  resetflag = ( fputs( "5", file ) >= 0 );
+  if( fclose( file ) )
+    resetflag = 0;
+  return resetflag;
+#else
+  return 0;
+#endif
+}
+
+/* Peak resident set size in kilobytes, zero if unknown */
+static long benchGetPeakMemory()
+{
+#if defined(__linux__)
+  FILE *file;
+  long peakkb;
+  char line[256];
+  peakkb = 0;
+  file = fopen( "/proc/self/status", "r" );
+  if( file )
+  {
+    while( fgets( line, sizeof(line), file ) )
+    {
+      if( !( strncmp( line, "VmHWM:", 6 ) ) )
+      {
+        peakkb = strtol( &line[6], 0, 10 );
+        break;
+      }
+    }
+    fclose( file );
+  }
+  return peakkb;
+#elif defined(_WIN32)
+  return 0;
+#else
+  struct rusage usage;
+  if( getrusage( RUSAGE_SELF, &usage ) )
+    return 0;
+ #if defined(__APPLE__)
+  return (long)( usage.ru_maxrss / 1024 );
+ #else
+  return (long)usage.ru_maxrss;
+ #endif
+#endif
+}
+
+
+////
+
+
+static const char *benchStageName[MD_STATUS_STAGE_COUNT] =
+{
+  [MD_STATUS_STAGE_INIT] = "init",
+  [MD_STATUS_STAGE_BUILDVERTICES] = "buildvertices",
+  [MD_STATUS_STAGE_BUILDTRIANGLES] = "buildtriangles",
+  [MD_STATUS_STAGE_BUILDTRIREFS] = "buildtrirefs",
+  [MD_STATUS_STAGE_BUILDQUEUE] = "buildqueue",
+  [MD_STATUS_STAGE_DECIMATION] = "decimation",
+  [MD_STATUS_STAGE_STORE] = "store",
+  [MD_STATUS_STAGE_DONE] = "done"
+};
+
+typedef struct
+{
+  int threadcount;
+  int flags;
+
+  /* Decimation */
+  int64_t decimationusecs;
+  size_t outvertexcount;
+  size_t outtricount;
+  long decimationcount;
+  mdStatistics statistics;
+
+  /* Optimization of the decimated mesh */
+  int64_t optimizationusecs;
+  double acmrbefore;
+  double acmrafter;
+
+  long peakmemorykb;
+  int peakmemoryresetflag;
+} benchResult;
+
+typedef struct
+{
+  int threadcount;
+  int threadlist[BENCH_THREAD_COUNT_MAX];
+  int flagscount;
+  int flagslist[BENCH_FLAGS_COUNT_MAX];
+  int generatormask;
+  size_t tricount;
+  double featurefactor;
+  int repeatcount;
+  int optimizeflag;
+  FILE *output;
+} benchConfig;
+
+
+/* Grid input, output goes to the work buffers with room for spare vertices */
+static void benchGridOperation( mdOperation *op, benchMesh *source, benchMesh *work )
+{
+  size_t vertexalloc;
+  vertexalloc = source->vertexcount + ( source->vertexcount >> 3 );
+  if( work->vertexalloc < vertexalloc )
+  {
+    work->vertexalloc = vertexalloc;
+    work->vertex = realloc( work->vertex, work->vertexalloc * 3 * sizeof(float) );
+  }
+  mdOperationGrid( op, source->gridwidth, source->gridheight, source->gridheights, MD_FORMAT_FLOAT, sizeof(float), source->gridwidth * sizeof(float), 1.0 / (double)( source->gridwidth - 1 ), 1.0 / (double)( source->gridheight - 1 ), source->gridmask );
+  op->vertex = work->vertex;
+  op->indices = work->indices;
+  op->vertexalloc = vertexalloc;
+  mdOperationWeldTolerance( op, 1.5 / (double)( source->gridwidth - 1 ) );
+  return;
+}
+
+/* Run decimation and optimization once, keep the fastest decimation of all repeats */
+static void benchRun( benchConfig *config, benchMesh *source, benchMesh *work, double featuresize, int threadcount, int flags, benchResult *result )
+{
+  int repeatindex;
+  int64_t usecs;
+  mdOperation op;
+  mdStatistics statistics;
+
+  memset( result, 0, sizeof(benchResult) );
+  result->threadcount = threadcount;
+  result->flags = flags;
+  result->decimationusecs = -1;
+  result->peakmemoryresetflag = benchResetPeakMemory();
+
+  for( repeatindex = 0 ; repeatindex < config->repeatcount ; repeatindex++ )
+  {
+    benchMeshCopy( work, source );
+    mdOperationInit( &op );
+    mdOperationData( &op, work->vertexcount, work->vertex, MD_FORMAT_FLOAT, 3 * sizeof(float), work->tricount, work->indices, MD_FORMAT_UINT32, 3 * sizeof(uint32_t) );
+    if( source->gridwidth )
+      benchGridOperation( &op, source, work );
+    mdOperationStrength( &op, featuresize );
+    mdOperationStatistics( &op, &statistics );
+    usecs = benchGetMicroseconds();
+    if( !( mdMeshDecimation( &op, threadcount, flags ) ) )
+    {
+      fprintf( stderr, "ERROR: mdMeshDecimation() failed\n" );
+      exit( 1 );
+    }
+    usecs = benchGetMicroseconds() - usecs;
+    if( ( result->decimationusecs < 0 ) || ( usecs < result->decimationusecs ) )
+    {
+      result->decimationusecs = usecs;
+      result->outvertexcount = op.vertexcount;
+      result->outtricount = op.tricount;
+      result->decimationcount = op.decimationcount;
+      result->statistics = statistics;
+    }
+  }
+
+  if( config->optimizeflag )
+  {
+    /* work holds the last decimated mesh, identical for every repeat */
+    result->acmrbefore = moEvaluateMesh( work->tricount, work->indices, sizeof(uint32_t), 3 * sizeof(uint32_t), BENCH_VERTEX_CACHE_SIZE, 0 );
+    usecs = benchGetMicroseconds();
+    moOptimizeMesh( work->vertexcount, work->tricount, work->indices, sizeof(uint32_t), 3 * sizeof(uint32_t), 0, 0, BENCH_VERTEX_CACHE_SIZE, threadcount, 0 );
+    result->optimizationusecs = benchGetMicroseconds() - usecs;
+    result->acmrafter = moEvaluateMesh( work->tricount, work->indices, sizeof(uint32_t), 3 * sizeof(uint32_t), BENCH_VERTEX_CACHE_SIZE, 0 );
+  }
+
+  result->peakmemorykb = benchGetPeakMemory();
+  return;
+}
+
+
+static double benchRate( size_t count, int64_t usecs )
+{
+  if( usecs <= 0 )
+    return 0.0;
+  return (double)count * 1000000.0 / (double)usecs;
+}
+
+/* Efficiency relative to the lowest thread count of the same mesh and flags, 1.0 is perfect scaling */
+static double benchEfficiency( int64_t baseusecs, int basethreadcount, int64_t usecs, int threadcount )
+{
+  if( ( usecs <= 0 ) || ( threadcount <= 0 ) )
+    return 0.0;
+  return ( (double)baseusecs * (double)basethreadcount ) / ( (double)usecs * (double)threadcount );
+}
+
+static void benchWriteResult( benchConfig *config, benchMesh *source, benchResult *result, benchResult *base, int lastflag )
+{
+  int stage;
+  FILE *output;
+
+  output = config->output;
+  fprintf( output, "        {\n" );
+  fprintf( output, "          \"threads\": %d,\n", result->threadcount );
+  fprintf( output, "          \"flags\": \"0x%x\",\n", result->flags );
+  fprintf( output, "          \"effectiveflags\": \"0x%x\",\n", result->statistics.effectiveflags );
+  fprintf( output, "          \"decimation\": {\n" );
+  fprintf( output, "            \"usecs\": %lld,\n", (long long)result->decimationusecs );
+  fprintf( output, "            \"trispersec\": %.1f,\n", benchRate( source->tricount, result->decimationusecs ) );
+  fprintf( output, "            \"scalingefficiency\": %.4f,\n", benchEfficiency( base->decimationusecs, base->threadcount, result->decimationusecs, result->threadcount ) );
+  fprintf( output, "            \"outvertexcount\": %zu,\n", result->outvertexcount );
+  fprintf( output, "            \"outtricount\": %zu,\n", result->outtricount );
+  fprintf( output, "            \"stages\": {\n" );
+  for( stage = 0 ; stage < MD_STATUS_STAGE_DONE ; stage++ )
+  {
+    fprintf( output, "              \"%s\": { \"wallusecs\": %ld, \"cpuusecs\": %ld, \"trispersec\": %.1f, \"scalingefficiency\": %.4f }%s\n", benchStageName[stage], result->statistics.stagewallusecs[stage], result->statistics.stagecpuusecs[stage], benchRate( source->tricount, result->statistics.stagewallusecs[stage] ), benchEfficiency( base->statistics.stagewallusecs[stage], base->threadcount, result->statistics.stagewallusecs[stage], result->threadcount ), ( stage < MD_STATUS_STAGE_DONE - 1 ? "," : "" ) );
+  }
+  fprintf( output, "            },\n" );
+  fprintf( output, "            \"opcreatecount\": %ld,\n", result->statistics.opcreatecount );
+  fprintf( output, "            \"opupdatecount\": %ld,\n", result->statistics.opupdatecount );
+  fprintf( output, "            \"lockretrycount\": %ld,\n", result->statistics.lockretrycount );
+  fprintf( output, "            \"lockglobalcount\": %ld,\n", result->statistics.lockglobalcount );
+  fprintf( output, "            \"meancollapsecost\": %.6f\n", ( result->decimationcount ? result->statistics.collapsecostsum / (double)result->decimationcount : 0.0 ) );
+  fprintf( output, "          },\n" );
+  if( config->optimizeflag )
+  {
+    fprintf( output, "          \"optimization\": {\n" );
+    fprintf( output, "            \"usecs\": %lld,\n", (long long)result->optimizationusecs );
+    fprintf( output, "            \"trispersec\": %.1f,\n", benchRate( result->outtricount, result->optimizationusecs ) );
+    fprintf( output, "            \"scalingefficiency\": %.4f,\n", benchEfficiency( base->optimizationusecs, base->threadcount, result->optimizationusecs, result->threadcount ) );
+    fprintf( output, "            \"acmrbefore\": %.4f,\n", result->acmrbefore );
+    fprintf( output, "            \"acmrafter\": %.4f\n", result->acmrafter );
+    fprintf( output, "          },\n" );
+  }
+  fprintf( output, "          \"peakrsskb\": %ld,\n", result->peakmemorykb );
+  fprintf( output, "          \"peakrssreset\": %s\n", ( result->peakmemoryresetflag ? "true" : "false" ) );
+  fprintf( output, "        }%s\n", ( lastflag ? "" : "," ) );
+  return;
+}
+
+
+////
+
+
+static int benchParseIntList( const char *string, int *list, int listmax )
+{
+  int count;
+  long value;
+  char *end;
+
+  count = 0;
+  for( ; ; )
+  {
+    value = strtol( string, &end, 0 );
+    if( ( end == string ) || ( count >= listmax ) )
+      return 0;
+    list[count++] = (int)value;
+    if( *end != ',' )
+      break;
+    string = end + 1;
+  }
+  if( *end )
+    return 0;
+
+  return count;
+}
+
+static int benchParseGenerators( const char *string )
+{
+  int mask, index;
+  size_t length;
+  const char *end;
+
+  mask = 0;
+  for( ; ; )
+  {
+    end = strchr( string, ',' );
+    length = ( end ? (size_t)( end - string ) : strlen( string ) );
+    for( index = 0 ; index < (int)BENCH_GENERATOR_COUNT ; index++ )
+    {
+      if( ( strlen( benchGeneratorList[index].name ) == length ) && !( strncmp( benchGeneratorList[index].name, string, length ) ) )
+        break;
+    }
+    if( index == (int)BENCH_GENERATOR_COUNT )
+      return 0;
+    mask |= 1 << index;
+    if( !( end ) )
+      break;
+    string = end + 1;
+  }
+
+  return mask;
+}
+
+static void benchUsage( const char *name )
+{
+  int index;
+  printf( "Usage: %s [options]\n", name );
+  printf( "  -m <list>    Meshes to generate, comma separated :" );
+  for( index = 0 ; index < (int)BENCH_GENERATOR_COUNT ; index++ )
+    printf( " %s", benchGeneratorList[index].name );
+  printf( " (default all)\n" );
+  printf( "  -n <count>   Approximate triangle count of each mesh (default %d)\n", BENCH_DEFAULT_TRICOUNT );
+  printf( "  -t <list>    Thread counts, comma separated (default powers of two up to the CPU count)\n" );
+  printf( "  -f <list>    Decimation MD_FLAGS_* values, comma separated (default 0)\n" );
+  printf( "  -z <factor>  Feature size as a factor of the mesh diagonal (default %g)\n", BENCH_DEFAULT_FEATURE_FACTOR );
+  printf( "  -r <count>   Repeat each decimation and keep the fastest (default %d)\n", BENCH_DEFAULT_REPEAT_COUNT );
+  printf( "  -O           Skip moOptimizeMesh() runs\n" );
+  printf( "  -o <file>    Write JSON to file instead of stdout\n" );
+  return;
+}
+
+
+int main( int argc, char **argv )
+{
+  int argindex, generatorindex, flagsindex, threadindex, baseindex, cpucount, firstflag;
+  double diagonal, featuresize;
+  int64_t usecs;
+  benchConfig config;
+  benchMesh source, work;
+  benchResult *resultlist;
+  char *end;
+
+  memset( &config, 0, sizeof(benchConfig) );
+  config.generatormask = ( 1 << BENCH_GENERATOR_COUNT ) - 1;
+  config.tricount = BENCH_DEFAULT_TRICOUNT;
+  config.featurefactor = BENCH_DEFAULT_FEATURE_FACTOR;
+  config.repeatcount = BENCH_DEFAULT_REPEAT_COUNT;
+  config.optimizeflag = 1;
+  config.flagscount = 1;
+  config.flagslist[0] = 0;
+  config.output = stdout;
+
+  for( argindex = 1 ; argindex < argc ; argindex++ )
+  {
+    if( ( argindex + 1 < argc ) && !( strcmp( argv[argindex], "-m" ) ) )
+    {
+      if( !( config.generatormask = benchParseGenerators( argv[++argindex] ) ) )
+        goto usage;
+    }
+    else if( ( argindex + 1 < argc ) && !( strcmp( argv[argindex], "-n" ) ) )
+    {
+      config.tricount = (size_t)strtod( argv[++argindex], &end );
+      if( ( *end ) || !( config.tricount ) )
+        goto usage;
+    }
+    else if( ( argindex + 1 < argc ) && !( strcmp( argv[argindex], "-t" ) ) )
+    {
+      if( !( config.threadcount = benchParseIntList( argv[++argindex], config.threadlist, BENCH_THREAD_COUNT_MAX ) ) )
+        goto usage;
+    }
+    else if( ( argindex + 1 < argc ) && !( strcmp( argv[argindex], "-f" ) ) )
+    {
+      if( !( config.flagscount = benchParseIntList( argv[++argindex], config.flagslist, BENCH_FLAGS_COUNT_MAX ) ) )
+        goto usage;
+    }
+    else if( ( argindex + 1 < argc ) && !( strcmp( argv[argindex], "-z" ) ) )
+    {
+      config.featurefactor = strtod( argv[++argindex], &end );
+      if( ( *end ) || ( config.featurefactor <= 0.0 ) )
+        goto usage;
+    }
+    else if( ( argindex + 1 < argc ) && !( strcmp( argv[argindex], "-r" ) ) )
+    {
+      config.repeatcount = atoi( argv[++argindex] );
+      if( config.repeatcount < 1 )
+        goto usage;
+    }
+    else if( !( strcmp( argv[argindex], "-O" ) ) )
+      config.optimizeflag = 0;
+    else if( ( argindex + 1 < argc ) && !( strcmp( argv[argindex], "-o" ) ) )
+    {
+      config.output = fopen( argv[++argindex], "w" );
+      if( !( config.output ) )
+      {
+        fprintf( stderr, "ERROR: Failed to open %s for writing\n", argv[argindex] );
+        return 1;
+      }
+    }
+    else
+      goto usage;
+  }
+
+  cpucount = benchGetCpuCount();
+  if( !( config.threadcount ) )
+  {
+    for( threadindex = 1 ; ( threadindex <= cpucount ) && ( config.threadcount < BENCH_THREAD_COUNT_MAX ) ; threadindex <<= 1 )
+      config.threadlist[ config.threadcount++ ] = threadindex;
+    if( config.threadlist[ config.threadcount - 1 ] != cpucount )
+      config.threadlist[ config.threadcount++ ] = cpucount;
+  }
+  baseindex = 0;
+  for( threadindex = 0 ; threadindex < config.threadcount ; threadindex++ )
+  {
+    if( config.threadlist[threadindex] < 1 )
+      goto usage;
+    if( config.threadlist[threadindex] < config.threadlist[baseindex] )
+      baseindex = threadindex;
+  }
+
+  resultlist = malloc( config.threadcount * sizeof(benchResult) );
+  memset( &work, 0, sizeof(benchMesh) );
+
+  fprintf( config.output, "{\n" );
+  fprintf( config.output, "  \"benchmark\": \"mmesh-bench\",\n" );
+  fprintf( config.output, "  \"cpucount\": %d,\n", cpucount );
+  fprintf( config.output, "  \"featurefactor\": %g,\n", config.featurefactor );
+  fprintf( config.output, "  \"repeatcount\": %d,\n", config.repeatcount );
+  fprintf( config.output, "  \"meshes\": [\n" );
+
+  firstflag = 1;
+  for( generatorindex = 0 ; generatorindex < (int)BENCH_GENERATOR_COUNT ; generatorindex++ )
+  {
+    if( !( config.generatormask & ( 1 << generatorindex ) ) )
+      continue;
+    fprintf( stderr, "Generating %s, %zu triangles\n", benchGeneratorList[generatorindex].name, config.tricount );
+    usecs = benchGetMicroseconds();
+    benchGeneratorList[generatorindex].generate( &source, config.tricount );
+    usecs = benchGetMicroseconds() - usecs;
+    diagonal = benchMeshDiagonal( &source );
+    featuresize = config.featurefactor * diagonal;
+
+    fprintf( config.output, "%s    {\n", ( firstflag ? "" : ",\n" ) );
+    fprintf( config.output, "      \"mesh\": \"%s\",\n", benchGeneratorList[generatorindex].name );
+    fprintf( config.output, "      \"vertexcount\": %zu,\n", source.vertexcount );
+    fprintf( config.output, "      \"tricount\": %zu,\n", source.tricount );
+    fprintf( config.output, "      \"generateusecs\": %lld,\n", (long long)usecs );
+    fprintf( config.output, "      \"featuresize\": %g,\n", featuresize );
+    fprintf( config.output, "      \"runs\": [\n" );
+    firstflag = 0;
+
+    for( flagsindex = 0 ; flagsindex < config.flagscount ; flagsindex++ )
+    {
+      for( threadindex = 0 ; threadindex < config.threadcount ; threadindex++ )
+      {
+        fprintf( stderr, "  %s, flags 0x%x, %d threads\n", benchGeneratorList[generatorindex].name, config.flagslist[flagsindex], config.threadlist[threadindex] );
+        benchRun( &config, &source, &work, featuresize, config.threadlist[threadindex], config.flagslist[flagsindex], &resultlist[threadindex] );
+      }
+      for( threadindex = 0 ; threadindex < config.threadcount ; threadindex++ )
+        benchWriteResult( &config, &source, &resultlist[threadindex], &resultlist[baseindex], ( flagsindex == config.flagscount - 1 ) && ( threadindex == config.threadcount - 1 ) );
+      fflush( config.output );
+    }
+
+    fprintf( config.output, "      ]\n" );
+    fprintf( config.output, "    }" );
+    benchMeshFree( &source );
+  }
+
+  fprintf( config.output, "\n  ]\n" );
+  fprintf( config.output, "}\n" );
+
+  benchMeshFree( &work );
+  free( resultlist );
+  if( config.output != stdout )
+    fclose( config.output );
+  return 0;
+
+  usage:
+  benchUsage( argv[0] );
+  return 1;
+}
@@ -0,0 +1,794 @@
+/* *****************************************************************************
+ *
+ * Copyright (c) 2007-2023 Alexis Naveros.
+ * Portions developed under contract to the SURVICE Engineering Company.
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ * claim that you wrote the original software. If you use this software
+ * in a product, an acknowledgment in the product documentation would be
+ * appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ * misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ *
+ * *****************************************************************************
+ */
+
+/*
+Microbenchmarks of the building blocks of mdMeshDecimation() and moOptimizeMesh()
+
+The decimator source is included directly to reach its static kernels : collapse penalty variants, quadric solve
+and evaluation, and the work barrier. Containers are exercised through their internal interfaces : mmHash under
+contention, mmBinSort and mmRadixHeap with a heavy-tailed cost distribution, mmBlock allocation. All inputs come
+from fixed seeds, results are written as JSON in nanoseconds per operation.
+
+  mmesh-microbench -s 4 -t 1,2,4,8 -o micro.json
+*/
+
+#include "meshdecimation.c"
+
+#include "meshoptimizer.h"
+
+
+#define MICRO_THREAD_COUNT_MAX (64)
+
+#define MICRO_SEED (0x5ca1ab1e)
+
+/* Base count of operations for each benchmark, multiplied by the -s scale */
+#define MICRO_KERNEL_COUNT (1<<22)
+#define MICRO_KERNEL_SET_COUNT (4096)
+#define MICRO_HASH_COUNT (1<<20)
+#define MICRO_BINSORT_COUNT (1<<20)
+#define MICRO_BLOCK_COUNT (1<<20)
+#define MICRO_BARRIER_COUNT (1<<14)
+#define MICRO_EVALUATE_GRID_SIZE (512)
+
+
+////
+
+
+/* SplitMix64 */
+static inline uint64_t microRandom( uint64_t *state )
+{
+  uint64_t z;
+  z = ( *state += 0x9e3779b97f4a7c15ULL );
+  z = ( z ^ ( z >> 30 ) ) * 0xbf58476d1ce4e5b9ULL;
+  z = ( z ^ ( z >> 27 ) ) * 0x94d049bb133111ebULL;
+  return z ^ ( z >> 31 );
+}
+
+/* Uniform in [0,1) */
+static inline double microRandomDouble( uint64_t *state )
+{
+  return (double)( microRandom( state ) >> 11 ) * ( 1.0 / 9007199254740992.0 );
+}
+
+/* Standard normal distribution, Box-Muller */
+static double microRandomNormal( uint64_t *state )
+{
+  double u0, u1;
+  u0 = microRandomDouble( state );
+  u1 = microRandomDouble( state );
+  if( u0 < 1e-300 )
+    u0 = 1e-300;
+  return sqrt( -2.0 * log( u0 ) ) * cos( 2.0 * M_PI * u1 );
+}
+
+
+////
+
+
+typedef struct
+{
+  FILE *output;
+  int firstflag;
+  double scale;
+  int threadcount;
+  int threadlist[MICRO_THREAD_COUNT_MAX];
+  /* Prevents the compiler from discarding the results of benchmarked calls */
+  volatile double sink;
+} microContext;
+
+static void microReport( microContext *context, const char *name, int threadcount, long opcount, uint64_t nsecs )
+{
+  fprintf( context->output, "%s    { \"name\": \"%s\", \"threads\": %d, \"count\": %ld, \"nsecs\": %llu, \"nsperop\": %.3f }", ( context->firstflag ? "" : ",\n" ), name, threadcount, opcount, (unsigned long long)nsecs, ( opcount ? (double)nsecs / (double)opcount : 0.0 ) );
+  context->firstflag = 0;
+  fflush( context->output );
+  fprintf( stderr, "  %-36s %3d threads %12.3f ns/op\n", name, threadcount, ( opcount ? (double)nsecs / (double)opcount : 0.0 ) );
+  return;
+}
+
+static long microScaleCount( microContext *context, long count )
+{
+  count = (long)( (double)count * context->scale );
+  return ( count > 0 ? count : 1 );
+}
+
+
+////
+
+
+typedef struct
+{
+  mdf CPU_ALIGN16 newpoint[4];
+  mdf CPU_ALIGN16 oldpoint[4];
+  mdf CPU_ALIGN16 leftpoint[4];
+  mdf CPU_ALIGN16 rightpoint[4];
+} microPenaltySet;
+
+static void microBenchPenaltyFunction( microContext *context, const char *name, microPenaltySet *setlist, long count, mdf (*collapsepenalty)( mdf *newpoint, mdf *oldpoint, mdf *leftpoint, mdf *rightpoint, int *denyflag, mdf compactnesstarget, int meshflags ) )
+{
+  int denyflag;
+  long index;
+  double sum;
+  uint64_t nsecs;
+  microPenaltySet *set;
+
+  sum = 0.0;
+  nsecs = mmGetNanosecondsTime();
+  for( index = 0 ; index < count ; index++ )
+  {
+    set = &setlist[ index & ( MICRO_KERNEL_SET_COUNT - 1 ) ];
+    denyflag = 0;
+    sum += collapsepenalty( set->newpoint, set->oldpoint, set->leftpoint, set->rightpoint, &denyflag, MD_COLLAPSE_COST_COMPACTNESS_TARGET, 0 );
+    sum += denyflag;
+  }
+  nsecs = mmGetNanosecondsTime() - nsecs;
+  context->sink += sum;
+  microReport( context, name, 1, count, nsecs );
+  return;
+}
+
+/* Collapse penalty of a triangle, the old vertex moves by a fraction of the triangle size */
+static void microBenchPenalty( microContext *context )
+{
+  int index, axis;
+  long count;
+  uint64_t randstate;
+  microPenaltySet *setlist, *set;
+
+  setlist = mmAlignAlloc( MICRO_KERNEL_SET_COUNT * sizeof(microPenaltySet), 64 );
+  randstate = MICRO_SEED;
+  for( index = 0 ; index < MICRO_KERNEL_SET_COUNT ; index++ )
+  {
+    set = &setlist[index];
+    for( axis = 0 ; axis < 3 ; axis++ )
+    {
+      set->leftpoint[axis] = microRandomDouble( &randstate );
+      set->rightpoint[axis] = microRandomDouble( &randstate );
+      set->oldpoint[axis] = microRandomDouble( &randstate );
+      set->newpoint[axis] = set->oldpoint[axis] + 0.25 * ( microRandomDouble( &randstate ) - 0.5 );
+    }
+    set->leftpoint[3] = 0.0;
+    set->rightpoint[3] = 0.0;
+    set->oldpoint[3] = 0.0;
+    set->newpoint[3] = 0.0;
+  }
+
+  count = microScaleCount( context, MICRO_KERNEL_COUNT );
+  microBenchPenaltyFunction( context, "mdEdgeCollapsePenaltyTriangle", setlist, count, mdEdgeCollapsePenaltyTriangle );
+#if CPU_SSE_SUPPORT
+ #if !MD_CONF_DOUBLE_PRECISION
+  #if CPU_SSE4_1_SUPPORT
+  microBenchPenaltyFunction( context, "mdEdgeCollapsePenaltyTriangleSSE4p1f", setlist, count, mdEdgeCollapsePenaltyTriangleSSE4p1f );
+  #elif CPU_SSE3_SUPPORT
+  microBenchPenaltyFunction( context, "mdEdgeCollapsePenaltyTriangleSSE3f", setlist, count, mdEdgeCollapsePenaltyTriangleSSE3f );
+  #elif CPU_SSE2_SUPPORT
+  microBenchPenaltyFunction( context, "mdEdgeCollapsePenaltyTriangleSSE2f", setlist, count, mdEdgeCollapsePenaltyTriangleSSE2f );
+  #endif
+ #else
+  #if CPU_SSE4_1_SUPPORT
+  microBenchPenaltyFunction( context, "mdEdgeCollapsePenaltyTriangleSSE4p1d", setlist, count, mdEdgeCollapsePenaltyTriangleSSE4p1d );
+  #elif CPU_SSE3_SUPPORT
+  microBenchPenaltyFunction( context, "mdEdgeCollapsePenaltyTriangleSSE3d", setlist, count, mdEdgeCollapsePenaltyTriangleSSE3d );
+  #elif CPU_SSE2_SUPPORT
+  microBenchPenaltyFunction( context, "mdEdgeCollapsePenaltyTriangleSSE2d", setlist, count, mdEdgeCollapsePenaltyTriangleSSE2d );
+  #endif
+ #endif
+#endif
+
+  mmAlignFree( setlist );
+  return;
+}
+
+
+/* Vertex quadrics summed from the planes of 6 triangles around a point, as in a regular mesh */
+static void microBenchQuadric( microContext *context )
+{
+  int index, planeindex, axis;
+  long count, opindex, solvecount;
+  double sum;
+  mdf normal[3], point[3], norm;
+  uint64_t randstate, nsecs;
+  mathQuadric *quadriclist, q;
+  mdf *pointlist;
+
+  quadriclist = malloc( MICRO_KERNEL_SET_COUNT * sizeof(mathQuadric) );
+  pointlist = malloc( MICRO_KERNEL_SET_COUNT * 3 * sizeof(mdf) );
+  randstate = MICRO_SEED ^ 0x9ad;
+  for( index = 0 ; index < MICRO_KERNEL_SET_COUNT ; index++ )
+  {
+    for( axis = 0 ; axis < 3 ; axis++ )
+      point[axis] = microRandomDouble( &randstate );
+    mathQuadricZero( &quadriclist[index] );
+    for( planeindex = 0 ; planeindex < 6 ; planeindex++ )
+    {
+      for( axis = 0 ; axis < 3 ; axis++ )
+        normal[axis] = microRandomNormal( &randstate );
+      norm = MD_VectorMagnitude( normal );
+      if( norm < 1e-6 )
+        normal[0] = norm = 1.0;
+      MD_VectorMulScalar( normal, 1.0 / norm );
+      mathQuadricInit( &q, normal[0], normal[1], normal[2], -MD_VectorDotProduct( normal, point ), 0.01 + microRandomDouble( &randstate ) );
+      mathQuadricAddQuadric( &quadriclist[index], &q );
+    }
+    for( axis = 0 ; axis < 3 ; axis++ )
+      pointlist[ ( index * 3 ) + axis ] = point[axis] + 0.01 * ( microRandomDouble( &randstate ) - 0.5 );
+  }
+
+  count = microScaleCount( context, MICRO_KERNEL_COUNT );
+  solvecount = 0;
+  nsecs = mmGetNanosecondsTime();
+  for( opindex = 0 ; opindex < count ; opindex++ )
+  {
+    index = (int)( opindex & ( MICRO_KERNEL_SET_COUNT - 1 ) );
+    solvecount += mathQuadricSolve( &quadriclist[index], point );
+  }
+  nsecs = mmGetNanosecondsTime() - nsecs;
+  context->sink += (double)solvecount + point[0];
+  microReport( context, "mathQuadricSolve", 1, count, nsecs );
+
+  sum = 0.0;
+  nsecs = mmGetNanosecondsTime();
+  for( opindex = 0 ; opindex < count ; opindex++ )
+  {
+    index = (int)( opindex & ( MICRO_KERNEL_SET_COUNT - 1 ) );
+    sum += mathQuadricEvaluate( &quadriclist[index], &pointlist[ index * 3 ] );
+  }
+  nsecs = mmGetNanosecondsTime() - nsecs;
+  context->sink += sum;
+  microReport( context, "mathQuadricEvaluate", 1, count, nsecs );
+
+  free( quadriclist );
+  free( pointlist );
+  return;
+}
+
+
+////
+
+
+typedef struct
+{
+  mtThread thread;
+  int threadid;
+  int threadcount;
+  long count;
+  void *hashtable;
+  mdBarrier *barrier;
+  /* Wall time of each phase, measured by thread zero between barriers */
+  uint64_t phasensecs[3];
+  long failcount;
+} microHashThread;
+
+static inline void microHashEdge( mdEdge *edge, long index )
+{
+  edge->v[0] = (mdi)index;
+  edge->v[1] = (mdi)( ( (uint64_t)index * 2654435761ULL ) & 0x7fffffff );
+  edge->triindex = (mdi)index;
+  edge->op = 0;
+  return;
+}
+
+static void *microHashThreadMain( void *value )
+{
+  int phase;
+  long index;
+  uint64_t nsecs;
+  mdEdge edge;
+  microHashThread *hthread;
+
+  hthread = value;
+  for( phase = 0 ; phase < 3 ; phase++ )
+  {
+    mdBarrierSync( hthread->barrier );
+    nsecs = mmGetNanosecondsTime();
+    /* Threads interleave their keys, all lock pages are shared */
+    for( index = hthread->threadid ; index < hthread->count ; index += hthread->threadcount )
+    {
+      microHashEdge( &edge, index );
+      if( phase == 0 )
+      {
+        if( mmHashLockAddEntry( hthread->hashtable, &mdEdgeHashAccess, &edge, 1 ) != MM_HASH_SUCCESS )
+          hthread->failcount++;
+      }
+      else if( phase == 1 )
+      {
+        if( mmHashLockReadEntry( hthread->hashtable, &mdEdgeHashAccess, &edge ) != MM_HASH_SUCCESS )
+          hthread->failcount++;
+      }
+      else
+      {
+        if( mmHashLockDeleteEntry( hthread->hashtable, &mdEdgeHashAccess, &edge, 0 ) != MM_HASH_SUCCESS )
+          hthread->failcount++;
+      }
+    }
+    mdBarrierSync( hthread->barrier );
+    hthread->phasensecs[phase] = mmGetNanosecondsTime() - nsecs;
+  }
+
+  return 0;
+}
+
+/* Edge hash table as sized by mdMeshHashInit(), all threads add, read then delete their share of the edges */
+static void microBenchHash( microContext *context, int threadcount )
+{
+  int threadindex;
+  long count, failcount;
+  size_t hashsize;
+  void *hashtable;
+  mdBarrier barrier;
+  microHashThread *threadlist;
+
+  count = microScaleCount( context, MICRO_HASH_COUNT );
+  hashsize = (size_t)( count * 1.5 );
+  hashtable = malloc( mmHashRequiredSize( sizeof(mdEdge), hashsize, 7 ) );
+  mmHashInit( hashtable, &mdEdgeHashAccess, sizeof(mdEdge), hashsize, 7, MD_EDGE_HASH_FLAGS, 0 );
+
+  mdBarrierInit( &barrier, threadcount );
+  threadlist = calloc( threadcount, sizeof(microHashThread) );
+  for( threadindex = 0 ; threadindex < threadcount ; threadindex++ )
+  {
+    threadlist[threadindex].threadid = threadindex;
+    threadlist[threadindex].threadcount = threadcount;
+    threadlist[threadindex].count = count;
+    threadlist[threadindex].hashtable = hashtable;
+    threadlist[threadindex].barrier = &barrier;
+    mtThreadCreate( &threadlist[threadindex].thread, microHashThreadMain, &threadlist[threadindex], MT_THREAD_FLAGS_JOINABLE );
+  }
+  failcount = 0;
+  for( threadindex = 0 ; threadindex < threadcount ; threadindex++ )
+  {
+    mtThreadJoin( &threadlist[threadindex].thread );
+    failcount += threadlist[threadindex].failcount;
+  }
+  if( failcount )
+    fprintf( stderr, "WARNING: %ld mmHash operations failed\n", failcount );
+
+  /* Per-op figures are wall time divided by the total count of ops, all threads included */
+  microReport( context, "mmHashLockAddEntry", threadcount, count, threadlist[0].phasensecs[0] );
+  microReport( context, "mmHashLockReadEntry", threadcount, count, threadlist[0].phasensecs[1] );
+  microReport( context, "mmHashLockDeleteEntry", threadcount, count, threadlist[0].phasensecs[2] );
+
+  free( threadlist );
+  mdBarrierDestroy( &barrier );
+  free( hashtable );
+  return;
+}
+
+
+////
+
+
+typedef struct
+{
+  mmListNode list;
+  double value;
+} microBinSortItem;
+
+static double microBinSortValueCallback( void *item )
+{
+  return ((microBinSortItem *)item)->value;
+}
+
+/* Collapse costs are heavy-tailed, most ops are cheap and a few are far above maxcost */
+static double microBinSortCost( uint64_t *randstate, double maxcost )
+{
+  double cost;
+  cost = 0.05 * maxcost * exp( 1.5 * microRandomNormal( randstate ) );
+  if( cost > 1.2 * maxcost )
+    cost = 1.2 * maxcost;
+  return cost;
+}
+
+/* Queue set up as in mdThreadMain(), ops are added, updated by neighborhood changes, then drained */
+static void microBenchBinSort( microContext *context )
+{
+  int groupthreshold;
+  long count, index, drained;
+  double maxcost, newvalue;
+  uint64_t randstate, nsecs;
+  microBinSortItem *itemlist, *item;
+  mmBinSort *binsort;
+
+  count = microScaleCount( context, MICRO_BINSORT_COUNT );
+  maxcost = 1.0;
+  groupthreshold = (int)( count >> 10 );
+  if( groupthreshold < 256 )
+    groupthreshold = 256;
+  else if( groupthreshold > 4096 )
+    groupthreshold = 4096;
+
+  itemlist = malloc( count * sizeof(microBinSortItem) );
+  randstate = MICRO_SEED ^ 0xb15;
+  for( index = 0 ; index < count ; index++ )
+    itemlist[index].value = microBinSortCost( &randstate, maxcost );
+
+  binsort = mmBinSortInit( offsetof(microBinSortItem,list), 64, 32, -0.2 * maxcost, 1.2 * maxcost, groupthreshold, microBinSortValueCallback, 6, -1 );
+
+  nsecs = mmGetNanosecondsTime();
+  for( index = 0 ; index < count ; index++ )
+    mmBinSortAdd( binsort, &itemlist[index], itemlist[index].value );
+  nsecs = mmGetNanosecondsTime() - nsecs;
+  microReport( context, "mmBinSortAdd", 1, count, nsecs );
+
+  /* Updates scale the cost by up to a factor of two either way */
+  nsecs = mmGetNanosecondsTime();
+  for( index = 0 ; index < count ; index++ )
+  {
+    item = &itemlist[ ( (uint64_t)index * 2654435761ULL ) % count ];
+    newvalue = item->value * exp2( 2.0 * microRandomDouble( &randstate ) - 1.0 );
+    if( newvalue > 1.2 * maxcost )
+      newvalue = 1.2 * maxcost;
+    mmBinSortUpdate( binsort, item, item->value, newvalue );
+    item->value = newvalue;
+  }
+  nsecs = mmGetNanosecondsTime() - nsecs;
+  microReport( context, "mmBinSortUpdate", 1, count, nsecs );
+
+  drained = 0;
+  nsecs = mmGetNanosecondsTime();
+  while( ( item = mmBinSortGetFirst( binsort, 1.2 * maxcost ) ) )
+  {
+    mmBinSortRemove( binsort, item, item->value );
+    drained++;
+  }
+  nsecs = mmGetNanosecondsTime() - nsecs;
+  microReport( context, "mmBinSortGetFirst+Remove", 1, drained, nsecs );
+
+  mmBinSortFree( binsort );
+  free( itemlist );
+  return;
+}
+
+/* Same workload as microBenchBinSort() through the radix heap of MD_FLAGS_RADIX_HEAP */
+static void microBenchRadixHeap( microContext *context )
+{
+  long count, index, drained;
+  double maxcost, newvalue;
+  uint64_t randstate, nsecs;
+  microBinSortItem *itemlist, *item;
+  mmRadixHeap *radixheap;
+
+  count = microScaleCount( context, MICRO_BINSORT_COUNT );
+  maxcost = 1.0;
+
+  itemlist = malloc( count * sizeof(microBinSortItem) );
+  randstate = MICRO_SEED ^ 0xb15;
+  for( index = 0 ; index < count ; index++ )
+    itemlist[index].value = microBinSortCost( &randstate, maxcost );
+
+  radixheap = mmRadixHeapInit( offsetof(microBinSortItem,list), microBinSortValueCallback, -1 );
+
+  nsecs = mmGetNanosecondsTime();
+  for( index = 0 ; index < count ; index++ )
+    mmRadixHeapAdd( radixheap, &itemlist[index], itemlist[index].value );
+  nsecs = mmGetNanosecondsTime() - nsecs;
+  microReport( context, "mmRadixHeapAdd", 1, count, nsecs );
+
+  nsecs = mmGetNanosecondsTime();
+  for( index = 0 ; index < count ; index++ )
+  {
+    item = &itemlist[ ( (uint64_t)index * 2654435761ULL ) % count ];
+    newvalue = item->value * exp2( 2.0 * microRandomDouble( &randstate ) - 1.0 );
+    if( newvalue > 1.2 * maxcost )
+      newvalue = 1.2 * maxcost;
+    mmRadixHeapUpdate( radixheap, item, item->value, newvalue );
+    item->value = newvalue;
+  }
+  nsecs = mmGetNanosecondsTime() - nsecs;
+  microReport( context, "mmRadixHeapUpdate", 1, count, nsecs );
+
+  drained = 0;
+  nsecs = mmGetNanosecondsTime();
+  while( ( item = mmRadixHeapGetFirst( radixheap, 1.2 * maxcost ) ) )
+  {
+    mmRadixHeapRemove( radixheap, item, item->value );
+    drained++;
+  }
+  nsecs = mmGetNanosecondsTime() - nsecs;
+  microReport( context, "mmRadixHeapGetFirst+Remove", 1, drained, nsecs );
+
+  mmRadixHeapFree( radixheap );
+  free( itemlist );
+  return;
+}
+
+
+////
+
+
+/* Chunks of the size of decimation ops */
+static void microBenchBlock( microContext *context )
+{
+  long count, index;
+  uint64_t nsecs;
+  void **chunklist;
+  mmBlockHead block;
+  mmBlockCache cache;
+
+  count = microScaleCount( context, MICRO_BLOCK_COUNT );
+  chunklist = malloc( count * sizeof(void *) );
+  mmBlockInit( &block, 64, 16384, 16384, 16 );
+
+  nsecs = mmGetNanosecondsTime();
+  for( index = 0 ; index < count ; index++ )
+    chunklist[index] = mmBlockAlloc( &block );
+  nsecs = mmGetNanosecondsTime() - nsecs;
+  microReport( context, "mmBlockAlloc", 1, count, nsecs );
+
+  nsecs = mmGetNanosecondsTime();
+  for( index = 0 ; index < count ; index++ )
+    mmBlockRelease( &block, chunklist[index] );
+  nsecs = mmGetNanosecondsTime() - nsecs;
+  microReport( context, "mmBlockRelease", 1, count, nsecs );
+
+  nsecs = mmGetNanosecondsTime();
+  for( index = 0 ; index < count ; index++ )
+    chunklist[index] = mmBlockAlloc( &block );
+  nsecs = mmGetNanosecondsTime() - nsecs;
+  microReport( context, "mmBlockAlloc (recycled)", 1, count, nsecs );
+
+  nsecs = mmGetNanosecondsTime();
+  for( index = 0 ; index < count ; index++ )
+    mmBlockFree( &block, chunklist[index] );
+  nsecs = mmGetNanosecondsTime() - nsecs;
+  microReport( context, "mmBlockFree", 1, count, nsecs );
+
+  /* Through a magazine, as the decimation threads allocate their ops */
+  mmBlockCacheInit( &cache, &block );
+  nsecs = mmGetNanosecondsTime();
+  for( index = 0 ; index < count ; index++ )
+    chunklist[index] = mmBlockCacheAlloc( &cache );
+  nsecs = mmGetNanosecondsTime() - nsecs;
+  microReport( context, "mmBlockCacheAlloc", 1, count, nsecs );
+
+  nsecs = mmGetNanosecondsTime();
+  for( index = 0 ; index < count ; index++ )
+    mmBlockCacheRelease( &cache, chunklist[index] );
+  mmBlockCacheFlush( &cache );
+  nsecs = mmGetNanosecondsTime() - nsecs;
+  microReport( context, "mmBlockCacheRelease", 1, count, nsecs );
+
+  mmBlockFreeAll( &block );
+  free( chunklist );
+  return;
+}
+
+
+////
+
+
+typedef struct
+{
+  mtThread thread;
+  long count;
+  mdBarrier *barrier;
+} microBarrierThread;
+
+static void *microBarrierThreadMain( void *value )
+{
+  long index;
+  microBarrierThread *bthread;
+
+  bthread = value;
+  for( index = 0 ; index < bthread->count ; index++ )
+    mdBarrierSync( bthread->barrier );
+
+  return 0;
+}
+
+static void microBenchBarrier( microContext *context, int threadcount )
+{
+  int threadindex;
+  long count;
+  uint64_t nsecs;
+  mdBarrier barrier;
+  microBarrierThread *threadlist;
+
+  count = microScaleCount( context, MICRO_BARRIER_COUNT );
+  mdBarrierInit( &barrier, threadcount );
+  threadlist = calloc( threadcount, sizeof(microBarrierThread) );
+  nsecs = mmGetNanosecondsTime();
+  for( threadindex = 0 ; threadindex < threadcount ; threadindex++ )
+  {
+    threadlist[threadindex].count = count;
+    threadlist[threadindex].barrier = &barrier;
+    mtThreadCreate( &threadlist[threadindex].thread, microBarrierThreadMain, &threadlist[threadindex], MT_THREAD_FLAGS_JOINABLE );
+  }
+  for( threadindex = 0 ; threadindex < threadcount ; threadindex++ )
+    mtThreadJoin( &threadlist[threadindex].thread );
+  nsecs = mmGetNanosecondsTime() - nsecs;
+  microReport( context, "mdBarrierSync", threadcount, count, nsecs );
+
+  free( threadlist );
+  mdBarrierDestroy( &barrier );
+  return;
+}
+
+
+////
+
+
+/* Regular grid, in row order and with triangles shuffled */
+static void microBenchEvaluate( microContext *context )
+{
+  int gridsize, x, y;
+  long tricount, triindex, swapindex, repeatcount, repeatindex;
+  double acmr;
+  uint32_t *indices, swap[3], v00;
+  uint64_t randstate, nsecs;
+
+  gridsize = (int)( MICRO_EVALUATE_GRID_SIZE * sqrt( context->scale ) );
+  if( gridsize < 8 )
+    gridsize = 8;
+  tricount = 2 * (long)( gridsize - 1 ) * (long)( gridsize - 1 );
+  indices = malloc( tricount * 3 * sizeof(uint32_t) );
+  triindex = 0;
+  for( y = 0 ; y < gridsize - 1 ; y++ )
+  {
+    for( x = 0 ; x < gridsize - 1 ; x++ )
+    {
+      v00 = (uint32_t)( ( y * gridsize ) + x );
+      indices[ triindex * 3 + 0 ] = v00;
+      indices[ triindex * 3 + 1 ] = v00 + 1;
+      indices[ triindex * 3 + 2 ] = v00 + gridsize + 1;
+      triindex++;
+      indices[ triindex * 3 + 0 ] = v00;
+      indices[ triindex * 3 + 1 ] = v00 + gridsize + 1;
+      indices[ triindex * 3 + 2 ] = v00 + gridsize;
+      triindex++;
+    }
+  }
+
+  repeatcount = 8;
+  acmr = 0.0;
+  nsecs = mmGetNanosecondsTime();
+  for( repeatindex = 0 ; repeatindex < repeatcount ; repeatindex++ )
+    acmr += moEvaluateMesh( tricount, indices, sizeof(uint32_t), 3 * sizeof(uint32_t), 32, 0 );
+  nsecs = mmGetNanosecondsTime() - nsecs;
+  context->sink += acmr;
+  microReport( context, "moEvaluateMesh (ordered)", 1, tricount * repeatcount, nsecs );
+
+  randstate = MICRO_SEED ^ 0xe7a;
+  for( triindex = tricount - 1 ; triindex > 0 ; triindex-- )
+  {
+    swapindex = (long)( microRandom( &randstate ) % (uint64_t)( triindex + 1 ) );
+    memcpy( swap, &indices[ triindex * 3 ], 3 * sizeof(uint32_t) );
+    memcpy( &indices[ triindex * 3 ], &indices[ swapindex * 3 ], 3 * sizeof(uint32_t) );
+    memcpy( &indices[ swapindex * 3 ], swap, 3 * sizeof(uint32_t) );
+  }
+  acmr = 0.0;
+  nsecs = mmGetNanosecondsTime();
+  for( repeatindex = 0 ; repeatindex < repeatcount ; repeatindex++ )
+    acmr += moEvaluateMesh( tricount, indices, sizeof(uint32_t), 3 * sizeof(uint32_t), 32, 0 );
+  nsecs = mmGetNanosecondsTime() - nsecs;
+  context->sink += acmr;
+  microReport( context, "moEvaluateMesh (shuffled)", 1, tricount * repeatcount, nsecs );
+
+  free( indices );
+  return;
+}
+
+
+////
+
+
+static int microParseIntList( const char *string, int *list, int listmax )
+{
+  int count;
+  long value;
+  char *end;
+
+  count = 0;
+  for( ; ; )
+  {
+    value = strtol( string, &end, 0 );
+    if( ( end == string ) || ( count >= listmax ) || ( value < 1 ) )
+      return 0;
+    list[count++] = (int)value;
+    if( *end != ',' )
+      break;
+    string = end + 1;
+  }
+  if( *end )
+    return 0;
+
+  return count;
+}
+
+int main( int argc, char **argv )
+{
+  int argindex, threadindex;
+  char *end;
+  microContext context;
+
+  memset( &context, 0, sizeof(microContext) );
+  context.output = stdout;
+  context.firstflag = 1;
+  context.scale = 1.0;
+  for( argindex = 1 ; argindex < argc ; argindex++ )
+  {
+    if( ( argindex + 1 < argc ) && !( strcmp( argv[argindex], "-s" ) ) )
+    {
+      context.scale = strtod( argv[++argindex], &end );
+      if( ( *end ) || ( context.scale <= 0.0 ) )
+        goto usage;
+    }
+    else if( ( argindex + 1 < argc ) && !( strcmp( argv[argindex], "-t" ) ) )
+    {
+      if( !( context.threadcount = microParseIntList( argv[++argindex], context.threadlist, MICRO_THREAD_COUNT_MAX ) ) )
+        goto usage;
+    }
+    else if( ( argindex + 1 < argc ) && !( strcmp( argv[argindex], "-o" ) ) )
+    {
+      context.output = fopen( argv[++argindex], "w" );
+      if( !( context.output ) )
+      {
+        fprintf( stderr, "ERROR: Failed to open %s for writing\n", argv[argindex] );
+        return 1;
+      }
+    }
+    else
+      goto usage;
+  }
+
+  mmInit();
+  if( !( context.threadcount ) )
+  {
+    context.threadlist[ context.threadcount++ ] = 1;
+    if( mmcore.cpuavailcount > 1 )
+      context.threadlist[ context.threadcount++ ] = ( mmcore.cpuavailcount < MICRO_THREAD_COUNT_MAX ? mmcore.cpuavailcount : MICRO_THREAD_COUNT_MAX );
+  }
+
+  fprintf( context.output, "{\n" );
+  fprintf( context.output, "  \"benchmark\": \"mmesh-microbench\",\n" );
+  fprintf( context.output, "  \"cpucount\": %d,\n", mmcore.cpucount );
+  fprintf( context.output, "  \"scale\": %g,\n", context.scale );
+  fprintf( context.output, "  \"results\": [\n" );
+
+  microBenchPenalty( &context );
+  microBenchQuadric( &context );
+  for( threadindex = 0 ; threadindex < context.threadcount ; threadindex++ )
+    microBenchHash( &context, context.threadlist[threadindex] );
+  microBenchBinSort( &context );
+  microBenchRadixHeap( &context );
+  microBenchBlock( &context );
+  for( threadindex = 0 ; threadindex < context.threadcount ; threadindex++ )
+  {
+    if( context.threadlist[threadindex] > 1 )
+      microBenchBarrier( &context, context.threadlist[threadindex] );
+  }
+  microBenchEvaluate( &context );
+
+  fprintf( context.output, "\n  ]\n" );
+  fprintf( context.output, "}\n" );
+  if( context.output != stdout )
+    fclose( context.output );
+  return 0;
+
+  usage:
+  printf( "Usage: %s [options]\n", argv[0] );
+  printf( "  -s <scale>   Multiply the count of operations of each benchmark (default 1.0)\n" );
+  printf( "  -t <list>    Thread counts for mmHash and mdBarrierSync, comma separated (default 1 and the CPU count)\n" );
+  printf( "  -o <file>    Write JSON to file instead of stdout\n" );
+  return 1;
+}
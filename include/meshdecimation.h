@@ -71,6 +71,67 @@ enum
 };
 
 
+#define MD_STATISTICS_THREAD_MAX (256)
+
+typedef struct
+{
+  /* Wall clock time spent in each MD_STATUS_STAGE_*, in microseconds */
+  long stagewallusecs[MD_STATUS_STAGE_COUNT];
+  /* CPU time spent in each MD_STATUS_STAGE_*, summed over all threads, in microseconds */
+  long stagecpuusecs[MD_STATUS_STAGE_COUNT];
+
+  /* MD_FLAGS_* in effect for the run, flags that were ignored are cleared ~ such as MD_FLAGS_MULTI_QUEUE with more threads than available CPUs */
+  int effectiveflags;
+
+  /* Count of threads that took part, and time each of them spent waiting in barriers or for global locks, in microseconds */
+  int threadcount;
+  long barrierwaitusecs[MD_STATISTICS_THREAD_MAX];
+
+  /* Count of ops created when building the queues */
+  long opcreatecount;
+  /* Count of ops re-evaluated due to neighborhood changes */
+  long opupdatecount;
+  /* Count of op evaluations denied by the collapse penalty or above the maximum cost */
+  long opdenycount;
+  /* Count of ops rejected by the collision check when about to collapse */
+  long opcollisioncount;
+
+  /* Count of failed vertex lock attempts that had to be retried */
+  long lockretrycount;
+  /* Count of times a thread fell back to the global vertex lock */
+  long lockglobalcount;
+  /* Count of times the triref buffer had to be grown during decimation */
+  long trirefgrowcount;
+
+  /* Sum of the costs of all collapses performed, relative to the maximum collapse cost */
+  double collapsecostsum;
+} mdStatistics;
+
+
+#define MD_ATTRIB_STREAM_MAX (8)
+#define MD_ATTRIB_COMPONENT_MAX (16)
+
+/* Weighted average of both vertices, for texture coordinates, colors, etc. */
+#define MD_ATTRIB_BLEND_LINEAR (0)
+/* Weighted average renormalized to unit length, for normals and tangents, float and double formats only */
+#define MD_ATTRIB_BLEND_NORMALIZE (1)
+/* Copy the attribute of the vertex with the highest weight, for identifiers, material indices, etc. */
+#define MD_ATTRIB_BLEND_NEAREST (2)
+
+/* Vertex attribute stream, blended on collapses and repacked with vertices by the library itself */
+typedef struct
+{
+  void *base;
+  /* Supported formats: MD_FORMAT_FLOAT, MD_FORMAT_DOUBLE, MD_FORMAT_UBYTE, MD_FORMAT_USHORT, MD_FORMAT_UINT8, MD_FORMAT_UINT16 */
+  /* 8 and 16 bits integer formats are blended as normalized values */
+  /* MD_FORMAT_INT, MD_FORMAT_UINT, MD_FORMAT_INT32, MD_FORMAT_UINT32 are only supported with MD_ATTRIB_BLEND_NEAREST */
+  int format;
+  size_t stride;
+  int componentcount;
+  int blendmode;
+} mdAttribStream;
+
+
 typedef struct
 {
   /* Input vertex data */
@@ -104,6 +165,13 @@ typedef struct
   int (*adjustcollapsed)( void *adjustcontext, double *collapsepoint, double *v0point, double *v1point );
   void *adjustcontext;
 
+  /* Optional batched variants of collapsemultiplier and adjustcollapse, invoked once for a block of edges ~ take precedence over the per-edge callbacks */
+  /* collapsemultiplierbatch receives count pairs of tridata and XYZ points, writes count multipliers */
+  void (*collapsemultiplierbatch)( void *collapsecontext, int count, void **tridata0, void **tridata1, double *point0, double *point1, double *multiplier );
+  /* adjustcollapsebatch adjusts count XYZ collapse points in place, writes a zero accept value to deny a collapse point */
+  void (*adjustcollapsebatchf)( void *adjustcontext, int count, float *collapsepoint, float *v0point, float *v1point, int *accept );
+  void (*adjustcollapsebatchd)( void *adjustcontext, int count, double *collapsepoint, double *v0point, double *v1point, int *accept );
+
   /* Optional callback, merge attributes for two vertices with the given blending factors */
   void (*vertexmerge)( void *mergecontext, int dstindex, int srcindex, double weight0, double weight1 );
   void *mergecontext;
@@ -112,6 +180,10 @@ typedef struct
   void (*vertexcopy)( void *mergecontext, int dstindex, int srcindex );
   void *copycontext;
 
+  /* Optional vertex attribute streams, blended and repacked without callbacks ~ set by mdOperationAttribStream() */
+  int attribcount;
+  mdAttribStream attrib[MD_ATTRIB_STREAM_MAX];
+
 
 
 #if 0
@@ -166,10 +238,17 @@ typedef struct
   /* Output: Count of edges that were reused by triangles */
   /* Any non-zero count indicates mesh topology errors in the input data */
   long collisioncount;
+  /* Output: Count of non-manifold vertices MD_FLAGS_CLEANUP_TOPOLOGY left unsplit, for lack of spare vertices in vertexalloc */
+  long cleanupunsplitcount;
 
   /* Output: Time spent performing the decimation */
   long msecs;
 
+  /* Optional time budget in milliseconds, decimation stops at the sync step that exceeds it and the mesh decimated so far is written ~ zero for no limit */
+  long timebudget;
+  /* Output: Non-zero if decimation was stopped early, by mdMeshDecimationCancel() or the time budget */
+  int stopped;
+
   /* Status callback */
   long statusmilliseconds;
   void *statuscontext;
@@ -178,6 +257,22 @@ typedef struct
   /* Optional vertex locking map, can be null if not used */
   uint32_t *lockmap;
 
+  /* Optional regular grid input set by mdOperationGrid(), replaces input vertex and indices data */
+  size_t gridwidth;
+  size_t gridheight;
+  void *gridheights;
+  /* Supported height formats: MD_FORMAT_FLOAT, MD_FORMAT_DOUBLE, MD_FORMAT_SHORT, MD_FORMAT_INT, MD_FORMAT_USHORT, MD_FORMAT_INT16, MD_FORMAT_INT32, MD_FORMAT_UINT16 */
+  int gridheightformat;
+  size_t gridsamplestride;
+  size_t gridrowstride;
+  double gridspacingx;
+  double gridspacingy;
+  /* Optional, one byte per sample, non-zero for samples without data ; triangles touching such samples are skipped */
+  const uint8_t *gridnodatamask;
+
+  /* Maximum distance between vertices welded by MD_FLAGS_WELD_VERTICES, zero to only weld identical positions */
+  double weldtolerance;
+
   /* Advanced configuration options */
   double compactnesstarget; /* default 0.25 */
   double compactnesspenalty; /* default 1.0 */
@@ -190,6 +285,9 @@ typedef struct
   /* Maximum memory usage, if possible ~ mdMeshDecimation() may still allocate more than that if necessary */
   size_t maxmemoryusage;
 
+  /* Optional statistics, filled in when decimation completes if non-null */
+  mdStatistics *statistics;
+
 } mdOperation;
 
 
@@ -222,6 +320,16 @@ MMESH_EXPORT void mdOperationInit( mdOperation *op );
 /* Set vertex and indices input data */
 MMESH_EXPORT void mdOperationData( mdOperation *op, size_t vertexcount, void *vertex, int vertexformat, size_t vertexstride, size_t tricount, void *indices, int indicesformat, size_t indicesstride );
 
+/* Set a regular grid of heights as input, vertex (x*spacingx,y*spacingy,height) ; each cell is split in two triangles */
+/* Saves the caller building vertex and index arrays, the decimation still builds its edge hash and needs as much memory as for indexed input */
+/* Sets op->vertexcount and op->tricount, vertex and indices formats and strides set by mdOperationData() are used for output only */
+/* Output vertex and indices buffers can be null, they are then allocated by malloc() to fit the decimated mesh, the caller frees them */
+/* If these can't be allocated, no mesh is written, op->vertexcount and op->tricount are zero and mdMeshDecimation() returns zero */
+MMESH_EXPORT int mdOperationGrid( mdOperation *op, size_t width, size_t height, void *heights, int heightformat, size_t samplestride, size_t rowstride, double spacingx, double spacingy, const uint8_t *nodatamask );
+
+/* Set optional tolerance for MD_FLAGS_WELD_VERTICES, default is zero to only weld vertices with identical positions */
+MMESH_EXPORT void mdOperationWeldTolerance( mdOperation *op, double tolerance );
+
 /* Set decimation strength, feature size proportional to scale of model */
 MMESH_EXPORT void mdOperationStrength( mdOperation *op, double featuresize );
 
@@ -231,21 +339,36 @@ MMESH_EXPORT void mdOperationBoundaryWeight( mdOperation *op, double boundarywei
 /* Set optional per-triangle data and callback to return a edge weight between two triangles */
 MMESH_EXPORT void mdOperationTriData( mdOperation *op, void *tridata, size_t tridatasize, double (*edgeweight)( void *tridata0, void *tridata1 ), double (*collapsemultiplier)( void *collapsecontext, void *tridata0, void *tridata1, double *point0, double *point1 ), void *collapsecontext );
 
+/* Set optional batched callback to return cost multipliers for a block of edges, replaces the collapsemultiplier of mdOperationTriData() */
+MMESH_EXPORT void mdOperationCollapseMultiplierBatch( mdOperation *op, void (*collapsemultiplierbatch)( void *collapsecontext, int count, void **tridata0, void **tridata1, double *point0, double *point1, double *multiplier ), void *collapsecontext );
+
 /* Set optional callback to copy vertex attributes (excluding vertex position) */
 MMESH_EXPORT void mdOperationVertexCopy( mdOperation *op, void (*vertexcopy)( void *copycontext, int dstindex, int srcindex ), void *copycontext );
 
 /* Set optional callback to blend vertex attributes (exclude vertex position) */
 MMESH_EXPORT void mdOperationVertexMerge( mdOperation *op, void (*vertexmerge)( void *mergecontext, int dstindex, int srcindex, double weight0, double weight1 ), void *mergecontext );
 
+/* Add an optional vertex attribute stream, MD_ATTRIB_BLEND_*, return zero if the stream is invalid or MD_ATTRIB_STREAM_MAX is reached */
+MMESH_EXPORT int mdOperationAttribStream( mdOperation *op, void *base, int format, size_t stride, int componentcount, int blendmode );
+
 /* Set optional callbacks to adjust the XYZ of potential collapse point */
 MMESH_EXPORT void mdOperationAdjustCollapse( mdOperation *op, int (*adjustcollapsef)( void *adjustcontext, float *collapsepoint, float *v0point, float *v1point ), int (*adjustcollapsed)( void *adjustcontext, double *collapsepoint, double *v0point, double *v1point ), void *adjustcontext );
 
+/* Set optional batched callbacks to adjust the XYZ of the potential collapse points of a block of edges */
+MMESH_EXPORT void mdOperationAdjustCollapseBatch( mdOperation *op, void (*adjustcollapsebatchf)( void *adjustcontext, int count, float *collapsepoint, float *v0point, float *v1point, int *accept ), void (*adjustcollapsebatchd)( void *adjustcontext, int count, double *collapsepoint, double *v0point, double *v1point, int *accept ), void *adjustcontext );
+
 /* Set optional computation and storage of normals */
 MMESH_EXPORT void mdOperationComputeNormals( mdOperation *op, void *base, int format, size_t stride );
 
+/* Set optional time budget, decimation stops at the sync step that exceeds it */
+MMESH_EXPORT void mdOperationTimeBudget( mdOperation *op, long milliseconds );
+
 /* Set optional callback to receive progress updates */
 MMESH_EXPORT void mdOperationStatusCallback( mdOperation *op, void (*statuscallback)( void *statuscontext, const mdStatus *status ), void *statuscontext, long milliseconds );
 
+/* Set optional struct to receive timing and work statistics once the decimation has completed */
+MMESH_EXPORT void mdOperationStatistics( mdOperation *op, mdStatistics *statistics );
+
 /* Optional, flag vertex for locking, op->vertexcount must already be set ; op->lockmap is allocated by malloc() if null */
 MMESH_EXPORT void mdOperationLockVertex( mdOperation *op, long vertexindex );
 
@@ -273,6 +396,35 @@ MMESH_EXPORT int mdMeshDecimation( mdOperation *operation, int threadcount, int
 #define MD_FLAGS_PLANAR_MODE (0x40)
 /* Disable allocating memory strictly from local NUMA nodes on which threads are locked */
 #define MD_FLAGS_DISABLE_NUMA (0x80)
+/* Produce bit-identical output for any thread count, collapses are ordered by cost and resolved in rounds, somewhat slower */
+#define MD_FLAGS_DETERMINISTIC (0x100)
+/* Weld duplicated vertices within op->weldtolerance before decimation, triangles collapsed by welding are dropped */
+/* Welded vertices keep the lowest vertex index, locked vertices are never welded */
+#define MD_FLAGS_WELD_VERTICES (0x200)
+/* Drop degenerate and duplicate triangles, split non-manifold fans around vertices into manifold sheets before decimation */
+/* Split vertices are cloned into the spare vertices of op->vertexalloc, the vertexcopy() callback copies their attributes */
+/* Vertices left unsplit for lack of spare vertices are counted in op->cleanupunsplitcount */
+/* Two triangles sharing an edge with inconsistent winding aren't connected through it, their shared vertices are split */
+#define MD_FLAGS_CLEANUP_TOPOLOGY (0x400)
+/* Assign edges to threads by Morton order of triangle centroids rather than by triangle index, each thread owns a compact region */
+/* Reduces lock contention and cross-thread updates for meshes with a spatially random triangle order */
+#define MD_FLAGS_SPATIAL_PARTITION (0x800)
+/* Renumber internal vertices and triangles in Morton order of their position for cache locality, for meshes with a spatially random order */
+/* Output keeps the original order of vertices and triangles, vertexcopy(), vertexmerge() and attribute indices remain the user's indices */
+#define MD_FLAGS_SPATIAL_REORDER (0x1000)
+/* Queue ops in a radix heap keyed on the integer form of collapse costs, O(1) amortized and free of tuned cost ranges */
+#define MD_FLAGS_RADIX_HEAP (0x2000)
+/* Experimental : share ops of all threads in a relaxed concurrent priority queue, any thread may collapse any low-cost op */
+/* Not combined with MD_FLAGS_DETERMINISTIC, ignored with a single thread or with more threads than available CPUs */
+/* Sub-queues use spin locks, a preempted lock holder would stall the other threads ; check mdStatistics.effectiveflags */
+#define MD_FLAGS_MULTI_QUEUE (0x4000)
+/* Back the large vertex, triangle, triangle reference and edge hash arrays with huge pages to reduce TLB misses */
+/* Reserved huge pages are used when available, transparent huge pages otherwise ; ignored where the system has neither */
+#define MD_FLAGS_HUGE_PAGES (0x8000)
+/* Interleave the pages of the large shared arrays over all NUMA nodes, instead of placing them by first touch of the thread owning each range */
+/* Always interleaved with MD_FLAGS_SPATIAL_PARTITION, threads then own spatial cells rather than the index ranges they initialize */
+/* Both placements are skipped with MD_FLAGS_DISABLE_NUMA or on systems with a single NUMA node */
+#define MD_FLAGS_NUMA_INTERLEAVE (0x10000)
 
 
 /* Low-level mesh decimation interface, allows reuse of external threads */
@@ -288,6 +440,80 @@ MMESH_EXPORT void mdMeshDecimationThread( mdState *state, int threadindex );
 /* Wait until the work has completed */
 MMESH_EXPORT void mdMeshDecimationEnd( mdState *state );
 
+/* Request decimation to stop at the current sync step, the mesh decimated so far is still written ~ can be called from any thread */
+MMESH_EXPORT void mdMeshDecimationCancel( mdState *state );
+
+
+/* Asynchronous mesh decimation, threads are launched by the library */
+
+/* Launch the decimation of the mesh specified by the mdOperation struct and return immediately */
+MMESH_EXPORT mdState *mdMeshDecimationStart( mdOperation *operation, int threadcount, int flags );
+
+/* Poll an asynchronous decimation, status can be null ; return non-zero once all threads are done */
+MMESH_EXPORT int mdMeshDecimationPoll( mdState *state, mdStatus *status );
+
+/* Wait for an asynchronous decimation to complete, write out the mesh and free the state */
+MMESH_EXPORT int mdMeshDecimationWait( mdState *state );
+
+
+/* Measurement of the geometric error between two meshes, typically the input and output of a decimation */
+
+typedef struct
+{
+  /* Reference mesh, such as a copy of the input of the decimation */
+  size_t refvertexcount;
+  void *refvertex;
+  int refvertexformat;
+  size_t refvertexstride;
+  size_t reftricount;
+  void *refindices;
+  int refindicesformat;
+  size_t refindicesstride;
+
+  /* Measured mesh, such as the output of the decimation */
+  size_t vertexcount;
+  void *vertex;
+  int vertexformat;
+  size_t vertexstride;
+  size_t tricount;
+  void *indices;
+  int indicesformat;
+  size_t indicesstride;
+
+  /* Count of area-weighted surface samples in each direction, zero picks the larger triangle count (at least 65536) */
+  /* Output: Count of surface samples used, vertices of both meshes are always sampled in addition */
+  size_t samplecount;
+
+  /* Output: Distances from the measured surface to the reference surface */
+  double forwardmax;
+  double forwardmean;
+  double forwardrms;
+  /* Output: Distances from the reference surface to the measured surface */
+  double backwardmax;
+  double backwardmean;
+  double backwardrms;
+  /* Output: Symmetric Hausdorff distance, and mean/rms distance over the samples of both directions */
+  double maxdistance;
+  double meandistance;
+  double rmsdistance;
+
+  /* Output: Time spent performing the measurement */
+  long msecs;
+
+} mdErrorOperation;
+
+/* Initialize mdErrorOperation with default values */
+MMESH_EXPORT void mdErrorOperationInit( mdErrorOperation *errop );
+
+/* Set vertex and indices data of the reference mesh */
+MMESH_EXPORT void mdErrorOperationReference( mdErrorOperation *errop, size_t vertexcount, void *vertex, int vertexformat, size_t vertexstride, size_t tricount, void *indices, int indicesformat, size_t indicesstride );
+
+/* Set vertex and indices data of the measured mesh */
+MMESH_EXPORT void mdErrorOperationData( mdErrorOperation *errop, size_t vertexcount, void *vertex, int vertexformat, size_t vertexstride, size_t tricount, void *indices, int indicesformat, size_t indicesstride );
+
+/* Measure distances between both surfaces in both directions, flags should be zero ; returns zero on invalid input */
+MMESH_EXPORT int mdMeasureError( mdErrorOperation *errop, int threadcount, int flags );
+
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,73 @@
+/* *****************************************************************************
+ *
+ * Copyright (c) 2012-2023 Alexis Naveros.
+ * Portions developed under contract to the SURVICE Engineering Company.
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ * claim that you wrote the original software. If you use this software
+ * in a product, an acknowledgment in the product documentation would be
+ * appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ * misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ *
+ * *****************************************************************************
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h> /* for size_t */
+
+#ifndef COMPILER_DLLEXPORT
+# if defined(_WIN32)
+#  define COMPILER_DLLEXPORT __declspec(dllexport)
+#  define COMPILER_DLLIMPORT __declspec(dllimport)
+# else
+#  define COMPILER_DLLEXPORT __attribute__ ((visibility ("default")))
+#  define COMPILER_DLLIMPORT __attribute__ ((visibility ("default")))
+# endif
+#endif
+
+#ifndef MMESH_EXPORT
+#  if defined(MMESH_DLL_EXPORTS) && defined(MMESH_DLL_IMPORTS)
+#    error "Only MMESH_DLL_EXPORTS or MMESH_DLL_IMPORTS can be defined, not both."
+#  elif defined(MMESH_DLL_EXPORTS)
+#    define MMESH_EXPORT COMPILER_DLLEXPORT
+#  elif defined(MMESH_DLL_IMPORTS)
+#    define MMESH_EXPORT COMPILER_DLLIMPORT
+#  else
+#    define MMESH_EXPORT
+#  endif
+#endif
+
+
+/*
+Timeline tracing of mesh decimation and optimization runs.
+
+While a trace is active, every run of mdMeshDecimation() and moOptimizeMesh() (or their low-level interfaces)
+records spans for its build stages, decimation sync steps, barrier waits, global lock pauses and output stage.
+Each thread records into its own ring buffer of eventcount spans, the oldest spans are overwritten when full.
+
+The trace is written as Chrome trace-event JSON, which can be opened in chrome://tracing or ui.perfetto.dev
+*/
+
+/* Begin recording, returns zero if a trace is already active or on allocation failure */
+MMESH_EXPORT int mmTraceBegin( size_t eventcount );
+
+/* Stop recording and write the timeline to filename, waits for traced runs in progress to complete */
+MMESH_EXPORT int mmTraceEnd( const char *filename );
+
+
+#ifdef __cplusplus
+}
+#endif
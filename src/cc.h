@@ -159,6 +159,7 @@
  #define CC_ALWAYSINLINE __attribute__((always_inline))
  #define CC_LIKELY(x) __builtin_expect(!!(x), 1)
  #define CC_UNLIKELY(x) __builtin_expect(!!(x), 0)
+ #define CC_PREFETCH(x) __builtin_prefetch(x)
  #define CC_UNUSED __attribute__((unused))
  #define CC_DEPRECATED __attribute__((deprecated))
  #define CC_DEPRECATED_MSG(x) __attribute__((deprecated(x)))
@@ -171,6 +172,12 @@
  #define CC_ALWAYSINLINE __forceinline
  #define CC_LIKELY(x) (x)
  #define CC_UNLIKELY(x) (x)
+ #if defined(_M_X64) || defined(_M_IX86)
+  #include <xmmintrin.h>
+  #define CC_PREFETCH(x) _mm_prefetch((const char *)(x),_MM_HINT_T0)
+ #else
+  #define CC_PREFETCH(x)
+ #endif
  #define CC_UNUSED
  #define CC_DEPRECATED _declspec(deprecated)
  #define CC_DEPRECATED_MSG(x) _declspec(deprecated(x))
@@ -196,6 +203,7 @@
  #define CC_ALWAYSINLINE
  #define CC_LIKELY(x) (x)
  #define CC_UNLIKELY(x) (x)
+ #define CC_PREFETCH(x)
  #define CC_UNUSED
  #define CC_DEPRECATED
  #define CC_DEPRECATED_MSG(x)
@@ -41,6 +41,8 @@
 #include "mmhash.h"
 
 #include "mmbinsort.h"
+#include "mmradixheap.h"
+#include "mmtrace.h"
 #include "meshdecimation.h"
 
 
@@ -104,6 +106,9 @@
 /* Enable progress report callback */
 #define MD_CONF_ENABLE_PROGRESS (1)
 
+/* Enable collection of timing and work statistics, only performed when mdOperation.statistics is set */
+#define MD_CONF_ENABLE_STATISTICS (1)
+
 /* Align all ops on 64 bytes to reduce cache line fetches */
 #define MD_CONF_OP_ALIGNMENT (0x40)
 
@@ -141,6 +146,13 @@
 
 #define MD_SYNC_STEP_COUNT (64)
 
+/* With targetvertexcountmax, the op queue covers costs up to this factor of maxcollapsecost */
+#define MD_TARGET_MAX_COST_RANGE (64.0)
+
+/* With MD_FLAGS_MULTI_QUEUE, count of shared sub-queues per thread, and rounds of two random picks before scanning all sub-queues */
+#define MD_MULTIQUEUE_FACTOR (4)
+#define MD_MULTIQUEUE_PICK_ROUNDS (4)
+
 #define MD_QUADRIC_DETERMINANT_MIN (0.0000000001)
 
 #define MD_GLOBAL_LOCK_THRESHOLD (16)
@@ -803,6 +815,9 @@ typedef struct MD_PACKED_EDGE_STRUCT
   void *op;
 } mdEdge;
 
+/* Deterministic mode, tags a directed edge shared by several triangles until the edge flags are resolved */
+#define MD_EDGE_OP_DUPLICATE ((void *)0x1)
+
 /* Double precision storage: 48 + 88 bytes (mathQuadric) = 136 bytes */
 #if CPU_SSE_SUPPORT && !MD_CONF_DOUBLE_PRECISION
 typedef struct CPU_ALIGN16
@@ -844,6 +859,25 @@ typedef struct CPU_ALIGN64
 } mdUpdateBuffer;
 
 
+/* Op queue, a hierarchical bucket sort of ops, or a radix heap of ops with MD_FLAGS_RADIX_HEAP */
+typedef struct
+{
+  void *binsort;
+  void *radixheap;
+} mdQueue;
+
+/* Sub-queue of the relaxed priority queue shared by all threads with MD_FLAGS_MULTI_QUEUE */
+typedef struct CPU_ALIGN64
+{
+  mdQueue queue;
+#if MD_CONFIG_ATOMIC_SUPPORT
+  mmAtomic32 atomlock;
+#else
+  mtSpin spinlock;
+#endif
+} mdSharedQueue;
+
+
 typedef struct
 {
 #if MD_CONFIG_ATOMIC_SUPPORT
@@ -853,6 +887,8 @@ typedef struct
   mtSpin spinlock;
 #endif
   mdUpdateBuffer *updatebuffer;
+  /* Shared sub-queue holding the op with MD_FLAGS_MULTI_QUEUE */
+  int queueindex;
   mdi v0, v1;
 #if CPU_SSE_SUPPORT
   mdf CPU_ALIGN16 collapsepoint[4];
@@ -865,7 +901,7 @@ typedef struct
   mmListNode list;
 } mdOp;
 
-/* If detached, the op is not present in tdata->binsort */
+/* If detached, the op is not present in the thread's queue */
 #define MD_OP_FLAGS_DETACHED (0x1)
 /* The parent edge was removed, the edge's op is scheduled to be deleted by the owner */
 #define MD_OP_FLAGS_DELETION_PENDING (0x2)
@@ -877,6 +913,36 @@ typedef struct
 #define MD_OP_FLAGS_DELETED (0x10)
 
 
+/* Deterministic mode, claim of a vertex by the lowest op of a round */
+typedef struct
+{
+  mdOp *op;
+  uint32_t roundindex;
+} mdDetClaim;
+
+/* Deterministic mode, per-thread candidate ops of a round, winners are moved to the front */
+typedef struct
+{
+  mdOp **oplist;
+  long opcount;
+  long opalloc;
+  long wincount;
+  size_t trirefneed;
+  char padding[64];
+} mdDetList;
+
+
+/* Vertex attribute stream, as declared by mdOperationAttribStream() */
+typedef struct
+{
+  void *base;
+  size_t stride;
+  size_t elementsize;
+  int format;
+  int componentcount;
+  int blendmode;
+} mdAttrib;
+
 typedef struct
 {
   int threadcount;
@@ -890,6 +956,8 @@ typedef struct
   size_t indicesstride;
   void *tridata;
   size_t tridatasize;
+  int vertexformat;
+  int indicesformat;
   void (*indicesUserToNative)( mdi *dst, void *src );
   void (*indicesNativeToUser)( void *dst, mdi *src );
   void (*vertexUserToNative)( mdf *dst, void *src, mdf factor );
@@ -901,8 +969,14 @@ typedef struct
   void *mergecontext;
   int (*adjustcollapse)( void *adjustcontext, mdf *collapsepoint, mdf *v0point, mdf *v1point );
   void *adjustcontext;
+  void (*collapsemultiplierbatch)( void *collapsecontext, int count, void **tridata0, void **tridata1, double *point0, double *point1, double *multiplier );
+  void (*adjustcollapsebatch)( void *adjustcontext, int count, mdf *collapsepoint, mdf *v0point, mdf *v1point, int *accept );
   void (*vertexcopy)( void *copycontext, int dstindex, int srcindex );
   void *copycontext;
+
+  /* Optional vertex attribute streams */
+  int attribcount;
+  mdAttrib attrib[MD_ATTRIB_STREAM_MAX];
   void (*writenormal)( void *dst, mdf *src );
 
   /* Per-vertex triangle references */
@@ -937,6 +1011,76 @@ typedef struct
   /* Hash table to locate edges from their vertex indices */
   void *edgehashtable;
 
+  /* Grid input, vertices and triangles are generated from heights */
+  int gridflag;
+  mdi gridwidth;
+  mdi gridheight;
+  void *gridheights;
+  int gridheightformat;
+  size_t gridsamplestride;
+  size_t gridrowstride;
+  mdf gridspacing[2];
+  const uint8_t *gridnodatamask;
+  /* With a no-data mask, count of triangles in all rows of cells before each row */
+  mdi *gridrowtribase;
+  /* Boundary flags derived from the grid layout, only while vertex indices still follow it */
+  int gridboundaryflag;
+
+  /* Optional vertex welding, spatial hash of cell representatives and map of vertices to their welded vertex */
+  int weldflag;
+  mdf weldtolerance;
+  void *weldhashtable;
+  mdi *weldmap;
+
+  /* Optional spatial partitioning, triangles sorted by Morton order of their centroids, each thread populates a contiguous range */
+  int partitionflag;
+  mdf *partitionbounds;
+  uint16_t *partitionkey;
+  mdi *partitionorder;
+
+  /* Optional renumbering along a space-filling curve, internal vertices and triangles sorted in Morton order for cache locality */
+  /* The maps translate internal indices to the user's indices and back, vertices at or beyond reordervertexcount are not renumbered */
+  int reorderflag;
+  int reorderaxisbits;
+  mdi reordervertexcount;
+  mdf *reorderbounds;
+  uint32_t *reorderkey;
+  mdf *reorderpoint;
+  mdi *reorderindices;
+  mdi *reordermap;
+  mdi *reorderrank;
+  mdi *reordertrimap;
+  mdi *reordertrirank;
+
+  /* Optional relaxed priority queue shared by all threads, MD_MULTIQUEUE_FACTOR sub-queues per thread */
+  int sharedqueueflag;
+  int sharedqueuecount;
+  mdSharedQueue *sharedqueue;
+
+  /* Optional huge pages backing the large arrays, mapped size of each array or zero when allocated normally */
+  int hugepageflag;
+  size_t vertexmmapsize;
+  size_t trireflistmmapsize;
+  size_t trilistmmapsize;
+  size_t edgehashmmapsize;
+
+  /* Optional NUMA placement of the large shared arrays, by first touch of the threads or interleaved over all nodes */
+  int numafirsttouchflag;
+  int numainterleaveflag;
+
+  /* Optional topology cleanup, cleaned up native indices and per-vertex fan analysis */
+  int cleanupflag;
+  mdi *cleanindices;
+  void *cleanhashtable;
+  mdi *cleanreflist;
+  mdi *cleanlabellist;
+  mdi *cleanclonebase;
+  mdi cleanvertexcount;
+  /* Count of non-manifold vertices left unsplit, for lack of spare vertices or memory */
+  mdi cleanunsplitcount;
+  /* Vertices at or beyond this index are clones, never locked */
+  mdi lockvertexcount;
+
   /* Collapse penalty function */
   mdf (*collapsepenalty)( mdf *newpoint, mdf *oldpoint, mdf *leftpoint, mdf *rightpoint, int *denyflag, mdf compactnesstarget, int meshflags );
 
@@ -997,6 +1141,11 @@ typedef struct
   int syncstepabort;
   mdf normalsearchangle;
 
+  /* Early stop on cancellation or past the deadline, thread zero decides before a step barrier, stopstep is the step index plus one */
+  volatile int cancelflag;
+  uint64_t deadline;
+  volatile int stopstep;
+
   /* Normal recomputation buffers */
   int clonesearchindex;
   void *vertexnormal;
@@ -1007,6 +1156,23 @@ typedef struct
   mtMutex finishmutex;
   mtSignal finishsignal;
 
+  /* Non-zero if statistics are collected */
+  int statisticsflag;
+  /* Timeline trace of the run, null if no trace is active */
+  mmTraceRun *tracerun;
+  /* Non-zero if either statistics or tracing require timings */
+  int timingflag;
+
+  /* Deterministic mode, per-vertex claims and per-thread candidate lists */
+  int deterministicflag;
+  mdDetClaim *detclaimlist;
+  mdDetList *detlist;
+  mdOp **detsortlist;
+  long detsortalloc;
+  /* Decisions of thread zero for the current round */
+  int detdoneflag;
+  mdOp *detlimitop;
+
 } mdMesh;
 
 
@@ -1426,6 +1592,403 @@ static void mdNormalNativeTo10_10_10_2( void *dst,  mdf *src )
 }
 
 
+/* Block conversion between user data and tight native arrays, used instead of one indirect call per element */
+
+#define MD_CONVERT_BLOCK_SIZE (256)
+
+static void mdConvertFloatToNative( mdf *dst, float *src, size_t count, mdf factor )
+{
+  size_t index;
+#if CPU_SSE2_SUPPORT && MD_CONF_DOUBLE_PRECISION
+  __m128 vsrc;
+  __m128d vfactor;
+#elif CPU_SSE_SUPPORT && !MD_CONF_DOUBLE_PRECISION
+  __m128 vfactor;
+#endif
+  index = 0;
+#if CPU_SSE2_SUPPORT && MD_CONF_DOUBLE_PRECISION
+  vfactor = _mm_set1_pd( factor );
+  for( ; index < ( count & ~(size_t)3 ) ; index += 4 )
+  {
+    vsrc = _mm_loadu_ps( &src[index] );
+    _mm_storeu_pd( &dst[index+0], _mm_mul_pd( _mm_cvtps_pd( vsrc ), vfactor ) );
+    _mm_storeu_pd( &dst[index+2], _mm_mul_pd( _mm_cvtps_pd( _mm_movehl_ps( vsrc, vsrc ) ), vfactor ) );
+  }
+#elif CPU_SSE_SUPPORT && !MD_CONF_DOUBLE_PRECISION
+  vfactor = _mm_set1_ps( factor );
+  for( ; index < ( count & ~(size_t)3 ) ; index += 4 )
+    _mm_storeu_ps( &dst[index], _mm_mul_ps( _mm_loadu_ps( &src[index] ), vfactor ) );
+#endif
+  for( ; index < count ; index++ )
+    dst[index] = src[index] * factor;
+  return;
+}
+
+static void mdConvertDoubleToNative( mdf *dst, double *src, size_t count, mdf factor )
+{
+  size_t index;
+#if CPU_SSE2_SUPPORT && MD_CONF_DOUBLE_PRECISION
+  __m128d vfactor;
+#endif
+  index = 0;
+#if CPU_SSE2_SUPPORT && MD_CONF_DOUBLE_PRECISION
+  vfactor = _mm_set1_pd( factor );
+  for( ; index < ( count & ~(size_t)1 ) ; index += 2 )
+    _mm_storeu_pd( &dst[index], _mm_mul_pd( _mm_loadu_pd( &src[index] ), vfactor ) );
+#endif
+  for( ; index < count ; index++ )
+    dst[index] = src[index] * factor;
+  return;
+}
+
+static void mdConvertNativeToFloat( float *dst, mdf *src, size_t count, mdf factor )
+{
+  size_t index;
+#if CPU_SSE2_SUPPORT && MD_CONF_DOUBLE_PRECISION
+  __m128d vfactor;
+  __m128 vlow, vhigh;
+#elif CPU_SSE_SUPPORT && !MD_CONF_DOUBLE_PRECISION
+  __m128 vfactor;
+#endif
+  index = 0;
+#if CPU_SSE2_SUPPORT && MD_CONF_DOUBLE_PRECISION
+  vfactor = _mm_set1_pd( factor );
+  for( ; index < ( count & ~(size_t)3 ) ; index += 4 )
+  {
+    vlow = _mm_cvtpd_ps( _mm_mul_pd( _mm_loadu_pd( &src[index+0] ), vfactor ) );
+    vhigh = _mm_cvtpd_ps( _mm_mul_pd( _mm_loadu_pd( &src[index+2] ), vfactor ) );
+    _mm_storeu_ps( &dst[index], _mm_movelh_ps( vlow, vhigh ) );
+  }
+#elif CPU_SSE_SUPPORT && !MD_CONF_DOUBLE_PRECISION
+  vfactor = _mm_set1_ps( factor );
+  for( ; index < ( count & ~(size_t)3 ) ; index += 4 )
+    _mm_storeu_ps( &dst[index], _mm_mul_ps( _mm_loadu_ps( &src[index] ), vfactor ) );
+#endif
+  for( ; index < count ; index++ )
+    dst[index] = src[index] * factor;
+  return;
+}
+
+static void mdConvertNativeToDouble( double *dst, mdf *src, size_t count, mdf factor )
+{
+  size_t index;
+#if CPU_SSE2_SUPPORT && MD_CONF_DOUBLE_PRECISION
+  __m128d vfactor;
+#endif
+  index = 0;
+#if CPU_SSE2_SUPPORT && MD_CONF_DOUBLE_PRECISION
+  vfactor = _mm_set1_pd( factor );
+  for( ; index < ( count & ~(size_t)1 ) ; index += 2 )
+    _mm_storeu_pd( &dst[index], _mm_mul_pd( _mm_loadu_pd( &src[index] ), vfactor ) );
+#endif
+  for( ; index < count ; index++ )
+    dst[index] = src[index] * factor;
+  return;
+}
+
+static void mdConvertUint16ToNative( mdi *dst, uint16_t *src, size_t count )
+{
+  size_t index;
+#if CPU_SSE2_SUPPORT && ( MD_SIZEOF_MDI == 4 )
+  __m128i vsrc, vzero;
+#endif
+  index = 0;
+#if CPU_SSE2_SUPPORT && ( MD_SIZEOF_MDI == 4 )
+  vzero = _mm_setzero_si128();
+  for( ; index < ( count & ~(size_t)7 ) ; index += 8 )
+  {
+    vsrc = _mm_loadu_si128( (__m128i *)&src[index] );
+    _mm_storeu_si128( (__m128i *)&dst[index+0], _mm_unpacklo_epi16( vsrc, vzero ) );
+    _mm_storeu_si128( (__m128i *)&dst[index+4], _mm_unpackhi_epi16( vsrc, vzero ) );
+  }
+#endif
+  for( ; index < count ; index++ )
+    dst[index] = src[index];
+  return;
+}
+
+static void mdConvertUint32ToNative( mdi *dst, uint32_t *src, size_t count )
+{
+#if MD_SIZEOF_MDI == 4
+  memcpy( dst, src, count * sizeof(uint32_t) );
+#else
+  size_t index;
+  for( index = 0 ; index < count ; index++ )
+    dst[index] = src[index];
+#endif
+  return;
+}
+
+static void mdConvertNativeToUint16( uint16_t *dst, mdi *src, size_t count )
+{
+  size_t index;
+#if CPU_SSE2_SUPPORT && ( MD_SIZEOF_MDI == 4 )
+  __m128i vbias32, vbias16, vlow, vhigh;
+#endif
+  index = 0;
+#if CPU_SSE2_SUPPORT && ( MD_SIZEOF_MDI == 4 )
+  /* No unsigned saturation before SSE4.1, bias into the signed range and back */
+  vbias32 = _mm_set1_epi32( 32768 );
+  vbias16 = _mm_set1_epi16( (short)0x8000 );
+  for( ; index < ( count & ~(size_t)7 ) ; index += 8 )
+  {
+    vlow = _mm_sub_epi32( _mm_loadu_si128( (__m128i *)&src[index+0] ), vbias32 );
+    vhigh = _mm_sub_epi32( _mm_loadu_si128( (__m128i *)&src[index+4] ), vbias32 );
+    _mm_storeu_si128( (__m128i *)&dst[index], _mm_add_epi16( _mm_packs_epi32( vlow, vhigh ), vbias16 ) );
+  }
+#endif
+  for( ; index < count ; index++ )
+    dst[index] = (uint16_t)src[index];
+  return;
+}
+
+static void mdConvertNativeToUint32( uint32_t *dst, mdi *src, size_t count )
+{
+#if MD_SIZEOF_MDI == 4
+  memcpy( dst, src, count * sizeof(uint32_t) );
+#else
+  size_t index;
+  for( index = 0 ; index < count ; index++ )
+    dst[index] = (uint32_t)src[index];
+#endif
+  return;
+}
+
+/* Convert count vertices from user data of any stride to a tight native array */
+static void mdVertexBlockUserToNative( mdf *dst, void *src, size_t srcstride, size_t count, mdf factor, int format, void (*usertonative)( mdf *dst, void *src, mdf factor ) )
+{
+  size_t index;
+  switch( format )
+  {
+    case MD_FORMAT_FLOAT:
+      if( srcstride == 3*sizeof(float) )
+        mdConvertFloatToNative( dst, src, 3*count, factor );
+      else
+      {
+        for( index = 0 ; index < count ; index++, dst += 3, src = ADDRESS( src, srcstride ) )
+          mdVertexFloatToNative( dst, src, factor );
+      }
+      break;
+    case MD_FORMAT_DOUBLE:
+      if( srcstride == 3*sizeof(double) )
+        mdConvertDoubleToNative( dst, src, 3*count, factor );
+      else
+      {
+        for( index = 0 ; index < count ; index++, dst += 3, src = ADDRESS( src, srcstride ) )
+          mdVertexDoubleToNative( dst, src, factor );
+      }
+      break;
+    default:
+      for( index = 0 ; index < count ; index++, dst += 3, src = ADDRESS( src, srcstride ) )
+        usertonative( dst, src, factor );
+      break;
+  }
+  return;
+}
+
+/* Convert count vertices from a tight native array to user data of any stride */
+static void mdVertexBlockNativeToUser( void *dst, size_t dststride, mdf *src, size_t count, mdf factor, int format, void (*nativetouser)( void *dst, mdf *src, mdf factor ) )
+{
+  size_t index;
+  switch( format )
+  {
+    case MD_FORMAT_FLOAT:
+      if( dststride == 3*sizeof(float) )
+        mdConvertNativeToFloat( dst, src, 3*count, factor );
+      else
+      {
+        for( index = 0 ; index < count ; index++, src += 3, dst = ADDRESS( dst, dststride ) )
+          mdVertexNativeToFloat( dst, src, factor );
+      }
+      break;
+    case MD_FORMAT_DOUBLE:
+      if( dststride == 3*sizeof(double) )
+        mdConvertNativeToDouble( dst, src, 3*count, factor );
+      else
+      {
+        for( index = 0 ; index < count ; index++, src += 3, dst = ADDRESS( dst, dststride ) )
+          mdVertexNativeToDouble( dst, src, factor );
+      }
+      break;
+    default:
+      for( index = 0 ; index < count ; index++, src += 3, dst = ADDRESS( dst, dststride ) )
+        nativetouser( dst, src, factor );
+      break;
+  }
+  return;
+}
+
+/* Convert count normals from a tight native array to user data of any stride */
+static void mdNormalBlockNativeToUser( void *dst, size_t dststride, mdf *src, size_t count, int format, void (*writenormal)( void *dst, mdf *src ) )
+{
+  size_t index;
+  if( ( format == MD_FORMAT_FLOAT ) && ( dststride == 3*sizeof(float) ) )
+    mdConvertNativeToFloat( dst, src, 3*count, 1.0 );
+  else if( ( format == MD_FORMAT_DOUBLE ) && ( dststride == 3*sizeof(double) ) )
+    mdConvertNativeToDouble( dst, src, 3*count, 1.0 );
+  else
+  {
+    for( index = 0 ; index < count ; index++, src += 3, dst = ADDRESS( dst, dststride ) )
+      writenormal( dst, src );
+  }
+  return;
+}
+
+/* Convert count triangles from user indices of any stride to a tight native array */
+static void mdIndicesBlockUserToNative( mdi *dst, void *src, size_t srcstride, size_t count, int format, void (*usertonative)( mdi *dst, void *src ) )
+{
+  size_t index;
+  switch( format )
+  {
+    case MD_FORMAT_SHORT:
+    case MD_FORMAT_USHORT:
+    case MD_FORMAT_INT16:
+    case MD_FORMAT_UINT16:
+      if( srcstride == 3*sizeof(uint16_t) )
+        mdConvertUint16ToNative( dst, src, 3*count );
+      else
+      {
+        for( index = 0 ; index < count ; index++, dst += 3, src = ADDRESS( src, srcstride ) )
+          mdIndicesInt16ToNative( dst, src );
+      }
+      break;
+    case MD_FORMAT_INT32:
+    case MD_FORMAT_UINT32:
+      if( srcstride == 3*sizeof(uint32_t) )
+        mdConvertUint32ToNative( dst, src, 3*count );
+      else
+      {
+        for( index = 0 ; index < count ; index++, dst += 3, src = ADDRESS( src, srcstride ) )
+          mdIndicesInt32ToNative( dst, src );
+      }
+      break;
+    default:
+      for( index = 0 ; index < count ; index++, dst += 3, src = ADDRESS( src, srcstride ) )
+        usertonative( dst, src );
+      break;
+  }
+  return;
+}
+
+/* Convert count triangles from a tight native array to user indices of any stride */
+static void mdIndicesBlockNativeToUser( void *dst, size_t dststride, mdi *src, size_t count, int format, void (*nativetouser)( void *dst, mdi *src ) )
+{
+  size_t index;
+  switch( format )
+  {
+    case MD_FORMAT_SHORT:
+    case MD_FORMAT_USHORT:
+    case MD_FORMAT_INT16:
+    case MD_FORMAT_UINT16:
+      if( dststride == 3*sizeof(uint16_t) )
+        mdConvertNativeToUint16( dst, src, 3*count );
+      else
+      {
+        for( index = 0 ; index < count ; index++, src += 3, dst = ADDRESS( dst, dststride ) )
+          mdIndicesNativeToInt16( dst, src );
+      }
+      break;
+    case MD_FORMAT_INT32:
+    case MD_FORMAT_UINT32:
+      if( dststride == 3*sizeof(uint32_t) )
+        mdConvertNativeToUint32( dst, src, 3*count );
+      else
+      {
+        for( index = 0 ; index < count ; index++, src += 3, dst = ADDRESS( dst, dststride ) )
+          mdIndicesNativeToInt32( dst, src );
+      }
+      break;
+    default:
+      for( index = 0 ; index < count ; index++, src += 3, dst = ADDRESS( dst, dststride ) )
+        nativetouser( dst, src );
+      break;
+  }
+  return;
+}
+
+
+/* Pick user/native conversion functions for an indices format, return zero if the format isn't supported */
+static int mdIndicesFormatFunctions( int format, void (**usertonative)( mdi *dst, void *src ), void (**nativetouser)( void *dst, mdi *src ) )
+{
+  switch( format )
+  {
+    case MD_FORMAT_BYTE:
+    case MD_FORMAT_UBYTE:
+      *usertonative = mdIndicesCharToNative;
+      *nativetouser = mdIndicesNativeToChar;
+      break;
+    case MD_FORMAT_SHORT:
+    case MD_FORMAT_USHORT:
+      *usertonative = mdIndicesShortToNative;
+      *nativetouser = mdIndicesNativeToShort;
+      break;
+    case MD_FORMAT_INT:
+    case MD_FORMAT_UINT:
+      *usertonative = mdIndicesIntToNative;
+      *nativetouser = mdIndicesNativeToInt;
+      break;
+    case MD_FORMAT_INT8:
+    case MD_FORMAT_UINT8:
+      *usertonative = mdIndicesInt8ToNative;
+      *nativetouser = mdIndicesNativeToInt8;
+      break;
+    case MD_FORMAT_INT16:
+    case MD_FORMAT_UINT16:
+      *usertonative = mdIndicesInt16ToNative;
+      *nativetouser = mdIndicesNativeToInt16;
+      break;
+    case MD_FORMAT_INT32:
+    case MD_FORMAT_UINT32:
+      *usertonative = mdIndicesInt32ToNative;
+      *nativetouser = mdIndicesNativeToInt32;
+      break;
+    case MD_FORMAT_INT64:
+    case MD_FORMAT_UINT64:
+      *usertonative = mdIndicesInt64ToNative;
+      *nativetouser = mdIndicesNativeToInt64;
+      break;
+    default:
+      return 0;
+  }
+  return 1;
+}
+
+/* Pick user/native conversion functions for a vertex format, return zero if the format isn't supported */
+static int mdVertexFormatFunctions( int format, void (**usertonative)( mdf *dst, void *src, mdf factor ), void (**nativetouser)( void *dst, mdf *src, mdf factor ) )
+{
+  switch( format )
+  {
+    case MD_FORMAT_FLOAT:
+      *usertonative = mdVertexFloatToNative;
+      *nativetouser = mdVertexNativeToFloat;
+      break;
+    case MD_FORMAT_DOUBLE:
+      *usertonative = mdVertexDoubleToNative;
+      *nativetouser = mdVertexNativeToDouble;
+      break;
+    case MD_FORMAT_SHORT:
+      *usertonative = mdVertexShortToNative;
+      *nativetouser = mdVertexNativeToShort;
+      break;
+    case MD_FORMAT_INT:
+      *usertonative = mdVertexIntToNative;
+      *nativetouser = mdVertexNativeToInt;
+      break;
+    case MD_FORMAT_INT16:
+      *usertonative = mdVertexInt16ToNative;
+      *nativetouser = mdVertexNativeToInt16;
+      break;
+    case MD_FORMAT_INT32:
+      *usertonative = mdVertexInt32ToNative;
+      *nativetouser = mdVertexNativeToInt32;
+      break;
+    default:
+      return 0;
+  }
+  return 1;
+}
+
+
 ////
 
 
@@ -1719,6 +2282,57 @@ static mdf mdEdgeSolvePointAdjust( mdVertex *vertex0, mdVertex *vertex1, mdf *po
   return bestcost;
 }
 
+/* Gather the candidate collapse points of an edge for a batched adjustcollapse, return the count of candidates */
+static int mdEdgeSolveCandidates( mdVertex *vertex0, mdVertex *vertex1, int solveflags, mathQuadric *q, mdf *candpoint )
+{
+  int candcount;
+  mdf localpoint[3];
+
+  /* Translate v1->q into v0's frame of reference */
+  mathQuadricTranslateStore( q, &vertex1->quadric, vertex0->point[0] - vertex1->point[0], vertex0->point[1] - vertex1->point[1], vertex0->point[2] - vertex1->point[2] );
+  mathQuadricAddQuadric( q, &vertex0->quadric );
+
+  candcount = 0;
+  if( ( solveflags & MD_POINT_SOLVE_FLAGS_QUADRIC ) && ( mathQuadricSolve( q, localpoint ) ) )
+  {
+    candpoint[0] = localpoint[0] + vertex0->point[0];
+    candpoint[1] = localpoint[1] + vertex0->point[1];
+    candpoint[2] = localpoint[2] + vertex0->point[2];
+    candpoint += 3;
+    candcount++;
+  }
+  if( solveflags & MD_POINT_SOLVE_FLAGS_MIDPOINT )
+  {
+    candpoint[0] = 0.5 * ( vertex0->point[0] + vertex1->point[0] );
+    candpoint[1] = 0.5 * ( vertex0->point[1] + vertex1->point[1] );
+    candpoint[2] = 0.5 * ( vertex0->point[2] + vertex1->point[2] );
+    candpoint += 3;
+    candcount++;
+  }
+  if( solveflags & MD_POINT_SOLVE_FLAGS_V0 )
+  {
+    MD_VectorCopy( candpoint, vertex0->point );
+    candpoint += 3;
+    candcount++;
+  }
+  if( solveflags & MD_POINT_SOLVE_FLAGS_V1 )
+  {
+    MD_VectorCopy( candpoint, vertex1->point );
+    candcount++;
+  }
+
+  return candcount;
+}
+
+static inline mdf mdEdgeSolveCandidateCost( mdVertex *vertex0, mathQuadric *q, mdf *candpoint )
+{
+  mdf localpoint[3];
+  localpoint[0] = candpoint[0] - vertex0->point[0];
+  localpoint[1] = candpoint[1] - vertex0->point[1];
+  localpoint[2] = candpoint[2] - vertex0->point[2];
+  return mathQuadricEvaluate( q, localpoint );
+}
+
 #else
 
 static mdf mdEdgeSolvePoint( mdVertex *vertex0, mdVertex *vertex1, mdf *point, int solveflags )
@@ -1893,17 +2507,58 @@ static mdf mdEdgeSolvePointAdjust( mdVertex *vertex0, mdVertex *vertex1, mdf *po
   return bestcost;
 }
 
-#endif
-
-
+/* Gather the candidate collapse points of an edge for a batched adjustcollapse, return the count of candidates */
+static int mdEdgeSolveCandidates( mdVertex *vertex0, mdVertex *vertex1, int solveflags, mathQuadric *q, mdf *candpoint )
+{
+  int candcount;
 
-////
+  mathQuadricAddStoreQuadric( q, &vertex0->quadric, &vertex1->quadric );
 
+  candcount = 0;
+  if( ( solveflags & MD_POINT_SOLVE_FLAGS_QUADRIC ) && ( mathQuadricSolve( q, candpoint ) ) )
+  {
+    candpoint += 3;
+    candcount++;
+  }
+  if( solveflags & MD_POINT_SOLVE_FLAGS_MIDPOINT )
+  {
+    candpoint[0] = 0.5 * ( vertex0->point[0] + vertex1->point[0] );
+    candpoint[1] = 0.5 * ( vertex0->point[1] + vertex1->point[1] );
+    candpoint[2] = 0.5 * ( vertex0->point[2] + vertex1->point[2] );
+    candpoint += 3;
+    candcount++;
+  }
+  if( solveflags & MD_POINT_SOLVE_FLAGS_V0 )
+  {
+    MD_VectorCopy( candpoint, vertex0->point );
+    candpoint += 3;
+    candcount++;
+  }
+  if( solveflags & MD_POINT_SOLVE_FLAGS_V1 )
+  {
+    MD_VectorCopy( candpoint, vertex1->point );
+    candcount++;
+  }
 
-static void mdMeshAccumulateBoundary( mdVertex *vertex0, mdVertex *vertex1, mdVertex *vertex2, mdf boundaryareafactor, mdf boundaryedgeexpand )
+  return candcount;
+}
+
+static inline mdf mdEdgeSolveCandidateCost( mdVertex *vertex0, mathQuadric *q, mdf *candpoint )
+{
+  return mathQuadricEvaluate( q, candpoint );
+}
+
+#endif
+
+
+
+////
+
+
+/* Compute the quadric of the boundary plane along edge vertex0,vertex1 ; return 0 if the triangle is degenerate */
+static int mdMeshComputeBoundaryQuadric( mdVertex *vertex0, mdVertex *vertex1, mdVertex *vertex2, mdf boundaryareafactor, mdf boundaryedgeexpand, mathQuadric *q )
 {
   mdf normal[3], sideplane[4], vecta[3], vectb[3], length, expandfactor;
-  mathQuadric q;
 
   MD_VectorSubStore( vecta, vertex1->point, vertex0->point );
   MD_VectorSubStore( vectb, vertex2->point, vertex0->point );
@@ -1911,7 +2566,7 @@ static void mdMeshAccumulateBoundary( mdVertex *vertex0, mdVertex *vertex1, mdVe
   length = MD_VectorMagnitude( vecta );
 
   if( ( length == 0.0 ) || ( MD_VectorMagnitude( normal ) == 0.0 ) )
-    return;
+    return 0;
 
   MD_VectorNormalize( normal );
 #if DEBUG_VERBOSE_BOUNDARY
@@ -1942,7 +2597,18 @@ static void mdMeshAccumulateBoundary( mdVertex *vertex0, mdVertex *vertex1, mdVe
   printf( "  Boundary expand %f\n", boundaryareafactor );
   printf( "  Boundary plane %f %f %f %f : Length %f\n", sideplane[0], sideplane[1], sideplane[2], sideplane[3], length );
 #endif
-  mathQuadricInit( &q, sideplane[0], sideplane[1], sideplane[2], sideplane[3], length * boundaryareafactor );
+  mathQuadricInit( q, sideplane[0], sideplane[1], sideplane[2], sideplane[3], length * boundaryareafactor );
+
+  return 1;
+}
+
+
+static void mdMeshAccumulateBoundary( mdVertex *vertex0, mdVertex *vertex1, mdVertex *vertex2, mdf boundaryareafactor, mdf boundaryedgeexpand )
+{
+  mathQuadric q;
+
+  if( !( mdMeshComputeBoundaryQuadric( vertex0, vertex1, vertex2, boundaryareafactor, boundaryedgeexpand, &q ) ) )
+    return;
 
 #if MD_CONFIG_ATOMIC_SUPPORT
   mmAtomicSpin32( &vertex0->atomicowner, -1, 0xffff );
@@ -1970,11 +2636,36 @@ static void mdMeshAccumulateBoundary( mdVertex *vertex0, mdVertex *vertex1, mdVe
 ////
 
 
+/* With MD_FLAGS_HUGE_PAGES, back a large array with huge pages ; returns null if the system can't map it, the caller falls back to a regular allocation */
+static void *mdMeshHugeAlloc( mdMesh *mesh, size_t memsize, size_t *retmmapsize )
+{
+  *retmmapsize = 0;
+  if( !( mesh->hugepageflag ) )
+    return 0;
+  return mmHugeAlloc( memsize, retmmapsize );
+}
+
+/* With MD_FLAGS_NUMA_INTERLEAVE, spread a large array over all nodes before it is touched ; falls back to first touch placement if unsupported */
+static void mdMeshNumaInterleave( mdMesh *mesh, void *memory, size_t memsize )
+{
+  if( !( mesh->numainterleaveflag ) || !( memory ) )
+    return;
+  if( !( mmNumaInterleave( memory, memsize ) ) )
+  {
+    mesh->numainterleaveflag = 0;
+    mesh->numafirsttouchflag = 1;
+  }
+  return;
+}
+
+
+
 static void mdEdgeHashClearEntry( void *context, void *entry )
 {
   mdEdge *edge;
   edge = entry;
   edge->v[0] = -1;
+  edge->v[1] = -1;
   return;
 }
 
@@ -2032,6 +2723,13 @@ static mmHashAccess mdEdgeHashAccess =
   .entrycmp = mdEdgeHashEntryCmp
 };
 
+/* The two vertex indices of mdEdge are the whole key, compared inline by mmHash when they fit in 8 bytes */
+#if MD_SIZEOF_MDI == 4
+ #define MD_EDGE_HASH_FLAGS (MM_HASH_FLAGS_NO_COUNT|MM_HASH_FLAGS_KEY64)
+#else
+ #define MD_EDGE_HASH_FLAGS (MM_HASH_FLAGS_NO_COUNT)
+#endif
+
 static int mdMeshHashInit( mdMesh *mesh, size_t trianglecount, mdf hashsizefactor, uint32_t lockpageshift, size_t maxmemoryusage )
 {
   size_t edgecount, hashmemsize, meshmemsize, trirefmemsize, jobmemsize, basememsize, totalmemorysize;
@@ -2077,22 +2775,273 @@ static int mdMeshHashInit( mdMesh *mesh, size_t trianglecount, mdf hashsizefacto
 
     if( ( maxmemoryusage ) && ( totalmemorysize > maxmemoryusage ) && ( hashsizefactor > 1.15 ) )
       continue;
-    mesh->edgehashtable = malloc( hashmemsize );
+    mesh->edgehashtable = mdMeshHugeAlloc( mesh, hashmemsize, &mesh->edgehashmmapsize );
+    if( !( mesh->edgehashtable ) )
+      mesh->edgehashtable = malloc( hashmemsize );
     if( mesh->edgehashtable )
       break;
   }
+  mdMeshNumaInterleave( mesh, mesh->edgehashtable, hashmemsize );
 
-  mmHashInit( mesh->edgehashtable, &mdEdgeHashAccess, sizeof(mdEdge), hashsize, lockpageshift, MM_HASH_FLAGS_NO_COUNT, 0 );
+  /* With first touch placement, the entries are cleared by the threads in mdMeshNumaFirstTouch() */
+  mmHashInit( mesh->edgehashtable, &mdEdgeHashAccess, sizeof(mdEdge), hashsize, lockpageshift, MD_EDGE_HASH_FLAGS | ( mesh->numafirsttouchflag ? MM_HASH_FLAGS_NO_CLEAR : 0 ), 0 );
 
   return 1;
 }
 
 static void mdMeshHashEnd( mdMesh *mesh )
 {
-  free( mesh->edgehashtable );
+  if( mesh->edgehashmmapsize )
+    mmMmapFree( mesh->edgehashtable, mesh->edgehashmmapsize );
+  else
+    free( mesh->edgehashtable );
+  return;
+}
+
+
+////
+
+
+/* Vertex welding, spatial hash entry for the lowest vertex index found in a cell */
+typedef struct
+{
+  int64_t cell[3];
+  mdi vertexindex;
+} mdWeldEntry;
+
+static void mdWeldHashClearEntry( void *context, void *entry )
+{
+  mdWeldEntry *weld;
+  weld = entry;
+  weld->vertexindex = -1;
+  return;
+}
+
+static int mdWeldHashEntryValid( void *context, void *entry )
+{
+  mdWeldEntry *weld;
+  weld = entry;
+  return ( weld->vertexindex >= 0 ? 1 : 0 );
+}
+
+static mmHashIndex mdWeldHashEntryKey( void *context, void *entry )
+{
+  mdWeldEntry *weld;
+  weld = entry;
+#if MM_HASH_INDEX_64_BITS
+  return ccHash64Data( weld->cell, 3*sizeof(int64_t) );
+#else
+  return ccHash32Data( weld->cell, 3*sizeof(int64_t) );
+#endif
+}
+
+static int mdWeldHashEntryCmp( void *context, void *entry, void *entryref )
+{
+  mdWeldEntry *weld, *weldref;
+  weld = entry;
+  weldref = entryref;
+  if( weld->vertexindex == -1 )
+    return MM_HASH_ENTRYCMP_INVALID;
+  if( ( weld->cell[0] == weldref->cell[0] ) && ( weld->cell[1] == weldref->cell[1] ) && ( weld->cell[2] == weldref->cell[2] ) )
+    return MM_HASH_ENTRYCMP_FOUND;
+  return MM_HASH_ENTRYCMP_SKIP;
+}
+
+static mmHashAccess mdWeldHashAccess =
+{
+  .clearentry = mdWeldHashClearEntry,
+  .entryvalid = mdWeldHashEntryValid,
+  .entrykey = mdWeldHashEntryKey,
+  .entrycmp = mdWeldHashEntryCmp
+};
+
+static int mdMeshWeldInit( mdMesh *mesh )
+{
+  size_t hashsize, hashmemsize;
+  hashsize = 2 * (size_t)mesh->vertexcount;
+  if( hashsize < 4096 )
+    hashsize = 4096;
+  hashmemsize = mmHashRequiredSize( sizeof(mdWeldEntry), hashsize, 7 );
+  mesh->weldhashtable = malloc( hashmemsize );
+  mesh->weldmap = malloc( mesh->vertexcount * sizeof(mdi) );
+  if( !( mesh->weldhashtable ) || !( mesh->weldmap ) )
+    return 0;
+  mmHashInit( mesh->weldhashtable, &mdWeldHashAccess, sizeof(mdWeldEntry), hashsize, 7, MM_HASH_FLAGS_NO_COUNT, 0 );
+  return 1;
+}
+
+static void mdMeshWeldEnd( mdMesh *mesh )
+{
+  free( mesh->weldhashtable );
+  free( mesh->weldmap );
+  mesh->weldhashtable = 0;
+  mesh->weldmap = 0;
+  return;
+}
+
+
+////
+
+
+/* Topology cleanup, hash entry for the lowest index of triangles sharing the same set of vertices */
+typedef struct
+{
+  mdi v[3];
+  mdi triindex;
+} mdCleanTriangle;
+
+static void mdCleanHashClearEntry( void *context, void *entry )
+{
+  mdCleanTriangle *cleantri;
+  cleantri = entry;
+  cleantri->v[0] = -1;
+  return;
+}
+
+static int mdCleanHashEntryValid( void *context, void *entry )
+{
+  mdCleanTriangle *cleantri;
+  cleantri = entry;
+  return ( cleantri->v[0] >= 0 ? 1 : 0 );
+}
+
+static mmHashIndex mdCleanHashEntryKey( void *context, void *entry )
+{
+  mdCleanTriangle *cleantri;
+  cleantri = entry;
+#if MM_HASH_INDEX_64_BITS
+  return ccHash64Data( cleantri->v, 3*sizeof(mdi) );
+#else
+  return ccHash32Data( cleantri->v, 3*sizeof(mdi) );
+#endif
+}
+
+static int mdCleanHashEntryCmp( void *context, void *entry, void *entryref )
+{
+  mdCleanTriangle *cleantri, *cleantriref;
+  cleantri = entry;
+  cleantriref = entryref;
+  if( cleantri->v[0] == -1 )
+    return MM_HASH_ENTRYCMP_INVALID;
+  if( ( cleantri->v[0] == cleantriref->v[0] ) && ( cleantri->v[1] == cleantriref->v[1] ) && ( cleantri->v[2] == cleantriref->v[2] ) )
+    return MM_HASH_ENTRYCMP_FOUND;
+  return MM_HASH_ENTRYCMP_SKIP;
+}
+
+static mmHashAccess mdCleanHashAccess =
+{
+  .clearentry = mdCleanHashClearEntry,
+  .entryvalid = mdCleanHashEntryValid,
+  .entrykey = mdCleanHashEntryKey,
+  .entrycmp = mdCleanHashEntryCmp
+};
+
+static int mdMeshCleanupInit( mdMesh *mesh )
+{
+  size_t hashsize, hashmemsize;
+  hashsize = 2 * (size_t)mesh->tricount;
+  if( hashsize < 4096 )
+    hashsize = 4096;
+  hashmemsize = mmHashRequiredSize( sizeof(mdCleanTriangle), hashsize, 7 );
+  mesh->cleanhashtable = malloc( hashmemsize );
+  mesh->cleanindices = malloc( 3 * (size_t)mesh->tricount * sizeof(mdi) );
+  mesh->cleanreflist = malloc( 3 * (size_t)mesh->tricount * sizeof(mdi) );
+  mesh->cleanlabellist = malloc( 3 * (size_t)mesh->tricount * sizeof(mdi) );
+  mesh->cleanclonebase = malloc( mesh->vertexcount * sizeof(mdi) );
+  if( !( mesh->cleanhashtable ) || !( mesh->cleanindices ) || !( mesh->cleanreflist ) || !( mesh->cleanlabellist ) || !( mesh->cleanclonebase ) )
+    return 0;
+  mmHashInit( mesh->cleanhashtable, &mdCleanHashAccess, sizeof(mdCleanTriangle), hashsize, 7, MM_HASH_FLAGS_NO_COUNT, 0 );
+  mesh->cleanvertexcount = mesh->vertexcount;
+  return 1;
+}
+
+static void mdMeshCleanupEnd( mdMesh *mesh )
+{
+  free( mesh->cleanhashtable );
+  free( mesh->cleanindices );
+  free( mesh->cleanreflist );
+  free( mesh->cleanlabellist );
+  free( mesh->cleanclonebase );
+  mesh->cleanhashtable = 0;
+  mesh->cleanindices = 0;
+  mesh->cleanreflist = 0;
+  mesh->cleanlabellist = 0;
+  mesh->cleanclonebase = 0;
+  return;
+}
+
+static void mdMeshCleanupHashCallback( void *opaque, void *entry, int newflag )
+{
+  mdCleanTriangle *cleantri, *insert;
+  if( newflag )
+    return;
+  cleantri = entry;
+  insert = opaque;
+  if( insert->triindex < cleantri->triindex )
+    cleantri->triindex = insert->triindex;
+  return;
+}
+
+static inline void mdSortIndices3( mdi *v )
+{
+  mdi swap;
+  if( v[0] > v[1] )
+  {
+    swap = v[0];
+    v[0] = v[1];
+    v[1] = swap;
+  }
+  if( v[1] > v[2] )
+  {
+    swap = v[1];
+    v[1] = v[2];
+    v[2] = swap;
+  }
+  if( v[0] > v[1] )
+  {
+    swap = v[0];
+    v[0] = v[1];
+    v[1] = swap;
+  }
   return;
 }
 
+/* Topology cleanup, edge from a vertex to a neighbor in the fan of triangles around the vertex */
+typedef struct
+{
+  mdi vertexindex;
+  mdi refindex;
+  int outflag;
+} mdCleanFanEdge;
+
+static int mdCleanCompareIndex( const void *p0, const void *p1 )
+{
+  mdi i0, i1;
+  i0 = *(const mdi *)p0;
+  i1 = *(const mdi *)p1;
+  return ( i0 > i1 ) - ( i0 < i1 );
+}
+
+static int mdCleanCompareFanEdge( const void *p0, const void *p1 )
+{
+  const mdCleanFanEdge *e0, *e1;
+  e0 = p0;
+  e1 = p1;
+  if( e0->vertexindex != e1->vertexindex )
+    return ( e0->vertexindex > e1->vertexindex ) - ( e0->vertexindex < e1->vertexindex );
+  return ( e0->refindex > e1->refindex ) - ( e0->refindex < e1->refindex );
+}
+
+static inline mdi mdCleanFindRoot( mdi *parent, mdi index )
+{
+  while( parent[index] != index )
+  {
+    parent[index] = parent[ parent[index] ];
+    index = parent[index];
+  }
+  return index;
+}
+
 
 ////
 
@@ -2100,19 +3049,62 @@ static void mdMeshHashEnd( mdMesh *mesh )
 /* If threadcount exceeds this number, updatebuffers will be shared by nearby cores */
 #define MD_THREAD_UPDATE_BUFFER_COUNTMAX (8)
 
+/* Count of edges gathered before solving their collapses together, batched callbacks are invoked once per block */
+#define MD_SOLVE_BLOCK_SIZE (32)
+
+typedef struct
+{
+  int count;
+  mdOp *op[MD_SOLVE_BLOCK_SIZE];
+  mdi v0[MD_SOLVE_BLOCK_SIZE];
+  mdi v1[MD_SOLVE_BLOCK_SIZE];
+} mdSolveBlock;
+
+#if MD_CONF_ENABLE_STATISTICS
+typedef struct
+{
+  /* CPU time at which the current stage began */
+  uint64_t stagecputime;
+  long stagewallusecs[MD_STATUS_STAGE_COUNT];
+  long stagecpuusecs[MD_STATUS_STAGE_COUNT];
+  long barrierwaitusecs;
+  long opcreatecount;
+  long opupdatecount;
+  long opdenycount;
+  long opcollisioncount;
+  long lockretrycount;
+  long lockglobalcount;
+  long trirefgrowcount;
+  double collapsecostsum;
+} mdThreadStatistics;
+
+ #define MD_STATISTICS_ADD(tdata,field,value) ((tdata)->stats.field+=(value))
+#else
+ #define MD_STATISTICS_ADD(tdata,field,value)
+#endif
+
 typedef struct CPU_ALIGN64
 {
   int threadid;
 
-  /* Memory block for ops */
+  /* Memory block for ops, allocated through a magazine of free chunks */
   mmBlockHead opblock;
+  mmBlockCache opcache;
 
-  /* Hierarchical bucket sort of ops */
-  void *binsort;
+  /* Queue of the thread's ops */
+  mdQueue queue;
+
+  /* With MD_FLAGS_MULTI_QUEUE, the sub-queues shared by all threads replace the thread's queue */
+  mdSharedQueue *sharedqueue;
+  int sharedqueuecount;
+  uint32_t sharedqueuerand;
 
   /* List of ops flagged by other threads in need of update */
   mdUpdateBuffer updatebuffer[MD_THREAD_UPDATE_BUFFER_COUNTMAX];
 
+  /* Edges gathered by populate and collapse updates, pending a collapse solve */
+  mdSolveBlock solveblock;
+
   /* Per-thread status trackers */
   volatile long statusbuildtricount;
   volatile long statusbuildrefcount;
@@ -2120,63 +3112,351 @@ typedef struct CPU_ALIGN64
   volatile long statusdeletioncount;
   volatile long statuscollisioncount;
 
+  /* Current stage and the time at which it began, only tracked if mesh->timingflag is set */
+  int stage;
+  uint64_t stagetime;
+
+#if MD_CONF_ENABLE_STATISTICS
+  /* Per-thread statistics, timings are only tracked if mesh->statisticsflag is set */
+  mdThreadStatistics stats;
+#endif
+
 } mdThreadData;
 
 
-static void mdUpdateBufferInit( mdUpdateBuffer *updatebuffer, int opalloc )
+/* Either queue has the same interface */
+static inline void mdQueueAdd( mdQueue *queue, mdOp *op, mdf collapsecost )
+{
+  if( queue->radixheap )
+    mmRadixHeapAdd( queue->radixheap, op, collapsecost );
+  else
+    mmBinSortAdd( queue->binsort, op, collapsecost );
+  return;
+}
+
+static inline void mdQueueRemove( mdQueue *queue, mdOp *op, mdf collapsecost )
+{
+  if( queue->radixheap )
+    mmRadixHeapRemove( queue->radixheap, op, collapsecost );
+  else
+    mmBinSortRemove( queue->binsort, op, collapsecost );
+  return;
+}
+
+static inline void mdQueueUpdate( mdQueue *queue, mdOp *op, mdf oldcollapsecost, mdf newcollapsecost )
+{
+  if( queue->radixheap )
+    mmRadixHeapUpdate( queue->radixheap, op, oldcollapsecost, newcollapsecost );
+  else
+    mmBinSortUpdate( queue->binsort, op, oldcollapsecost, newcollapsecost );
+  return;
+}
+
+static inline mdOp *mdQueueGetFirst( mdQueue *queue, mdf failmax )
+{
+  if( queue->radixheap )
+    return mmRadixHeapGetFirst( queue->radixheap, failmax );
+  return mmBinSortGetFirst( queue->binsort, failmax );
+}
+
+static inline mdOp *mdQueueGetRemoveFirst( mdQueue *queue, mdf failmax )
+{
+  if( queue->radixheap )
+    return mmRadixHeapGetRemoveFirst( queue->radixheap, failmax );
+  return mmBinSortGetRemoveFirst( queue->binsort, failmax );
+}
+
+
+static inline void mdSharedQueueLock( mdSharedQueue *sharedqueue )
 {
-  updatebuffer->opbuffer = malloc( opalloc * sizeof(mdOp *) );
-  updatebuffer->opcount = 0;
-  updatebuffer->opalloc = opalloc;
 #if MD_CONFIG_ATOMIC_SUPPORT
-  mmAtomicWrite32( &updatebuffer->atomlock, 0x0 );
+  mmAtomicSpin32( &sharedqueue->atomlock, 0x0, 0x1 );
 #else
-  mtSpinInit( &updatebuffer->spinlock );
+  mtSpinLock( &sharedqueue->spinlock );
 #endif
   return;
 }
 
-static void mdUpdateBufferEnd( mdUpdateBuffer *updatebuffer )
+static inline int mdSharedQueueTryLock( mdSharedQueue *sharedqueue )
 {
-#ifndef MD_CONFIG_ATOMIC_SUPPORT
-  mtSpinDestroy( &updatebuffer->spinlock );
+#if MD_CONFIG_ATOMIC_SUPPORT
+  return mmAtomicCmpReplace32( &sharedqueue->atomlock, 0x0, 0x1 );
+#else
+  return mtSpinTryLock( &sharedqueue->spinlock );
 #endif
-  free( updatebuffer->opbuffer );
-  return;
 }
 
-static void mdUpdateBufferAdd( mdUpdateBuffer *updatebuffer, mdOp *op, int orflags )
+static inline void mdSharedQueueUnlock( mdSharedQueue *sharedqueue )
 {
-  int32_t flags;
 #if MD_CONFIG_ATOMIC_SUPPORT
-  for( ; ; )
+  mmAtomicWrite32( &sharedqueue->atomlock, 0x0 );
+#else
+  mtSpinUnlock( &sharedqueue->spinlock );
+#endif
+  return;
+}
+
+static inline mdSharedQueue *mdSharedQueuePick( mdThreadData *tdata )
+{
+  uint32_t rand;
+  rand = tdata->sharedqueuerand;
+  rand ^= rand << 13;
+  rand ^= rand >> 17;
+  rand ^= rand << 5;
+  tdata->sharedqueuerand = rand;
+  return &tdata->sharedqueue[ rand % (uint32_t)tdata->sharedqueuecount ];
+}
+
+/* Lowest op of the best of two random sub-queues, sub-queues locked by other threads are skipped */
+/* The op is not removed, it stays in its sub-queue until collapsed or updated like ops of the thread's own queue */
+static mdOp *mdSharedQueueGetFirst( mdThreadData *tdata, mdf failmax )
+{
+  int roundindex, pickindex, queueindex;
+  mdf bestcost;
+  mdOp *op, *bestop;
+  mdSharedQueue *sharedqueue;
+
+  for( roundindex = 0 ; roundindex < MD_MULTIQUEUE_PICK_ROUNDS ; roundindex++ )
   {
-    flags = mmAtomicRead32( &op->flags );
-    if( flags & MD_OP_FLAGS_UPDATE_QUEUED )
+    bestop = 0;
+    bestcost = 0.0;
+    for( pickindex = 0 ; pickindex < 2 ; pickindex++ )
     {
-      if( !( flags & MD_OP_FLAGS_UPDATE_NEEDED ) || ( orflags ) )
-        mmAtomicOr32( &op->flags, orflags | MD_OP_FLAGS_UPDATE_NEEDED );
-      return;
+      sharedqueue = mdSharedQueuePick( tdata );
+      if( !( mdSharedQueueTryLock( sharedqueue ) ) )
+        continue;
+      op = mdQueueGetFirst( &sharedqueue->queue, failmax );
+      if( ( op ) && ( !( bestop ) || ( op->collapsecost < bestcost ) ) )
+      {
+        bestop = op;
+        bestcost = op->collapsecost;
+      }
+      mdSharedQueueUnlock( sharedqueue );
     }
-    if( mmAtomicCmpReplace32( &op->flags, flags, flags | orflags | MD_OP_FLAGS_UPDATE_QUEUED | MD_OP_FLAGS_UPDATE_NEEDED ) )
-      break;
+    if( bestop )
+      return bestop;
   }
-  /* TODO: Avoid spin lock, use atomic increment for write offset? Careful with this realloc, pointer could become invalid */
-  mmAtomicSpin32( &updatebuffer->atomlock, 0x0, 0x1 );
-  if( updatebuffer->opcount >= updatebuffer->opalloc )
+
+  /* Picked sub-queues had no op below failmax, check them all before reporting the queue as empty */
+  for( queueindex = 0 ; queueindex < tdata->sharedqueuecount ; queueindex++ )
   {
-    updatebuffer->opalloc <<= 1;
-    updatebuffer->opbuffer = realloc( updatebuffer->opbuffer, updatebuffer->opalloc * sizeof(mdOp *) );
+    sharedqueue = &tdata->sharedqueue[ ( queueindex + tdata->threadid ) % tdata->sharedqueuecount ];
+    mdSharedQueueLock( sharedqueue );
+    op = mdQueueGetFirst( &sharedqueue->queue, failmax );
+    mdSharedQueueUnlock( sharedqueue );
+    if( op )
+      return op;
   }
-  updatebuffer->opbuffer[ updatebuffer->opcount++ ] = op;
-  mmAtomicWrite32( &updatebuffer->atomlock, 0x0 );
-#else
-  mtSpinLock( &op->spinlock );
-  op->flags |= orflags;
-  flags = op->flags;
-  if( flags & MD_OP_FLAGS_UPDATE_QUEUED )
+
+  return 0;
+}
+
+
+/* Op queue of the thread, or the shared sub-queues with MD_FLAGS_MULTI_QUEUE ; the caller holds the op's edge lock */
+/* In shared sub-queues, op->collapsecost is only written under the sub-queue lock, other threads read it through mdMeshOpValueCallback() */
+static inline void mdThreadQueueAdd( mdThreadData *tdata, mdOp *op, mdf collapsecost )
+{
+  mdSharedQueue *sharedqueue;
+  if( tdata->sharedqueue )
   {
-    if( !( flags & MD_OP_FLAGS_UPDATE_NEEDED ) )
+    /* Ops are spread over random sub-queues, they remain in it through updates until removed */
+    sharedqueue = mdSharedQueuePick( tdata );
+    op->queueindex = (int)( sharedqueue - tdata->sharedqueue );
+    mdSharedQueueLock( sharedqueue );
+    op->collapsecost = collapsecost;
+    mdQueueAdd( &sharedqueue->queue, op, collapsecost );
+    mdSharedQueueUnlock( sharedqueue );
+    return;
+  }
+  mdQueueAdd( &tdata->queue, op, collapsecost );
+  return;
+}
+
+static inline void mdThreadQueueRemove( mdThreadData *tdata, mdOp *op, mdf collapsecost )
+{
+  mdSharedQueue *sharedqueue;
+  if( tdata->sharedqueue )
+  {
+    sharedqueue = &tdata->sharedqueue[ op->queueindex ];
+    mdSharedQueueLock( sharedqueue );
+    mdQueueRemove( &sharedqueue->queue, op, collapsecost );
+    mdSharedQueueUnlock( sharedqueue );
+    return;
+  }
+  mdQueueRemove( &tdata->queue, op, collapsecost );
+  return;
+}
+
+static inline void mdThreadQueueUpdate( mdThreadData *tdata, mdOp *op, mdf oldcollapsecost, mdf newcollapsecost )
+{
+  mdSharedQueue *sharedqueue;
+  if( tdata->sharedqueue )
+  {
+    sharedqueue = &tdata->sharedqueue[ op->queueindex ];
+    mdSharedQueueLock( sharedqueue );
+    op->collapsecost = newcollapsecost;
+    mdQueueUpdate( &sharedqueue->queue, op, oldcollapsecost, newcollapsecost );
+    mdSharedQueueUnlock( sharedqueue );
+    return;
+  }
+  mdQueueUpdate( &tdata->queue, op, oldcollapsecost, newcollapsecost );
+  return;
+}
+
+static inline mdOp *mdThreadQueueGetFirst( mdThreadData *tdata, mdf failmax )
+{
+  if( tdata->sharedqueue )
+    return mdSharedQueueGetFirst( tdata, failmax );
+  return mdQueueGetFirst( &tdata->queue, failmax );
+}
+
+/* Deterministic mode never shares queues */
+static inline mdOp *mdThreadQueueGetRemoveFirst( mdThreadData *tdata, mdf failmax )
+{
+  return mdQueueGetRemoveFirst( &tdata->queue, failmax );
+}
+
+
+static const char *mdStatusStageName[] =
+{
+ [MD_STATUS_STAGE_INIT] = "Initializing",
+ [MD_STATUS_STAGE_BUILDVERTICES] = "Building Vertices",
+ [MD_STATUS_STAGE_BUILDTRIANGLES] = "Building Triangles",
+ [MD_STATUS_STAGE_BUILDTRIREFS] = "Building Trirefs",
+ [MD_STATUS_STAGE_BUILDQUEUE] = "Building Queues",
+ [MD_STATUS_STAGE_DECIMATION] = "Decimating Mesh",
+ [MD_STATUS_STAGE_STORE] = "Storing Geometry",
+ [MD_STATUS_STAGE_DONE] = "Done"
+};
+
+
+/* Mark the beginning of a new stage for the thread, closing the statistics and trace span of the previous one */
+static void mdThreadBeginStage( mdMesh *mesh, mdThreadData *tdata, int stage )
+{
+  uint64_t walltime;
+#if MD_CONF_ENABLE_STATISTICS
+  uint64_t cputime;
+#endif
+  if( !( mesh->timingflag ) )
+    return;
+  walltime = mmGetMicrosecondsTime();
+#if MD_CONF_ENABLE_STATISTICS
+  if( mesh->statisticsflag )
+  {
+    cputime = mmGetThreadCpuMicrosecondsTime();
+    if( tdata->stagetime )
+    {
+      tdata->stats.stagewallusecs[ tdata->stage ] += (long)( walltime - tdata->stagetime );
+      tdata->stats.stagecpuusecs[ tdata->stage ] += (long)( cputime - tdata->stats.stagecputime );
+    }
+    tdata->stats.stagecputime = cputime;
+  }
+#endif
+  if( ( mesh->tracerun ) && ( tdata->stagetime ) )
+    mmTraceSpan( mesh->tracerun, tdata->threadid, mdStatusStageName[ tdata->stage ], 0, 0, tdata->stagetime, walltime );
+  tdata->stage = stage;
+  tdata->stagetime = walltime;
+  return;
+}
+
+/* Account for time spent waiting on other threads since waittime */
+static void mdThreadWaitDone( mdMesh *mesh, mdThreadData *tdata, const char *name, uint64_t waittime )
+{
+  uint64_t walltime;
+  walltime = mmGetMicrosecondsTime();
+#if MD_CONF_ENABLE_STATISTICS
+  tdata->stats.barrierwaitusecs += (long)( walltime - waittime );
+#endif
+  if( mesh->tracerun )
+    mmTraceSpan( mesh->tracerun, tdata->threadid, name, 0, 0, waittime, walltime );
+  return;
+}
+
+/* Synchronize on the work barrier, tracking the time spent waiting */
+static void mdThreadBarrierSync( mdMesh *mesh, mdThreadData *tdata )
+{
+  uint64_t waittime;
+  if( mesh->timingflag )
+  {
+    waittime = mmGetMicrosecondsTime();
+    mdBarrierSync( &mesh->workbarrier );
+    mdThreadWaitDone( mesh, tdata, "Barrier Wait", waittime );
+    return;
+  }
+  mdBarrierSync( &mesh->workbarrier );
+  return;
+}
+
+/* Pause if another thread requested a global lock, tracking the time spent waiting */
+static inline void mdThreadBarrierCheckGlobal( mdMesh *mesh, mdThreadData *tdata )
+{
+  uint64_t waittime;
+  if( ( mesh->timingflag ) && ( mesh->workbarrier.lockflag ) )
+  {
+    waittime = mmGetMicrosecondsTime();
+    mdBarrierCheckGlobal( &mesh->workbarrier );
+    mdThreadWaitDone( mesh, tdata, "Global Lock Pause", waittime );
+    return;
+  }
+  mdBarrierCheckGlobal( &mesh->workbarrier );
+  return;
+}
+
+
+static void mdUpdateBufferInit( mdUpdateBuffer *updatebuffer, int opalloc )
+{
+  updatebuffer->opbuffer = malloc( opalloc * sizeof(mdOp *) );
+  updatebuffer->opcount = 0;
+  updatebuffer->opalloc = opalloc;
+#if MD_CONFIG_ATOMIC_SUPPORT
+  mmAtomicWrite32( &updatebuffer->atomlock, 0x0 );
+#else
+  mtSpinInit( &updatebuffer->spinlock );
+#endif
+  return;
+}
+
+static void mdUpdateBufferEnd( mdUpdateBuffer *updatebuffer )
+{
+#ifndef MD_CONFIG_ATOMIC_SUPPORT
+  mtSpinDestroy( &updatebuffer->spinlock );
+#endif
+  free( updatebuffer->opbuffer );
+  return;
+}
+
+static void mdUpdateBufferAdd( mdUpdateBuffer *updatebuffer, mdOp *op, int orflags )
+{
+  int32_t flags;
+#if MD_CONFIG_ATOMIC_SUPPORT
+  for( ; ; )
+  {
+    flags = mmAtomicRead32( &op->flags );
+    if( flags & MD_OP_FLAGS_UPDATE_QUEUED )
+    {
+      if( !( flags & MD_OP_FLAGS_UPDATE_NEEDED ) || ( orflags ) )
+        mmAtomicOr32( &op->flags, orflags | MD_OP_FLAGS_UPDATE_NEEDED );
+      return;
+    }
+    if( mmAtomicCmpReplace32( &op->flags, flags, flags | orflags | MD_OP_FLAGS_UPDATE_QUEUED | MD_OP_FLAGS_UPDATE_NEEDED ) )
+      break;
+  }
+  /* TODO: Avoid spin lock, use atomic increment for write offset? Careful with this realloc, pointer could become invalid */
+  mmAtomicSpin32( &updatebuffer->atomlock, 0x0, 0x1 );
+  if( updatebuffer->opcount >= updatebuffer->opalloc )
+  {
+    updatebuffer->opalloc <<= 1;
+    updatebuffer->opbuffer = realloc( updatebuffer->opbuffer, updatebuffer->opalloc * sizeof(mdOp *) );
+  }
+  updatebuffer->opbuffer[ updatebuffer->opcount++ ] = op;
+  mmAtomicWrite32( &updatebuffer->atomlock, 0x0 );
+#else
+  mtSpinLock( &op->spinlock );
+  op->flags |= orflags;
+  flags = op->flags;
+  if( flags & MD_OP_FLAGS_UPDATE_QUEUED )
+  {
+    if( !( flags & MD_OP_FLAGS_UPDATE_NEEDED ) )
       op->flags |= MD_OP_FLAGS_UPDATE_NEEDED;
     mtSpinUnlock( &op->spinlock );
     return;
@@ -2958,8 +4238,34 @@ static mdf mdEdgeCollapsePenalty( mdMesh *mesh, mdThreadData *tdata, mdi v0, mdi
 }
 
 
+/* Translate internal vertex and triangle indices to the user's indices and back, identity without spatial reordering */
+static inline mdi mdVertexUserIndex( mdMesh *mesh, mdi vertexindex )
+{
+  if( vertexindex < mesh->reordervertexcount )
+    return mesh->reordermap[ vertexindex ];
+  return vertexindex;
+}
+
+static inline mdi mdVertexInternalIndex( mdMesh *mesh, mdi userindex )
+{
+  if( userindex < mesh->reordervertexcount )
+    return mesh->reorderrank[ userindex ];
+  return userindex;
+}
+
+static inline mdi mdTriangleInternalIndex( mdMesh *mesh, mdi usertriindex )
+{
+  if( mesh->reordervertexcount )
+    return mesh->reordertrirank[ usertriindex ];
+  return usertriindex;
+}
+
+
 static inline int mdGetVertexLockFlag( mdMesh *mesh, mdi vertexindex )
 {
+  vertexindex = mdVertexUserIndex( mesh, vertexindex );
+  if( vertexindex >= mesh->lockvertexcount )
+    return 0;
   return ( mesh->lockmap[ vertexindex >> 5 ] & (((uint32_t)1)<<(vertexindex&(32-1))) ) != 0;
 }
 
@@ -2976,17 +4282,9 @@ static mdf mdVertexDistance( mdVertex *vertex0, mdVertex *vertex1 )
 #endif
 
 
-/* Experimental: collapsemultiplier */
-static mdf mdSolveEdgeCollapse( mdMesh *mesh, mdi v0, mdi v1, mdf *point )
+static int mdSolveEdgeFlags( mdMesh *mesh, mdi v0, mdi v1 )
 {
   int solveflags;
-  mdf cost, costmultiplier;
-  mdEdge edge;
-  mdVertex *vertex0, *vertex1;
-  void *tridata0, *tridata1;
-  vertex0 = &mesh->vertexlist[v0];
-  vertex1 = &mesh->vertexlist[v1];
-
   solveflags = MD_POINT_SOLVE_FLAGS_V0 | MD_POINT_SOLVE_FLAGS_V1 | MD_POINT_SOLVE_FLAGS_MIDPOINT | MD_POINT_SOLVE_FLAGS_QUADRIC;
   if( mesh->lockmap )
   {
@@ -2995,46 +4293,52 @@ static mdf mdSolveEdgeCollapse( mdMesh *mesh, mdi v0, mdi v1, mdf *point )
     if( mdGetVertexLockFlag( mesh, v1 ) )
       solveflags &= MD_POINT_SOLVE_FLAGS_V1;
   }
+  return solveflags;
+}
 
-  if( !solveflags )
-    return MD_OP_FAIL_VALUE;
-
-  if( mesh->adjustcollapse )
-    cost = mdEdgeSolvePointAdjust( vertex0, vertex1, point, solveflags, mesh->adjustcollapse, mesh->adjustcontext );
-  else
-    cost = mdEdgeSolvePoint( vertex0, vertex1, point, solveflags );
+/* Locate the custom data of the triangles on both sides of an edge */
+static void mdSolveEdgeTriData( mdMesh *mesh, mdi v0, mdi v1, void **tridata0, void **tridata1 )
+{
+  mdEdge edge;
+  /* TODO: Redundant hash checks with code calling mdSolveEdgeCollapse(), optimize */
+  *tridata0 = 0;
+  edge.v[0] = v0;
+  edge.v[1] = v1;
+  if( mmHashLockReadEntry( mesh->edgehashtable, &mdEdgeHashAccess, &edge ) == MM_HASH_SUCCESS )
+    *tridata0 = ADDRESS( mesh->trilist, ( edge.triindex * mesh->trisize ) + sizeof(mdTriangle) );
+  *tridata1 = 0;
+  edge.v[0] = v1;
+  edge.v[1] = v0;
+  if( mmHashLockReadEntry( mesh->edgehashtable, &mdEdgeHashAccess, &edge ) == MM_HASH_SUCCESS )
+    *tridata1 = ADDRESS( mesh->trilist, ( edge.triindex * mesh->trisize ) + sizeof(mdTriangle) );
+  return;
+}
 
-  if( mesh->collapsemultiplier )
-  {
-    /* TODO: Redundant hash checks with code calling mdSolveEdgeCollapse(), optimize */
-    tridata0 = 0;
-    edge.v[0] = v0;
-    edge.v[1] = v1;
-    if( mmHashLockReadEntry( mesh->edgehashtable, &mdEdgeHashAccess, &edge ) == MM_HASH_SUCCESS )
-      tridata0 = ADDRESS( mesh->trilist, ( edge.triindex * mesh->trisize ) + sizeof(mdTriangle) );
-    tridata1 = 0;
-    edge.v[0] = v1;
-    edge.v[1] = v0;
-    if( mmHashLockReadEntry( mesh->edgehashtable, &mdEdgeHashAccess, &edge ) == MM_HASH_SUCCESS )
-      tridata1 = ADDRESS( mesh->trilist, ( edge.triindex * mesh->trisize ) + sizeof(mdTriangle) );
+static double mdSolveEdgeMultiplier( mdMesh *mesh, mdi v0, mdi v1 )
+{
+  double costmultiplier;
+  mdVertex *vertex0, *vertex1;
+  void *tridata0, *tridata1;
+  vertex0 = &mesh->vertexlist[v0];
+  vertex1 = &mesh->vertexlist[v1];
+  mdSolveEdgeTriData( mesh, v0, v1, &tridata0, &tridata1 );
 #if MD_CONF_DOUBLE_PRECISION
-    costmultiplier = mesh->collapsemultiplier( mesh->collapsecontext, tridata0, tridata1, vertex0->point, vertex1->point );
+  costmultiplier = mesh->collapsemultiplier( mesh->collapsecontext, tridata0, tridata1, vertex0->point, vertex1->point );
 #else
-    double pt0[3], pt1[3];
-    MD_VectorCopy( pt0, vertex0->point );
-    MD_VectorCopy( pt1, vertex1->point );
-    costmultiplier = mesh->collapsemultiplier( mesh->collapsecontext, tridata0, tridata1, pt0, pt1 );
+  double pt0[3], pt1[3];
+  MD_VectorCopy( pt0, vertex0->point );
+  MD_VectorCopy( pt1, vertex1->point );
+  costmultiplier = mesh->collapsemultiplier( mesh->collapsecontext, tridata0, tridata1, pt0, pt1 );
 #endif
 #if DEBUG_VERBOSE_COLLAPSE || DEBUG_VERBOSE_COST
-    printf( "    Costmultiplier for %d,%d : %f\n", (int)v0, (int)v1, costmultiplier );
+  printf( "    Costmultiplier for %d,%d : %f\n", (int)v0, (int)v1, costmultiplier );
 #endif
-    if( costmultiplier < 0.0 )
-      return MD_OP_FAIL_VALUE;
-    cost *= costmultiplier;
-  }
+  return costmultiplier;
+}
 
-/* WWW */
 #if MD_CONFIG_DISTANCE_BIAS
+static mdf mdSolveEdgeBias( mdMesh *mesh, mdVertex *vertex0, mdVertex *vertex1 )
+{
   mdf sumbias;
   sumbias = vertex0->sumbias + vertex1->sumbias;
   if( sumbias < mesh->biasclampdistance )
@@ -3044,68 +4348,271 @@ static mdf mdSolveEdgeCollapse( mdMesh *mesh, mdi v0, mdi v1, mdf *point )
  #if DEBUG_VERBOSE_COST >= 2
   printf( "      Cost sumbias += %f %e\n", sumbias, sumbias );
  #endif
-  cost += sumbias;
-#endif
-
-  return cost;
+  return sumbias;
 }
+#endif
 
+/* Experimental: collapsemultiplier */
+static mdf mdSolveEdgeCollapse( mdMesh *mesh, mdi v0, mdi v1, mdf *point )
+{
+  int solveflags;
+  mdf cost, costmultiplier;
+  mdVertex *vertex0, *vertex1;
+  vertex0 = &mesh->vertexlist[v0];
+  vertex1 = &mesh->vertexlist[v1];
 
+  solveflags = mdSolveEdgeFlags( mesh, v0, v1 );
+  if( !solveflags )
+    return MD_OP_FAIL_VALUE;
 
-////
+  if( mesh->adjustcollapse )
+    cost = mdEdgeSolvePointAdjust( vertex0, vertex1, point, solveflags, mesh->adjustcollapse, mesh->adjustcontext );
+  else
+    cost = mdEdgeSolvePoint( vertex0, vertex1, point, solveflags );
 
+  if( mesh->collapsemultiplier )
+  {
+    costmultiplier = mdSolveEdgeMultiplier( mesh, v0, v1 );
+    if( costmultiplier < 0.0 )
+      return MD_OP_FAIL_VALUE;
+    cost *= costmultiplier;
+  }
 
+/* WWW */
+#if MD_CONFIG_DISTANCE_BIAS
+  cost += mdSolveEdgeBias( mesh, vertex0, vertex1 );
+#endif
 
-static void mdMeshEdgeSetOpCallback( void *opaque, void *entry, int newflag )
-{
-  mdEdge *edge;
-  edge = entry;
-  edge->op = opaque;
-  return;
+  return cost;
 }
 
 
-static double mdMeshOpValueCallback( void *item )
-{
+/* Solve a block of edge collapses with the batched adjustcollapse and collapsemultiplier callbacks, each invoked once for the whole block */
+static void mdSolveEdgeCollapseBatch( mdMesh *mesh, mdSolveBlock *block )
+{
+  int index, candindex, candcount, multcount;
+  int solveflags[MD_SOLVE_BLOCK_SIZE];
+  int candbase[MD_SOLVE_BLOCK_SIZE+1];
+  int accept[4*MD_SOLVE_BLOCK_SIZE];
+  int multindex[MD_SOLVE_BLOCK_SIZE];
+  mdf cost;
+  mdf candpoint[3*4*MD_SOLVE_BLOCK_SIZE];
+  mdf candv0[3*4*MD_SOLVE_BLOCK_SIZE];
+  mdf candv1[3*4*MD_SOLVE_BLOCK_SIZE];
+  mathQuadric q[MD_SOLVE_BLOCK_SIZE];
+  void *tridata0[MD_SOLVE_BLOCK_SIZE];
+  void *tridata1[MD_SOLVE_BLOCK_SIZE];
+  double point0[3*MD_SOLVE_BLOCK_SIZE];
+  double point1[3*MD_SOLVE_BLOCK_SIZE];
+  double multiplier[MD_SOLVE_BLOCK_SIZE];
   mdOp *op;
-  op = item;
-  return (double)op->collapsecost;
-}
+  mdVertex *vertex0, *vertex1;
 
-static void mdMeshAddOp( mdMesh *mesh, mdThreadData *tdata, mdi v0, mdi v1 )
-{
-  int denyflag, opflags;
-  mdOp *op;
-  mdEdge edge;
+  /* Solve collapse points, or gather all candidate points for the batched adjustcollapse */
+  candcount = 0;
+  for( index = 0 ; index < block->count ; index++ )
+  {
+    op = block->op[index];
+    vertex0 = &mesh->vertexlist[ block->v0[index] ];
+    vertex1 = &mesh->vertexlist[ block->v1[index] ];
+    candbase[index] = candcount;
+    solveflags[index] = mdSolveEdgeFlags( mesh, block->v0[index], block->v1[index] );
+    op->value = MD_OP_FAIL_VALUE;
+    if( !( solveflags[index] ) )
+      continue;
+    if( mesh->adjustcollapsebatch )
+    {
+      candindex = candcount;
+      candcount += mdEdgeSolveCandidates( vertex0, vertex1, solveflags[index], &q[index], &candpoint[3*candindex] );
+      for( ; candindex < candcount ; candindex++ )
+      {
+        MD_VectorCopy( &candv0[3*candindex], vertex0->point );
+        MD_VectorCopy( &candv1[3*candindex], vertex1->point );
+      }
+    }
+    else if( mesh->adjustcollapse )
+      op->value = mdEdgeSolvePointAdjust( vertex0, vertex1, op->collapsepoint, solveflags[index], mesh->adjustcollapse, mesh->adjustcontext );
+    else
+      op->value = mdEdgeSolvePoint( vertex0, vertex1, op->collapsepoint, solveflags[index] );
+  }
+  candbase[index] = candcount;
 
-#if DEBUG_VERBOSE_COLLAPSE || DEBUG_VERBOSE_COST
-  mdVertex *vertex0, *vertex1;
-  vertex0 = &mesh->vertexlist[ v0 ];
-  vertex1 = &mesh->vertexlist[ v1 ];
-  printf( "  Add Edge Op %d,%d ; %f %f %f ~ %f %f %f\n", (int)v0, (int)v1, vertex0->point[0], vertex0->point[1], vertex0->point[2], vertex1->point[0], vertex1->point[1], vertex1->point[2] );
-#endif
+  /* Pick the lowest cost among the accepted candidate points of each edge */
+  if( ( mesh->adjustcollapsebatch ) && ( candcount ) )
+  {
+    mesh->adjustcollapsebatch( mesh->adjustcontext, candcount, candpoint, candv0, candv1, accept );
+    for( index = 0 ; index < block->count ; index++ )
+    {
+      op = block->op[index];
+      vertex0 = &mesh->vertexlist[ block->v0[index] ];
+      for( candindex = candbase[index] ; candindex < candbase[index+1] ; candindex++ )
+      {
+        if( !( accept[candindex] ) )
+          continue;
+        cost = mdEdgeSolveCandidateCost( vertex0, &q[index], &candpoint[3*candindex] );
+        if( cost < op->value )
+        {
+          op->value = cost;
+          MD_VectorCopy( op->collapsepoint, &candpoint[3*candindex] );
+        }
+      }
+    }
+  }
 
-  op = mmBlockAlloc( &tdata->opblock );
-  opflags = 0x0;
-  op->updatebuffer = tdata->updatebuffer;
-  op->v0 = v0;
-  op->v1 = v1;
-  op->value = mdSolveEdgeCollapse( mesh, v0, v1, op->collapsepoint );
-#if CPU_SSE_SUPPORT
-  op->collapsepoint[3] = 0.0;
-#endif
-  if( op->value < MD_OP_FAIL_VALUE )
-    op->penalty = mdEdgeCollapsePenalty( mesh, tdata, v0, v1, op->collapsepoint, &denyflag );
-  else
+  /* Cost multipliers */
+  if( mesh->collapsemultiplierbatch )
+  {
+    multcount = 0;
+    for( index = 0 ; index < block->count ; index++ )
+    {
+      if( !( solveflags[index] ) )
+        continue;
+      mdSolveEdgeTriData( mesh, block->v0[index], block->v1[index], &tridata0[multcount], &tridata1[multcount] );
+      vertex0 = &mesh->vertexlist[ block->v0[index] ];
+      vertex1 = &mesh->vertexlist[ block->v1[index] ];
+      point0[3*multcount+0] = vertex0->point[0];
+      point0[3*multcount+1] = vertex0->point[1];
+      point0[3*multcount+2] = vertex0->point[2];
+      point1[3*multcount+0] = vertex1->point[0];
+      point1[3*multcount+1] = vertex1->point[1];
+      point1[3*multcount+2] = vertex1->point[2];
+      multindex[multcount] = index;
+      multcount++;
+    }
+    if( multcount )
+      mesh->collapsemultiplierbatch( mesh->collapsecontext, multcount, tridata0, tridata1, point0, point1, multiplier );
+    for( candindex = 0 ; candindex < multcount ; candindex++ )
+    {
+      index = multindex[candindex];
+#if DEBUG_VERBOSE_COLLAPSE || DEBUG_VERBOSE_COST
+      printf( "    Costmultiplier for %d,%d : %f\n", (int)block->v0[index], (int)block->v1[index], multiplier[candindex] );
+#endif
+      op = block->op[index];
+      if( multiplier[candindex] < 0.0 )
+      {
+        op->value = MD_OP_FAIL_VALUE;
+        solveflags[index] = 0;
+      }
+      else
+        op->value *= multiplier[candindex];
+    }
+  }
+  else if( mesh->collapsemultiplier )
+  {
+    for( index = 0 ; index < block->count ; index++ )
+    {
+      if( !( solveflags[index] ) )
+        continue;
+      op = block->op[index];
+      multiplier[index] = mdSolveEdgeMultiplier( mesh, block->v0[index], block->v1[index] );
+      if( multiplier[index] < 0.0 )
+      {
+        op->value = MD_OP_FAIL_VALUE;
+        solveflags[index] = 0;
+      }
+      else
+        op->value *= multiplier[index];
+    }
+  }
+
+#if MD_CONFIG_DISTANCE_BIAS
+  for( index = 0 ; index < block->count ; index++ )
+  {
+    if( solveflags[index] )
+      block->op[index]->value += mdSolveEdgeBias( mesh, &mesh->vertexlist[ block->v0[index] ], &mesh->vertexlist[ block->v1[index] ] );
+  }
+#endif
+
+  return;
+}
+
+/* Solve all collapses gathered in the block */
+static void mdSolveEdgeCollapseBlock( mdMesh *mesh, mdSolveBlock *block )
+{
+  int index;
+  mdOp *op;
+
+  if( ( mesh->collapsemultiplierbatch ) || ( mesh->adjustcollapsebatch ) )
+    mdSolveEdgeCollapseBatch( mesh, block );
+  else
+  {
+    for( index = 0 ; index < block->count ; index++ )
+    {
+      op = block->op[index];
+      op->value = mdSolveEdgeCollapse( mesh, block->v0[index], block->v1[index], op->collapsepoint );
+    }
+  }
+#if CPU_SSE_SUPPORT
+  for( index = 0 ; index < block->count ; index++ )
+    block->op[index]->collapsepoint[3] = 0.0;
+#endif
+
+  return;
+}
+
+
+
+////
+
+
+
+static void mdMeshEdgeSetOpCallback( void *opaque, void *entry, int newflag )
+{
+  mdEdge *edge;
+  edge = entry;
+  edge->op = opaque;
+  return;
+}
+
+
+static double mdMeshOpValueCallback( void *item )
+{
+  mdOp *op;
+  op = item;
+  return (double)op->collapsecost;
+}
+
+static mdOp *mdMeshAllocOp( mdMesh *mesh, mdThreadData *tdata, mdi v0, mdi v1 )
+{
+  mdOp *op;
+
+#if DEBUG_VERBOSE_COLLAPSE || DEBUG_VERBOSE_COST
+  mdVertex *vertex0, *vertex1;
+  vertex0 = &mesh->vertexlist[ v0 ];
+  vertex1 = &mesh->vertexlist[ v1 ];
+  printf( "  Add Edge Op %d,%d ; %f %f %f ~ %f %f %f\n", (int)v0, (int)v1, vertex0->point[0], vertex0->point[1], vertex0->point[2], vertex1->point[0], vertex1->point[1], vertex1->point[2] );
+#endif
+
+  op = mmBlockCacheAlloc( &tdata->opcache );
+  op->updatebuffer = tdata->updatebuffer;
+  op->v0 = v0;
+  op->v1 = v1;
+  return op;
+}
+
+/* Compute the penalty of a solved op, queue it for collapse and link it to its edge */
+static void mdMeshAttachOp( mdMesh *mesh, mdThreadData *tdata, mdOp *op )
+{
+  int denyflag, opflags;
+  mdEdge edge;
+
+  opflags = 0x0;
+  if( op->value < MD_OP_FAIL_VALUE )
+    op->penalty = mdEdgeCollapsePenalty( mesh, tdata, op->v0, op->v1, op->collapsepoint, &denyflag );
+  else
   {
     op->penalty = 0.0;
     denyflag = 1;
   }
   op->collapsecost = op->value + op->penalty;
+  MD_STATISTICS_ADD( tdata, opcreatecount, 1 );
   if( ( denyflag ) || ( op->collapsecost >= mesh->maxcollapseacceptcost ) )
+  {
     opflags |= MD_OP_FLAGS_DETACHED;
+    MD_STATISTICS_ADD( tdata, opdenycount, 1 );
+  }
   else
-    mmBinSortAdd( tdata->binsort, op, op->collapsecost );
+    mdThreadQueueAdd( tdata, op, op->collapsecost );
 #if MD_CONFIG_ATOMIC_SUPPORT
   mmAtomicWrite32( &op->flags, opflags );
 #else
@@ -3113,8 +4620,8 @@ static void mdMeshAddOp( mdMesh *mesh, mdThreadData *tdata, mdi v0, mdi v1 )
   mtSpinInit( &op->spinlock );
 #endif
 
-  edge.v[0] = v0;
-  edge.v[1] = v1;
+  edge.v[0] = op->v0;
+  edge.v[1] = op->v1;
   if( mmHashLockCallEntry( mesh->edgehashtable, &mdEdgeHashAccess, &edge, mdMeshEdgeSetOpCallback, op, 0 ) != MM_HASH_SUCCESS )
   {
 /*
@@ -3129,42 +4636,84 @@ static void mdMeshAddOp( mdMesh *mesh, mdThreadData *tdata, mdi v0, mdi v1 )
   return;
 }
 
-static void mdMeshPopulateOpList( mdMesh *mesh, mdThreadData *tdata, mdi tribase, mdi tricount )
+static void mdMeshAddOp( mdMesh *mesh, mdThreadData *tdata, mdi v0, mdi v1 )
 {
-  mdTriangle *tri, *tristart, *triend;
-  long populatecount;
+  mdSolveBlock block;
+  block.count = 1;
+  block.op[0] = mdMeshAllocOp( mesh, tdata, v0, v1 );
+  block.v0[0] = v0;
+  block.v1[0] = v1;
+  mdSolveEdgeCollapseBlock( mesh, &block );
+  mdMeshAttachOp( mesh, tdata, block.op[0] );
+  return;
+}
 
-  tristart = ADDRESS( mesh->trilist, tribase * mesh->trisize );
-  triend = ADDRESS( tristart, tricount * mesh->trisize );
+static void mdMeshPopulateFlush( mdMesh *mesh, mdThreadData *tdata )
+{
+  int index;
+  mdSolveBlock *block;
+  block = &tdata->solveblock;
+  mdSolveEdgeCollapseBlock( mesh, block );
+  for( index = 0 ; index < block->count ; index++ )
+    mdMeshAttachOp( mesh, tdata, block->op[index] );
+  block->count = 0;
+  return;
+}
+
+/* Gather new ops in blocks, their collapses are solved together */
+static void mdMeshPopulateOp( mdMesh *mesh, mdThreadData *tdata, mdi v0, mdi v1 )
+{
+  mdSolveBlock *block;
+  block = &tdata->solveblock;
+  block->op[ block->count ] = mdMeshAllocOp( mesh, tdata, v0, v1 );
+  block->v0[ block->count ] = v0;
+  block->v1[ block->count ] = v1;
+  if( ++block->count == MD_SOLVE_BLOCK_SIZE )
+    mdMeshPopulateFlush( mesh, tdata );
+  return;
+}
+
+/* Add ops for the triangles in the range, taken in the order of triorder if not null */
+static void mdMeshPopulateOpList( mdMesh *mesh, mdThreadData *tdata, mdi *triorder, mdi tribase, mdi tricount )
+{
+  mdi index, triindex;
+  mdTriangle *tri;
+  long populatecount;
 
   populatecount = 0;
-  for( tri = tristart ; tri < triend ; tri = ADDRESS( tri, mesh->trisize ) )
+  for( index = tribase ; index < tribase + tricount ; index++ )
   {
+    triindex = ( triorder ? triorder[index] : index );
+    tri = ADDRESS( mesh->trilist, triindex * mesh->trisize );
 #if DEBUG_VERBOSE_COLLAPSE
-    printf( "Triangle %d, edges %d,%d,%d ~ edgeflags 0x%02x\n", (int)( tri - tristart ), tri->v[0], tri->v[1], tri->v[2], tri->u.edgeflags );
+    printf( "Triangle %d, edges %d,%d,%d ~ edgeflags 0x%02x\n", (int)triindex, tri->v[0], tri->v[1], tri->v[2], tri->u.edgeflags );
 #endif
 #if 0
     if( ( ( tri->v[0] < tri->v[1] ) || ( tri->u.edgeflags & MD_EDGEFLAGS_BOUNDARY01 ) ) && !( tri->u.edgeflags & MD_EDGEFLAGS_DENYEDGE01 ) )
-      mdMeshAddOp( mesh, tdata, tri->v[0], tri->v[1] );
+      mdMeshPopulateOp( mesh, tdata, tri->v[0], tri->v[1] );
     if( ( ( tri->v[1] < tri->v[2] ) || ( tri->u.edgeflags & MD_EDGEFLAGS_BOUNDARY12 ) ) && !( tri->u.edgeflags & MD_EDGEFLAGS_DENYEDGE12 ) )
-      mdMeshAddOp( mesh, tdata, tri->v[1], tri->v[2] );
+      mdMeshPopulateOp( mesh, tdata, tri->v[1], tri->v[2] );
     if( ( ( tri->v[2] < tri->v[0] ) || ( tri->u.edgeflags & MD_EDGEFLAGS_BOUNDARY20 ) ) && !( tri->u.edgeflags & MD_EDGEFLAGS_DENYEDGE20 ) )
-      mdMeshAddOp( mesh, tdata, tri->v[2], tri->v[0] );
+      mdMeshPopulateOp( mesh, tdata, tri->v[2], tri->v[0] );
 #else
     /* Don't add ops for the whole triangle if any of the triangle's edge was denied? */
-    if( !( tri->u.edgeflags & (MD_EDGEFLAGS_DENYEDGE01|MD_EDGEFLAGS_DENYEDGE12|MD_EDGEFLAGS_DENYEDGE20) ) )
+    if( tri->v[0] == -1 )
+      ;
+    else if( !( tri->u.edgeflags & (MD_EDGEFLAGS_DENYEDGE01|MD_EDGEFLAGS_DENYEDGE12|MD_EDGEFLAGS_DENYEDGE20) ) )
     {
       if( ( tri->v[0] < tri->v[1] ) || ( tri->u.edgeflags & MD_EDGEFLAGS_BOUNDARY01 ) )
-        mdMeshAddOp( mesh, tdata, tri->v[0], tri->v[1] );
+        mdMeshPopulateOp( mesh, tdata, tri->v[0], tri->v[1] );
       if( ( tri->v[1] < tri->v[2] ) || ( tri->u.edgeflags & MD_EDGEFLAGS_BOUNDARY12 ) )
-        mdMeshAddOp( mesh, tdata, tri->v[1], tri->v[2] );
+        mdMeshPopulateOp( mesh, tdata, tri->v[1], tri->v[2] );
       if( ( tri->v[2] < tri->v[0] ) || ( tri->u.edgeflags & MD_EDGEFLAGS_BOUNDARY20 ) )
-        mdMeshAddOp( mesh, tdata, tri->v[2], tri->v[0] );
+        mdMeshPopulateOp( mesh, tdata, tri->v[2], tri->v[0] );
     }
 #endif
     populatecount++;
     tdata->statuspopulatecount = populatecount;
   }
+  if( tdata->solveblock.count )
+    mdMeshPopulateFlush( mesh, tdata );
 
   return;
 }
@@ -3175,9 +4724,162 @@ static void mdMeshPopulateOpList( mdMesh *mesh, mdThreadData *tdata, mdi tribase
 
 
 
+/* Size of one component of an attribute stream, zero if the format isn't supported */
+static size_t mdAttribFormatSize( int format )
+{
+  switch( format )
+  {
+    case MD_FORMAT_FLOAT:
+      return sizeof(float);
+    case MD_FORMAT_DOUBLE:
+      return sizeof(double);
+    case MD_FORMAT_UBYTE:
+    case MD_FORMAT_UINT8:
+      return sizeof(uint8_t);
+    case MD_FORMAT_USHORT:
+    case MD_FORMAT_UINT16:
+      return sizeof(uint16_t);
+    case MD_FORMAT_INT:
+    case MD_FORMAT_UINT:
+    case MD_FORMAT_INT32:
+    case MD_FORMAT_UINT32:
+      return sizeof(uint32_t);
+    default:
+      return 0;
+  }
+}
+
+/* Blend attribute stream of srcindex into dstindex, weights sum to one */
+static void mdAttribBlend( mdAttrib *attrib, mdi dstindex, mdi srcindex, mdf weight0, mdf weight1 )
+{
+  int index, count;
+  double sum, scale;
+  float *dstf, *srcf;
+  double *dstd, *srcd;
+  uint8_t *dstb, *srcb;
+  uint16_t *dsts, *srcs;
+#if CPU_SSE_SUPPORT
+  __m128 vw0, vw1;
+#endif
+#if CPU_SSE2_SUPPORT
+  __m128d vw0d, vw1d;
+#endif
+
+  count = attrib->componentcount;
+  if( attrib->blendmode == MD_ATTRIB_BLEND_NEAREST )
+  {
+    if( weight1 > weight0 )
+      memcpy( ADDRESS( attrib->base, dstindex * attrib->stride ), ADDRESS( attrib->base, srcindex * attrib->stride ), attrib->elementsize );
+    return;
+  }
+  switch( attrib->format )
+  {
+    case MD_FORMAT_FLOAT:
+      dstf = ADDRESS( attrib->base, dstindex * attrib->stride );
+      srcf = ADDRESS( attrib->base, srcindex * attrib->stride );
+      index = 0;
+#if CPU_SSE_SUPPORT
+      vw0 = _mm_set1_ps( (float)weight0 );
+      vw1 = _mm_set1_ps( (float)weight1 );
+      for( ; index < ( count & ~3 ) ; index += 4 )
+        _mm_storeu_ps( &dstf[index], _mm_add_ps( _mm_mul_ps( _mm_loadu_ps( &dstf[index] ), vw0 ), _mm_mul_ps( _mm_loadu_ps( &srcf[index] ), vw1 ) ) );
+#endif
+      for( ; index < count ; index++ )
+        dstf[index] = ( dstf[index] * (float)weight0 ) + ( srcf[index] * (float)weight1 );
+      if( attrib->blendmode == MD_ATTRIB_BLEND_NORMALIZE )
+      {
+        sum = 0.0;
+        for( index = 0 ; index < count ; index++ )
+          sum += (double)dstf[index] * (double)dstf[index];
+        if( sum > 0.0 )
+        {
+          scale = 1.0 / sqrt( sum );
+          for( index = 0 ; index < count ; index++ )
+            dstf[index] = (float)( dstf[index] * scale );
+        }
+      }
+      break;
+    case MD_FORMAT_DOUBLE:
+      dstd = ADDRESS( attrib->base, dstindex * attrib->stride );
+      srcd = ADDRESS( attrib->base, srcindex * attrib->stride );
+      index = 0;
+#if CPU_SSE2_SUPPORT
+      vw0d = _mm_set1_pd( weight0 );
+      vw1d = _mm_set1_pd( weight1 );
+      for( ; index < ( count & ~1 ) ; index += 2 )
+        _mm_storeu_pd( &dstd[index], _mm_add_pd( _mm_mul_pd( _mm_loadu_pd( &dstd[index] ), vw0d ), _mm_mul_pd( _mm_loadu_pd( &srcd[index] ), vw1d ) ) );
+#endif
+      for( ; index < count ; index++ )
+        dstd[index] = ( dstd[index] * weight0 ) + ( srcd[index] * weight1 );
+      if( attrib->blendmode == MD_ATTRIB_BLEND_NORMALIZE )
+      {
+        sum = 0.0;
+        for( index = 0 ; index < count ; index++ )
+          sum += dstd[index] * dstd[index];
+        if( sum > 0.0 )
+        {
+          scale = 1.0 / sqrt( sum );
+          for( index = 0 ; index < count ; index++ )
+            dstd[index] *= scale;
+        }
+      }
+      break;
+    case MD_FORMAT_UBYTE:
+    case MD_FORMAT_UINT8:
+      dstb = ADDRESS( attrib->base, dstindex * attrib->stride );
+      srcb = ADDRESS( attrib->base, srcindex * attrib->stride );
+      for( index = 0 ; index < count ; index++ )
+        dstb[index] = (uint8_t)( ( (mdf)dstb[index] * weight0 ) + ( (mdf)srcb[index] * weight1 ) + 0.5 );
+      break;
+    case MD_FORMAT_USHORT:
+    case MD_FORMAT_UINT16:
+      dsts = ADDRESS( attrib->base, dstindex * attrib->stride );
+      srcs = ADDRESS( attrib->base, srcindex * attrib->stride );
+      for( index = 0 ; index < count ; index++ )
+        dsts[index] = (uint16_t)( ( (mdf)dsts[index] * weight0 ) + ( (mdf)srcs[index] * weight1 ) + 0.5 );
+      break;
+    default:
+      break;
+  }
+  return;
+}
+
+/* Copy all attribute streams of a vertex */
+static inline void mdAttribCopyVertex( mdMesh *mesh, mdi dstindex, mdi srcindex )
+{
+  int attribindex;
+  mdAttrib *attrib;
+  for( attribindex = 0, attrib = mesh->attrib ; attribindex < mesh->attribcount ; attribindex++, attrib++ )
+    memcpy( ADDRESS( attrib->base, dstindex * attrib->stride ), ADDRESS( attrib->base, srcindex * attrib->stride ), attrib->elementsize );
+  return;
+}
+
+/* Move a run of vertices to lower indices when repacking, contiguous streams are moved at once */
+static void mdAttribMoveRun( mdMesh *mesh, mdi dstindex, mdi srcindex, mdi count )
+{
+  int attribindex;
+  mdi index;
+  mdAttrib *attrib;
+  if( ( count <= 0 ) || ( dstindex == srcindex ) )
+    return;
+  for( attribindex = 0, attrib = mesh->attrib ; attribindex < mesh->attribcount ; attribindex++, attrib++ )
+  {
+    if( attrib->stride == attrib->elementsize )
+      memmove( ADDRESS( attrib->base, dstindex * attrib->stride ), ADDRESS( attrib->base, srcindex * attrib->stride ), count * attrib->elementsize );
+    else
+    {
+      for( index = 0 ; index < count ; index++ )
+        memcpy( ADDRESS( attrib->base, ( dstindex + index ) * attrib->stride ), ADDRESS( attrib->base, ( srcindex + index ) * attrib->stride ), attrib->elementsize );
+    }
+  }
+  return;
+}
+
+
 /* Merge vertex attributes of v0 and v1, write to v0 */
 static inline void mdEdgeCollapseMergeVertexAttribs( mdMesh *mesh, mdThreadData *tdata, mdi v0, mdi v1, mdf *collapsepoint )
 {
+  int attribindex;
   mdVertex *vertex0, *vertex1;
   mdf dist[3], dist0, dist1, weightsum, weightsuminv;
   mdf weight0, weight1;
@@ -3202,7 +4904,13 @@ static inline void mdEdgeCollapseMergeVertexAttribs( mdMesh *mesh, mdThreadData
     weight0 = 0.5;
     weight1 = 0.5;
   }
-  mesh->vertexmerge( mesh->mergecontext, v0, v1, weight0, weight1 );
+  /* Attribute streams and callbacks use the user's vertex indices */
+  v0 = mdVertexUserIndex( mesh, v0 );
+  v1 = mdVertexUserIndex( mesh, v1 );
+  for( attribindex = 0 ; attribindex < mesh->attribcount ; attribindex++ )
+    mdAttribBlend( &mesh->attrib[attribindex], v0, v1, weight0, weight1 );
+  if( mesh->vertexmerge )
+    mesh->vertexmerge( mesh->mergecontext, v0, v1, weight0, weight1 );
   return;
 }
 
@@ -3329,6 +5037,39 @@ static mdi mdEdgeCollapseDeleteTriangle( mdMesh *mesh, mdThreadData *tdata, mdi
 }
 
 
+static void mdEdgeCollapseUpdateFlush( mdMesh *mesh, mdThreadData *tdata )
+{
+  int index;
+  mdOp *op;
+  mdSolveBlock *block;
+  block = &tdata->solveblock;
+  mdSolveEdgeCollapseBlock( mesh, block );
+  for( index = 0 ; index < block->count ; index++ )
+  {
+    op = block->op[index];
+    mdUpdateBufferAdd( &op->updatebuffer[ tdata->threadid >> mesh->updatebuffershift ], op, 0x0 );
+#if DEBUG_VERBOSE_COLLAPSE
+    printf( "    Update Edge %d,%d After  ; Point %f %f %f ; Cost %e\n", op->v0, op->v1, op->collapsepoint[0], op->collapsepoint[1], op->collapsepoint[2], op->value + op->penalty );
+    printf( "    Edge %d,%d ; Value %e ; Penalty %e ; Cost %e\n", op->v0, op->v1, op->value, op->penalty, op->value + op->penalty );
+#endif
+  }
+  block->count = 0;
+  return;
+}
+
+/* Gather ops of edges updated by a collapse, their collapses are solved together once all triangles are updated */
+static void mdEdgeCollapseUpdateOp( mdMesh *mesh, mdThreadData *tdata, mdOp *op, mdi v0, mdi v1 )
+{
+  mdSolveBlock *block;
+  block = &tdata->solveblock;
+  block->op[ block->count ] = op;
+  block->v0[ block->count ] = v0;
+  block->v1[ block->count ] = v1;
+  if( ++block->count == MD_SOLVE_BLOCK_SIZE )
+    mdEdgeCollapseUpdateFlush( mesh, tdata );
+  return;
+}
+
 static void mdEdgeCollapseUpdateTriangle( mdMesh *mesh, mdThreadData *tdata, mdTriangle *tri, mdi newv, int pivot, int left, int right )
 {
   mdEdge edge;
@@ -3374,15 +5115,7 @@ static void mdEdgeCollapseUpdateTriangle( mdMesh *mesh, mdThreadData *tdata, mdT
 #if DEBUG_VERBOSE_COLLAPSE
     printf( "    Update Edge %d,%d Before ; Point %f %f %f ; Cost %.16f\n", op->v0, op->v1, op->collapsepoint[0], op->collapsepoint[1], op->collapsepoint[2], op->collapsecost );
 #endif
-    op->value = mdSolveEdgeCollapse( mesh, edge.v[0], edge.v[1], op->collapsepoint );
-#if CPU_SSE_SUPPORT
-    op->collapsepoint[3] = 0.0;
-#endif
-    mdUpdateBufferAdd( &op->updatebuffer[ tdata->threadid >> mesh->updatebuffershift ], op, 0x0 );
-#if DEBUG_VERBOSE_COLLAPSE
-    printf( "    Update Edge %d,%d After  ; Point %f %f %f ; Cost %e\n", op->v0, op->v1, op->collapsepoint[0], op->collapsepoint[1], op->collapsepoint[2], op->value + op->penalty );
-    printf( "    Edge %d,%d ; Value %e ; Penalty %e ; Cost %e\n", op->v0, op->v1, op->value, op->penalty, op->value + op->penalty );
-#endif
+    mdEdgeCollapseUpdateOp( mesh, tdata, op, edge.v[0], edge.v[1] );
   }
 
   /* Update op on left side of pivot, update edge's vertex to new vertex */
@@ -3421,15 +5154,7 @@ static void mdEdgeCollapseUpdateTriangle( mdMesh *mesh, mdThreadData *tdata, mdT
 #if DEBUG_VERBOSE_COLLAPSE
     printf( "    Update Edge %d,%d Before ; Point %f %f %f ; Cost %f\n", op->v0, op->v1, op->collapsepoint[0], op->collapsepoint[1], op->collapsepoint[2], op->collapsecost );
 #endif
-    op->value = mdSolveEdgeCollapse( mesh, edge.v[0], edge.v[1], op->collapsepoint );
-#if CPU_SSE_SUPPORT
-    op->collapsepoint[3] = 0.0;
-#endif
-    mdUpdateBufferAdd( &op->updatebuffer[ tdata->threadid >> mesh->updatebuffershift ], op, 0x0 );
-#if DEBUG_VERBOSE_COLLAPSE
-    printf( "    Update Edge %d,%d After  ; Point %f %f %f ; Cost %e\n", op->v0, op->v1, op->collapsepoint[0], op->collapsepoint[1], op->collapsepoint[2], op->value + op->penalty );
-    printf( "    Edge %d,%d ; Value %e ; Penalty %e ; Cost %e\n", op->v0, op->v1, op->value, op->penalty, op->value + op->penalty );
-#endif
+    mdEdgeCollapseUpdateOp( mesh, tdata, op, edge.v[0], edge.v[1] );
   }
 
   tri->v[pivot] = newv;
@@ -3499,6 +5224,8 @@ static mdi *mdEdgeCollapseUpdateAll( mdMesh *mesh, mdThreadData *tdata, mdi *tri
     else
       MD_ERROR( "SHOULD NOT HAPPEN %s:%d\n", 1, __FILE__, __LINE__ );
   }
+  if( tdata->solveblock.count )
+    mdEdgeCollapseUpdateFlush( mesh, tdata );
 
   return trirefstore;
 }
@@ -3768,6 +5495,7 @@ int mdLockBufferTryLock( mdMesh *mesh, mdThreadData *tdata, mdLockBuffer *buffer
   if( ( owner != -1 ) || !( mmAtomicCmpReplace32( &vertex->atomicowner, -1, tdata->threadid ) ) )
   {
     mdLockBufferUnlockAll( mesh, tdata, buffer );
+    MD_STATISTICS_ADD( tdata, lockretrycount, 1 );
     return 0;
   }
 #else
@@ -3782,6 +5510,7 @@ int mdLockBufferTryLock( mdMesh *mesh, mdThreadData *tdata, mdLockBuffer *buffer
   {
     mtSpinUnlock( &vertex->ownerspinlock );
     mdLockBufferUnlockAll( mesh, tdata, buffer );
+    MD_STATISTICS_ADD( tdata, lockretrycount, 1 );
     return 0;
   }
   vertex->owner = tdata->threadid;
@@ -3811,6 +5540,7 @@ int mdLockBufferLock( mdMesh *mesh, mdThreadData *tdata, mdLockBuffer *buffer, m
   }
   /* Lock failed, release all locks and wait until we get the lock we got stuck on */
   mdLockBufferUnlockAll( mesh, tdata, buffer );
+  MD_STATISTICS_ADD( tdata, lockretrycount, 1 );
   mmAtomicSpinWaitEq32( &vertex->atomicowner, -1 );
 #else
   mtSpinLock( &vertex->ownerspinlock );
@@ -3831,6 +5561,7 @@ int mdLockBufferLock( mdMesh *mesh, mdThreadData *tdata, mdLockBuffer *buffer, m
   mtSpinUnlock( &vertex->ownerspinlock );
   /* Lock failed, release all locks */
   mdLockBufferUnlockAll( mesh, tdata, buffer );
+  MD_STATISTICS_ADD( tdata, lockretrycount, 1 );
 #endif
   return 0;
 }
@@ -3902,6 +5633,7 @@ static void mdOpResolveLockEdge( mdMesh *mesh, mdThreadData *tdata, mdLockBuffer
       mtSpinLock( &mesh->globalvertexspinlock );
 #endif
       globalflag = 1;
+      MD_STATISTICS_ADD( tdata, lockglobalcount, 1 );
     }
     if( !( mdLockBufferLock( mesh, tdata, lockbuffer, op->v0 ) ) || !( mdLockBufferLock( mesh, tdata, lockbuffer, op->v1 ) ) )
     {
@@ -3968,6 +5700,7 @@ static void mdOpResolveLockFull( mdMesh *mesh, mdThreadData *tdata, mdLockBuffer
       mtSpinLock( &mesh->globalvertexspinlock );
 #endif
       globalflag = 1;
+      MD_STATISTICS_ADD( tdata, lockglobalcount, 1 );
     }
     if( !( mdLockBufferLock( mesh, tdata, lockbuffer, op->v0 ) ) || !( mdLockBufferLock( mesh, tdata, lockbuffer, op->v1 ) ) )
     {
@@ -4031,7 +5764,7 @@ static void mdEdgeCollapse( mdMesh *mesh, mdThreadData *tdata, mdi v0, mdi v1, m
   newv = v0;
 
   /* Collapse other custom vertex attributes */
-  if( mesh->vertexmerge )
+  if( ( mesh->vertexmerge ) || ( mesh->attribcount ) )
     mdEdgeCollapseMergeVertexAttribs( mesh, tdata, v0, v1, collapsepoint );
 
   /* Vertices of the collapsed edge */
@@ -4185,21 +5918,32 @@ static void mdEdgeCollapse( mdMesh *mesh, mdThreadData *tdata, mdi v0, mdi v1, m
 
 
 
+/* Count of edges read from the hash table as one batch by the collision check */
+#define MD_EDGE_COLLISION_BATCH (16)
+
 typedef struct
 {
   int collisionflag;
   mdi trileft;
   mdi triright;
+  int edgecount;
+  mdEdge edge[MD_EDGE_COLLISION_BATCH];
+  int hashread[MD_EDGE_COLLISION_BATCH];
 } mdEdgeCollisionData;
 
-static void mdEdgeCollisionCallback( void *opaque, void *entry, int newflag )
+/* Read all edges of the batch, any edge present for another triangle than the two deleted ones is a collision */
+static void mdEdgeCollisionFlush( mdMesh *mesh, mdEdgeCollisionData *ecd )
 {
-  mdEdge *edge;
-  mdEdgeCollisionData *ecd;
-  edge = entry;
-  ecd = opaque;
-  if( ( edge->triindex != ecd->trileft ) && ( edge->triindex != ecd->triright ) )
-    ecd->collisionflag = 1;
+  int index;
+  mmHashLockReadEntries( mesh->edgehashtable, &mdEdgeHashAccess, ecd->edge, ecd->edgecount, ecd->hashread );
+  for( index = 0 ; index < ecd->edgecount ; index++ )
+  {
+    if( ecd->hashread[index] != MM_HASH_SUCCESS )
+      continue;
+    if( ( ecd->edge[index].triindex != ecd->trileft ) && ( ecd->edge[index].triindex != ecd->triright ) )
+      ecd->collisionflag = 1;
+  }
+  ecd->edgecount = 0;
   return;
 }
 
@@ -4215,7 +5959,7 @@ static int mdEdgeCollisionCheck( mdMesh *mesh, mdThreadData *tdata, mdi v0, mdi
   int index, trirefcount, left, right;
   mdi triindex, vsrc, vdst;
   mdi *trireflist;
-  mdEdge edge;
+  mdEdge *edge;
   mdTriangle *tri;
   mdVertex *vertex0, *vertex1;
   mdEdgeCollisionData ecd;
@@ -4243,19 +5987,17 @@ static int mdEdgeCollisionCheck( mdMesh *mesh, mdThreadData *tdata, mdi v0, mdi
 #endif
 
   /* Find the triangles that would be deleted so that we don't detect false collisions with them */
+  ecd.edge[0].v[0] = v0;
+  ecd.edge[0].v[1] = v1;
+  ecd.edge[1].v[0] = v1;
+  ecd.edge[1].v[1] = v0;
+  mmHashLockReadEntries( mesh->edgehashtable, &mdEdgeHashAccess, ecd.edge, 2, ecd.hashread );
   ecd.collisionflag = 0;
-  ecd.trileft = -1;
-  edge.v[0] = v0;
-  edge.v[1] = v1;
-  if( mmHashLockReadEntry( mesh->edgehashtable, &mdEdgeHashAccess, &edge ) == MM_HASH_SUCCESS )
-    ecd.trileft = edge.triindex;
-  ecd.triright = -1;
-  edge.v[0] = v1;
-  edge.v[1] = v0;
-  if( mmHashLockReadEntry( mesh->edgehashtable, &mdEdgeHashAccess, &edge ) == MM_HASH_SUCCESS )
-    ecd.triright = edge.triindex;
+  ecd.trileft = ( ecd.hashread[0] == MM_HASH_SUCCESS ? ecd.edge[0].triindex : -1 );
+  ecd.triright = ( ecd.hashread[1] == MM_HASH_SUCCESS ? ecd.edge[1].triindex : -1 );
+  ecd.edgecount = 0;
 
-  /* Check all trirefs for collision */
+  /* Check all trirefs for collision, edges are read by batches to overlap the cache misses */
   for( index = 0 ; index < trirefcount ; index++ )
   {
     triindex = trireflist[ index ];
@@ -4290,14 +6032,22 @@ static int mdEdgeCollisionCheck( mdMesh *mesh, mdThreadData *tdata, mdi v0, mdi
       continue;
     }
 
-    edge.v[0] = vdst;
-    edge.v[1] = tri->v[right];
-    mmHashLockCallEntry( mesh->edgehashtable, &mdEdgeHashAccess, &edge, mdEdgeCollisionCallback, &ecd, 0 );
-    if( ecd.collisionflag )
-      return 0;
-    edge.v[0] = tri->v[left];
-    edge.v[1] = vdst;
-    mmHashLockCallEntry( mesh->edgehashtable, &mdEdgeHashAccess, &edge, mdEdgeCollisionCallback, &ecd, 0 );
+    edge = &ecd.edge[ ecd.edgecount ];
+    edge[0].v[0] = vdst;
+    edge[0].v[1] = tri->v[right];
+    edge[1].v[0] = tri->v[left];
+    edge[1].v[1] = vdst;
+    ecd.edgecount += 2;
+    if( ecd.edgecount == MD_EDGE_COLLISION_BATCH )
+    {
+      mdEdgeCollisionFlush( mesh, &ecd );
+      if( ecd.collisionflag )
+        return 0;
+    }
+  }
+  if( ecd.edgecount )
+  {
+    mdEdgeCollisionFlush( mesh, &ecd );
     if( ecd.collisionflag )
       return 0;
   }
@@ -4311,30 +6061,310 @@ static int mdEdgeCollisionCheck( mdMesh *mesh, mdThreadData *tdata, mdi v0, mdi
 
 
 
-/* Mesh init step 0, allocate, NOT threaded */
-static int mdMeshInit( mdMesh *mesh, size_t maxmemoryusage )
+/* Bits per axis of the Morton code of triangle centroids, the counting sort uses 2^(3*bits) buckets */
+#define MD_PARTITION_AXIS_BITS (5)
+#define MD_PARTITION_BUCKET_COUNT (1<<(3*MD_PARTITION_AXIS_BITS))
+
+static int mdMeshPartitionInit( mdMesh *mesh )
 {
-  int retval;
-  mdf hashsizefactor;
+  mesh->partitionbounds = malloc( mesh->threadcount * 6 * sizeof(mdf) );
+  mesh->partitionkey = malloc( mesh->tricount * sizeof(uint16_t) );
+  mesh->partitionorder = malloc( mesh->tricount * sizeof(mdi) );
+  if( !( mesh->partitionbounds ) || !( mesh->partitionkey ) || !( mesh->partitionorder ) )
+    return 0;
+  return 1;
+}
 
-  /* Allocate vertices, no extra room for vertices, we overwrite existing ones as we decimate */
-  mesh->vertexlist = mmAlignAlloc( mesh->vertexalloc * sizeof(mdVertex), 0x40 );
+static void mdMeshPartitionEnd( mdMesh *mesh )
+{
+  free( mesh->partitionbounds );
+  free( mesh->partitionkey );
+  free( mesh->partitionorder );
+  mesh->partitionbounds = 0;
+  mesh->partitionkey = 0;
+  mesh->partitionorder = 0;
+  return;
+}
 
-  /* Allocate space for per-vertex lists of face references, including future vertices */
-  mesh->trireflistcount = 0;
-  mesh->trireflistalloc = ( 2 * 6 * mesh->tricount ) + ( mesh->threadcount * MD_TRIREF_AVAIL_MIN_COUNT );
-  mesh->trireflist = malloc( mesh->trireflistalloc * sizeof(mdi) );
+/* Spread the low 10 bits of value, two zero bits between each bit */
+static inline uint32_t mdMortonSpread( uint32_t value )
+{
+  value &= 0x3ff;
+  value = ( value | ( value << 16 ) ) & 0x030000ff;
+  value = ( value | ( value << 8 ) ) & 0x0300f00f;
+  value = ( value | ( value << 4 ) ) & 0x030c30c3;
+  value = ( value | ( value << 2 ) ) & 0x09249249;
+  return value;
+}
 
-  /* Allocate triangles */
-  mesh->trisize = ( sizeof(mdTriangle) + mesh->tridatasize + 0x7 ) & ~0x7;
-  mesh->trilist = malloc( mesh->tricount * mesh->trisize );
+/* Bounding box of the vertices in the thread's range, stored in threadbounds[] at 6 values per thread */
+static void mdMeshVertexBounds( mdMesh *mesh, mdThreadData *tdata, int threadcount, mdf *threadbounds )
+{
+  int axis;
+  mdi vertexindex, vertexbase, vertexmax, vertexperthread;
+  mdf *bounds;
+  mdVertex *vertex;
 
-  /* Allocate edge hash table */
-  retval = 1;
-  hashsizefactor = 1.7;
-  if( !( mesh->operationflags & MD_FLAGS_NO_DECIMATION ) )
+  vertexperthread = ( mesh->vertexcount / threadcount ) + 1;
+  vertexbase = tdata->threadid * vertexperthread;
+  vertexmax = vertexbase + vertexperthread;
+  if( vertexmax > mesh->vertexcount )
+    vertexmax = mesh->vertexcount;
+
+  bounds = &threadbounds[ tdata->threadid * 6 ];
+  for( axis = 0 ; axis < 3 ; axis++ )
+  {
+    bounds[axis+0] = FLT_MAX;
+    bounds[axis+3] = -FLT_MAX;
+  }
+  vertex = &mesh->vertexlist[vertexbase];
+  for( vertexindex = vertexbase ; vertexindex < vertexmax ; vertexindex++, vertex++ )
+  {
+    for( axis = 0 ; axis < 3 ; axis++ )
+    {
+      bounds[axis+0] = mdfmin( bounds[axis+0], vertex->point[axis] );
+      bounds[axis+3] = mdfmax( bounds[axis+3], vertex->point[axis] );
+    }
+  }
+
+  return;
+}
+
+/* Reduce the bounding boxes of all threads, compute the scale mapping coordinates to cells of 2^axisbits per axis */
+static void mdMeshReduceBounds( mdf *threadbounds, int threadcount, int axisbits, mdf *bounds, mdf *scale )
+{
+  int axis, threadindex;
+  mdf range;
+
+  for( axis = 0 ; axis < 3 ; axis++ )
+  {
+    bounds[axis+0] = FLT_MAX;
+    bounds[axis+3] = -FLT_MAX;
+  }
+  for( threadindex = 0 ; threadindex < threadcount ; threadindex++ )
+  {
+    for( axis = 0 ; axis < 3 ; axis++ )
+    {
+      bounds[axis+0] = mdfmin( bounds[axis+0], threadbounds[ ( threadindex * 6 ) + axis + 0 ] );
+      bounds[axis+3] = mdfmax( bounds[axis+3], threadbounds[ ( threadindex * 6 ) + axis + 3 ] );
+    }
+  }
+  for( axis = 0 ; axis < 3 ; axis++ )
+  {
+    range = bounds[axis+3] - bounds[axis+0];
+    scale[axis] = ( range > 0.0 ? ( (mdf)( 1 << axisbits ) - 0.5 ) / range : 0.0 );
+  }
+
+  return;
+}
+
+/* Partition step 1, bounding box of the vertices in the thread's range */
+static void mdMeshPartitionBounds( mdMesh *mesh, mdThreadData *tdata, int threadcount )
+{
+  mdMeshVertexBounds( mesh, tdata, threadcount, mesh->partitionbounds );
+  return;
+}
+
+/* Partition step 2, Morton code of the centroid of triangles in the thread's range */
+static void mdMeshPartitionKeys( mdMesh *mesh, mdThreadData *tdata, int threadcount )
+{
+  int axis;
+  uint32_t cell[3];
+  mdi triindex, tribase, trimax, triperthread;
+  mdf centroid;
+  mdf bounds[6], scale[3];
+  mdTriangle *tri;
+  mdVertex *vertex0, *vertex1, *vertex2;
+
+  /* All threads reduce the bounding boxes of all threads, it's cheaper than another barrier */
+  mdMeshReduceBounds( mesh->partitionbounds, threadcount, MD_PARTITION_AXIS_BITS, bounds, scale );
+
+  triperthread = ( mesh->tricount / threadcount ) + 1;
+  tribase = tdata->threadid * triperthread;
+  trimax = tribase + triperthread;
+  if( trimax > mesh->tricount )
+    trimax = mesh->tricount;
+
+  tri = ADDRESS( mesh->trilist, tribase * mesh->trisize );
+  for( triindex = tribase ; triindex < trimax ; triindex++, tri = ADDRESS( tri, mesh->trisize ) )
+  {
+    if( tri->v[0] == -1 )
+    {
+      mesh->partitionkey[triindex] = 0;
+      continue;
+    }
+    vertex0 = &mesh->vertexlist[ tri->v[0] ];
+    vertex1 = &mesh->vertexlist[ tri->v[1] ];
+    vertex2 = &mesh->vertexlist[ tri->v[2] ];
+    for( axis = 0 ; axis < 3 ; axis++ )
+    {
+      centroid = (1.0/3.0) * ( vertex0->point[axis] + vertex1->point[axis] + vertex2->point[axis] );
+      cell[axis] = (uint32_t)( ( centroid - bounds[axis+0] ) * scale[axis] );
+    }
+    mesh->partitionkey[triindex] = (uint16_t)( mdMortonSpread( cell[0] ) | ( mdMortonSpread( cell[1] ) << 1 ) | ( mdMortonSpread( cell[2] ) << 2 ) );
+  }
+
+  return;
+}
+
+/* Partition step 3, counting sort of triangles by Morton code, NOT threaded */
+static void mdMeshPartitionSort( mdMesh *mesh )
+{
+  mdi triindex, bucketindex, sum, count;
+  mdi *bucketbase;
+
+  bucketbase = calloc( MD_PARTITION_BUCKET_COUNT, sizeof(mdi) );
+  for( triindex = 0 ; triindex < mesh->tricount ; triindex++ )
+    bucketbase[ mesh->partitionkey[triindex] ]++;
+  sum = 0;
+  for( bucketindex = 0 ; bucketindex < MD_PARTITION_BUCKET_COUNT ; bucketindex++ )
+  {
+    count = bucketbase[bucketindex];
+    bucketbase[bucketindex] = sum;
+    sum += count;
+  }
+  for( triindex = 0 ; triindex < mesh->tricount ; triindex++ )
+    mesh->partitionorder[ bucketbase[ mesh->partitionkey[triindex] ]++ ] = triindex;
+  free( bucketbase );
+
+  return;
+}
+
+
+////
+
+
+
+/* Maximum bits per axis of the Morton code of vertices, the counting sort uses up to 2^(3*bits) buckets */
+#define MD_REORDER_AXIS_BITS_MAX (7)
+
+static int mdMeshReorderInit( mdMesh *mesh )
+{
+  /* Use about as many Morton cells as vertices */
+  mesh->reorderaxisbits = 1;
+  while( ( mesh->reorderaxisbits < MD_REORDER_AXIS_BITS_MAX ) && ( ( (mdi)1 << ( 3 * mesh->reorderaxisbits ) ) < mesh->vertexcount ) )
+    mesh->reorderaxisbits++;
+  mesh->reordervertexcount = 0;
+  mesh->reorderbounds = malloc( mesh->threadcount * 6 * sizeof(mdf) );
+  mesh->reorderkey = malloc( mesh->vertexalloc * sizeof(uint32_t) );
+  mesh->reorderpoint = malloc( mesh->vertexalloc * 3 * sizeof(mdf) );
+  mesh->reordermap = malloc( mesh->vertexalloc * sizeof(mdi) );
+  mesh->reorderrank = malloc( mesh->vertexalloc * sizeof(mdi) );
+  mesh->reordertrimap = malloc( mesh->tricount * sizeof(mdi) );
+  mesh->reordertrirank = malloc( mesh->tricount * sizeof(mdi) );
+  /* With topology cleanup, the cleaned up indices are remapped in place */
+  mesh->reorderindices = 0;
+  if( !( mesh->cleanupflag ) )
+  {
+    mesh->reorderindices = malloc( 3 * (size_t)mesh->tricount * sizeof(mdi) );
+    if( !( mesh->reorderindices ) )
+      return 0;
+  }
+  if( !( mesh->reorderbounds ) || !( mesh->reorderkey ) || !( mesh->reorderpoint ) || !( mesh->reordermap ) || !( mesh->reorderrank ) || !( mesh->reordertrimap ) || !( mesh->reordertrirank ) )
+    return 0;
+  return 1;
+}
+
+/* Release buffers only needed to build the mesh, the maps are kept until the mesh is written out */
+static void mdMeshReorderRelease( mdMesh *mesh )
+{
+  free( mesh->reorderbounds );
+  free( mesh->reorderkey );
+  free( mesh->reorderpoint );
+  free( mesh->reorderindices );
+  mesh->reorderbounds = 0;
+  mesh->reorderkey = 0;
+  mesh->reorderpoint = 0;
+  mesh->reorderindices = 0;
+  return;
+}
+
+static void mdMeshReorderEnd( mdMesh *mesh )
+{
+  mdMeshReorderRelease( mesh );
+  free( mesh->reordermap );
+  free( mesh->reorderrank );
+  free( mesh->reordertrimap );
+  free( mesh->reordertrirank );
+  mesh->reordermap = 0;
+  mesh->reorderrank = 0;
+  mesh->reordertrimap = 0;
+  mesh->reordertrirank = 0;
+  mesh->reordervertexcount = 0;
+  return;
+}
+
+
+
+////
+
+
+
+/* Mesh init step 0, allocate, NOT threaded */
+static int mdMeshInit( mdMesh *mesh, size_t maxmemoryusage )
+{
+  int retval;
+  mdf hashsizefactor;
+
+  /* Allocate vertices, no extra room for vertices, we overwrite existing ones as we decimate */
+  mesh->vertexlist = mdMeshHugeAlloc( mesh, mesh->vertexalloc * sizeof(mdVertex), &mesh->vertexmmapsize );
+  if( !( mesh->vertexlist ) )
+    mesh->vertexlist = mmAlignAlloc( mesh->vertexalloc * sizeof(mdVertex), 0x40 );
+  mdMeshNumaInterleave( mesh, mesh->vertexlist, mesh->vertexalloc * sizeof(mdVertex) );
+
+  /* Allocate space for per-vertex lists of face references, including future vertices */
+  mesh->trireflistcount = 0;
+  mesh->trireflistalloc = ( 2 * 6 * mesh->tricount ) + ( mesh->threadcount * MD_TRIREF_AVAIL_MIN_COUNT );
+  mesh->trireflist = mdMeshHugeAlloc( mesh, mesh->trireflistalloc * sizeof(mdi), &mesh->trireflistmmapsize );
+  if( !( mesh->trireflist ) )
+    mesh->trireflist = malloc( mesh->trireflistalloc * sizeof(mdi) );
+  mdMeshNumaInterleave( mesh, mesh->trireflist, mesh->trireflistalloc * sizeof(mdi) );
+
+  /* Allocate triangles */
+  mesh->trisize = ( sizeof(mdTriangle) + mesh->tridatasize + 0x7 ) & ~0x7;
+  mesh->trilist = mdMeshHugeAlloc( mesh, mesh->tricount * mesh->trisize, &mesh->trilistmmapsize );
+  if( !( mesh->trilist ) )
+    mesh->trilist = malloc( mesh->tricount * mesh->trisize );
+  mdMeshNumaInterleave( mesh, mesh->trilist, mesh->tricount * mesh->trisize );
+
+  /* Allocate edge hash table */
+  retval = 1;
+  hashsizefactor = 1.7;
+  if( !( mesh->operationflags & MD_FLAGS_NO_DECIMATION ) )
     retval = mdMeshHashInit( mesh, mesh->tricount, hashsizefactor, 7, maxmemoryusage );
 
+  /* Spatial hash and vertex map for optional vertex welding */
+  if( ( retval ) && ( mesh->weldflag ) )
+    retval = mdMeshWeldInit( mesh );
+
+  /* Buffers for optional topology cleanup */
+  if( ( retval ) && ( mesh->cleanupflag ) )
+    retval = mdMeshCleanupInit( mesh );
+
+  /* Buffers for optional spatial partitioning of triangles across threads */
+  if( ( retval ) && ( mesh->partitionflag ) )
+    retval = mdMeshPartitionInit( mesh );
+
+  /* Buffers for optional renumbering of vertices and triangles along a space-filling curve */
+  if( ( retval ) && ( mesh->reorderflag ) )
+    retval = mdMeshReorderInit( mesh );
+
+  /* Sub-queues of the optional relaxed priority queue shared by all threads, initialized by their threads */
+  if( ( retval ) && ( mesh->sharedqueueflag ) )
+  {
+    mesh->sharedqueuecount = mesh->threadcount * MD_MULTIQUEUE_FACTOR;
+    mesh->sharedqueue = mmAlignAlloc( mesh->sharedqueuecount * sizeof(mdSharedQueue), 0x40 );
+    if( !( mesh->sharedqueue ) )
+      retval = 0;
+  }
+
+  /* Deterministic mode, per-vertex claims and per-thread lists of candidate ops */
+  if( ( mesh->deterministicflag ) && !( mesh->operationflags & MD_FLAGS_NO_DECIMATION ) )
+  {
+    mesh->detclaimlist = calloc( mesh->vertexalloc, sizeof(mdDetClaim) );
+    mesh->detlist = calloc( mesh->threadcount, sizeof(mdDetList) );
+  }
+
 #if MD_CONFIG_ATOMIC_SUPPORT
   mmAtomicWrite32( &mesh->trireflock, 0x0 );
   mmAtomicWrite32( &mesh->globalvertexlock, 0x0 );
@@ -4348,13 +6378,204 @@ static int mdMeshInit( mdMesh *mesh, size_t maxmemoryusage )
 }
 
 
+/* Grid input : vertex index is y*gridwidth+x, cell x,y is split in triangles (a,b,d) and (a,d,c) */
+/* with a=(x,y), b=(x+1,y), c=(x,y+1), d=(x+1,y+1) ; triangles are numbered by row, cell, then half */
+
+typedef struct
+{
+  mdi x;
+  mdi y;
+  int half;
+} mdGridCursor;
+
+static inline int mdGridTriangleValid( mdMesh *mesh, mdi x, mdi y, int half )
+{
+  mdi base;
+  const uint8_t *mask;
+  mask = mesh->gridnodatamask;
+  if( !( mask ) )
+    return 1;
+  base = ( y * mesh->gridwidth ) + x;
+  if( ( mask[base] ) || ( mask[ base + mesh->gridwidth + 1 ] ) )
+    return 0;
+  return !( half ? mask[ base + mesh->gridwidth ] : mask[ base + 1 ] );
+}
+
+/* Count valid triangles in each row of cells, return the total */
+static mdi mdGridCountTriangles( mdMesh *mesh )
+{
+  mdi x, y, tricount;
+  tricount = 0;
+  for( y = 0 ; y < mesh->gridheight - 1 ; y++ )
+  {
+    if( mesh->gridrowtribase )
+      mesh->gridrowtribase[y] = tricount;
+    if( !( mesh->gridnodatamask ) )
+    {
+      tricount += 2 * ( mesh->gridwidth - 1 );
+      continue;
+    }
+    for( x = 0 ; x < mesh->gridwidth - 1 ; x++ )
+      tricount += mdGridTriangleValid( mesh, x, y, 0 ) + mdGridTriangleValid( mesh, x, y, 1 );
+  }
+  return tricount;
+}
+
+static void mdGridNextTriangle( mdMesh *mesh, mdGridCursor *cursor )
+{
+  for( ; ; )
+  {
+    cursor->half ^= 1;
+    if( !( cursor->half ) )
+    {
+      if( ++cursor->x == mesh->gridwidth - 1 )
+      {
+        cursor->x = 0;
+        if( ++cursor->y == mesh->gridheight - 1 )
+          return;
+      }
+    }
+    if( mdGridTriangleValid( mesh, cursor->x, cursor->y, cursor->half ) )
+      return;
+  }
+}
+
+/* Position cursor on triangle triindex, arithmetic without a mask, else search row bases and scan the row */
+static void mdGridLocateTriangle( mdMesh *mesh, mdGridCursor *cursor, mdi triindex )
+{
+  mdi lo, hi, mid, cellindex;
+  if( !( mesh->gridnodatamask ) )
+  {
+    cellindex = triindex >> 1;
+    cursor->half = triindex & 1;
+    cursor->y = cellindex / ( mesh->gridwidth - 1 );
+    cursor->x = cellindex % ( mesh->gridwidth - 1 );
+    return;
+  }
+  lo = 0;
+  hi = mesh->gridheight - 2;
+  while( lo < hi )
+  {
+    mid = ( lo + hi + 1 ) >> 1;
+    if( mesh->gridrowtribase[mid] <= triindex )
+      lo = mid;
+    else
+      hi = mid - 1;
+  }
+  cursor->y = lo;
+  cursor->x = 0;
+  cursor->half = 0;
+  triindex -= mesh->gridrowtribase[lo];
+  if( !( mdGridTriangleValid( mesh, 0, lo, 0 ) ) )
+    mdGridNextTriangle( mesh, cursor );
+  for( ; triindex ; triindex-- )
+    mdGridNextTriangle( mesh, cursor );
+  return;
+}
+
+static void mdGridBlockIndices( mdMesh *mesh, mdi *dst, mdGridCursor *cursor, int count )
+{
+  mdi a, width;
+  width = mesh->gridwidth;
+  for( ; count ; count--, dst += 3 )
+  {
+    a = ( cursor->y * width ) + cursor->x;
+    dst[0] = a;
+    if( !( cursor->half ) )
+    {
+      dst[1] = a + 1;
+      dst[2] = a + width + 1;
+    }
+    else
+    {
+      dst[1] = a + width + 1;
+      dst[2] = a + width;
+    }
+    mdGridNextTriangle( mesh, cursor );
+  }
+  return;
+}
+
+static void mdGridBlockVertices( mdMesh *mesh, mdf *dst, mdi vertexindex, int count, mdf factor )
+{
+  mdi x, y;
+  mdf height;
+  void *sample;
+  x = vertexindex % mesh->gridwidth;
+  y = vertexindex / mesh->gridwidth;
+  for( ; count ; count--, dst += 3 )
+  {
+    sample = ADDRESS( mesh->gridheights, ( (size_t)y * mesh->gridrowstride ) + ( (size_t)x * mesh->gridsamplestride ) );
+    switch( mesh->gridheightformat )
+    {
+      case MD_FORMAT_FLOAT:
+        height = *(float *)sample;
+        break;
+      case MD_FORMAT_DOUBLE:
+        height = *(double *)sample;
+        break;
+      case MD_FORMAT_SHORT:
+        height = *(short *)sample;
+        break;
+      case MD_FORMAT_INT:
+        height = *(int *)sample;
+        break;
+      case MD_FORMAT_USHORT:
+        height = *(unsigned short *)sample;
+        break;
+      case MD_FORMAT_INT16:
+        height = *(int16_t *)sample;
+        break;
+      case MD_FORMAT_INT32:
+        height = *(int32_t *)sample;
+        break;
+      case MD_FORMAT_UINT16:
+      default:
+        height = *(uint16_t *)sample;
+        break;
+    }
+    dst[0] = ( (mdf)x * mesh->gridspacing[0] ) * factor;
+    dst[1] = ( (mdf)y * mesh->gridspacing[1] ) * factor;
+    dst[2] = height * factor;
+    if( ++x == mesh->gridwidth )
+    {
+      x = 0;
+      y++;
+    }
+  }
+  return;
+}
+
+
+static inline void mdVertexInit( mdVertex *vertex, mdf *point )
+{
+#if MD_CONFIG_ATOMIC_SUPPORT
+  mmAtomicWrite32( &vertex->atomicowner, -1 );
+#else
+  vertex->owner = -1;
+  mtSpinInit( &vertex->ownerspinlock );
+#endif
+  MD_VectorCopy( vertex->point, point );
+#if CPU_SSE_SUPPORT && !MD_CONF_DOUBLE_PRECISION
+  vertex->point[3] = 0.0;
+#endif
+  vertex->trirefcount = 0;
+  vertex->redirectindex = -1;
+#if MD_CONFIG_DISTANCE_BIAS
+  vertex->sumbias = 0.0;
+#endif
+  mathQuadricZero( &vertex->quadric );
+  return;
+}
+
 /* Mesh init step 1, initialize vertices, threaded */
 static void mdMeshInitVertices( mdMesh *mesh, mdThreadData *tdata, int threadcount )
 {
-  int vertexindex, vertexindexmax, vertexperthread;
+  int vertexindex, vertexindexmax, vertexperthread, blockindex, blockcount;
   mdf factor;
   mdVertex *vertex;
   void *point;
+  mdf nativepoint[3*MD_CONVERT_BLOCK_SIZE];
 
   vertexperthread = ( mesh->vertexcount / threadcount ) + 1;
   vertexindex = tdata->threadid * vertexperthread;
@@ -4365,25 +6586,25 @@ static void mdMeshInitVertices( mdMesh *mesh, mdThreadData *tdata, int threadcou
   factor = mesh->normalizationfactor;
   vertex = &mesh->vertexlist[vertexindex];
   point = ADDRESS( mesh->point, vertexindex * mesh->pointstride );
-  for( ; vertexindex < vertexindexmax ; vertexindex++, vertex++ )
+  blockindex = 0;
+  blockcount = 0;
+  for( ; vertexindex < vertexindexmax ; vertexindex++, vertex++, blockindex++ )
   {
-#if MD_CONFIG_ATOMIC_SUPPORT
-    mmAtomicWrite32( &vertex->atomicowner, -1 );
-#else
-    vertex->owner = -1;
-    mtSpinInit( &vertex->ownerspinlock );
-#endif
-    mesh->vertexUserToNative( vertex->point, point, factor );
-#if CPU_SSE_SUPPORT && !MD_CONF_DOUBLE_PRECISION
-    vertex->point[3] = 0.0;
-#endif
-    vertex->trirefcount = 0;
-    vertex->redirectindex = -1;
-#if MD_CONFIG_DISTANCE_BIAS
-    vertex->sumbias = 0.0;
-#endif
-    mathQuadricZero( &vertex->quadric );
-    point = ADDRESS( point, mesh->pointstride );
+    if( blockindex == blockcount )
+    {
+      blockindex = 0;
+      blockcount = vertexindexmax - vertexindex;
+      if( blockcount > MD_CONVERT_BLOCK_SIZE )
+        blockcount = MD_CONVERT_BLOCK_SIZE;
+      if( mesh->gridflag )
+        mdGridBlockVertices( mesh, nativepoint, vertexindex, blockcount, factor );
+      else
+      {
+        mdVertexBlockUserToNative( nativepoint, point, mesh->pointstride, blockcount, factor, mesh->vertexformat, mesh->vertexUserToNative );
+        point = ADDRESS( point, blockcount * mesh->pointstride );
+      }
+    }
+    mdVertexInit( vertex, &nativepoint[3*blockindex] );
   }
 
   return;
@@ -4413,67 +6634,513 @@ static inline void mdMeshForbidEdge( mdMesh *mesh, int v0, int v1 )
 }
 
 
-/* Mesh init step 2, initialize triangles, threaded */
-static void mdMeshInitTriangles( mdMesh *mesh, mdThreadData *tdata, int threadcount )
+/* Deterministic mode, the lowest triangle index keeps a directed edge shared by several triangles */
+static void mdMeshEdgeClaimCallback( void *opaque, void *entry, int newflag )
+{
+  mdEdge *edge, *claim;
+  if( newflag )
+    return;
+  edge = entry;
+  claim = opaque;
+  if( claim->triindex < edge->triindex )
+    edge->triindex = claim->triindex;
+  edge->op = MD_EDGE_OP_DUPLICATE;
+  claim->op = MD_EDGE_OP_DUPLICATE;
+  return;
+}
+
+/* Deterministic mode, add edge to hash ; collisions are only tagged, edge flags are resolved by mdMeshResolveEdgeFlags() */
+static void mdMeshClaimEdge( mdMesh *mesh, mdThreadData *tdata, mdi triindex, mdi v0, mdi v1 )
 {
-  int i, triperthread, triindex, triindexmax;
-  long buildtricount;
-  void *indices, *tridata;
-  mdTriangle *tri;
-  mdVertex *vertex;
   mdEdge edge;
-  mathQuadric q;
+  edge.v[0] = v0;
+  edge.v[1] = v1;
+  edge.triindex = triindex;
+  edge.op = 0;
+  mmHashLockCallEntry( mesh->edgehashtable, &mdEdgeHashAccess, &edge, mdMeshEdgeClaimCallback, &edge, 1 );
+  if( edge.op )
+    tdata->statuscollisioncount++;
+  return;
+}
 
-  triperthread = ( mesh->tricount / threadcount ) + 1;
-  triindex = tdata->threadid * triperthread;
-  triindexmax = triindex + triperthread;
-  if( triindexmax > mesh->tricount )
-    triindexmax = mesh->tricount;
 
-  /* Initialize triangles */
-  buildtricount = 0;
-  indices = ADDRESS( mesh->indices, triindex * mesh->indicesstride );
-  tridata = ADDRESS( mesh->tridata, triindex * mesh->tridatasize );
-  tri = ADDRESS( mesh->trilist, triindex * mesh->trisize );
-  edge.op = 0;
-  for( ; triindex < triindexmax ; triindex++, indices = ADDRESS( indices, mesh->indicesstride ), tri = ADDRESS( tri, mesh->trisize ), tridata = ADDRESS( tridata, mesh->tridatasize ) )
+/* Vertex welding, cell of a vertex ; exact positions are used as cell when no tolerance is set */
+static void mdMeshWeldCell( mdMesh *mesh, mdf *point, int64_t *cell )
+{
+  int axis;
+  double invtolerance, coord;
+  if( mesh->weldtolerance > 0.0 )
   {
-    mesh->indicesUserToNative( tri->v, indices );
-#if DEBUG_VERBOSE_QUADRIC
-    printf( "Triangle %d ; %d,%d,%d\n", triindex, (int)tri->v[0], (int)tri->v[1], (int)tri->v[2] );
-#endif
-#if DEBUG_VERBOSE_QUADRIC || DEBUG_VERBOSE_CHECKS
-    if( ( tri->v[0] == tri->v[1] ) || ( tri->v[1] == tri->v[2] ) ||( tri->v[0] == tri->v[2] ) )
-      printf( "    ERROR: Repeated indices in triangle %d ; %d,%d,%d\n", triindex, (int)tri->v[0], (int)tri->v[1], (int)tri->v[2] );
+    invtolerance = 1.0 / mesh->weldtolerance;
+    for( axis = 0 ; axis < 3 ; axis++ )
+      cell[axis] = (int64_t)floor( (double)point[axis] * invtolerance );
+  }
+  else
+  {
+    for( axis = 0 ; axis < 3 ; axis++ )
+    {
+      /* Adding zero turns negative zero into positive zero */
+      coord = (double)point[axis] + 0.0;
+      memcpy( &cell[axis], &coord, sizeof(int64_t) );
+    }
+  }
+  return;
+}
+
+/* Vertex welding, keep the lowest vertex index as representative of a cell */
+static void mdMeshWeldInsertCallback( void *opaque, void *entry, int newflag )
+{
+  mdWeldEntry *weld, *insert;
+  if( newflag )
+    return;
+  weld = entry;
+  insert = opaque;
+  if( insert->vertexindex < weld->vertexindex )
+    weld->vertexindex = insert->vertexindex;
+  return;
+}
+
+/* Mesh init step 1b, vertex welding, insert all vertices in the spatial hash, threaded */
+static void mdMeshWeldInsert( mdMesh *mesh, mdThreadData *tdata, int threadcount )
+{
+  int vertexindex, vertexindexmax, vertexperthread;
+  mdVertex *vertex;
+  mdWeldEntry weld;
+
+  vertexperthread = ( mesh->vertexcount / threadcount ) + 1;
+  vertexindex = tdata->threadid * vertexperthread;
+  vertexindexmax = vertexindex + vertexperthread;
+  if( vertexindexmax > mesh->vertexcount )
+    vertexindexmax = mesh->vertexcount;
+
+  vertex = &mesh->vertexlist[vertexindex];
+  for( ; vertexindex < vertexindexmax ; vertexindex++, vertex++ )
+  {
+    mesh->weldmap[vertexindex] = vertexindex;
+    /* Locked vertices are never welded */
+    if( ( mesh->lockmap ) && ( mdGetVertexLockFlag( mesh, vertexindex ) ) )
+      continue;
+    mdMeshWeldCell( mesh, vertex->point, weld.cell );
+    weld.vertexindex = vertexindex;
+    mmHashLockCallEntry( mesh->weldhashtable, &mdWeldHashAccess, &weld, mdMeshWeldInsertCallback, &weld, 1 );
+  }
+
+  return;
+}
+
+/* Mesh init step 1c, vertex welding, map vertices to the lowest representative within tolerance in neighboring cells, threaded */
+static void mdMeshWeldResolve( mdMesh *mesh, mdThreadData *tdata, int threadcount )
+{
+  int vertexindex, vertexindexmax, vertexperthread, range, dx, dy, dz;
+  int64_t cell[3];
+  mdf tolerancesquared;
+  mdf vector[3];
+  mdi bestindex;
+  mdVertex *vertex;
+  mdWeldEntry weld;
+
+  vertexperthread = ( mesh->vertexcount / threadcount ) + 1;
+  vertexindex = tdata->threadid * vertexperthread;
+  vertexindexmax = vertexindex + vertexperthread;
+  if( vertexindexmax > mesh->vertexcount )
+    vertexindexmax = mesh->vertexcount;
+
+  range = ( mesh->weldtolerance > 0.0 ? 1 : 0 );
+  tolerancesquared = mesh->weldtolerance * mesh->weldtolerance;
+  vertex = &mesh->vertexlist[vertexindex];
+  for( ; vertexindex < vertexindexmax ; vertexindex++, vertex++ )
+  {
+    if( ( mesh->lockmap ) && ( mdGetVertexLockFlag( mesh, vertexindex ) ) )
+      continue;
+    mdMeshWeldCell( mesh, vertex->point, cell );
+    bestindex = vertexindex;
+    for( dz = -range ; dz <= range ; dz++ )
+    {
+      for( dy = -range ; dy <= range ; dy++ )
+      {
+        for( dx = -range ; dx <= range ; dx++ )
+        {
+          weld.cell[0] = cell[0] + dx;
+          weld.cell[1] = cell[1] + dy;
+          weld.cell[2] = cell[2] + dz;
+          if( mmHashLockReadEntry( mesh->weldhashtable, &mdWeldHashAccess, &weld ) != MM_HASH_SUCCESS )
+            continue;
+          if( weld.vertexindex >= bestindex )
+            continue;
+          MD_VectorSubStore( vector, mesh->vertexlist[ weld.vertexindex ].point, vertex->point );
+          if( MD_VectorDotProduct( vector, vector ) <= tolerancesquared )
+            bestindex = weld.vertexindex;
+        }
+      }
+    }
+    mesh->weldmap[vertexindex] = bestindex;
+  }
+
+  return;
+}
+
+/* Mesh init step 1d, vertex welding, follow representatives to the final welded vertex, threaded */
+static void mdMeshWeldRemap( mdMesh *mesh, mdThreadData *tdata, int threadcount )
+{
+  int vertexindex, vertexindexmax, vertexperthread;
+  long weldcount;
+  mdi targetindex;
+
+  vertexperthread = ( mesh->vertexcount / threadcount ) + 1;
+  vertexindex = tdata->threadid * vertexperthread;
+  vertexindexmax = vertexindex + vertexperthread;
+  if( vertexindexmax > mesh->vertexcount )
+    vertexindexmax = mesh->vertexcount;
+
+  /* Representatives only map to lower indices, chains are short and always terminate */
+  weldcount = 0;
+  for( ; vertexindex < vertexindexmax ; vertexindex++ )
+  {
+    targetindex = mesh->weldmap[vertexindex];
+    if( targetindex == vertexindex )
+      continue;
+    while( mesh->weldmap[targetindex] != targetindex )
+      targetindex = mesh->weldmap[targetindex];
+    mesh->weldmap[vertexindex] = targetindex;
+    weldcount++;
+  }
+
+  /* Welded vertices are gone from the mesh */
+#if MD_CONFIG_ATOMIC_SUPPORT
+  mmAtomicAddL( &mesh->trackvertexcount, -weldcount );
+#else
+  mtSpinLock( &mesh->trackspinlock );
+  mesh->trackvertexcount -= weldcount;
+  mtSpinUnlock( &mesh->trackspinlock );
+#endif
+
+  return;
+}
+
+
+/* Read a block of native indices from user indices or grid input, remapped to welded vertices */
+static void mdMeshReadIndices( mdMesh *mesh, mdi *dst, mdi triindex, int count, mdGridCursor *gridcursor )
+{
+  int i;
+  if( mesh->gridflag )
+    mdGridBlockIndices( mesh, dst, gridcursor, count );
+  else
+    mdIndicesBlockUserToNative( dst, ADDRESS( mesh->indices, triindex * mesh->indicesstride ), mesh->indicesstride, count, mesh->indicesformat, mesh->indicesUserToNative );
+  if( mesh->weldmap )
+  {
+    for( i = 0 ; i < 3 * count ; i++ )
+      dst[i] = mesh->weldmap[ dst[i] ];
+  }
+  return;
+}
+
+
+/* Native indices to renumber, the cleaned up indices when the topology cleanup stage ran */
+static inline mdi *mdMeshReorderIndices( mdMesh *mesh )
+{
+  if( mesh->cleanindices )
+    return mesh->cleanindices;
+  return mesh->reorderindices;
+}
+
+/* Reorder step 1, load native indices of triangles and bounding box of the vertices in the thread's range, threaded */
+static void mdMeshReorderLoad( mdMesh *mesh, mdThreadData *tdata, int threadcount )
+{
+  int triperthread, triindex, triindexmax, blockcount;
+
+  /* Spatial reordering is disabled for grid input, no grid cursor is needed */
+  if( mesh->reorderindices )
+  {
+    triperthread = ( mesh->tricount / threadcount ) + 1;
+    triindex = tdata->threadid * triperthread;
+    triindexmax = triindex + triperthread;
+    if( triindexmax > mesh->tricount )
+      triindexmax = mesh->tricount;
+    for( ; triindex < triindexmax ; triindex += blockcount )
+    {
+      blockcount = triindexmax - triindex;
+      if( blockcount > MD_CONVERT_BLOCK_SIZE )
+        blockcount = MD_CONVERT_BLOCK_SIZE;
+      mdMeshReadIndices( mesh, &mesh->reorderindices[ 3 * (size_t)triindex ], triindex, blockcount, 0 );
+    }
+  }
+
+  mdMeshVertexBounds( mesh, tdata, threadcount, mesh->reorderbounds );
+
+  return;
+}
+
+/* Reorder step 2, Morton code of vertices in the thread's range, keep a copy of their points, threaded */
+static void mdMeshReorderKeys( mdMesh *mesh, mdThreadData *tdata, int threadcount )
+{
+  int axis;
+  uint32_t cell[3];
+  mdi vertexindex, vertexbase, vertexmax, vertexperthread;
+  mdf bounds[6], scale[3];
+  mdVertex *vertex;
+
+  mdMeshReduceBounds( mesh->reorderbounds, threadcount, mesh->reorderaxisbits, bounds, scale );
+
+  vertexperthread = ( mesh->vertexcount / threadcount ) + 1;
+  vertexbase = tdata->threadid * vertexperthread;
+  vertexmax = vertexbase + vertexperthread;
+  if( vertexmax > mesh->vertexcount )
+    vertexmax = mesh->vertexcount;
+
+  vertex = &mesh->vertexlist[vertexbase];
+  for( vertexindex = vertexbase ; vertexindex < vertexmax ; vertexindex++, vertex++ )
+  {
+    MD_VectorCopy( &mesh->reorderpoint[ 3 * (size_t)vertexindex ], vertex->point );
+    for( axis = 0 ; axis < 3 ; axis++ )
+      cell[axis] = (uint32_t)( ( vertex->point[axis] - bounds[axis+0] ) * scale[axis] );
+    mesh->reorderkey[vertexindex] = mdMortonSpread( cell[0] ) | ( mdMortonSpread( cell[1] ) << 1 ) | ( mdMortonSpread( cell[2] ) << 2 );
+  }
+
+  return;
+}
+
+/* Reorder step 3, counting sort of vertices by Morton code, NOT threaded */
+static void mdMeshReorderSortVertices( mdMesh *mesh )
+{
+  mdi vertexindex, bucketindex, bucketcount, sum, count, internalindex;
+  mdi *bucketbase;
+
+  bucketcount = (mdi)1 << ( 3 * mesh->reorderaxisbits );
+  bucketbase = calloc( bucketcount, sizeof(mdi) );
+  for( vertexindex = 0 ; vertexindex < mesh->vertexcount ; vertexindex++ )
+    bucketbase[ mesh->reorderkey[vertexindex] ]++;
+  sum = 0;
+  for( bucketindex = 0 ; bucketindex < bucketcount ; bucketindex++ )
+  {
+    count = bucketbase[bucketindex];
+    bucketbase[bucketindex] = sum;
+    sum += count;
+  }
+  for( vertexindex = 0 ; vertexindex < mesh->vertexcount ; vertexindex++ )
+  {
+    internalindex = bucketbase[ mesh->reorderkey[vertexindex] ]++;
+    mesh->reordermap[internalindex] = vertexindex;
+    mesh->reorderrank[vertexindex] = internalindex;
+  }
+  free( bucketbase );
+
+  /* From now on, internal vertex indices differ from the user's indices */
+  mesh->reordervertexcount = mesh->vertexcount;
+
+  return;
+}
+
+/* Reorder step 4, move vertices in the thread's range to their internal index, remap native indices of triangles in the thread's range, threaded */
+static void mdMeshReorderRemap( mdMesh *mesh, mdThreadData *tdata, int threadcount )
+{
+  int i;
+  mdi vertexindex, vertexbase, vertexmax, vertexperthread;
+  mdi triindex, tribase, trimax, triperthread;
+  mdi *v;
+
+  vertexperthread = ( mesh->vertexcount / threadcount ) + 1;
+  vertexbase = tdata->threadid * vertexperthread;
+  vertexmax = vertexbase + vertexperthread;
+  if( vertexmax > mesh->vertexcount )
+    vertexmax = mesh->vertexcount;
+  /* Vertices hold nothing but their point at this stage */
+  for( vertexindex = vertexbase ; vertexindex < vertexmax ; vertexindex++ )
+    mdVertexInit( &mesh->vertexlist[vertexindex], &mesh->reorderpoint[ 3 * (size_t)mesh->reordermap[vertexindex] ] );
+
+  triperthread = ( mesh->tricount / threadcount ) + 1;
+  tribase = tdata->threadid * triperthread;
+  trimax = tribase + triperthread;
+  if( trimax > mesh->tricount )
+    trimax = mesh->tricount;
+  v = &mdMeshReorderIndices( mesh )[ 3 * (size_t)tribase ];
+  for( triindex = tribase ; triindex < trimax ; triindex++, v += 3 )
+  {
+    /* Triangles dropped by the cleanup stage only have v[0] set to -1 */
+    if( v[0] == -1 )
+      continue;
+    for( i = 0 ; i < 3 ; i++ )
+      v[i] = mesh->reorderrank[ v[i] ];
+  }
+
+  return;
+}
+
+/* Sort key of a triangle, its lowest internal vertex index, deleted triangles go last */
+static inline mdi mdMeshReorderTriangleKey( mdMesh *mesh, mdi *v )
+{
+  mdi key;
+  if( v[0] == -1 )
+    return mesh->vertexcount;
+  key = v[0];
+  if( v[1] < key )
+    key = v[1];
+  if( v[2] < key )
+    key = v[2];
+  return key;
+}
+
+/* Reorder step 5, counting sort of triangles by their lowest internal vertex index, NOT threaded */
+static void mdMeshReorderSortTriangles( mdMesh *mesh )
+{
+  mdi triindex, bucketindex, sum, count, key, internalindex;
+  mdi *bucketbase, *indices, *v;
+
+  bucketbase = calloc( mesh->vertexcount + 1, sizeof(mdi) );
+  indices = mdMeshReorderIndices( mesh );
+  for( triindex = 0, v = indices ; triindex < mesh->tricount ; triindex++, v += 3 )
+  {
+    key = mdMeshReorderTriangleKey( mesh, v );
+    bucketbase[key]++;
+  }
+  sum = 0;
+  for( bucketindex = 0 ; bucketindex <= mesh->vertexcount ; bucketindex++ )
+  {
+    count = bucketbase[bucketindex];
+    bucketbase[bucketindex] = sum;
+    sum += count;
+  }
+  for( triindex = 0, v = indices ; triindex < mesh->tricount ; triindex++, v += 3 )
+  {
+    key = mdMeshReorderTriangleKey( mesh, v );
+    internalindex = bucketbase[key]++;
+    mesh->reordertrimap[internalindex] = triindex;
+    mesh->reordertrirank[triindex] = internalindex;
+  }
+  free( bucketbase );
+
+  return;
+}
+
+
+/* Mesh init step 2, initialize triangles, threaded */
+static void mdMeshInitTriangles( mdMesh *mesh, mdThreadData *tdata, int threadcount )
+{
+  int i, triperthread, triindex, triindexmax, blockindex, blockcount;
+  long buildtricount;
+  mdi usertriindex;
+  mdi *v;
+  void *tridata, *srctridata;
+  mdTriangle *tri;
+  mdVertex *vertex;
+  mdEdge edge;
+  mathQuadric q;
+  mdi nativeindices[3*MD_CONVERT_BLOCK_SIZE];
+  mdGridCursor gridcursor;
+
+  triperthread = ( mesh->tricount / threadcount ) + 1;
+  triindex = tdata->threadid * triperthread;
+  triindexmax = triindex + triperthread;
+  if( triindexmax > mesh->tricount )
+    triindexmax = mesh->tricount;
+
+  /* Initialize triangles */
+  buildtricount = 0;
+  tridata = ADDRESS( mesh->tridata, triindex * mesh->tridatasize );
+  tri = ADDRESS( mesh->trilist, triindex * mesh->trisize );
+  edge.op = 0;
+  blockindex = 0;
+  blockcount = 0;
+  if( ( mesh->gridflag ) && ( triindex < triindexmax ) )
+    mdGridLocateTriangle( mesh, &gridcursor, triindex );
+  for( ; triindex < triindexmax ; triindex++, blockindex++, tri = ADDRESS( tri, mesh->trisize ), tridata = ADDRESS( tridata, mesh->tridatasize ) )
+  {
+    if( mesh->reordervertexcount )
+    {
+      /* Triangles are gathered in spatial order, indices were already read and remapped by the optional reorder stage */
+      usertriindex = mesh->reordertrimap[triindex];
+      v = &mdMeshReorderIndices( mesh )[ 3 * (size_t)usertriindex ];
+      tri->v[0] = v[0];
+      tri->v[1] = v[1];
+      tri->v[2] = v[2];
+      srctridata = ADDRESS( mesh->tridata, usertriindex * mesh->tridatasize );
+    }
+    else
+    {
+      if( blockindex == blockcount )
+      {
+        blockindex = 0;
+        blockcount = triindexmax - triindex;
+        if( blockcount > MD_CONVERT_BLOCK_SIZE )
+          blockcount = MD_CONVERT_BLOCK_SIZE;
+        /* Indices were already read and cleaned up by the optional cleanup stage */
+        if( mesh->cleanindices )
+          memcpy( nativeindices, &mesh->cleanindices[ 3 * (size_t)triindex ], 3 * blockcount * sizeof(mdi) );
+        else
+          mdMeshReadIndices( mesh, nativeindices, triindex, blockcount, &gridcursor );
+      }
+      tri->v[0] = nativeindices[3*blockindex+0];
+      tri->v[1] = nativeindices[3*blockindex+1];
+      tri->v[2] = nativeindices[3*blockindex+2];
+      srctridata = tridata;
+    }
+    /* Triangles collapsed by vertex welding or dropped by the cleanup stage are deleted */
+    if( ( tri->v[0] == -1 ) || ( ( mesh->weldmap ) && ( ( tri->v[0] == tri->v[1] ) || ( tri->v[1] == tri->v[2] ) || ( tri->v[2] == tri->v[0] ) ) ) )
+    {
+      tri->v[0] = -1;
+      tri->u.edgeflags = 0;
+      continue;
+    }
+#if DEBUG_VERBOSE_QUADRIC
+    printf( "Triangle %d ; %d,%d,%d\n", triindex, (int)tri->v[0], (int)tri->v[1], (int)tri->v[2] );
+#endif
+#if DEBUG_VERBOSE_QUADRIC || DEBUG_VERBOSE_CHECKS
+    if( ( tri->v[0] == tri->v[1] ) || ( tri->v[1] == tri->v[2] ) ||( tri->v[0] == tri->v[2] ) )
+      printf( "    ERROR: Repeated indices in triangle %d ; %d,%d,%d\n", triindex, (int)tri->v[0], (int)tri->v[1], (int)tri->v[2] );
 #endif
     tri->u.edgeflags = 0;
-#if MD_CONF_LOCAL_VERTEX_ORIGINS
-    mdTriangleComputeLocalQuadric( mesh, tri, &q );
+    if( mesh->deterministicflag )
+    {
+      /* Quadrics are accumulated per vertex in a fixed order by mdMeshBuildVertexQuadrics() */
+      for( i = 0 ; i < 3 ; i++ )
+      {
+        vertex = &mesh->vertexlist[ tri->v[i] ];
+#if MD_CONFIG_ATOMIC_SUPPORT
+        mmAtomicSpin32( &vertex->atomicowner, -1, tdata->threadid );
+        vertex->trirefcount++;
+        mmAtomicWrite32( &vertex->atomicowner, -1 );
 #else
-    mdTriangleComputeQuadric( mesh, tri, &q );
+        mtSpinLock( &vertex->ownerspinlock );
+        vertex->trirefcount++;
+        mtSpinUnlock( &vertex->ownerspinlock );
 #endif
-    for( i = 0 ; i < 3 ; i++ )
+      }
+    }
+    else
     {
-      vertex = &mesh->vertexlist[ tri->v[i] ];
+#if MD_CONF_LOCAL_VERTEX_ORIGINS
+      mdTriangleComputeLocalQuadric( mesh, tri, &q );
+#else
+      mdTriangleComputeQuadric( mesh, tri, &q );
+#endif
+      for( i = 0 ; i < 3 ; i++ )
+      {
+        vertex = &mesh->vertexlist[ tri->v[i] ];
 #if DEBUG_VERBOSE_QUADRIC
-      printf( "  Accum quadric to vertex %d\n", (int)tri->v[i] );
+        printf( "  Accum quadric to vertex %d\n", (int)tri->v[i] );
 #endif
 #if MD_CONFIG_ATOMIC_SUPPORT
-      mmAtomicSpin32( &vertex->atomicowner, -1, tdata->threadid );
-      mathQuadricAddQuadric( &vertex->quadric, &q );
-      vertex->trirefcount++;
-      mmAtomicWrite32( &vertex->atomicowner, -1 );
+        mmAtomicSpin32( &vertex->atomicowner, -1, tdata->threadid );
+        mathQuadricAddQuadric( &vertex->quadric, &q );
+        vertex->trirefcount++;
+        mmAtomicWrite32( &vertex->atomicowner, -1 );
 #else
-      mtSpinLock( &vertex->ownerspinlock );
-      mathQuadricAddQuadric( &vertex->quadric, &q );
-      vertex->trirefcount++;
-      mtSpinUnlock( &vertex->ownerspinlock );
+        mtSpinLock( &vertex->ownerspinlock );
+        mathQuadricAddQuadric( &vertex->quadric, &q );
+        vertex->trirefcount++;
+        mtSpinUnlock( &vertex->ownerspinlock );
 #endif
+      }
     }
     if( mesh->tridatasize )
-      memcpy( ADDRESS(tri,sizeof(mdTriangle)), tridata, mesh->tridatasize );
+      memcpy( ADDRESS(tri,sizeof(mdTriangle)), srctridata, mesh->tridatasize );
 
-    if( !( mesh->operationflags & MD_FLAGS_NO_DECIMATION ) )
+    if( !( mesh->operationflags & MD_FLAGS_NO_DECIMATION ) && ( mesh->deterministicflag ) )
+    {
+      mdMeshClaimEdge( mesh, tdata, triindex, tri->v[0], tri->v[1] );
+      mdMeshClaimEdge( mesh, tdata, triindex, tri->v[1], tri->v[2] );
+      mdMeshClaimEdge( mesh, tdata, triindex, tri->v[2], tri->v[0] );
+    }
+    else if( !( mesh->operationflags & MD_FLAGS_NO_DECIMATION ) )
     {
       edge.triindex = triindex;
       edge.v[0] = tri->v[0];
@@ -4544,56 +7211,358 @@ static void mdMeshInitTrirefs( mdMesh *mesh )
 }
 
 
-/* Accumulate quadrics from boundaries or weighted edges as returned by user callback */
-static inline void mdMeshAccumBoundaryEdges( mdMesh *mesh, mdTriangle *tri, mdVertex **trivertex )
+/* Topology cleanup step 1, read indices, drop degenerate triangles, count vertex references and hash triangles, threaded */
+static void mdMeshCleanupLoad( mdMesh *mesh, mdThreadData *tdata, int threadcount )
 {
-  int hashread;
-  mdf edgeweight, boundaryedgeexpand;
-  mdEdge edge;
-  mdTriangle *trilink;
+  int i, triperthread, triindex, triindexmax, blockcount;
+  mdi *v;
+  mdVertex *vertex;
+  mdCleanTriangle cleantri;
+  mdGridCursor gridcursor;
 
-  boundaryedgeexpand = mesh->boundaryedgeexpand;
+  triperthread = ( mesh->tricount / threadcount ) + 1;
+  triindex = tdata->threadid * triperthread;
+  triindexmax = triindex + triperthread;
+  if( triindexmax > mesh->tricount )
+    triindexmax = mesh->tricount;
 
-  edge.v[0] = tri->v[1];
-  edge.v[1] = tri->v[0];
-  hashread = mmHashLockReadEntry( mesh->edgehashtable, &mdEdgeHashAccess, &edge );
-  edgeweight = mesh->boundaryareafactor;
-  if( !( tri->u.edgeflags & MD_EDGEFLAGS_DENYEDGE01 ) && ( hashread != MM_HASH_SUCCESS ) )
-  {
-#if DEBUG_VERBOSE_BOUNDARY
-    printf( "Boundary %d,%d (%d)\n", tri->v[1], tri->v[0], tri->v[2] );
-#endif
-    tri->u.edgeflags |= MD_EDGEFLAGS_BOUNDARY01;
-  }
-  else if( ( mesh->edgeweight ) && ( hashread == MM_HASH_SUCCESS ) )
+  if( ( mesh->gridflag ) && ( triindex < triindexmax ) )
+    mdGridLocateTriangle( mesh, &gridcursor, triindex );
+  for( ; triindex < triindexmax ; triindex += blockcount )
   {
-    trilink = ADDRESS( mesh->trilist, edge.triindex * mesh->trisize );
-    edgeweight *= mesh->edgeweight( ADDRESS( tri, sizeof(mdTriangle) ), ADDRESS( trilink, sizeof(mdTriangle) ) );
-    if( edgeweight <= 0.0 )
-      goto skip01;
-#if DEBUG_VERBOSE_BOUNDARY
-    printf( "Edge weight %d,%d (%d) ; %f\n", tri->v[1], tri->v[0], tri->v[2], edgeweight );
+    blockcount = triindexmax - triindex;
+    if( blockcount > MD_CONVERT_BLOCK_SIZE )
+      blockcount = MD_CONVERT_BLOCK_SIZE;
+    mdMeshReadIndices( mesh, &mesh->cleanindices[ 3 * (size_t)triindex ], triindex, blockcount, &gridcursor );
+    for( cleantri.triindex = triindex ; cleantri.triindex < triindex + blockcount ; cleantri.triindex++ )
+    {
+      v = &mesh->cleanindices[ 3 * (size_t)cleantri.triindex ];
+      if( ( v[0] == v[1] ) || ( v[1] == v[2] ) || ( v[2] == v[0] ) )
+      {
+        v[0] = -1;
+        continue;
+      }
+      for( i = 0 ; i < 3 ; i++ )
+      {
+        vertex = &mesh->vertexlist[ v[i] ];
+#if MD_CONFIG_ATOMIC_SUPPORT
+        mmAtomicSpin32( &vertex->atomicowner, -1, tdata->threadid );
+        vertex->trirefcount++;
+        mmAtomicWrite32( &vertex->atomicowner, -1 );
+#else
+        mtSpinLock( &vertex->ownerspinlock );
+        vertex->trirefcount++;
+        mtSpinUnlock( &vertex->ownerspinlock );
 #endif
+      }
+      /* Duplicates are found regardless of winding, the key is the sorted set of vertices */
+      cleantri.v[0] = v[0];
+      cleantri.v[1] = v[1];
+      cleantri.v[2] = v[2];
+      mdSortIndices3( cleantri.v );
+      mmHashLockCallEntry( mesh->cleanhashtable, &mdCleanHashAccess, &cleantri, mdMeshCleanupHashCallback, &cleantri, 1 );
+    }
   }
-  else
-    goto skip01;
-  mdMeshAccumulateBoundary( trivertex[0], trivertex[1], trivertex[2], edgeweight, boundaryedgeexpand );
-  skip01:
 
-  edge.v[0] = tri->v[2];
-  edge.v[1] = tri->v[1];
-  hashread = mmHashLockReadEntry( mesh->edgehashtable, &mdEdgeHashAccess, &edge );
-  edgeweight = mesh->boundaryareafactor;
-  if( !( tri->u.edgeflags & MD_EDGEFLAGS_DENYEDGE12 ) && ( hashread != MM_HASH_SUCCESS ) )
-  {
+  return;
+}
+
+/* Topology cleanup step 3, drop duplicate triangles and store vertex references of remaining triangles, threaded */
+static void mdMeshCleanupDedup( mdMesh *mesh, mdThreadData *tdata, int threadcount )
+{
+  int i, triperthread, triindex, triindexmax;
+  mdi *v;
+  mdVertex *vertex;
+  mdCleanTriangle cleantri;
+
+  triperthread = ( mesh->tricount / threadcount ) + 1;
+  triindex = tdata->threadid * triperthread;
+  triindexmax = triindex + triperthread;
+  if( triindexmax > mesh->tricount )
+    triindexmax = mesh->tricount;
+
+  for( ; triindex < triindexmax ; triindex++ )
+  {
+    v = &mesh->cleanindices[ 3 * (size_t)triindex ];
+    if( v[0] == -1 )
+      continue;
+    cleantri.v[0] = v[0];
+    cleantri.v[1] = v[1];
+    cleantri.v[2] = v[2];
+    mdSortIndices3( cleantri.v );
+    if( ( mmHashLockReadEntry( mesh->cleanhashtable, &mdCleanHashAccess, &cleantri ) == MM_HASH_SUCCESS ) && ( cleantri.triindex != triindex ) )
+    {
+      v[0] = -1;
+      tdata->statuscollisioncount++;
+      continue;
+    }
+    for( i = 0 ; i < 3 ; i++ )
+    {
+      vertex = &mesh->vertexlist[ v[i] ];
+#if MD_CONFIG_ATOMIC_SUPPORT
+      mmAtomicSpin32( &vertex->atomicowner, -1, tdata->threadid );
+      mesh->cleanreflist[ vertex->trirefbase + vertex->trirefcount++ ] = triindex;
+      mmAtomicWrite32( &vertex->atomicowner, -1 );
+#else
+      mtSpinLock( &vertex->ownerspinlock );
+      mesh->cleanreflist[ vertex->trirefbase + vertex->trirefcount++ ] = triindex;
+      mtSpinUnlock( &vertex->ownerspinlock );
+#endif
+    }
+  }
+
+  return;
+}
+
+/* Topology cleanup step 4, split the triangles around each vertex in fans connected by manifold edges, threaded */
+/* An edge shared by two triangles of inconsistent winding doesn't connect them, as for the edge hash it's two boundary edges */
+static void mdMeshCleanupFans( mdMesh *mesh, mdThreadData *tdata, int threadcount )
+{
+  int vertexindex, vertexindexmax, vertexperthread, slot;
+  mdi refindex, refcount, edgeindex, edgecount, neighborindex, root0, root1, labelcount, fanalloc, newalloc;
+  mdi *reflist, *labellist, *v, *parent, *rootlabel, *newparent, *newrootlabel;
+  mdVertex *vertex;
+  mdCleanFanEdge *fanedge, *newfanedge;
+
+  vertexperthread = ( mesh->cleanvertexcount / threadcount ) + 1;
+  vertexindex = tdata->threadid * vertexperthread;
+  vertexindexmax = vertexindex + vertexperthread;
+  if( vertexindexmax > mesh->cleanvertexcount )
+    vertexindexmax = mesh->cleanvertexcount;
+
+  fanalloc = 0;
+  fanedge = 0;
+  parent = 0;
+  rootlabel = 0;
+  vertex = &mesh->vertexlist[vertexindex];
+  for( ; vertexindex < vertexindexmax ; vertexindex++, vertex++ )
+  {
+    mesh->cleanclonebase[vertexindex] = 0;
+    refcount = vertex->trirefcount;
+    if( refcount < 2 )
+      continue;
+    reflist = &mesh->cleanreflist[ vertex->trirefbase ];
+    labellist = &mesh->cleanlabellist[ vertex->trirefbase ];
+    if( refcount > fanalloc )
+    {
+      newalloc = refcount + ( refcount >> 1 );
+      newfanedge = realloc( fanedge, 2 * newalloc * sizeof(mdCleanFanEdge) );
+      if( newfanedge )
+        fanedge = newfanedge;
+      newparent = realloc( parent, newalloc * sizeof(mdi) );
+      if( newparent )
+        parent = newparent;
+      newrootlabel = realloc( rootlabel, newalloc * sizeof(mdi) );
+      if( newrootlabel )
+        rootlabel = newrootlabel;
+      /* Out of memory, leave the vertex unsplit and have mdMeshCleanupClone() count it */
+      if( !( newfanedge ) || !( newparent ) || !( newrootlabel ) )
+      {
+        mesh->cleanclonebase[vertexindex] = -1;
+        continue;
+      }
+      fanalloc = newalloc;
+    }
+
+    /* Sort references by triangle index, labels are then independent of thread count */
+    qsort( reflist, refcount, sizeof(mdi), mdCleanCompareIndex );
+
+    /* Gather both edges of each triangle touching the vertex */
+    edgecount = 0;
+    for( refindex = 0 ; refindex < refcount ; refindex++ )
+    {
+      v = &mesh->cleanindices[ 3 * (size_t)reflist[refindex] ];
+      slot = ( v[0] == vertexindex ? 0 : ( v[1] == vertexindex ? 1 : 2 ) );
+      fanedge[edgecount].vertexindex = v[ slot < 2 ? slot + 1 : 0 ];
+      fanedge[edgecount].refindex = refindex;
+      fanedge[edgecount].outflag = 1;
+      edgecount++;
+      fanedge[edgecount].vertexindex = v[ slot > 0 ? slot - 1 : 2 ];
+      fanedge[edgecount].refindex = refindex;
+      fanedge[edgecount].outflag = 0;
+      edgecount++;
+      parent[refindex] = refindex;
+    }
+    qsort( fanedge, edgecount, sizeof(mdCleanFanEdge), mdCleanCompareFanEdge );
+
+    /* Triangles are connected through an edge used exactly once in each direction */
+    for( edgeindex = 0 ; edgeindex < edgecount ; )
+    {
+      if( ( edgeindex + 1 < edgecount ) && ( fanedge[edgeindex+1].vertexindex == fanedge[edgeindex].vertexindex ) && ( ( edgeindex + 2 >= edgecount ) || ( fanedge[edgeindex+2].vertexindex != fanedge[edgeindex].vertexindex ) ) )
+      {
+        if( fanedge[edgeindex].outflag != fanedge[edgeindex+1].outflag )
+        {
+          root0 = mdCleanFindRoot( parent, fanedge[edgeindex].refindex );
+          root1 = mdCleanFindRoot( parent, fanedge[edgeindex+1].refindex );
+          if( root0 < root1 )
+            parent[root1] = root0;
+          else
+            parent[root0] = root1;
+        }
+        edgeindex += 2;
+        continue;
+      }
+      /* Boundary edge or edge shared by more than two triangles, no connection */
+      neighborindex = fanedge[edgeindex].vertexindex;
+      for( ; ( edgeindex < edgecount ) && ( fanedge[edgeindex].vertexindex == neighborindex ) ; edgeindex++ );
+    }
+
+    /* Label fans in order of their lowest triangle, fan zero keeps the vertex */
+    labelcount = 0;
+    for( refindex = 0 ; refindex < refcount ; refindex++ )
+    {
+      root0 = mdCleanFindRoot( parent, refindex );
+      if( root0 == refindex )
+        rootlabel[refindex] = labelcount++;
+      labellist[refindex] = rootlabel[root0];
+    }
+
+    /* Locked vertices are never split */
+    if( ( mesh->lockmap ) && ( mdGetVertexLockFlag( mesh, vertexindex ) ) )
+      labelcount = 1;
+    mesh->cleanclonebase[vertexindex] = labelcount - 1;
+  }
+
+  free( fanedge );
+  free( parent );
+  free( rootlabel );
+
+  return;
+}
+
+/* Topology cleanup step 5, assign spare vertices as clones for extra fans, NOT threaded */
+static void mdMeshCleanupClone( mdMesh *mesh )
+{
+  mdi vertexindex, cloneindex, clonecount, clonebase;
+  mdVertex *vertex;
+
+  clonebase = mesh->vertexcount;
+  vertex = mesh->vertexlist;
+  for( vertexindex = 0 ; vertexindex < mesh->cleanvertexcount ; vertexindex++, vertex++ )
+  {
+    clonecount = mesh->cleanclonebase[vertexindex];
+    mesh->cleanclonebase[vertexindex] = -1;
+    if( !( clonecount ) )
+      continue;
+    /* Without memory for the fan analysis or enough spare vertices from op->vertexalloc, the vertex is left non-manifold */
+    if( ( clonecount < 0 ) || ( ( clonebase + clonecount ) > mesh->vertexalloc ) )
+    {
+      mesh->cleanunsplitcount++;
+      continue;
+    }
+    mesh->cleanclonebase[vertexindex] = clonebase;
+    for( cloneindex = clonebase ; cloneindex < clonebase + clonecount ; cloneindex++ )
+    {
+      mdVertexInit( &mesh->vertexlist[cloneindex], vertex->point );
+      mdAttribCopyVertex( mesh, cloneindex, vertexindex );
+      if( mesh->vertexcopy )
+        mesh->vertexcopy( mesh->copycontext, cloneindex, vertexindex );
+    }
+    clonebase += clonecount;
+  }
+
+#if MD_CONFIG_ATOMIC_SUPPORT
+  mmAtomicAddL( &mesh->trackvertexcount, clonebase - mesh->vertexcount );
+#else
+  mesh->trackvertexcount += clonebase - mesh->vertexcount;
+#endif
+  mesh->vertexcount = clonebase;
+
+  return;
+}
+
+/* Topology cleanup step 6, redirect extra fans to their vertex clones and reset reference counts, threaded */
+static void mdMeshCleanupRemap( mdMesh *mesh, mdThreadData *tdata, int threadcount )
+{
+  int vertexindex, vertexindexmax, vertexperthread, slot;
+  mdi refindex, label;
+  mdi *reflist, *labellist, *v;
+  mdVertex *vertex;
+
+  vertexperthread = ( mesh->cleanvertexcount / threadcount ) + 1;
+  vertexindex = tdata->threadid * vertexperthread;
+  vertexindexmax = vertexindex + vertexperthread;
+  if( vertexindexmax > mesh->cleanvertexcount )
+    vertexindexmax = mesh->cleanvertexcount;
+
+  vertex = &mesh->vertexlist[vertexindex];
+  for( ; vertexindex < vertexindexmax ; vertexindex++, vertex++ )
+  {
+    if( mesh->cleanclonebase[vertexindex] >= 0 )
+    {
+      reflist = &mesh->cleanreflist[ vertex->trirefbase ];
+      labellist = &mesh->cleanlabellist[ vertex->trirefbase ];
+      for( refindex = 0 ; refindex < vertex->trirefcount ; refindex++ )
+      {
+        label = labellist[refindex];
+        if( !( label ) )
+          continue;
+        /* Other slots of the triangle may be redirected concurrently, but never to this vertex */
+        v = &mesh->cleanindices[ 3 * (size_t)reflist[refindex] ];
+        slot = ( v[0] == vertexindex ? 0 : ( v[1] == vertexindex ? 1 : 2 ) );
+        v[slot] = mesh->cleanclonebase[vertexindex] + label - 1;
+      }
+    }
+    vertex->trirefcount = 0;
+  }
+
+  return;
+}
+
+
+/* Accumulate quadrics from boundaries or weighted edges as returned by user callback */
+static inline void mdMeshAccumBoundaryEdges( mdMesh *mesh, mdTriangle *tri, mdVertex **trivertex )
+{
+  int hashread[3];
+  mdf edgeweight, boundaryedgeexpand;
+  mdEdge edge[3];
+  mdTriangle *trilink;
+
+  boundaryedgeexpand = mesh->boundaryedgeexpand;
+
+  /* Read the three opposite edges as a batch, overlapping their cache misses */
+  edge[0].v[0] = tri->v[1];
+  edge[0].v[1] = tri->v[0];
+  edge[1].v[0] = tri->v[2];
+  edge[1].v[1] = tri->v[1];
+  edge[2].v[0] = tri->v[0];
+  edge[2].v[1] = tri->v[2];
+  mmHashLockReadEntries( mesh->edgehashtable, &mdEdgeHashAccess, edge, 3, hashread );
+
+  edgeweight = mesh->boundaryareafactor;
+  if( !( tri->u.edgeflags & MD_EDGEFLAGS_DENYEDGE01 ) && ( hashread[0] != MM_HASH_SUCCESS ) )
+  {
+#if DEBUG_VERBOSE_BOUNDARY
+    printf( "Boundary %d,%d (%d)\n", tri->v[1], tri->v[0], tri->v[2] );
+#endif
+    tri->u.edgeflags |= MD_EDGEFLAGS_BOUNDARY01;
+  }
+  else if( ( mesh->edgeweight ) && ( hashread[0] == MM_HASH_SUCCESS ) )
+  {
+    trilink = ADDRESS( mesh->trilist, edge[0].triindex * mesh->trisize );
+    edgeweight *= mesh->edgeweight( ADDRESS( tri, sizeof(mdTriangle) ), ADDRESS( trilink, sizeof(mdTriangle) ) );
+    if( edgeweight <= 0.0 )
+      goto skip01;
+#if DEBUG_VERBOSE_BOUNDARY
+    printf( "Edge weight %d,%d (%d) ; %f\n", tri->v[1], tri->v[0], tri->v[2], edgeweight );
+#endif
+  }
+  else
+    goto skip01;
+  mdMeshAccumulateBoundary( trivertex[0], trivertex[1], trivertex[2], edgeweight, boundaryedgeexpand );
+  skip01:
+
+  edgeweight = mesh->boundaryareafactor;
+  if( !( tri->u.edgeflags & MD_EDGEFLAGS_DENYEDGE12 ) && ( hashread[1] != MM_HASH_SUCCESS ) )
+  {
 #if DEBUG_VERBOSE_BOUNDARY
     printf( "Boundary %d,%d (%d)\n", tri->v[2], tri->v[1], tri->v[0] );
 #endif
     tri->u.edgeflags |= MD_EDGEFLAGS_BOUNDARY12;
   }
-  else if( ( mesh->edgeweight ) && ( hashread == MM_HASH_SUCCESS ) )
+  else if( ( mesh->edgeweight ) && ( hashread[1] == MM_HASH_SUCCESS ) )
   {
-    trilink = ADDRESS( mesh->trilist, edge.triindex * mesh->trisize );
+    trilink = ADDRESS( mesh->trilist, edge[1].triindex * mesh->trisize );
     edgeweight *= mesh->edgeweight( ADDRESS( tri, sizeof(mdTriangle) ), ADDRESS( trilink, sizeof(mdTriangle) ) );
     if( edgeweight <= 0.0 )
       goto skip12;
@@ -4606,20 +7575,17 @@ static inline void mdMeshAccumBoundaryEdges( mdMesh *mesh, mdTriangle *tri, mdVe
   mdMeshAccumulateBoundary( trivertex[1], trivertex[2], trivertex[0], edgeweight, boundaryedgeexpand );
   skip12:
 
-  edge.v[0] = tri->v[0];
-  edge.v[1] = tri->v[2];
-  hashread = mmHashLockReadEntry( mesh->edgehashtable, &mdEdgeHashAccess, &edge );
   edgeweight = mesh->boundaryareafactor;
-  if( !( tri->u.edgeflags & MD_EDGEFLAGS_DENYEDGE20 ) && ( hashread != MM_HASH_SUCCESS ) )
+  if( !( tri->u.edgeflags & MD_EDGEFLAGS_DENYEDGE20 ) && ( hashread[2] != MM_HASH_SUCCESS ) )
   {
 #if DEBUG_VERBOSE_BOUNDARY
     printf( "Boundary %d,%d (%d)\n", tri->v[0], tri->v[2], tri->v[1] );
 #endif
     tri->u.edgeflags |= MD_EDGEFLAGS_BOUNDARY20;
   }
-  else if( ( mesh->edgeweight ) && ( hashread == MM_HASH_SUCCESS ) )
+  else if( ( mesh->edgeweight ) && ( hashread[2] == MM_HASH_SUCCESS ) )
   {
-    trilink = ADDRESS( mesh->trilist, edge.triindex * mesh->trisize );
+    trilink = ADDRESS( mesh->trilist, edge[2].triindex * mesh->trisize );
     edgeweight *= mesh->edgeweight( ADDRESS( tri, sizeof(mdTriangle) ), ADDRESS( trilink, sizeof(mdTriangle) ) );
     if( edgeweight <= 0.0 )
       goto skip20;
@@ -4636,6 +7602,120 @@ static inline void mdMeshAccumBoundaryEdges( mdMesh *mesh, mdTriangle *tri, mdVe
 }
 
 
+static const int mdEdgeFlagsDeny[3] = { MD_EDGEFLAGS_DENYEDGE01, MD_EDGEFLAGS_DENYEDGE12, MD_EDGEFLAGS_DENYEDGE20 };
+static const int mdEdgeFlagsBoundary[3] = { MD_EDGEFLAGS_BOUNDARY01, MD_EDGEFLAGS_BOUNDARY12, MD_EDGEFLAGS_BOUNDARY20 };
+
+/* Deterministic mode, resolve denied and boundary edges of a triangle once all edges have been hashed */
+static inline void mdMeshResolveEdgeFlags( mdMesh *mesh, mdi triindex, mdTriangle *tri )
+{
+  int i0, i1, edgeflags;
+  mdEdge edge;
+
+  edgeflags = 0;
+  for( i0 = 0 ; i0 < 3 ; i0++ )
+  {
+    i1 = ( i0 < 2 ? i0 + 1 : 0 );
+    /* Deny the edge if it is shared by several triangles, in either direction */
+    edge.v[0] = tri->v[i0];
+    edge.v[1] = tri->v[i1];
+    if( ( mmHashLockReadEntry( mesh->edgehashtable, &mdEdgeHashAccess, &edge ) == MM_HASH_SUCCESS ) && ( ( edge.triindex != triindex ) || ( edge.op ) ) )
+      edgeflags |= mdEdgeFlagsDeny[i0];
+    edge.v[0] = tri->v[i1];
+    edge.v[1] = tri->v[i0];
+    if( mmHashLockReadEntry( mesh->edgehashtable, &mdEdgeHashAccess, &edge ) == MM_HASH_SUCCESS )
+    {
+      if( edge.op )
+        edgeflags |= mdEdgeFlagsDeny[i0];
+    }
+    else if( !( edgeflags & mdEdgeFlagsDeny[i0] ) )
+    {
+#if DEBUG_VERBOSE_BOUNDARY
+      printf( "Boundary %d,%d\n", tri->v[i1], tri->v[i0] );
+#endif
+      edgeflags |= mdEdgeFlagsBoundary[i0];
+    }
+  }
+  tri->u.edgeflags = edgeflags;
+
+  return;
+}
+
+/* Grid input, boundary edges of a triangle derived from the grid layout rather than edge hash lookups */
+static int mdGridBoundaryFlags( mdMesh *mesh, mdTriangle *tri )
+{
+  int edgeflags;
+  mdi x, y;
+  edgeflags = 0;
+  x = tri->v[0] % mesh->gridwidth;
+  y = tri->v[0] / mesh->gridwidth;
+  if( tri->v[1] == tri->v[0] + 1 )
+  {
+    /* Triangle (a,b,d), neighbors are below, on the right and the other half of the cell */
+    if( ( y == 0 ) || !( mdGridTriangleValid( mesh, x, y - 1, 1 ) ) )
+      edgeflags |= MD_EDGEFLAGS_BOUNDARY01;
+    if( ( x + 1 == mesh->gridwidth - 1 ) || !( mdGridTriangleValid( mesh, x + 1, y, 1 ) ) )
+      edgeflags |= MD_EDGEFLAGS_BOUNDARY12;
+    if( !( mdGridTriangleValid( mesh, x, y, 1 ) ) )
+      edgeflags |= MD_EDGEFLAGS_BOUNDARY20;
+  }
+  else
+  {
+    /* Triangle (a,d,c), neighbors are the other half of the cell, above and on the left */
+    if( !( mdGridTriangleValid( mesh, x, y, 0 ) ) )
+      edgeflags |= MD_EDGEFLAGS_BOUNDARY01;
+    if( ( y + 1 == mesh->gridheight - 1 ) || !( mdGridTriangleValid( mesh, x, y + 1, 0 ) ) )
+      edgeflags |= MD_EDGEFLAGS_BOUNDARY12;
+    if( ( x == 0 ) || !( mdGridTriangleValid( mesh, x - 1, y, 0 ) ) )
+      edgeflags |= MD_EDGEFLAGS_BOUNDARY20;
+  }
+  return edgeflags;
+}
+
+/* Grid input, flag boundary edges and accumulate their quadrics */
+static void mdGridAccumBoundaryEdges( mdMesh *mesh, mdTriangle *tri, mdVertex **trivertex )
+{
+  int edgeflags;
+  edgeflags = mdGridBoundaryFlags( mesh, tri );
+  tri->u.edgeflags |= edgeflags;
+  if( edgeflags & MD_EDGEFLAGS_BOUNDARY01 )
+    mdMeshAccumulateBoundary( trivertex[0], trivertex[1], trivertex[2], mesh->boundaryareafactor, mesh->boundaryedgeexpand );
+  if( edgeflags & MD_EDGEFLAGS_BOUNDARY12 )
+    mdMeshAccumulateBoundary( trivertex[1], trivertex[2], trivertex[0], mesh->boundaryareafactor, mesh->boundaryedgeexpand );
+  if( edgeflags & MD_EDGEFLAGS_BOUNDARY20 )
+    mdMeshAccumulateBoundary( trivertex[2], trivertex[0], trivertex[1], mesh->boundaryareafactor, mesh->boundaryedgeexpand );
+  return;
+}
+
+/* Deterministic mode, weight of the boundary quadric along an edge of a triangle, zero if none */
+static mdf mdMeshBoundaryEdgeWeight( mdMesh *mesh, mdTriangle *tri, int edgeindex )
+{
+  mdf edgeweight;
+  mdEdge edge;
+  mdTriangle *trilink;
+
+  if( tri->u.edgeflags & mdEdgeFlagsBoundary[edgeindex] )
+    return mesh->boundaryareafactor;
+  if( !( mesh->edgeweight ) )
+    return 0.0;
+  edge.v[0] = tri->v[ edgeindex < 2 ? edgeindex + 1 : 0 ];
+  edge.v[1] = tri->v[ edgeindex ];
+  if( mmHashLockReadEntry( mesh->edgehashtable, &mdEdgeHashAccess, &edge ) != MM_HASH_SUCCESS )
+    return 0.0;
+  trilink = ADDRESS( mesh->trilist, edge.triindex * mesh->trisize );
+  edgeweight = mesh->boundaryareafactor * mesh->edgeweight( ADDRESS( tri, sizeof(mdTriangle) ), ADDRESS( trilink, sizeof(mdTriangle) ) );
+  return ( edgeweight > 0.0 ? edgeweight : 0.0 );
+}
+
+static void mdMeshEdgeClearTagCallback( void *opaque, void *entry, int newflag )
+{
+  mdEdge *edge;
+  edge = entry;
+  if( edge->op == MD_EDGE_OP_DUPLICATE )
+    edge->op = 0;
+  return;
+}
+
+
 /* Mesh init step 4, store vertex trirefs and accumulate boundary quadrics, threaded */
 static void mdMeshBuildTrirefs( mdMesh *mesh, mdThreadData *tdata, int threadcount )
 {
@@ -4657,6 +7737,8 @@ static void mdMeshBuildTrirefs( mdMesh *mesh, mdThreadData *tdata, int threadcou
   trireflist = mesh->trireflist;
   for( ; triindex < triindexmax ; triindex++, tri = ADDRESS( tri, mesh->trisize ) )
   {
+    if( tri->v[0] == -1 )
+      continue;
     for( i = 0 ; i < 3 ; i++ )
     {
       vertex = &mesh->vertexlist[ tri->v[i] ];
@@ -4673,7 +7755,20 @@ static void mdMeshBuildTrirefs( mdMesh *mesh, mdThreadData *tdata, int threadcou
     }
 
     if( !( mesh->operationflags & MD_FLAGS_NO_DECIMATION ) )
-      mdMeshAccumBoundaryEdges( mesh, tri, trivertex );
+    {
+      /* Grid layout intact, boundary flags without edge hash lookups ; the edge hash is still built for collapses */
+      if( mesh->gridboundaryflag )
+      {
+        if( mesh->deterministicflag )
+          tri->u.edgeflags = mdGridBoundaryFlags( mesh, tri );
+        else
+          mdGridAccumBoundaryEdges( mesh, tri, trivertex );
+      }
+      else if( mesh->deterministicflag )
+        mdMeshResolveEdgeFlags( mesh, triindex, tri );
+      else
+        mdMeshAccumBoundaryEdges( mesh, tri, trivertex );
+    }
 
     buildrefcount++;
     tdata->statusbuildrefcount = buildrefcount;
@@ -4683,9 +7778,81 @@ static void mdMeshBuildTrirefs( mdMesh *mesh, mdThreadData *tdata, int threadcou
 }
 
 
+/* Mesh init step 5, deterministic mode only, sort vertex trirefs and accumulate quadrics in that fixed order, threaded */
+static void mdMeshBuildVertexQuadrics( mdMesh *mesh, mdThreadData *tdata, int threadcount )
+{
+  int i, pivot, next, prev, vertexindex, vertexindexmax, vertexperthread;
+  mdi index, triindex, trirefcount;
+  mdi *trireflist;
+  mdf edgeweight;
+  mdEdge edge;
+  mdTriangle *tri;
+  mdVertex *vertex, *trivertex[3];
+  mathQuadric q;
+
+  vertexperthread = ( mesh->vertexcount / threadcount ) + 1;
+  vertexindex = tdata->threadid * vertexperthread;
+  vertexindexmax = vertexindex + vertexperthread;
+  if( vertexindexmax > mesh->vertexcount )
+    vertexindexmax = mesh->vertexcount;
+
+  vertex = &mesh->vertexlist[vertexindex];
+  for( ; vertexindex < vertexindexmax ; vertexindex++, vertex++ )
+  {
+    /* Trirefs were stored in whatever order threads reached them, sort them by triangle index */
+    trireflist = &mesh->trireflist[ vertex->trirefbase ];
+    trirefcount = vertex->trirefcount;
+    for( index = 1 ; index < trirefcount ; index++ )
+    {
+      triindex = trireflist[index];
+      for( i = index ; ( i > 0 ) && ( trireflist[i-1] > triindex ) ; i-- )
+        trireflist[i] = trireflist[i-1];
+      trireflist[i] = triindex;
+    }
+    if( mesh->operationflags & MD_FLAGS_NO_DECIMATION )
+      continue;
+
+    for( index = 0 ; index < trirefcount ; index++ )
+    {
+      tri = ADDRESS( mesh->trilist, trireflist[index] * mesh->trisize );
+#if MD_CONF_LOCAL_VERTEX_ORIGINS
+      mdTriangleComputeLocalQuadric( mesh, tri, &q );
+#else
+      mdTriangleComputeQuadric( mesh, tri, &q );
+#endif
+      mathQuadricAddQuadric( &vertex->quadric, &q );
+
+      /* Boundary quadrics of the two edges of the triangle that touch the vertex */
+      pivot = ( tri->v[0] == vertexindex ? 0 : ( tri->v[1] == vertexindex ? 1 : 2 ) );
+      next = ( pivot < 2 ? pivot + 1 : 0 );
+      prev = ( pivot > 0 ? pivot - 1 : 2 );
+      for( i = 0 ; i < 3 ; i++ )
+        trivertex[i] = &mesh->vertexlist[ tri->v[i] ];
+      edgeweight = mdMeshBoundaryEdgeWeight( mesh, tri, pivot );
+      if( ( edgeweight > 0.0 ) && ( mdMeshComputeBoundaryQuadric( trivertex[pivot], trivertex[next], trivertex[prev], edgeweight, mesh->boundaryedgeexpand, &q ) ) )
+        mathQuadricAddQuadric( &vertex->quadric, &q );
+      edgeweight = mdMeshBoundaryEdgeWeight( mesh, tri, prev );
+      if( ( edgeweight > 0.0 ) && ( mdMeshComputeBoundaryQuadric( trivertex[prev], trivertex[pivot], trivertex[next], edgeweight, mesh->boundaryedgeexpand, &q ) ) )
+        mathQuadricAddQuadric( &vertex->quadric, &q );
+
+      /* Edges shared by several triangles were tagged in the hash table, clear the tag before ops are linked */
+      if( tri->u.edgeflags & mdEdgeFlagsDeny[pivot] )
+      {
+        edge.v[0] = tri->v[pivot];
+        edge.v[1] = tri->v[next];
+        mmHashLockCallEntry( mesh->edgehashtable, &mdEdgeHashAccess, &edge, mdMeshEdgeClearTagCallback, 0, 0 );
+      }
+    }
+  }
+
+  return;
+}
+
+
 /* Mesh clean up */
 static void mdMeshEnd( mdMesh *mesh )
 {
+  int threadindex;
 #ifndef MD_CONFIG_ATOMIC_SUPPORT
   mdi index;
   mdVertex *vertex;
@@ -4696,9 +7863,32 @@ static void mdMeshEnd( mdMesh *mesh )
   mtSpinDestroy( &mesh->globalvertexspinlock );
   mtSpinDestroy( &mesh->trackspinlock );
 #endif
-  mmAlignFree( mesh->vertexlist );
-  free( mesh->trireflist );
-  free( mesh->trilist );
+  if( mesh->vertexmmapsize )
+    mmMmapFree( mesh->vertexlist, mesh->vertexmmapsize );
+  else
+    mmAlignFree( mesh->vertexlist );
+  if( mesh->trireflistmmapsize )
+    mmMmapFree( mesh->trireflist, mesh->trireflistmmapsize );
+  else
+    free( mesh->trireflist );
+  if( mesh->trilistmmapsize )
+    mmMmapFree( mesh->trilist, mesh->trilistmmapsize );
+  else
+    free( mesh->trilist );
+  if( mesh->detlist )
+  {
+    for( threadindex = 0 ; threadindex < mesh->threadcount ; threadindex++ )
+      free( mesh->detlist[threadindex].oplist );
+    free( mesh->detlist );
+  }
+  free( mesh->detclaimlist );
+  free( mesh->detsortlist );
+  mdMeshWeldEnd( mesh );
+  mdMeshCleanupEnd( mesh );
+  mdMeshPartitionEnd( mesh );
+  mdMeshReorderEnd( mesh );
+  if( mesh->sharedqueue )
+    mmAlignFree( mesh->sharedqueue );
   return;
 }
 
@@ -4708,18 +7898,49 @@ static void mdMeshEnd( mdMesh *mesh )
 
 
 
-static void mdMeshGrowTriRefBuffer( mdMesh *mesh, size_t trirefavailneed )
+/* Make room for trirefavailneed more trirefs, caller must ensure no other thread is accessing trirefs */
+static void mdMeshResizeTriRefBuffer( mdMesh *mesh, mdThreadData *tdata, size_t trirefavailneed )
 {
   size_t trirefalloc;
-  mdBarrierLockGlobal( &mesh->workbarrier );
+  mdi *trireflist;
   trirefalloc = mesh->trireflistcount + trirefavailneed;
   if( trirefalloc > mesh->trireflistalloc )
   {
     trirefalloc += 4096;
+    /* Mapped huge pages can not be reallocated, move the trirefs to a regular allocation */
+    if( mesh->trireflistmmapsize )
+    {
+      trireflist = malloc( trirefalloc * sizeof(mdi) );
+      memcpy( trireflist, mesh->trireflist, mesh->trireflistalloc * sizeof(mdi) );
+      mmMmapFree( mesh->trireflist, mesh->trireflistmmapsize );
+      mesh->trireflistmmapsize = 0;
+      mesh->trireflist = trireflist;
+    }
+    else
+      mesh->trireflist = realloc( mesh->trireflist, trirefalloc * sizeof(mdi) );
     mesh->trireflistalloc = trirefalloc;
-    mesh->trireflist = realloc( mesh->trireflist, mesh->trireflistalloc * sizeof(mdi) );
+    MD_STATISTICS_ADD( tdata, trirefgrowcount, 1 );
+  }
+  return;
+}
+
+static void mdMeshGrowTriRefBuffer( mdMesh *mesh, mdThreadData *tdata, size_t trirefavailneed )
+{
+  uint64_t waittime, growtime;
+  waittime = 0;
+  if( mesh->timingflag )
+    waittime = mmGetMicrosecondsTime();
+  mdBarrierLockGlobal( &mesh->workbarrier );
+  growtime = 0;
+  if( mesh->timingflag )
+  {
+    mdThreadWaitDone( mesh, tdata, "Global Lock Wait", waittime );
+    growtime = mmGetMicrosecondsTime();
   }
+  mdMeshResizeTriRefBuffer( mesh, tdata, trirefavailneed );
   mdBarrierUnlockGlobal( &mesh->workbarrier );
+  if( mesh->tracerun )
+    mmTraceSpan( mesh->tracerun, tdata->threadid, "Triref Growth", "trirefs", (int64_t)mesh->trireflistalloc, growtime, mmGetMicrosecondsTime() );
   return;
 }
 
@@ -4764,45 +7985,50 @@ static void mdSortOp( mdMesh *mesh, mdThreadData *tdata, mdOp *op, int denyflag
   collapsecost = op->value + op->penalty;
   if( ( denyflag ) || ( collapsecost >= mesh->maxcollapseacceptcost ) )
   {
+    MD_STATISTICS_ADD( tdata, opdenycount, 1 );
 #if MD_CONFIG_ATOMIC_SUPPORT
     if( !( mmAtomicRead32( &op->flags ) & MD_OP_FLAGS_DETACHED ) )
     {
-      mmBinSortRemove( tdata->binsort, op, op->collapsecost );
+      mdThreadQueueRemove( tdata, op, op->collapsecost );
       mmAtomicOr32( &op->flags, MD_OP_FLAGS_DETACHED );
     }
 #else
     mtSpinLock( &op->spinlock );
     if( !( op->flags & MD_OP_FLAGS_DETACHED ) )
     {
-      mmBinSortRemove( tdata->binsort, op, op->collapsecost );
+      mdThreadQueueRemove( tdata, op, op->collapsecost );
       op->flags |= MD_OP_FLAGS_DETACHED;
     }
     mtSpinUnlock( &op->spinlock );
 #endif
+    /* Detached, the op is in no queue */
+    op->collapsecost = collapsecost;
   }
   else
   {
 #if MD_CONFIG_ATOMIC_SUPPORT
     if( mmAtomicRead32( &op->flags ) & MD_OP_FLAGS_DETACHED )
     {
-      mmBinSortAdd( tdata->binsort, op, collapsecost );
+      mdThreadQueueAdd( tdata, op, collapsecost );
       mmAtomicAnd32( &op->flags, ~MD_OP_FLAGS_DETACHED );
     }
     else if( op->collapsecost != collapsecost )
-      mmBinSortUpdate( tdata->binsort, op, op->collapsecost, collapsecost );
+      mdThreadQueueUpdate( tdata, op, op->collapsecost, collapsecost );
 #else
     mtSpinLock( &op->spinlock );
     if( op->flags & MD_OP_FLAGS_DETACHED )
     {
-      mmBinSortAdd( tdata->binsort, op, collapsecost );
+      mdThreadQueueAdd( tdata, op, collapsecost );
       op->flags &= ~MD_OP_FLAGS_DETACHED;
     }
     else if( op->collapsecost != collapsecost )
-      mmBinSortUpdate( tdata->binsort, op, op->collapsecost, collapsecost );
+      mdThreadQueueUpdate( tdata, op, op->collapsecost, collapsecost );
     mtSpinUnlock( &op->spinlock );
 #endif
+    /* Shared sub-queues already stored the cost under their lock */
+    if( !( tdata->sharedqueue ) )
+      op->collapsecost = collapsecost;
   }
-  op->collapsecost = collapsecost;
   return;
 }
 
@@ -4831,7 +8057,7 @@ static void mdUpdateOp( mdMesh *mesh, mdThreadData *tdata, mdOp *op, int32_t opf
   if( flags & MD_OP_FLAGS_DELETION_PENDING )
   {
     if( !( flags & MD_OP_FLAGS_DETACHED ) )
-      mmBinSortRemove( tdata->binsort, op, op->collapsecost );
+      mdThreadQueueRemove( tdata, op, op->collapsecost );
     /* Race condition, flag the op as deleted but don't free it ~ Free them all at the end with FreeAll(). */
     /*    mmBlockFree( &tdata->opblock, op );  */
 #if MD_CONFIG_ATOMIC_SUPPORT
@@ -4844,6 +8070,7 @@ static void mdUpdateOp( mdMesh *mesh, mdThreadData *tdata, mdOp *op, int32_t opf
   }
   else
   {
+    MD_STATISTICS_ADD( tdata, opupdatecount, 1 );
     if( op->value < MD_OP_FAIL_VALUE )
       op->penalty = mdEdgeCollapsePenalty( mesh, tdata, op->v0, op->v1, op->collapsepoint, &denyflag );
     else
@@ -4905,13 +8132,37 @@ static void mdUpdateBufferOps( mdMesh *mesh, mdThreadData *tdata, mdUpdateBuffer
 }
 
 
-static inline mdf mdfMeshProcessGetStepMaxCost( mdMesh *mesh, int stepindex )
+/* Count of ops processed between checks for cancellation and deadline, power of two */
+#define MD_STOP_CHECK_INTERVAL (64)
+
+/* Cancellation was requested or the deadline has passed, any thread can skip the rest of its step */
+static inline int mdMeshProcessStopPending( mdMesh *mesh )
 {
-  mdf stepf, maxcost;
-  stepf = (mdf)stepindex / (mdf)mesh->syncstepcount;
-  /* Spread out the steps based on x^2, very tight steps at first */
-  stepf *= stepf;
-  maxcost = mesh->maxcollapsecost * stepf;
+  return ( ( mesh->cancelflag ) || ( ( mesh->deadline ) && ( mmGetMillisecondsTime() >= mesh->deadline ) ) );
+}
+
+/* Called by thread zero only before a step barrier, flag decimation to stop at stepindex if cancelled or past the deadline */
+static void mdMeshProcessCheckStop( mdMesh *mesh, int stepindex )
+{
+  if( ( !( mesh->stopstep ) ) && ( mdMeshProcessStopPending( mesh ) ) )
+    mesh->stopstep = stepindex + 1;
+  return;
+}
+
+/* After the barrier, all threads agree on the step decimation stops at */
+static inline int mdMeshProcessStopped( mdMesh *mesh, int stepindex )
+{
+  return ( ( mesh->stopstep ) && ( stepindex + 1 >= mesh->stopstep ) );
+}
+
+
+static inline mdf mdfMeshProcessGetStepMaxCost( mdMesh *mesh, int stepindex )
+{
+  mdf stepf, maxcost;
+  stepf = (mdf)stepindex / (mdf)mesh->syncstepcount;
+  /* Spread out the steps based on x^2, very tight steps at first */
+  stepf *= stepf;
+  maxcost = mesh->maxcollapsecost * stepf;
   return maxcost;
 }
 
@@ -4920,9 +8171,11 @@ static inline mdf mdfMeshProcessGetStepMaxCost( mdMesh *mesh, int stepindex )
 static int mdMeshProcessQueue( mdMesh *mesh, mdThreadData *tdata )
 {
   int index, decimationcount, stepindex, growtriref;
+  unsigned int stopcheck;
   size_t trirefneed, trirefavail;
   long targetvertexcountmin, targetvertexcountmax, trackvertexcount;
   int32_t opflags;
+  uint64_t steptime;
   mdf maxcost;
   mdOp *op;
   mdLockBuffer lockbuffer;
@@ -4931,6 +8184,7 @@ static int mdMeshProcessQueue( mdMesh *mesh, mdThreadData *tdata )
 
   stepindex = 0;
   maxcost = 0.0;
+  steptime = ( mesh->tracerun ? mmGetMicrosecondsTime() : 0 );
 
 #if DEBUG_VERBOSE_WORK >= 2
   printf( "Thread %d work, begin decimation, maxcollapsecost %f\n", mesh->maxcollapsecost );
@@ -4939,6 +8193,7 @@ static int mdMeshProcessQueue( mdMesh *mesh, mdThreadData *tdata )
     printf( "Begin decimation, maxcollapsecost %f\n", mesh->maxcollapsecost );
 #endif
 
+  stopcheck = 0;
   decimationcount = 0;
   targetvertexcountmin = mesh->targetvertexcountmin;
   targetvertexcountmax = mesh->targetvertexcountmax;
@@ -4951,14 +8206,23 @@ static int mdMeshProcessQueue( mdMesh *mesh, mdThreadData *tdata )
         mdUpdateBufferOps( mesh, tdata, &tdata->updatebuffer[index], &lockbuffer );
     }
 
-    /* Acquire first op from thread's "queue" */
-    op = mmBinSortGetFirst( tdata->binsort, maxcost );
+    /* Acquire first op from thread's "queue", treat it as empty to reach the step barrier early on cancellation or past the deadline */
+    op = 0;
+    if( ( ++stopcheck & ( MD_STOP_CHECK_INTERVAL - 1 ) ) || !( mdMeshProcessStopPending( mesh ) ) )
+      op = mdThreadQueueGetFirst( tdata, maxcost );
     if( !op )
     {
+      if( mesh->tracerun )
+      {
+        mmTraceSpan( mesh->tracerun, tdata->threadid, "Decimation Step", "step", stepindex, steptime, mmGetMicrosecondsTime() );
+        steptime = 0;
+      }
       /* TODO: Consider stealing an op from another queue? Many threads become idle, waiting for the next step */
       if( targetvertexcountmax )
       {
-        mdBarrierSync( &mesh->workbarrier );
+        if( !( tdata->threadid ) )
+          mdMeshProcessCheckStop( mesh, stepindex + 1 );
+        mdThreadBarrierSync( mesh, tdata );
 #if MD_CONFIG_ATOMIC_SUPPORT
         trackvertexcount = mmAtomicReadL( &mesh->trackvertexcount );
 #else
@@ -4969,10 +8233,12 @@ static int mdMeshProcessQueue( mdMesh *mesh, mdThreadData *tdata )
           break;
         if( stepindex >= mesh->syncstepabort )
           break;
+        if( mdMeshProcessStopped( mesh, stepindex ) )
+          break;
 #if DEBUG_VERBOSE_WORK >= 2
         printf( "Thread %d work, wait to begin step %d\n", tdata->threadid, stepindex );
 #endif
-        mdBarrierSync( &mesh->workbarrier );
+        mdThreadBarrierSync( mesh, tdata );
       }
       else
       {
@@ -4981,15 +8247,24 @@ static int mdMeshProcessQueue( mdMesh *mesh, mdThreadData *tdata )
 #if DEBUG_VERBOSE_WORK >= 2
         printf( "Thread %d work, wait to begin step %d\n", tdata->threadid, stepindex );
 #endif
-        mdBarrierSync( &mesh->workbarrier );
+        if( !( tdata->threadid ) )
+          mdMeshProcessCheckStop( mesh, stepindex );
+        mdThreadBarrierSync( mesh, tdata );
+        if( mdMeshProcessStopped( mesh, stepindex ) )
+          break;
       }
       maxcost = mdfMeshProcessGetStepMaxCost( mesh, stepindex );
+      /* Past the range of the binsort queue, ops are taken in queue order ; the radix heap has no range, take all ops */
+      if( ( targetvertexcountmax ) && ( maxcost > MD_TARGET_MAX_COST_RANGE * mesh->maxcollapsecost ) )
+        maxcost = MD_OP_FAIL_VALUE;
 #if DEBUG_VERBOSE_WORK >= 2
       printf( "Thread %d work, begin step %d, maxcost %e\n", tdata->threadid, stepindex, maxcost );
 #elif DEBUG_VERBOSE_WORK > 0
       if( tdata->threadid == 0 )
         printf( "Decimation, begin step %d, maxcost %e\n", stepindex, maxcost );
 #endif
+      if( mesh->tracerun )
+        steptime = mmGetMicrosecondsTime();
       /* Update all ops flagged as requiring update */
       if( !( mesh->operationflags & MD_FLAGS_CONTINUOUS_UPDATE ) )
       {
@@ -5008,7 +8283,7 @@ static int mdMeshProcessQueue( mdMesh *mesh, mdThreadData *tdata )
 #endif
 
     /* Check if a thread requested a global lock */
-    mdBarrierCheckGlobal( &mesh->workbarrier );
+    mdThreadBarrierCheckGlobal( mesh, tdata );
 
     for( ; ; )
     {
@@ -5024,7 +8299,7 @@ static int mdMeshProcessQueue( mdMesh *mesh, mdThreadData *tdata )
       /* Release all locks for op */
       mdLockBufferUnlockAll( mesh, tdata, &lockbuffer );
       /* Grow triref buffer and try again */
-      mdMeshGrowTriRefBuffer( mesh, trirefneed * mesh->threadcount );
+      mdMeshGrowTriRefBuffer( mesh, tdata, trirefneed * mesh->threadcount );
     }
 
     /* If our op was flagged for update between mdUpdateBufferOps() and before we acquired lock, no big deal, catch the update */
@@ -5041,24 +8316,31 @@ static int mdMeshProcessQueue( mdMesh *mesh, mdThreadData *tdata )
       mdLockBufferUnlockAll( mesh, tdata, &lockbuffer );
       continue;
     }
+    /* With shared queues, another thread may have collapsed or detached the op before we acquired lock */
+    if( opflags & ( MD_OP_FLAGS_DELETED | MD_OP_FLAGS_DETACHED ) )
+    {
+      mdLockBufferUnlockAll( mesh, tdata, &lockbuffer );
+      continue;
+    }
 
     growtriref = 0;
 
     /* Prevent 2D collapses */
     if( !( mdEdgeCollisionCheck( mesh, tdata, op->v0, op->v1 ) ) )
     {
+      MD_STATISTICS_ADD( tdata, opcollisioncount, 1 );
 #if MD_CONFIG_ATOMIC_SUPPORT
       if( mmAtomicRead32( &op->flags ) & MD_OP_FLAGS_DETACHED )
         MD_ERROR( "SHOULD NOT HAPPEN %s:%d\n", 1, __FILE__, __LINE__ );
       mmAtomicOr32( &op->flags, MD_OP_FLAGS_DETACHED );
-      mmBinSortRemove( tdata->binsort, op, op->collapsecost );
+      mdThreadQueueRemove( tdata, op, op->collapsecost );
 #else
       mtSpinLock( &op->spinlock );
       if( op->flags & MD_OP_FLAGS_DETACHED )
         MD_ERROR( "SHOULD NOT HAPPEN %s:%d\n", 1, __FILE__, __LINE__ );
       op->flags |= MD_OP_FLAGS_DETACHED;
       mtSpinUnlock( &op->spinlock );
-      mmBinSortRemove( tdata->binsort, op, op->collapsecost );
+      mdThreadQueueRemove( tdata, op, op->collapsecost );
 #endif
       goto opdone;
     }
@@ -5098,6 +8380,7 @@ static int mdMeshProcessQueue( mdMesh *mesh, mdThreadData *tdata )
 
     /* Perform the edge collapse */
     mdEdgeCollapse( mesh, tdata, op->v0, op->v1, op->collapsepoint, &growtriref );
+    MD_STATISTICS_ADD( tdata, collapsecostsum, op->collapsecost / mesh->maxcollapsecost );
     decimationcount++;
 
     opdone:
@@ -5108,15 +8391,19 @@ static int mdMeshProcessQueue( mdMesh *mesh, mdThreadData *tdata )
     if( growtriref )
     {
       /* Check if a thread requested a global lock */
-      mdBarrierCheckGlobal( &mesh->workbarrier );
+      mdThreadBarrierCheckGlobal( mesh, tdata );
       /* Grow triref buffer if still required */
       if( mdMeshTriRefAvail( mesh ) < ( mesh->threadcount * MD_TRIREF_AVAIL_MIN_COUNT ) )
-        mdMeshGrowTriRefBuffer( mesh, mesh->threadcount * MD_TRIREF_AVAIL_MIN_COUNT );
+        mdMeshGrowTriRefBuffer( mesh, tdata, mesh->threadcount * MD_TRIREF_AVAIL_MIN_COUNT );
     }
   }
 
   mdLockBufferEnd( &lockbuffer );
 
+  /* Close the step we were in if we stopped early */
+  if( ( mesh->tracerun ) && ( steptime ) )
+    mmTraceSpan( mesh->tracerun, tdata->threadid, "Decimation Step", "step", stepindex, steptime, mmGetMicrosecondsTime() );
+
 #if DEBUG_VERBOSE_WORK >= 2
   printf( "Thread %d work, end decimation, %d collapses\n", tdata->threadid, decimationcount );
 #endif
@@ -5130,6 +8417,410 @@ static int mdMeshProcessQueue( mdMesh *mesh, mdThreadData *tdata )
 
 
 
+////
+
+
+
+/*
+Deterministic mode
+
+Within each sync step, decimation proceeds in rounds. All candidate ops of the step claim every vertex that
+mdOpResolveLockFull() would lock for them, the lowest op by a hash of its vertex indices keeps the claim. An op
+holding all its claims has no conflicting op ranking before it, the winners of a round have disjoint neighborhoods
+and can be collapsed in parallel in any order. Losers are returned to the queue for the next round. Ranking by cost
+instead would serialize long chains of neighboring ops over smooth regions, costs within a step are already close.
+Vertex targets are applied to the winners of a round sorted by cost.
+*/
+
+static inline int mdDetOpCompare( mdOp *op0, mdOp *op1 )
+{
+  if( op0->collapsecost != op1->collapsecost )
+    return ( op0->collapsecost < op1->collapsecost ? -1 : 1 );
+  if( op0->v0 != op1->v0 )
+    return ( op0->v0 < op1->v0 ? -1 : 1 );
+  if( op0->v1 != op1->v1 )
+    return ( op0->v1 < op1->v1 ? -1 : 1 );
+  return 0;
+}
+
+/* Rank of ops when claiming vertices, a hash of the edge spreads winners evenly over the mesh */
+static inline int mdDetOpClaimCompare( mdOp *op0, mdOp *op1 )
+{
+  uint32_t rank0, rank1;
+  rank0 = ( (uint32_t)op0->v0 * 0x9e3779b1 ) ^ ( (uint32_t)op0->v1 * 0x85ebca77 );
+  rank0 ^= rank0 >> 15;
+  rank0 *= 0xc2b2ae3d;
+  rank1 = ( (uint32_t)op1->v0 * 0x9e3779b1 ) ^ ( (uint32_t)op1->v1 * 0x85ebca77 );
+  rank1 ^= rank1 >> 15;
+  rank1 *= 0xc2b2ae3d;
+  if( rank0 != rank1 )
+    return ( rank0 < rank1 ? -1 : 1 );
+  if( op0->v0 != op1->v0 )
+    return ( op0->v0 < op1->v0 ? -1 : 1 );
+  if( op0->v1 != op1->v1 )
+    return ( op0->v1 < op1->v1 ? -1 : 1 );
+  return 0;
+}
+
+static int mdDetOpSortCallback( const void *p0, const void *p1 )
+{
+  return mdDetOpCompare( *(mdOp **)p0, *(mdOp **)p1 );
+}
+
+static void mdDetListAdd( mdDetList *detlist, mdOp *op )
+{
+  if( detlist->opcount >= detlist->opalloc )
+  {
+    detlist->opalloc = ( detlist->opalloc ? detlist->opalloc << 1 : 4096 );
+    detlist->oplist = realloc( detlist->oplist, detlist->opalloc * sizeof(mdOp *) );
+  }
+  detlist->oplist[ detlist->opcount++ ] = op;
+  return;
+}
+
+/* Follow redirects of collapsed vertices */
+static void mdDetOpResolve( mdMesh *mesh, mdOp *op )
+{
+  for( ; ; )
+  {
+    if( mesh->vertexlist[ op->v0 ].redirectindex != -1 )
+      op->v0 = mesh->vertexlist[ op->v0 ].redirectindex;
+    else if( mesh->vertexlist[ op->v1 ].redirectindex != -1 )
+      op->v1 = mesh->vertexlist[ op->v1 ].redirectindex;
+    else
+      break;
+  }
+  return;
+}
+
+static void mdDetClaimVertex( mdMesh *mesh, mdThreadData *tdata, mdi vertexindex, mdOp *op, uint32_t roundindex )
+{
+  mdVertex *vertex;
+  mdDetClaim *claim;
+
+  vertex = &mesh->vertexlist[ vertexindex ];
+  claim = &mesh->detclaimlist[ vertexindex ];
+#if MD_CONFIG_ATOMIC_SUPPORT
+  mmAtomicSpin32( &vertex->atomicowner, -1, tdata->threadid );
+#else
+  mtSpinLock( &vertex->ownerspinlock );
+#endif
+  if( ( claim->roundindex != roundindex ) || ( mdDetOpClaimCompare( op, claim->op ) < 0 ) )
+  {
+    claim->op = op;
+    claim->roundindex = roundindex;
+  }
+#if MD_CONFIG_ATOMIC_SUPPORT
+  mmAtomicWrite32( &vertex->atomicowner, -1 );
+#else
+  mtSpinUnlock( &vertex->ownerspinlock );
+#endif
+  return;
+}
+
+/* Claim the op's edge and all trirefs vertices ; with checkflag set, return 1 if the op holds all these claims */
+static int mdDetOpClaim( mdMesh *mesh, mdThreadData *tdata, mdOp *op, uint32_t roundindex, int checkflag )
+{
+  int side, i;
+  mdi vertexindex, index, trirefcount;
+  mdi *trireflist;
+  mdTriangle *tri;
+  mdVertex *vertex;
+
+  for( side = 0 ; side < 2 ; side++ )
+  {
+    vertexindex = ( side ? op->v1 : op->v0 );
+    if( !( checkflag ) )
+      mdDetClaimVertex( mesh, tdata, vertexindex, op, roundindex );
+    else if( mesh->detclaimlist[ vertexindex ].op != op )
+      return 0;
+    vertex = &mesh->vertexlist[ vertexindex ];
+    trireflist = &mesh->trireflist[ vertex->trirefbase ];
+    trirefcount = vertex->trirefcount;
+    for( index = 0 ; index < trirefcount ; index++ )
+    {
+      tri = ADDRESS( mesh->trilist, trireflist[index] * mesh->trisize );
+      if( tri->v[0] == -1 )
+        continue;
+      for( i = 0 ; i < 3 ; i++ )
+      {
+        if( tri->v[i] == vertexindex )
+          continue;
+        if( !( checkflag ) )
+          mdDetClaimVertex( mesh, tdata, tri->v[i], op, roundindex );
+        else if( mesh->detclaimlist[ tri->v[i] ].op != op )
+          return 0;
+      }
+    }
+  }
+
+  return 1;
+}
+
+/* Thread zero decides the outcome of the round while all other threads wait */
+static void mdDetRoundDecide( mdMesh *mesh, mdThreadData *tdata )
+{
+  int threadindex;
+  long index, opcount, wincount, trackvertexcount;
+  size_t trirefneed;
+  mdDetList *detlist;
+  mdOp *op;
+
+  opcount = 0;
+  wincount = 0;
+  trirefneed = 0;
+  for( threadindex = 0 ; threadindex < mesh->threadcount ; threadindex++ )
+  {
+    detlist = &mesh->detlist[threadindex];
+    opcount += detlist->opcount;
+    wincount += detlist->wincount;
+    trirefneed += detlist->trirefneed;
+  }
+  mesh->detdoneflag = ( opcount == 0 );
+  mesh->detlimitop = 0;
+  if( !( wincount ) )
+    return;
+
+  /* No other thread is touching trirefs, make room for all collapses of the round */
+  mdMeshResizeTriRefBuffer( mesh, tdata, trirefneed + ( mesh->threadcount * MD_TRIREF_AVAIL_MIN_COUNT ) );
+
+  /* If tracking vertex count, winners are accepted by increasing cost until a target is reached */
+  if( !( mesh->targetvertexcountmin | mesh->targetvertexcountmax ) )
+    return;
+  if( mesh->detsortalloc < wincount )
+  {
+    mesh->detsortalloc = wincount;
+    mesh->detsortlist = realloc( mesh->detsortlist, mesh->detsortalloc * sizeof(mdOp *) );
+  }
+  wincount = 0;
+  for( threadindex = 0 ; threadindex < mesh->threadcount ; threadindex++ )
+  {
+    detlist = &mesh->detlist[threadindex];
+    memcpy( &mesh->detsortlist[wincount], detlist->oplist, detlist->wincount * sizeof(mdOp *) );
+    wincount += detlist->wincount;
+  }
+  qsort( mesh->detsortlist, wincount, sizeof(mdOp *), mdDetOpSortCallback );
+#if MD_CONFIG_ATOMIC_SUPPORT
+  trackvertexcount = mmAtomicReadL( &mesh->trackvertexcount );
+#else
+  trackvertexcount = mesh->trackvertexcount;
+#endif
+  for( index = 0 ; index < wincount ; index++ )
+  {
+    op = mesh->detsortlist[index];
+    trackvertexcount--;
+    if( ( mesh->targetvertexcountmin ) && ( trackvertexcount <= mesh->targetvertexcountmin ) )
+      break;
+    if( ( mesh->targetvertexcountmax ) && ( trackvertexcount < mesh->targetvertexcountmax ) && ( op->collapsecost > mesh->maxcollapsecost ) )
+      break;
+  }
+  if( index < wincount )
+    mesh->detlimitop = mesh->detsortlist[index];
+
+  return;
+}
+
+
+/* Deterministic variant of mdMeshProcessQueue(), the same collapses are performed for any thread count */
+static int mdMeshProcessQueueDeterministic( mdMesh *mesh, mdThreadData *tdata )
+{
+  int index, decimationcount, stepindex, growtriref;
+  uint32_t roundindex;
+  long opcount, targetvertexcountmin, targetvertexcountmax, trackvertexcount;
+  int32_t opflags;
+  uint64_t steptime;
+  mdf maxcost;
+  mdOp *op;
+  mdDetList *detlist;
+  mdLockBuffer lockbuffer;
+
+  mdLockBufferInit( &lockbuffer, 2 );
+  detlist = &mesh->detlist[ tdata->threadid ];
+
+  stepindex = 0;
+  roundindex = 0;
+  maxcost = 0.0;
+  steptime = ( mesh->tracerun ? mmGetMicrosecondsTime() : 0 );
+
+  decimationcount = 0;
+  targetvertexcountmin = mesh->targetvertexcountmin;
+  targetvertexcountmax = mesh->targetvertexcountmax;
+  for( ; ; )
+  {
+    /* Update all ops flagged as requiring update */
+    if( !( mesh->operationflags & MD_FLAGS_CONTINUOUS_UPDATE ) )
+    {
+      for( index = 0 ; index < mesh->updatebuffercount ; index++ )
+        mdUpdateBufferOps( mesh, tdata, &tdata->updatebuffer[index], &lockbuffer );
+    }
+
+    /* Run rounds until no op is left below the step's maxcost */
+    for( ; ; )
+    {
+      roundindex++;
+
+      /* Update all ops flagged as requiring update, all collapses of the previous round are done */
+      if( mesh->operationflags & MD_FLAGS_CONTINUOUS_UPDATE )
+      {
+        for( index = 0 ; index < mesh->updatebuffercount ; index++ )
+          mdUpdateBufferOps( mesh, tdata, &tdata->updatebuffer[index], &lockbuffer );
+      }
+
+      /* Pull candidates from the thread's queue */
+      detlist->opcount = 0;
+      while( ( op = mdThreadQueueGetRemoveFirst( tdata, maxcost ) ) )
+        mdDetListAdd( detlist, op );
+      opcount = detlist->opcount;
+      detlist->opcount = 0;
+      for( index = 0 ; index < opcount ; index++ )
+      {
+        op = detlist->oplist[index];
+        mdDetOpResolve( mesh, op );
+#if MD_CONFIG_ATOMIC_SUPPORT
+        opflags = mmAtomicRead32( &op->flags );
+#else
+        mtSpinLock( &op->spinlock );
+        opflags = op->flags;
+        mtSpinUnlock( &op->spinlock );
+#endif
+        /* Binsort buckets are approximate, return ops above maxcost */
+        if( op->collapsecost > maxcost )
+          mdThreadQueueAdd( tdata, op, op->collapsecost );
+        /* If the op was flagged for update since the step began, catch the update and leave it for the next round */
+        else if( opflags & MD_OP_FLAGS_UPDATE_NEEDED )
+        {
+          mdThreadQueueAdd( tdata, op, op->collapsecost );
+          mdUpdateOp( mesh, tdata, op, ~MD_OP_FLAGS_UPDATE_NEEDED );
+        }
+        else
+          detlist->oplist[ detlist->opcount++ ] = op;
+      }
+      for( index = 0 ; index < detlist->opcount ; index++ )
+        mdDetOpClaim( mesh, tdata, detlist->oplist[index], roundindex, 0 );
+      mdThreadBarrierSync( mesh, tdata );
+
+      /* Move winners to the front of the list, drop ops failing the collision check */
+      detlist->wincount = 0;
+      detlist->trirefneed = 0;
+      for( index = 0 ; index < detlist->opcount ; )
+      {
+        op = detlist->oplist[index];
+        if( !( mdDetOpClaim( mesh, tdata, op, roundindex, 1 ) ) )
+        {
+          index++;
+          continue;
+        }
+        /* Prevent 2D collapses */
+        if( !( mdEdgeCollisionCheck( mesh, tdata, op->v0, op->v1 ) ) )
+        {
+          MD_STATISTICS_ADD( tdata, opcollisioncount, 1 );
+#if MD_CONFIG_ATOMIC_SUPPORT
+          mmAtomicOr32( &op->flags, MD_OP_FLAGS_DETACHED );
+#else
+          mtSpinLock( &op->spinlock );
+          op->flags |= MD_OP_FLAGS_DETACHED;
+          mtSpinUnlock( &op->spinlock );
+#endif
+          detlist->oplist[index] = detlist->oplist[ --detlist->opcount ];
+          continue;
+        }
+        detlist->oplist[index] = detlist->oplist[ detlist->wincount ];
+        detlist->oplist[ detlist->wincount++ ] = op;
+        detlist->trirefneed += mdMeshCountOpTriRefNeed( mesh, op );
+        index++;
+      }
+      mdThreadBarrierSync( mesh, tdata );
+
+      if( !( tdata->threadid ) )
+      {
+        mdDetRoundDecide( mesh, tdata );
+        /* On cancellation or past the deadline, end the step now and drop this round's candidates */
+        mdMeshProcessCheckStop( mesh, stepindex + 1 );
+        if( mesh->stopstep )
+          mesh->detdoneflag = 1;
+      }
+      mdThreadBarrierSync( mesh, tdata );
+      if( mesh->detdoneflag )
+        break;
+
+      /* Perform the edge collapses, all neighborhoods are disjoint */
+      for( index = 0 ; index < detlist->wincount ; index++ )
+      {
+        op = detlist->oplist[index];
+        if( ( mesh->detlimitop ) && ( mdDetOpCompare( op, mesh->detlimitop ) >= 0 ) )
+          continue;
+        if( ( targetvertexcountmin | targetvertexcountmax ) )
+        {
+#if MD_CONFIG_ATOMIC_SUPPORT
+          mmAtomicAddL( &mesh->trackvertexcount, -1 );
+#else
+          mtSpinLock( &mesh->trackspinlock );
+          mesh->trackvertexcount--;
+          mtSpinUnlock( &mesh->trackspinlock );
+#endif
+        }
+        /* Room for trirefs was made by mdDetRoundDecide(), ignore growtriref */
+        growtriref = 0;
+        mdEdgeCollapse( mesh, tdata, op->v0, op->v1, op->collapsepoint, &growtriref );
+        MD_STATISTICS_ADD( tdata, collapsecostsum, op->collapsecost / mesh->maxcollapsecost );
+        decimationcount++;
+      }
+
+      /* A vertex count target was reached */
+      if( mesh->detlimitop )
+        goto end;
+
+      /* Return all candidates to the queue, ops of collapsed edges are already pending deletion */
+      for( index = 0 ; index < detlist->opcount ; index++ )
+      {
+        op = detlist->oplist[index];
+        mdThreadQueueAdd( tdata, op, op->collapsecost );
+      }
+      mdThreadBarrierSync( mesh, tdata );
+    }
+
+    if( mesh->tracerun )
+    {
+      mmTraceSpan( mesh->tracerun, tdata->threadid, "Decimation Step", "step", stepindex, steptime, mmGetMicrosecondsTime() );
+      steptime = 0;
+    }
+    if( targetvertexcountmax )
+    {
+#if MD_CONFIG_ATOMIC_SUPPORT
+      trackvertexcount = mmAtomicReadL( &mesh->trackvertexcount );
+#else
+      trackvertexcount = mesh->trackvertexcount;
+#endif
+      stepindex++;
+      if( ( stepindex > mesh->syncstepcount ) && ( trackvertexcount < targetvertexcountmax ) )
+        break;
+      if( stepindex >= mesh->syncstepabort )
+        break;
+    }
+    else if( ++stepindex > mesh->syncstepcount )
+      break;
+    if( mdMeshProcessStopped( mesh, stepindex ) )
+      break;
+    maxcost = mdfMeshProcessGetStepMaxCost( mesh, stepindex );
+    /* Past the range of the queue, mdMeshProcessQueue() takes all ops in queue order ; take all ops as candidates */
+    if( ( targetvertexcountmax ) && ( maxcost > MD_TARGET_MAX_COST_RANGE * mesh->maxcollapsecost ) )
+      maxcost = MD_OP_FAIL_VALUE;
+    if( mesh->tracerun )
+      steptime = mmGetMicrosecondsTime();
+  }
+
+  end:
+  mdLockBufferEnd( &lockbuffer );
+
+  /* Close the step we were in if we stopped early */
+  if( ( mesh->tracerun ) && ( steptime ) )
+    mmTraceSpan( mesh->tracerun, tdata->threadid, "Decimation Step", "step", stepindex, steptime, mmGetMicrosecondsTime() );
+
+  return decimationcount;
+}
+
+
+
 //////
 
 
@@ -5300,8 +8991,9 @@ static mdi mdMeshCloneVertex( mdMesh *mesh, mdi cloneindex, mdf *point )
     /* Copy the point from the cloned vertex */
     MD_VectorCopy( vertex->point, point );
     /* Copy custom vertex attributes, if any */
+    mdAttribCopyVertex( mesh, mdVertexUserIndex( mesh, vertexindex ), mdVertexUserIndex( mesh, cloneindex ) );
     if( mesh->vertexcopy )
-      mesh->vertexcopy( mesh->copycontext, vertexindex, cloneindex );
+      mesh->vertexcopy( mesh->copycontext, mdVertexUserIndex( mesh, vertexindex ), mdVertexUserIndex( mesh, cloneindex ) );
     retindex = vertexindex;
     if( vertexindex >= mesh->vertexcount )
       mesh->vertexcount = vertexindex+1;
@@ -5480,19 +9172,27 @@ static int mdMeshVertexCheckUse( mdMesh *mesh, mdi *trireflist, int trirefcount
 
 static void mdMeshWriteVertices( mdMesh *mesh )
 {
-  mdi vertexindex, writeindex;
+  mdi userindex, vertexindex, writeindex, runsrc, rundst, runcount;
+  size_t blockcount;
   mdf factor;
-  mdf *point;
+  void *point;
   mdi *trireflist;
   mdVertex *vertex;
+  mdf nativepoint[3*MD_CONVERT_BLOCK_SIZE];
 
   factor = 1.0 / mesh->normalizationfactor;
   point = mesh->point;
   writeindex = 0;
-  vertex = mesh->vertexlist;
+  blockcount = 0;
+  runsrc = 0;
+  rundst = 0;
+  runcount = 0;
   trireflist = mesh->trireflist;
-  for( vertexindex = 0 ; vertexindex < mesh->vertexcount ; vertexindex++, vertex++ )
+  /* Vertices are written in the user's order, with spatial reordering internal indices differ */
+  for( userindex = 0 ; userindex < mesh->vertexcount ; userindex++ )
   {
+    vertexindex = mdVertexInternalIndex( mesh, userindex );
+    vertex = &mesh->vertexlist[ vertexindex ];
     if( !( mesh->operationflags & MD_FLAGS_NO_VERTEX_PACKING ) )
     {
       if( vertex->redirectindex != -1 )
@@ -5503,12 +9203,28 @@ static void mdMeshWriteVertices( mdMesh *mesh )
         continue;
     }
     vertex->redirectindex = writeindex;
-    mesh->vertexNativeToUser( point, vertex->point, factor );
-    if( ( mesh->vertexcopy ) && ( writeindex != vertexindex  ) )
-      mesh->vertexcopy( mesh->copycontext, writeindex, vertexindex );
-    point = ADDRESS( point, mesh->pointstride );
+    MD_VectorCopy( &nativepoint[3*blockcount], vertex->point );
+    if( ++blockcount == MD_CONVERT_BLOCK_SIZE )
+    {
+      mdVertexBlockNativeToUser( point, mesh->pointstride, nativepoint, blockcount, factor, mesh->vertexformat, mesh->vertexNativeToUser );
+      point = ADDRESS( point, blockcount * mesh->pointstride );
+      blockcount = 0;
+    }
+    if( ( mesh->vertexcopy ) && ( writeindex != userindex  ) )
+      mesh->vertexcopy( mesh->copycontext, writeindex, userindex );
+    /* Attribute streams are moved by runs of consecutive vertices */
+    if( userindex != runsrc + runcount )
+    {
+      mdAttribMoveRun( mesh, rundst, runsrc, runcount );
+      runsrc = userindex;
+      rundst = writeindex;
+      runcount = 0;
+    }
+    runcount++;
     writeindex++;
   }
+  mdAttribMoveRun( mesh, rundst, runsrc, runcount );
+  mdVertexBlockNativeToUser( point, mesh->pointstride, nativepoint, blockcount, factor, mesh->vertexformat, mesh->vertexNativeToUser );
   mesh->vertexpackcount = writeindex;
   if( mesh->operationflags & MD_FLAGS_NO_VERTEX_PACKING )
     mesh->vertexpackcount = mesh->vertexcount;
@@ -5521,23 +9237,28 @@ static void mdMeshWriteVertices( mdMesh *mesh )
 
 static void mdMeshWriteIndices( mdMesh *mesh )
 {
-  mdi finaltricount, v[3];
-  mdTriangle *tri, *triend;
+  size_t blockcount;
+  mdi usertriindex, finaltricount;
+  mdi *v;
+  mdTriangle *tri;
   mdVertex *vertex0, *vertex1, *vertex2;
   void *indices, *tridata;
+  mdi nativeindices[3*MD_CONVERT_BLOCK_SIZE];
 
   indices = mesh->indices;
+  blockcount = 0;
   finaltricount = 0;
-  tri = mesh->trilist;
-  triend = ADDRESS( tri, mesh->tricount * mesh->trisize );
   tridata = mesh->tridata;
 #if DEBUG_VERBOSE_OUTPUT
   printf( "Final triangle list\n" );
 #endif
-  for( ; tri < triend ; tri = ADDRESS( tri, mesh->trisize ) )
+  /* Triangles are written in the user's order, with spatial reordering internal indices differ */
+  for( usertriindex = 0 ; usertriindex < mesh->tricount ; usertriindex++ )
   {
+    tri = ADDRESS( mesh->trilist, mdTriangleInternalIndex( mesh, usertriindex ) * mesh->trisize );
     if( tri->v[0] == -1 )
       continue;
+    v = &nativeindices[3*blockcount];
     vertex0 = &mesh->vertexlist[ tri->v[0] ];
     v[0] = vertex0->redirectindex;
     vertex1 = &mesh->vertexlist[ tri->v[1] ];
@@ -5554,15 +9275,20 @@ static void mdMeshWriteIndices( mdMesh *mesh )
       printf( "    ERROR: Out of range vertex in triangle %d ; %d,%d,%d >= %d\n", (int)finaltricount, (int)v[0], (int)v[1], (int)v[2], (int)mesh->vertexpackcount );
 #endif
 
-    mesh->indicesNativeToUser( indices, v );
+    if( ++blockcount == MD_CONVERT_BLOCK_SIZE )
+    {
+      mdIndicesBlockNativeToUser( indices, mesh->indicesstride, nativeindices, blockcount, mesh->indicesformat, mesh->indicesNativeToUser );
+      indices = ADDRESS( indices, blockcount * mesh->indicesstride );
+      blockcount = 0;
+    }
     if( mesh->tridatasize )
     {
       memcpy( tridata, ADDRESS(tri,sizeof(mdTriangle)), mesh->tridatasize );
       tridata = ADDRESS( tridata, mesh->tridatasize );
     }
-    indices = ADDRESS( indices, mesh->indicesstride );
     finaltricount++;
   }
+  mdIndicesBlockNativeToUser( indices, mesh->indicesstride, nativeindices, blockcount, mesh->indicesformat, mesh->indicesNativeToUser );
 #if DEBUG_VERBOSE_OUTPUT
   printf( "Final triangle count: %d\n", (int)finaltricount );
 #endif
@@ -5575,21 +9301,23 @@ static void mdMeshWriteIndices( mdMesh *mesh )
 /* Write vertices and indices, recompute normals, store them along with vertices and indices at once */
 static void mdMeshWriteVerticesAndNormals( mdMesh *mesh )
 {
-  mdi vertexindex, writeindex;
+  mdi userindex, vertexindex, writeindex, runsrc, rundst, runcount;
+  size_t blockcount;
   mdf factor;
-  mdf *point, *normal;
+  mdf *normal;
   mdVertex *vertex;
   mdi *trireflist;
-  void (*writenormal)( void *dst, mdf *src );
-  void *normaldst;
+  void *point, *normaldst;
+  mdf nativepoint[3*MD_CONVERT_BLOCK_SIZE];
+  mdf nativenormal[3*MD_CONVERT_BLOCK_SIZE];
 
   /* Start search for free vertices to clone at 0 */
   mesh->clonesearchindex = 0;
-  mesh->trinormal = malloc( mesh->tripackcount * sizeof(mdTriNormal) );
-  mesh->vertexnormal = malloc( mesh->vertexalloc * 3 * sizeof(normal) );
+  mesh->vertexnormal = malloc( mesh->vertexalloc * 3 * sizeof(mdf) );
 
   /* Count triangles and assign redirectindex to each in sequence */
   mdMeshPackCountTriangles( mesh );
+  mesh->trinormal = malloc( mesh->tripackcount * sizeof(mdTriNormal) );
 
   /* Build up mesh->trinormal, store normals, area and vertex angles of each triangle */
   mdMeshBuildTriangleNormals( mesh );
@@ -5608,12 +9336,17 @@ static void mdMeshWriteVerticesAndNormals( mdMesh *mesh )
 
   /* Write vertices along with normals and other attributes */
   factor = 1.0 / mesh->normalizationfactor;
-  writenormal = mesh->writenormal;
   point = mesh->point;
+  normaldst = mesh->normalbase;
   writeindex = 0;
-  vertex = mesh->vertexlist;
-  for( vertexindex = 0 ; vertexindex < mesh->vertexcount ; vertexindex++, vertex++ )
-  {
+  blockcount = 0;
+  runsrc = 0;
+  rundst = 0;
+  runcount = 0;
+  for( userindex = 0 ; userindex < mesh->vertexcount ; userindex++ )
+  {
+    vertexindex = mdVertexInternalIndex( mesh, userindex );
+    vertex = &mesh->vertexlist[ vertexindex ];
     if( !( mesh->operationflags & MD_FLAGS_NO_VERTEX_PACKING ) )
     {
       if( vertex->redirectindex != -1 )
@@ -5622,15 +9355,33 @@ static void mdMeshWriteVerticesAndNormals( mdMesh *mesh )
         continue;
     }
     vertex->redirectindex = writeindex;
-    mesh->vertexNativeToUser( point, vertex->point, factor );
     normal = ADDRESS( mesh->vertexnormal, vertexindex * 3 * sizeof(mdf) );
-    normaldst = ADDRESS( mesh->normalbase, writeindex * mesh->normalstride );
-    writenormal( normaldst, normal );
-    if( ( mesh->vertexcopy ) && ( writeindex != vertexindex  ) )
-      mesh->vertexcopy( mesh->copycontext, writeindex, vertexindex );
-    point = ADDRESS( point, mesh->pointstride );
+    MD_VectorCopy( &nativepoint[3*blockcount], vertex->point );
+    MD_VectorCopy( &nativenormal[3*blockcount], normal );
+    if( ++blockcount == MD_CONVERT_BLOCK_SIZE )
+    {
+      mdVertexBlockNativeToUser( point, mesh->pointstride, nativepoint, blockcount, factor, mesh->vertexformat, mesh->vertexNativeToUser );
+      mdNormalBlockNativeToUser( normaldst, mesh->normalstride, nativenormal, blockcount, mesh->normalformat, mesh->writenormal );
+      point = ADDRESS( point, blockcount * mesh->pointstride );
+      normaldst = ADDRESS( normaldst, blockcount * mesh->normalstride );
+      blockcount = 0;
+    }
+    if( ( mesh->vertexcopy ) && ( writeindex != userindex  ) )
+      mesh->vertexcopy( mesh->copycontext, writeindex, userindex );
+    /* Attribute streams are moved by runs of consecutive vertices */
+    if( userindex != runsrc + runcount )
+    {
+      mdAttribMoveRun( mesh, rundst, runsrc, runcount );
+      runsrc = userindex;
+      rundst = writeindex;
+      runcount = 0;
+    }
+    runcount++;
     writeindex++;
   }
+  mdAttribMoveRun( mesh, rundst, runsrc, runcount );
+  mdVertexBlockNativeToUser( point, mesh->pointstride, nativepoint, blockcount, factor, mesh->vertexformat, mesh->vertexNativeToUser );
+  mdNormalBlockNativeToUser( normaldst, mesh->normalstride, nativenormal, blockcount, mesh->normalformat, mesh->writenormal );
 
   mesh->vertexpackcount = writeindex;
   if( mesh->operationflags & MD_FLAGS_NO_VERTEX_PACKING )
@@ -5659,6 +9410,9 @@ typedef struct
   long decimationcount;
   mdThreadData *tdata;
   int stage;
+#if MD_CONF_ENABLE_STATISTICS
+  mdThreadStatistics stats;
+#endif
 } mdThreadInit;
 
 #ifndef MD_CONFIG_ATOMIC_SUPPORT
@@ -5672,27 +9426,102 @@ int mdFreeOpCallback( void *chunk, void *userpointer )
 #endif
 
 
-static void *mdThreadMain( void *value )
+/* The radix heap is keyed on the integer form of costs, it needs no range */
+static void mdQueueInit( mdMesh *mesh, mdQueue *queue, int groupthreshold, int nodeindex )
 {
-  int index, tribase, trimax, triperthread, nodeindex;
-  int groupthreshold;
-  mdThreadInit *tinit;
-  mdThreadData tdata;
-  mdMesh *mesh;
+  int rootbucketcount;
+  double maxcostrange;
 
-  tinit = value;
-  mesh = tinit->mesh;
-  tinit->tdata = &tdata;
+  queue->binsort = 0;
+  queue->radixheap = 0;
+  if( mesh->operationflags & MD_FLAGS_RADIX_HEAP )
+    queue->radixheap = mmRadixHeapInit( offsetof(mdOp,list), mdMeshOpValueCallback, nodeindex );
+  else if( !mesh->targetvertexcountmax )
+    queue->binsort = mmBinSortInit( offsetof(mdOp,list), 64, 32, -0.2 * mesh->maxcollapsecost, 1.2 * mesh->maxcollapsecost, groupthreshold, mdMeshOpValueCallback, 6, nodeindex );
+  else
+  {
+    rootbucketcount = 4096;
+    maxcostrange = MD_TARGET_MAX_COST_RANGE * mesh->maxcollapsecost;
+    queue->binsort = mmBinSortInit( offsetof(mdOp,list), rootbucketcount, 16, -0.2 * mesh->maxcollapsecost, maxcostrange, groupthreshold, mdMeshOpValueCallback, 6, nodeindex );
+  }
 
-  /* Thread memory initialization */
-  memset( &tdata, 0, sizeof(mdThreadData) );
-  tdata.threadid = tinit->threadid;
-  tdata.statusbuildtricount = 0;
-  tdata.statusbuildrefcount = 0;
-  tdata.statuspopulatecount = 0;
-  tdata.statusdeletioncount = 0;
-  tdata.statuscollisioncount = 0;
-  groupthreshold = mesh->tricount >> 10;
+  return;
+}
+
+static void mdQueueEnd( mdQueue *queue )
+{
+  if( queue->radixheap )
+    mmRadixHeapFree( queue->radixheap );
+  else
+    mmBinSortFree( queue->binsort );
+  return;
+}
+
+static void mdSharedQueueInit( mdMesh *mesh, mdSharedQueue *sharedqueue, int groupthreshold, int nodeindex )
+{
+  mdQueueInit( mesh, &sharedqueue->queue, groupthreshold, nodeindex );
+#if MD_CONFIG_ATOMIC_SUPPORT
+  mmAtomicWrite32( &sharedqueue->atomlock, 0x0 );
+#else
+  mtSpinInit( &sharedqueue->spinlock );
+#endif
+  return;
+}
+
+static void mdSharedQueueEnd( mdSharedQueue *sharedqueue )
+{
+  mdQueueEnd( &sharedqueue->queue );
+#if !MD_CONFIG_ATOMIC_SUPPORT
+  mtSpinDestroy( &sharedqueue->spinlock );
+#endif
+  return;
+}
+
+
+/* First touch of the shared arrays not initialized by a threaded step, each thread clears its share so that the pages land on its NUMA node */
+/* Must complete on all threads before the next barrier, nothing reads the edge hash or writes trirefs before that */
+static void mdMeshNumaFirstTouch( mdMesh *mesh, mdThreadData *tdata )
+{
+  size_t trirefperthread, trirefbase, trirefmax;
+
+  if( mesh->edgehashtable )
+    mmHashClearPart( mesh->edgehashtable, &mdEdgeHashAccess, tdata->threadid, mesh->threadcount );
+
+  /* References of each vertex range are stored in the same order, roughly matching the vertices initialized by the thread */
+  trirefperthread = ( mesh->trireflistalloc / mesh->threadcount ) + 1;
+  trirefbase = (size_t)tdata->threadid * trirefperthread;
+  trirefmax = trirefbase + trirefperthread;
+  if( trirefmax > mesh->trireflistalloc )
+    trirefmax = mesh->trireflistalloc;
+  if( trirefbase < trirefmax )
+    memset( &mesh->trireflist[ trirefbase ], 0, ( trirefmax - trirefbase ) * sizeof(mdi) );
+
+  return;
+}
+
+
+static void *mdThreadMain( void *value )
+{
+  int index, tribase, trimax, triperthread, nodeindex, cpuindex;
+  int groupthreshold;
+  mdThreadInit *tinit;
+  mdThreadData tdata;
+  mdMesh *mesh;
+
+  tinit = value;
+  mesh = tinit->mesh;
+  tinit->tdata = &tdata;
+
+  /* Thread memory initialization */
+  memset( &tdata, 0, sizeof(mdThreadData) );
+  tdata.threadid = tinit->threadid;
+  tdata.statusbuildtricount = 0;
+  tdata.statusbuildrefcount = 0;
+  tdata.statuspopulatecount = 0;
+  tdata.statusdeletioncount = 0;
+  tdata.statuscollisioncount = 0;
+  mdThreadBeginStage( mesh, &tdata, MD_STATUS_STAGE_INIT );
+  groupthreshold = mesh->tricount >> 10;
   if( groupthreshold < 256 )
     groupthreshold = 256;
   else if( groupthreshold > 4096 )
@@ -5701,61 +9530,134 @@ static void *mdThreadMain( void *value )
   nodeindex = -1;
   if( ( mmcore.numa.capable ) && !( mesh->operationflags & MD_FLAGS_DISABLE_NUMA ) )
   {
-    mmBindThreadToCpu( tdata.threadid );
-    nodeindex = mmGetNodeForCpu( tdata.threadid );
+    /* Thread indices map onto the CPUs allowed to the process, not onto all CPUs of the system */
+    cpuindex = mmGetCpuForThread( tdata.threadid );
+    mmBindThreadToCpu( cpuindex );
+    nodeindex = mmGetNodeForCpu( cpuindex );
     mmBlockNumaInit( &tdata.opblock, nodeindex, sizeof(mdOp), 16384, 16384, MD_CONF_OP_ALIGNMENT );
   }
   else
     mmBlockInit( &tdata.opblock, sizeof(mdOp), 16384, 16384, MD_CONF_OP_ALIGNMENT );
+  mmBlockCacheInit( &tdata.opcache, &tdata.opblock );
+  if( mesh->numafirsttouchflag )
+    mdMeshNumaFirstTouch( mesh, &tdata );
 
-  if( !mesh->targetvertexcountmax )
-    tdata.binsort = mmBinSortInit( offsetof(mdOp,list), 64, 32, -0.2 * mesh->maxcollapsecost, 1.2 * mesh->maxcollapsecost, groupthreshold, mdMeshOpValueCallback, 6, nodeindex );
-  else
+  /* Each thread initializes its own sub-queues of the shared queue, on its own NUMA node */
+  if( mesh->sharedqueue )
   {
-    int rootbucketcount;
-    double maxcostrange;
-    rootbucketcount = 4096;
-    maxcostrange = 64.0 * mesh->maxcollapsecost;
-    tdata.binsort = mmBinSortInit( offsetof(mdOp,list), rootbucketcount, 16, -0.2 * mesh->maxcollapsecost, maxcostrange, groupthreshold, mdMeshOpValueCallback, 6, nodeindex );
+    tdata.sharedqueue = mesh->sharedqueue;
+    tdata.sharedqueuecount = mesh->sharedqueuecount;
+    tdata.sharedqueuerand = 0x9e3779b9 ^ ( (uint32_t)( tdata.threadid + 1 ) * 0x85ebca6b );
+    for( index = tdata.threadid * MD_MULTIQUEUE_FACTOR ; index < ( tdata.threadid + 1 ) * MD_MULTIQUEUE_FACTOR ; index++ )
+      mdSharedQueueInit( mesh, &mesh->sharedqueue[index], groupthreshold, nodeindex );
   }
+  else
+    mdQueueInit( mesh, &tdata.queue, groupthreshold, nodeindex );
 
   for( index = 0 ; index < mesh->updatebuffercount ; index++ )
     mdUpdateBufferInit( &tdata.updatebuffer[index], 4096 );
 
   /* Wait until all threads have properly initialized */
-  if( mesh->updatestatusflag )
-    mdBarrierSync( &mesh->workbarrier );
+  if( ( mesh->updatestatusflag ) || ( mesh->statisticsflag ) )
+    mdThreadBarrierSync( mesh, &tdata );
 
   /* Build mesh step 1 */
   if( !( tdata.threadid ) )
     tinit->stage = MD_STATUS_STAGE_BUILDVERTICES;
+  mdThreadBeginStage( mesh, &tdata, MD_STATUS_STAGE_BUILDVERTICES );
   mdMeshInitVertices( mesh, &tdata, mesh->threadcount );
-  mdBarrierSync( &mesh->workbarrier );
+  mdThreadBarrierSync( mesh, &tdata );
+
+  /* Build mesh steps 1b to 1d, optional vertex welding */
+  if( mesh->weldflag )
+  {
+    mdMeshWeldInsert( mesh, &tdata, mesh->threadcount );
+    mdThreadBarrierSync( mesh, &tdata );
+    mdMeshWeldResolve( mesh, &tdata, mesh->threadcount );
+    mdThreadBarrierSync( mesh, &tdata );
+    mdMeshWeldRemap( mesh, &tdata, mesh->threadcount );
+    mdThreadBarrierSync( mesh, &tdata );
+  }
 
   /* Build mesh step 2 */
   if( !( tdata.threadid ) )
     tinit->stage = MD_STATUS_STAGE_BUILDTRIANGLES;
+  mdThreadBeginStage( mesh, &tdata, MD_STATUS_STAGE_BUILDTRIANGLES );
+
+  /* Build mesh steps 2a to 2f, optional topology cleanup of degenerate, duplicate and non-manifold triangles */
+  if( mesh->cleanupflag )
+  {
+    mdMeshCleanupLoad( mesh, &tdata, mesh->threadcount );
+    mdThreadBarrierSync( mesh, &tdata );
+    if( !( tdata.threadid ) )
+      mdMeshInitTrirefs( mesh );
+    mdThreadBarrierSync( mesh, &tdata );
+    mdMeshCleanupDedup( mesh, &tdata, mesh->threadcount );
+    mdThreadBarrierSync( mesh, &tdata );
+    mdMeshCleanupFans( mesh, &tdata, mesh->threadcount );
+    mdThreadBarrierSync( mesh, &tdata );
+    if( !( tdata.threadid ) )
+      mdMeshCleanupClone( mesh );
+    mdThreadBarrierSync( mesh, &tdata );
+    mdMeshCleanupRemap( mesh, &tdata, mesh->threadcount );
+    mdThreadBarrierSync( mesh, &tdata );
+  }
+
+  /* Build mesh steps 2g to 2k, optional renumbering of vertices and triangles in Morton order for cache locality */
+  if( mesh->reorderflag )
+  {
+    mdMeshReorderLoad( mesh, &tdata, mesh->threadcount );
+    mdThreadBarrierSync( mesh, &tdata );
+    mdMeshReorderKeys( mesh, &tdata, mesh->threadcount );
+    mdThreadBarrierSync( mesh, &tdata );
+    if( !( tdata.threadid ) )
+      mdMeshReorderSortVertices( mesh );
+    mdThreadBarrierSync( mesh, &tdata );
+    mdMeshReorderRemap( mesh, &tdata, mesh->threadcount );
+    mdThreadBarrierSync( mesh, &tdata );
+    if( !( tdata.threadid ) )
+      mdMeshReorderSortTriangles( mesh );
+    mdThreadBarrierSync( mesh, &tdata );
+  }
+
   mdMeshInitTriangles( mesh, &tdata, mesh->threadcount );
-  mdBarrierSync( &mesh->workbarrier );
+  mdThreadBarrierSync( mesh, &tdata );
+
+  /* The weld map, cleanup and reorder buffers are no longer needed once triangles are built */
+  if( !( tdata.threadid ) )
+  {
+    mdMeshWeldEnd( mesh );
+    mdMeshCleanupEnd( mesh );
+    mdMeshReorderRelease( mesh );
+  }
 
   /* Build mesh step 3 is not parallel, have the thread zero run it */
+  mdThreadBeginStage( mesh, &tdata, MD_STATUS_STAGE_BUILDTRIREFS );
   if( !( tdata.threadid ) )
   {
     tinit->stage = MD_STATUS_STAGE_BUILDTRIREFS;
     /* Build mesh step 3 is not parallel, have the thread zero run it */
     mdMeshInitTrirefs( mesh );
   }
-  mdBarrierSync( &mesh->workbarrier );
+  mdThreadBarrierSync( mesh, &tdata );
 
   /* Build mesh step 4 */
   mdMeshBuildTrirefs( mesh, &tdata, mesh->threadcount );
-  mdBarrierSync( &mesh->workbarrier );
+  mdThreadBarrierSync( mesh, &tdata );
+
+  /* Build mesh step 5, sort trirefs and accumulate quadrics in an order independent of thread count */
+  if( mesh->deterministicflag )
+  {
+    mdMeshBuildVertexQuadrics( mesh, &tdata, mesh->threadcount );
+    mdThreadBarrierSync( mesh, &tdata );
+  }
 
   if( !( mesh->operationflags & MD_FLAGS_NO_DECIMATION ) )
   {
     /* Initialize the thread's op queue */
     if( !( tdata.threadid ) )
       tinit->stage = MD_STATUS_STAGE_BUILDQUEUE;
+    mdThreadBeginStage( mesh, &tdata, MD_STATUS_STAGE_BUILDQUEUE );
 
     triperthread = ( mesh->tricount / mesh->threadcount ) + 1;
     tribase = tdata.threadid * triperthread;
@@ -5763,24 +9665,53 @@ static void *mdThreadMain( void *value )
     if( trimax > mesh->tricount )
       trimax = mesh->tricount;
 
+    /* Optional spatial partitioning, have each thread own ops of a compact region of the surface */
+    if( mesh->partitionflag )
+    {
+      mdMeshPartitionBounds( mesh, &tdata, mesh->threadcount );
+      mdThreadBarrierSync( mesh, &tdata );
+      mdMeshPartitionKeys( mesh, &tdata, mesh->threadcount );
+      mdThreadBarrierSync( mesh, &tdata );
+      if( !( tdata.threadid ) )
+        mdMeshPartitionSort( mesh );
+      mdThreadBarrierSync( mesh, &tdata );
+    }
+
     /* Initialize a list of ops for all edges */
-    mdMeshPopulateOpList( mesh, &tdata, tribase, trimax - tribase );
+    mdMeshPopulateOpList( mesh, &tdata, mesh->partitionorder, tribase, trimax - tribase );
 
     /* Wait for all threads to reach this point */
-    mdBarrierSync( &mesh->workbarrier );
+    if( !( tdata.threadid ) )
+      mdMeshProcessCheckStop( mesh, 0 );
+    mdThreadBarrierSync( mesh, &tdata );
+    if( !( tdata.threadid ) )
+      mdMeshPartitionEnd( mesh );
 
-    /* Process the thread's op queue */
+    /* Process the thread's op queue, unless cancelled or past the deadline already */
     if( !( tdata.threadid ) )
       tinit->stage = MD_STATUS_STAGE_DECIMATION;
-    tinit->decimationcount = mdMeshProcessQueue( mesh, &tdata );
+    mdThreadBeginStage( mesh, &tdata, MD_STATUS_STAGE_DECIMATION );
+    if( mdMeshProcessStopped( mesh, 0 ) )
+      tinit->decimationcount = 0;
+    else if( mesh->deterministicflag )
+      tinit->decimationcount = mdMeshProcessQueueDeterministic( mesh, &tdata );
+    else
+      tinit->decimationcount = mdMeshProcessQueue( mesh, &tdata );
   }
 
   /* We need to synchronize the work barrier first, in case we had a request for a global lock on it */
-  mdBarrierSync( &mesh->workbarrier );
+  mdThreadBarrierSync( mesh, &tdata );
+  mdThreadBeginStage( mesh, &tdata, MD_STATUS_STAGE_STORE );
 
   /* Wait for all threads to reach this point */
   tinit->deletioncount = tdata.statusdeletioncount;
   tinit->collisioncount = tdata.statuscollisioncount;
+#if MD_CONF_ENABLE_STATISTICS
+  tinit->stats = tdata.stats;
+#endif
+
+  /* Chunks left in the magazine were never handed out as ops */
+  mmBlockCacheFlush( &tdata.opcache );
 
   /* If we didn't use atomic operations, we have spinlocks to destroy in each op */
 #ifndef MD_CONFIG_ATOMIC_SUPPORT
@@ -5791,7 +9722,13 @@ static void *mdThreadMain( void *value )
   mmBlockFreeAll( &tdata.opblock );
   for( index = 0 ; index < mesh->updatebuffercount ; index++ )
     mdUpdateBufferEnd( &tdata.updatebuffer[index] );
-  mmBinSortFree( tdata.binsort );
+  if( mesh->sharedqueue )
+  {
+    for( index = tdata.threadid * MD_MULTIQUEUE_FACTOR ; index < ( tdata.threadid + 1 ) * MD_MULTIQUEUE_FACTOR ; index++ )
+      mdSharedQueueEnd( &mesh->sharedqueue[index] );
+  }
+  else
+    mdQueueEnd( &tdata.queue );
 
   /* Send finish signal */
   mtMutexLock( &mesh->finishmutex );
@@ -5810,18 +9747,6 @@ static void *mdThreadMain( void *value )
 
 
 
-static const char *mdStatusStageName[] =
-{
- [MD_STATUS_STAGE_INIT] = "Initializing",
- [MD_STATUS_STAGE_BUILDVERTICES] = "Building Vertices",
- [MD_STATUS_STAGE_BUILDTRIANGLES] = "Building Triangles",
- [MD_STATUS_STAGE_BUILDTRIREFS] = "Building Trirefs",
- [MD_STATUS_STAGE_BUILDQUEUE] = "Building Queues",
- [MD_STATUS_STAGE_DECIMATION] = "Decimating Mesh",
- [MD_STATUS_STAGE_STORE] = "Storing Geometry",
- [MD_STATUS_STAGE_DONE] = "Done"
-};
-
 static double mdStatusStageProgress[] =
 {
  [MD_STATUS_STAGE_INIT] = 0.0,
@@ -5930,6 +9855,60 @@ void mdOperationData( mdOperation *op, size_t vertexcount, void *vertex, int ver
   return;
 }
 
+int mdOperationGrid( mdOperation *op, size_t width, size_t height, void *heights, int heightformat, size_t samplestride, size_t rowstride, double spacingx, double spacingy, const uint8_t *nodatamask )
+{
+  size_t x, y, base, tricount;
+  switch( heightformat )
+  {
+    case MD_FORMAT_FLOAT:
+    case MD_FORMAT_DOUBLE:
+    case MD_FORMAT_SHORT:
+    case MD_FORMAT_INT:
+    case MD_FORMAT_USHORT:
+    case MD_FORMAT_INT16:
+    case MD_FORMAT_INT32:
+    case MD_FORMAT_UINT16:
+      break;
+    default:
+      return 0;
+  }
+  if( !( heights ) || ( width < 2 ) || ( height < 2 ) || ( ( width * height ) > INT32_MAX ) )
+    return 0;
+  op->gridwidth = width;
+  op->gridheight = height;
+  op->gridheights = heights;
+  op->gridheightformat = heightformat;
+  op->gridsamplestride = samplestride;
+  op->gridrowstride = rowstride;
+  op->gridspacingx = spacingx;
+  op->gridspacingy = spacingy;
+  op->gridnodatamask = nodatamask;
+  tricount = 2 * ( width - 1 ) * ( height - 1 );
+  if( nodatamask )
+  {
+    tricount = 0;
+    for( y = 0 ; y < height - 1 ; y++ )
+    {
+      for( x = 0 ; x < width - 1 ; x++ )
+      {
+        base = ( y * width ) + x;
+        if( ( nodatamask[base] ) || ( nodatamask[ base + width + 1 ] ) )
+          continue;
+        tricount += !( nodatamask[ base + 1 ] ) + !( nodatamask[ base + width ] );
+      }
+    }
+  }
+  op->vertexcount = width * height;
+  op->tricount = tricount;
+  return 1;
+}
+
+void mdOperationWeldTolerance( mdOperation *op, double tolerance )
+{
+  op->weldtolerance = tolerance;
+  return;
+}
+
 void mdOperationStrength( mdOperation *op, double featuresize )
 {
   op->featuresize = featuresize;
@@ -5952,6 +9931,13 @@ void mdOperationTriData( mdOperation *op, void *tridata, size_t tridatasize, dou
   return;
 }
 
+void mdOperationCollapseMultiplierBatch( mdOperation *op, void (*collapsemultiplierbatch)( void *collapsecontext, int count, void **tridata0, void **tridata1, double *point0, double *point1, double *multiplier ), void *collapsecontext )
+{
+  op->collapsemultiplierbatch = collapsemultiplierbatch;
+  op->collapsecontext = collapsecontext;
+  return;
+}
+
 void mdOperationVertexCopy( mdOperation *op, void (*vertexcopy)( void *copycontext, int dstindex, int srcindex ), void *copycontext )
 {
   op->vertexcopy = vertexcopy;
@@ -5959,6 +9945,28 @@ void mdOperationVertexCopy( mdOperation *op, void (*vertexcopy)( void *copyconte
   return;
 }
 
+int mdOperationAttribStream( mdOperation *op, void *base, int format, size_t stride, int componentcount, int blendmode )
+{
+  mdAttribStream *attrib;
+  if( ( op->attribcount >= MD_ATTRIB_STREAM_MAX ) || !( base ) || !( mdAttribFormatSize( format ) ) )
+    return 0;
+  if( ( componentcount < 1 ) || ( componentcount > MD_ATTRIB_COMPONENT_MAX ) || ( stride < componentcount * mdAttribFormatSize( format ) ) )
+    return 0;
+  if( ( blendmode != MD_ATTRIB_BLEND_LINEAR ) && ( blendmode != MD_ATTRIB_BLEND_NORMALIZE ) && ( blendmode != MD_ATTRIB_BLEND_NEAREST ) )
+    return 0;
+  if( ( blendmode == MD_ATTRIB_BLEND_NORMALIZE ) && ( format != MD_FORMAT_FLOAT ) && ( format != MD_FORMAT_DOUBLE ) )
+    return 0;
+  if( ( blendmode != MD_ATTRIB_BLEND_NEAREST ) && ( mdAttribFormatSize( format ) == sizeof(uint32_t) ) && ( format != MD_FORMAT_FLOAT ) )
+    return 0;
+  attrib = &op->attrib[ op->attribcount++ ];
+  attrib->base = base;
+  attrib->format = format;
+  attrib->stride = stride;
+  attrib->componentcount = componentcount;
+  attrib->blendmode = blendmode;
+  return 1;
+}
+
 void mdOperationVertexMerge( mdOperation *op, void (*vertexmerge)( void *mergecontext, int dstindex, int srcindex, double dstfactor, double srcfactor ), void *mergecontext )
 {
   op->vertexmerge = vertexmerge;
@@ -5974,6 +9982,14 @@ void mdOperationAdjustCollapse( mdOperation *op, int (*adjustcollapsef)( void *a
   return;
 }
 
+void mdOperationAdjustCollapseBatch( mdOperation *op, void (*adjustcollapsebatchf)( void *adjustcontext, int count, float *collapsepoint, float *v0point, float *v1point, int *accept ), void (*adjustcollapsebatchd)( void *adjustcontext, int count, double *collapsepoint, double *v0point, double *v1point, int *accept ), void *adjustcontext )
+{
+  op->adjustcollapsebatchf = adjustcollapsebatchf;
+  op->adjustcollapsebatchd = adjustcollapsebatchd;
+  op->adjustcontext = adjustcontext;
+  return;
+}
+
 void mdOperationComputeNormals( mdOperation *op, void *base, int format, size_t stride )
 {
   op->normalbase = base;
@@ -5982,6 +9998,12 @@ void mdOperationComputeNormals( mdOperation *op, void *base, int format, size_t
   return;
 }
 
+void mdOperationTimeBudget( mdOperation *op, long milliseconds )
+{
+  op->timebudget = milliseconds;
+  return;
+}
+
 void mdOperationStatusCallback( mdOperation *op, void (*statuscallback)( void *statuscontext, const mdStatus *status ), void *statuscontext, long milliseconds )
 {
   op->statusmilliseconds = milliseconds;
@@ -5990,6 +10012,12 @@ void mdOperationStatusCallback( mdOperation *op, void (*statuscallback)( void *s
   return;
 }
 
+void mdOperationStatistics( mdOperation *op, mdStatistics *statistics )
+{
+  op->statistics = statistics;
+  return;
+}
+
 void mdOperationLockVertex( mdOperation *op, long vertexindex )
 {
   size_t mapsize;
@@ -6018,12 +10046,27 @@ void mdOperationFreeLocks( mdOperation *op )
 //////
 
 
+typedef struct
+{
+  mdState *state;
+  int threadindex;
+} mdMeshDecimationThreadLaunch;
+
 struct mdState
 {
   mdOperation *operation;
   mdMesh mesh;
   mdThreadInit threadinit[MD_THREAD_COUNT_MAX];
   mdStatus status;
+  /* Time at which the initialization began, then its duration */
+  uint64_t initwalltime;
+#if MD_CONF_ENABLE_STATISTICS
+  uint64_t initcputime;
+#endif
+  /* Threads launched by mdMeshDecimationStart() */
+  int threadlaunchcount;
+  mtThread thread[MD_THREAD_COUNT_MAX];
+  mdMeshDecimationThreadLaunch threadlaunch[MD_THREAD_COUNT_MAX];
 };
 
 static void mdMeshDecimationFree( mdState *state )
@@ -6033,6 +10076,8 @@ static void mdMeshDecimationFree( mdState *state )
   if( !( mesh->operationflags & MD_FLAGS_NO_DECIMATION ) )
     mdMeshHashEnd( mesh );
   mdMeshEnd( mesh );
+  free( mesh->gridrowtribase );
+  mmTraceRunEnd( mesh->tracerun );
   mdBarrierDestroy( &mesh->workbarrier );
   mtMutexDestroy( &mesh->finishmutex );
   mtSignalDestroy( &mesh->finishsignal );
@@ -6043,7 +10088,7 @@ static void mdMeshDecimationFree( mdState *state )
 /* Initialize state to decimate the mesh specified by the mdOperation struct */
 mdState *mdMeshDecimationInit( mdOperation *operation, int threadcount, int flags )
 {
-  int threadindex;
+  int threadindex, attribindex;
   double featuresize, normalizationfactor;
   mdState *state;
   mdMesh *mesh;
@@ -6064,6 +10109,18 @@ mdState *mdMeshDecimationInit( mdOperation *operation, int threadcount, int flag
   operation->decimationcount = 0;
   operation->msecs = 0;
 
+#if MD_CONF_ENABLE_STATISTICS
+  if( operation->statistics )
+  {
+    mesh->statisticsflag = 1;
+    state->initcputime = mmGetThreadCpuMicrosecondsTime();
+  }
+#endif
+  mesh->tracerun = mmTraceRunBegin( "mdMeshDecimation", threadcount );
+  mesh->timingflag = ( mesh->statisticsflag || mesh->tracerun );
+  if( mesh->timingflag )
+    state->initwalltime = mmGetMicrosecondsTime();
+
   /* Get operation general settings */
   mesh->point = operation->vertex;
   mesh->pointstride = operation->vertexstride;
@@ -6072,89 +10129,66 @@ mdState *mdMeshDecimationInit( mdOperation *operation, int threadcount, int flag
   mesh->indicesstride = operation->indicesstride;
   mesh->tridata = operation->tridata;
   mesh->tridatasize = operation->tridatasize;
-  switch( operation->indicesformat )
-  {
-    case MD_FORMAT_BYTE:
-    case MD_FORMAT_UBYTE:
-      mesh->indicesUserToNative = mdIndicesCharToNative;
-      mesh->indicesNativeToUser = mdIndicesNativeToChar;
-      break;
-    case MD_FORMAT_SHORT:
-    case MD_FORMAT_USHORT:
-      mesh->indicesUserToNative = mdIndicesShortToNative;
-      mesh->indicesNativeToUser = mdIndicesNativeToShort;
-      break;
-    case MD_FORMAT_INT:
-    case MD_FORMAT_UINT:
-      mesh->indicesUserToNative = mdIndicesIntToNative;
-      mesh->indicesNativeToUser = mdIndicesNativeToInt;
-      break;
-    case MD_FORMAT_INT8:
-    case MD_FORMAT_UINT8:
-      mesh->indicesUserToNative = mdIndicesInt8ToNative;
-      mesh->indicesNativeToUser = mdIndicesNativeToInt8;
-      break;
-    case MD_FORMAT_INT16:
-    case MD_FORMAT_UINT16:
-      mesh->indicesUserToNative = mdIndicesInt16ToNative;
-      mesh->indicesNativeToUser = mdIndicesNativeToInt16;
-      break;
-    case MD_FORMAT_INT32:
-    case MD_FORMAT_UINT32:
-      mesh->indicesUserToNative = mdIndicesInt32ToNative;
-      mesh->indicesNativeToUser = mdIndicesNativeToInt32;
-      break;
-    case MD_FORMAT_INT64:
-    case MD_FORMAT_UINT64:
-      mesh->indicesUserToNative = mdIndicesInt64ToNative;
-      mesh->indicesNativeToUser = mdIndicesNativeToInt64;
-      break;
-    default:
-      goto error;
-  }
-  switch( operation->vertexformat )
-  {
-    case MD_FORMAT_FLOAT:
-      mesh->vertexUserToNative = mdVertexFloatToNative;
-      mesh->vertexNativeToUser = mdVertexNativeToFloat;
-      break;
-    case MD_FORMAT_DOUBLE:
-      mesh->vertexUserToNative = mdVertexDoubleToNative;
-      mesh->vertexNativeToUser = mdVertexNativeToDouble;
-      break;
-    case MD_FORMAT_SHORT:
-      mesh->vertexUserToNative = mdVertexShortToNative;
-      mesh->vertexNativeToUser = mdVertexNativeToShort;
-      break;
-    case MD_FORMAT_INT:
-      mesh->vertexUserToNative = mdVertexIntToNative;
-      mesh->vertexNativeToUser = mdVertexNativeToInt;
-      break;
-    case MD_FORMAT_INT16:
-      mesh->vertexUserToNative = mdVertexInt16ToNative;
-      mesh->vertexNativeToUser = mdVertexNativeToInt16;
-      break;
-    case MD_FORMAT_INT32:
-      mesh->vertexUserToNative = mdVertexInt32ToNative;
-      mesh->vertexNativeToUser = mdVertexNativeToInt32;
-      break;
-    default:
-      goto error;
-  }
+  mesh->indicesformat = operation->indicesformat;
+  mesh->vertexformat = operation->vertexformat;
+  if( !( mdIndicesFormatFunctions( operation->indicesformat, &mesh->indicesUserToNative, &mesh->indicesNativeToUser ) ) )
+    goto error;
+  if( !( mdVertexFormatFunctions( operation->vertexformat, &mesh->vertexUserToNative, &mesh->vertexNativeToUser ) ) )
+    goto error;
   mesh->edgeweight = operation->edgeweight;
   mesh->collapsemultiplier = operation->collapsemultiplier;
   mesh->collapsecontext = operation->collapsecontext;
   mesh->vertexmerge = operation->vertexmerge;
   mesh->mergecontext = operation->mergecontext;
+  mesh->collapsemultiplierbatch = operation->collapsemultiplierbatch;
 #if MD_CONF_DOUBLE_PRECISION
   mesh->adjustcollapse = (void *)operation->adjustcollapsed;
+  mesh->adjustcollapsebatch = (void *)operation->adjustcollapsebatchd;
 #else
   mesh->adjustcollapse = (void *)operation->adjustcollapsef;
+  mesh->adjustcollapsebatch = (void *)operation->adjustcollapsebatchf;
 #endif
   mesh->adjustcontext = operation->adjustcontext;
   mesh->vertexcopy = operation->vertexcopy;
   mesh->copycontext = operation->copycontext;
+  mesh->attribcount = operation->attribcount;
+  for( attribindex = 0 ; attribindex < mesh->attribcount ; attribindex++ )
+  {
+    mesh->attrib[attribindex].base = operation->attrib[attribindex].base;
+    mesh->attrib[attribindex].stride = operation->attrib[attribindex].stride;
+    mesh->attrib[attribindex].format = operation->attrib[attribindex].format;
+    mesh->attrib[attribindex].componentcount = operation->attrib[attribindex].componentcount;
+    mesh->attrib[attribindex].blendmode = operation->attrib[attribindex].blendmode;
+    mesh->attrib[attribindex].elementsize = operation->attrib[attribindex].componentcount * mdAttribFormatSize( operation->attrib[attribindex].format );
+  }
   mesh->tricount = operation->tricount;
+
+  /* Grid input, vertices and triangles are generated from the height samples */
+  if( operation->gridheights )
+  {
+    mesh->gridflag = 1;
+    mesh->gridwidth = (mdi)operation->gridwidth;
+    mesh->gridheight = (mdi)operation->gridheight;
+    mesh->gridheights = operation->gridheights;
+    mesh->gridheightformat = operation->gridheightformat;
+    mesh->gridsamplestride = operation->gridsamplestride;
+    mesh->gridrowstride = operation->gridrowstride;
+    mesh->gridspacing[0] = operation->gridspacingx;
+    mesh->gridspacing[1] = operation->gridspacingy;
+    mesh->gridnodatamask = operation->gridnodatamask;
+    if( ( mesh->gridwidth < 2 ) || ( mesh->gridheight < 2 ) )
+      goto error;
+    if( mesh->gridnodatamask )
+    {
+      mesh->gridrowtribase = malloc( ( mesh->gridheight - 1 ) * sizeof(mdi) );
+      if( !( mesh->gridrowtribase ) )
+        goto error;
+    }
+    mesh->vertexcount = mesh->gridwidth * mesh->gridheight;
+    mesh->tricount = mdGridCountTriangles( mesh );
+    operation->vertexcount = mesh->vertexcount;
+    operation->tricount = mesh->tricount;
+  }
   if( mesh->tricount < 2 )
     goto error;
 
@@ -6200,9 +10234,35 @@ mdState *mdMeshDecimationInit( mdOperation *operation, int threadcount, int flag
 
   /* Record start time */
   operation->msecs = mmGetMillisecondsTime();
+  operation->stopped = 0;
+  mesh->deadline = 0;
+  if( operation->timebudget > 0 )
+    mesh->deadline = operation->msecs + operation->timebudget;
 
   mesh->threadcount = threadcount;
   mesh->operationflags = flags;
+  mesh->deterministicflag = ( flags & MD_FLAGS_DETERMINISTIC ? 1 : 0 );
+  mesh->weldflag = ( flags & MD_FLAGS_WELD_VERTICES ? 1 : 0 );
+  mesh->cleanupflag = ( flags & MD_FLAGS_CLEANUP_TOPOLOGY ? 1 : 0 );
+  mesh->partitionflag = ( ( flags & MD_FLAGS_SPATIAL_PARTITION ) && ( threadcount > 1 ) && !( flags & MD_FLAGS_NO_DECIMATION ) ? 1 : 0 );
+  /* Grid input is already in spatial order, and its boundaries are derived from vertex indices */
+  mesh->reorderflag = ( ( flags & MD_FLAGS_SPATIAL_REORDER ) && !( mesh->gridflag ) && !( flags & MD_FLAGS_NO_DECIMATION ) ? 1 : 0 );
+  /* Welding and cleanup remap vertex indices of grid triangles and add clones, boundaries then come from the edge hash */
+  mesh->gridboundaryflag = ( ( mesh->gridflag ) && !( mesh->weldflag ) && !( mesh->cleanupflag ) && !( mesh->edgeweight ) ? 1 : 0 );
+  /* Sub-queue locks are spin locks, with more threads than available CPUs a preempted lock holder stalls all the others */
+  mesh->sharedqueueflag = ( ( flags & MD_FLAGS_MULTI_QUEUE ) && ( threadcount > 1 ) && ( threadcount <= mmcore.cpuavailcount ) && !( mesh->deterministicflag ) && !( flags & MD_FLAGS_NO_DECIMATION ) ? 1 : 0 );
+  mesh->hugepageflag = ( flags & MD_FLAGS_HUGE_PAGES ? 1 : 0 );
+  /* Vertices and triangles are first touched by the threads initializing them, the edge hash and trirefs by mdMeshNumaFirstTouch() */
+  /* With spatial partitioning, threads don't work on the index ranges they initialized, interleave instead */
+  mesh->numafirsttouchflag = 0;
+  mesh->numainterleaveflag = 0;
+  if( ( mmcore.numa.capable ) && !( flags & MD_FLAGS_DISABLE_NUMA ) && ( mmGetNodeCount() > 1 ) )
+  {
+    if( ( flags & MD_FLAGS_NUMA_INTERLEAVE ) || ( mesh->partitionflag ) )
+      mesh->numainterleaveflag = 1;
+    else
+      mesh->numafirsttouchflag = 1;
+  }
 
   /* To compute vertex normals */
   mesh->normalbase = operation->normalbase;
@@ -6238,205 +10298,1174 @@ mdState *mdMeshDecimationInit( mdOperation *operation, int threadcount, int flag
     }
   }
 
-  /* Vertex lock map */
-  mesh->lockmap = operation->lockmap;
-
-  /* Advanced configuration options */
-  mesh->compactnesstarget = operation->compactnesstarget;
-  mesh->compactnesspenalty = operation->compactnesspenalty;
-  mesh->boundaryareafactor = featuresize * operation->boundaryweight;
-  mesh->areaexpand = featuresize * featuresize * operation->edgeexpand;
-  mesh->boundaryedgeexpand = featuresize * operation->boundaryedgeexpand;
-  mesh->syncstepcount = operation->syncstepcount;
-  mesh->syncstepabort = operation->syncstepabort;
-  if( mesh->syncstepcount < 1 )
-    mesh->syncstepcount = 1;
-  if( mesh->syncstepcount > 1024 )
-    mesh->syncstepcount = 1024;
-  mesh->normalsearchangle = cos( 1.0 * operation->normalsearchangle * (M_PI/180.0) );
-  if( mesh->normalsearchangle > 0.9 )
-    mesh->normalsearchangle = 0.9;
+  /* Vertex lock map */
+  mesh->lockmap = operation->lockmap;
+  mesh->lockvertexcount = mesh->vertexcount;
+
+  /* Advanced configuration options */
+  mesh->compactnesstarget = operation->compactnesstarget;
+  mesh->compactnesspenalty = operation->compactnesspenalty;
+  mesh->boundaryareafactor = featuresize * operation->boundaryweight;
+  mesh->areaexpand = featuresize * featuresize * operation->edgeexpand;
+  mesh->boundaryedgeexpand = featuresize * operation->boundaryedgeexpand;
+  mesh->weldtolerance = normalizationfactor * operation->weldtolerance;
+  mesh->syncstepcount = operation->syncstepcount;
+  mesh->syncstepabort = operation->syncstepabort;
+  if( mesh->syncstepcount < 1 )
+    mesh->syncstepcount = 1;
+  if( mesh->syncstepcount > 1024 )
+    mesh->syncstepcount = 1024;
+  mesh->normalsearchangle = cos( 1.0 * operation->normalsearchangle * (M_PI/180.0) );
+  if( mesh->normalsearchangle > 0.9 )
+    mesh->normalsearchangle = 0.9;
+
+  /* Synchronization */
+  mdBarrierInit( &mesh->workbarrier, threadcount );
+
+  /* Determine update buffer shift required, find the count of updatebuffers */
+  for( mesh->updatebuffershift = 0 ; ( threadcount >> mesh->updatebuffershift ) > MD_THREAD_UPDATE_BUFFER_COUNTMAX ; mesh->updatebuffershift++ );
+  mesh->updatebuffercount = ( ( threadcount - 1 ) >> mesh->updatebuffershift ) + 1;
+
+  /* Runtime picking of collapse penalty computation path */
+  mesh->collapsepenalty = mdEdgeCollapsePenaltyTriangle;
+#if CPU_SSE_SUPPORT && 1
+ #if !MD_CONF_DOUBLE_PRECISION
+  #if CPU_SSE4_1_SUPPORT
+    mesh->collapsepenalty = mdEdgeCollapsePenaltyTriangleSSE4p1f;
+  #elif CPU_SSE3_SUPPORT
+    mesh->collapsepenalty = mdEdgeCollapsePenaltyTriangleSSE3f;
+  #elif CPU_SSE2_SUPPORT
+    mesh->collapsepenalty = mdEdgeCollapsePenaltyTriangleSSE2f;
+  #endif
+ #else
+  #if CPU_SSE4_1_SUPPORT
+    mesh->collapsepenalty = mdEdgeCollapsePenaltyTriangleSSE4p1d;
+  #elif CPU_SSE3_SUPPORT
+    mesh->collapsepenalty = mdEdgeCollapsePenaltyTriangleSSE3d;
+  #elif CPU_SSE2_SUPPORT
+    mesh->collapsepenalty = mdEdgeCollapsePenaltyTriangleSSE2d;
+  #endif
+ #endif
+#endif
+
+  /* Finish status tracking */
+  mesh->finishcount = threadcount;
+  mtMutexInit( &mesh->finishmutex );
+  mtSignalInit( &mesh->finishsignal );
+
+  /* Initialize entire mesh storage */
+  mesh->vertexalloc = operation->vertexalloc;
+  if( mesh->vertexalloc < mesh->vertexcount )
+    mesh->vertexalloc = mesh->vertexcount;
+  if( !( mdMeshInit( mesh, operation->maxmemoryusage ) ) )
+  {
+    mdMeshDecimationFree( state );
+    return 0;
+  }
+
+  /* Initialize thread init data */
+  for( threadindex = 0 ; threadindex < mesh->threadcount ; threadindex++ )
+  {
+    tinit = &state->threadinit[threadindex];
+    tinit->threadid = threadindex;
+    tinit->mesh = mesh;
+    tinit->stage = MD_STATUS_STAGE_INIT;
+    tinit->tdata = 0;
+  }
+
+  /* Status update */
+  mesh->updatestatusflag = 0;
+  status->progress = 0.0;
+  status->stage = MD_STATUS_STAGE_INIT;
+  status->trianglecount = mesh->tricount;
+  if( operation->statuscallback )
+  {
+    mesh->updatestatusflag = 1;
+    mdUpdateStatus( mesh, state->threadinit, status );
+    operation->statuscallback( operation->statuscontext, status );
+  }
+
+  if( mesh->tracerun )
+    mmTraceSpan( mesh->tracerun, threadcount, mdStatusStageName[MD_STATUS_STAGE_INIT], 0, 0, state->initwalltime, mmGetMicrosecondsTime() );
+  if( mesh->timingflag )
+    state->initwalltime = mmGetMicrosecondsTime() - state->initwalltime;
+#if MD_CONF_ENABLE_STATISTICS
+  if( mesh->statisticsflag )
+    state->initcputime = mmGetThreadCpuMicrosecondsTime() - state->initcputime;
+#endif
+
+  return state;
+
+  /* Free all global data */
+  error:
+  free( mesh->gridrowtribase );
+  mmTraceRunEnd( mesh->tracerun );
+  free( state );
+  return 0;
+}
+
+/* Perform the work for specified thread, must be called synchronously for all threadcount */
+void mdMeshDecimationThread( mdState *state, int threadindex )
+{
+  mdMesh *mesh;
+  mdThreadInit *tinit;
+  mesh = &state->mesh;
+  if( threadindex < mesh->threadcount )
+  {
+    tinit = &state->threadinit[threadindex];
+    tinit->threadid = threadindex;
+    tinit->mesh = mesh;
+    tinit->stage = MD_STATUS_STAGE_INIT;
+    tinit->tdata = 0;
+    mdThreadMain( tinit );
+  }
+  return;
+}
+
+#if MD_CONF_ENABLE_STATISTICS
+/* Gather per-thread statistics ; stage wall time is the slowest thread, CPU time is summed over threads */
+static void mdMeshDecimationStatistics( mdState *state, mdStatistics *statistics, uint64_t storewalltime, uint64_t storecputime )
+{
+  int threadid, stageindex;
+  mdMesh *mesh;
+  mdThreadStatistics *stats;
+
+  mesh = &state->mesh;
+  memset( statistics, 0, sizeof(mdStatistics) );
+  statistics->threadcount = mesh->threadcount;
+
+  /* Flags ignored for this run, by thread count, CPU count, grid input or NUMA topology */
+  statistics->effectiveflags = mesh->operationflags;
+  if( !( mesh->sharedqueueflag ) )
+    statistics->effectiveflags &= ~MD_FLAGS_MULTI_QUEUE;
+  if( !( mesh->partitionflag ) )
+    statistics->effectiveflags &= ~MD_FLAGS_SPATIAL_PARTITION;
+  if( !( mesh->reorderflag ) )
+    statistics->effectiveflags &= ~MD_FLAGS_SPATIAL_REORDER;
+  if( !( mesh->numainterleaveflag ) )
+    statistics->effectiveflags &= ~MD_FLAGS_NUMA_INTERLEAVE;
+  for( threadid = 0 ; threadid < mesh->threadcount ; threadid++ )
+  {
+    stats = &state->threadinit[threadid].stats;
+    for( stageindex = 0 ; stageindex < MD_STATUS_STAGE_COUNT ; stageindex++ )
+    {
+      if( statistics->stagewallusecs[stageindex] < stats->stagewallusecs[stageindex] )
+        statistics->stagewallusecs[stageindex] = stats->stagewallusecs[stageindex];
+      statistics->stagecpuusecs[stageindex] += stats->stagecpuusecs[stageindex];
+    }
+    if( threadid < MD_STATISTICS_THREAD_MAX )
+      statistics->barrierwaitusecs[threadid] = stats->barrierwaitusecs;
+    statistics->opcreatecount += stats->opcreatecount;
+    statistics->opupdatecount += stats->opupdatecount;
+    statistics->opdenycount += stats->opdenycount;
+    statistics->opcollisioncount += stats->opcollisioncount;
+    statistics->lockretrycount += stats->lockretrycount;
+    statistics->lockglobalcount += stats->lockglobalcount;
+    statistics->trirefgrowcount += stats->trirefgrowcount;
+    statistics->collapsecostsum += stats->collapsecostsum;
+  }
+
+  /* Initialization and storage are performed by the calling thread */
+  statistics->stagewallusecs[MD_STATUS_STAGE_INIT] += (long)state->initwalltime;
+  statistics->stagecpuusecs[MD_STATUS_STAGE_INIT] += (long)state->initcputime;
+  statistics->stagewallusecs[MD_STATUS_STAGE_STORE] += (long)storewalltime;
+  statistics->stagecpuusecs[MD_STATUS_STAGE_STORE] += (long)storecputime;
+
+  return;
+}
+#endif
+
+/* Wait until the work has completed and write out the mesh */
+static int mdMeshDecimationStore( mdState *state )
+{
+  int threadid, threadcount, retval;
+  long statuswait;
+  mdOperation *operation;
+  mdMesh *mesh;
+  mdThreadInit *threadinit;
+  mdStatus *status;
+  mdThreadInit *tinit;
+  uint64_t storewalltime, writetime;
+#if MD_CONF_ENABLE_STATISTICS
+  uint64_t storecputime;
+#endif
+
+  operation = state->operation;
+  mesh = &state->mesh;
+  threadinit = state->threadinit;
+  status = &state->status;
+
+  threadcount = mesh->threadcount;
+  statuswait = ( operation->statusmilliseconds > 2 ? operation->statusmilliseconds : 2 );
+
+  /* Wait for all threads to complete */
+#if MD_CONF_ENABLE_PROGRESS
+  if( !( mesh->updatestatusflag ) )
+  {
+    mtMutexLock( &mesh->finishmutex );
+    while( mesh->finishcount )
+      mtSignalWait( &mesh->finishsignal, &mesh->finishmutex );
+    mtMutexUnlock( &mesh->finishmutex );
+  }
+  else
+  {
+    mtMutexLock( &mesh->finishmutex );
+    while( mesh->finishcount )
+    {
+      mdUpdateStatus( mesh, threadinit, status );
+      operation->statuscallback( operation->statuscontext, status );
+      mtSignalWaitTimeout( &mesh->finishsignal, &mesh->finishmutex, statuswait );
+    }
+    mtMutexUnlock( &mesh->finishmutex );
+  }
+#else
+  mtMutexLock( &mesh->finishmutex );
+  while( mesh->finishcount )
+    mtSignalWait( &barrier->signal, &barrier->mutex );
+  mtMutexUnlock( &mesh->finishmutex );
+#endif
+
+  /* Count sums of all threads */
+  operation->decimationcount = 0;
+  operation->collisioncount = 0;
+  tinit = threadinit;
+  for( threadid = 0 ; threadid < threadcount ; threadid++, tinit++ )
+  {
+    operation->decimationcount += tinit->decimationcount;
+    operation->collisioncount += tinit->collisioncount;
+  }
+  operation->cleanupunsplitcount = mesh->cleanunsplitcount;
+
+  if( mesh->updatestatusflag )
+  {
+    threadinit->stage = MD_STATUS_STAGE_STORE;
+    mdUpdateStatus( mesh, threadinit, status );
+    operation->statuscallback( operation->statuscontext, status );
+  }
+
+  storewalltime = 0;
+  if( mesh->timingflag )
+    storewalltime = mmGetMicrosecondsTime();
+#if MD_CONF_ENABLE_STATISTICS
+  storecputime = 0;
+  if( mesh->statisticsflag )
+    storecputime = mmGetThreadCpuMicrosecondsTime();
+#endif
+
+  /* Grid input, allocate output buffers not provided by the user */
+  retval = 1;
+  if( ( mesh->gridflag ) && !( mesh->point ) )
+    mesh->point = malloc( mesh->vertexalloc * mesh->pointstride );
+  if( ( mesh->gridflag ) && !( mesh->indices ) )
+    mesh->indices = malloc( mesh->tricount * mesh->indicesstride );
+
+  writetime = 0;
+  if( ( mesh->gridflag ) && ( !( mesh->point ) || !( mesh->indices ) ) )
+  {
+    /* Out of memory, no mesh is written */
+    if( !( operation->vertex ) )
+      free( mesh->point );
+    if( !( operation->indices ) )
+      free( mesh->indices );
+    mesh->vertexpackcount = 0;
+    mesh->tripackcount = 0;
+    retval = 0;
+  }
+  else
+  {
+    /* Write out the final mesh */
+    if( ( mesh->normalbase ) && ( mesh->writenormal ) )
+      mdMeshWriteVerticesAndNormals( mesh );
+    else
+      mdMeshWriteVertices( mesh );
+    if( mesh->tracerun )
+    {
+      writetime = mmGetMicrosecondsTime();
+      mmTraceSpan( mesh->tracerun, threadcount, "Write Vertices", 0, 0, storewalltime, writetime );
+    }
+    mdMeshWriteIndices( mesh );
+  }
+  operation->vertexcount = mesh->vertexpackcount;
+  operation->tricount = mesh->tripackcount;
+  operation->stopped = ( mesh->stopstep ? 1 : 0 );
+  /* Shrink allocated grid output to fit, keep the larger buffer if that fails */
+  if( ( retval ) && ( mesh->gridflag ) && !( operation->vertex ) )
+  {
+    operation->vertex = realloc( mesh->point, ( mesh->vertexpackcount ? mesh->vertexpackcount : 1 ) * mesh->pointstride );
+    if( !( operation->vertex ) )
+      operation->vertex = mesh->point;
+  }
+  if( ( retval ) && ( mesh->gridflag ) && !( operation->indices ) )
+  {
+    operation->indices = realloc( mesh->indices, ( mesh->tripackcount ? mesh->tripackcount : 1 ) * mesh->indicesstride );
+    if( !( operation->indices ) )
+      operation->indices = mesh->indices;
+  }
+  if( mesh->tracerun )
+    mmTraceSpan( mesh->tracerun, threadcount, "Write Indices", 0, 0, writetime, mmGetMicrosecondsTime() );
+
+#if MD_CONF_ENABLE_STATISTICS
+  if( mesh->statisticsflag )
+  {
+    storewalltime = mmGetMicrosecondsTime() - storewalltime;
+    storecputime = mmGetThreadCpuMicrosecondsTime() - storecputime;
+    mdMeshDecimationStatistics( state, operation->statistics, storewalltime, storecputime );
+  }
+#endif
+
+  if( mesh->updatestatusflag )
+  {
+    threadinit->stage = MD_STATUS_STAGE_DONE;
+    mdUpdateStatus( mesh, state->threadinit, status );
+    operation->statuscallback( operation->statuscontext, status );
+  }
+
+  /* Requires mmhash.c compiled with MM_HASH_DEBUG_STATISTICS */
+#if MM_HASH_DEBUG_STATISTICS
+  mmHashPrintStatistics( mesh->edgehashtable );
+#endif
+
+  return retval;
+}
+
+/* Wait until the work has completed */
+void mdMeshDecimationEnd( mdState *state )
+{
+  mdOperation *operation;
+  operation = state->operation;
+  mdMeshDecimationStore( state );
+  mdMeshDecimationFree( state );
+  /* Store total processing time */
+  operation->msecs = mmGetMillisecondsTime() - operation->msecs;
+  return;
+}
+
+/* Request decimation to stop at the current sync step */
+void mdMeshDecimationCancel( mdState *state )
+{
+  state->mesh.cancelflag = 1;
+  return;
+}
+
+
+////
+
+
+static void *mdMeshDecimationThreadMain( void *value )
+{
+  mdMeshDecimationThreadLaunch *threadlaunch;
+  threadlaunch = (mdMeshDecimationThreadLaunch *)value;
+  mdMeshDecimationThread( threadlaunch->state, threadlaunch->threadindex );
+  return 0;
+}
+
+/* Launch the decimation and return immediately */
+mdState *mdMeshDecimationStart( mdOperation *operation, int threadcount, int flags )
+{
+  int threadindex, maxthreadcount;
+  mdState *state;
+
+  maxthreadcount = operation->tricount / 128;
+  if( maxthreadcount > MD_THREAD_COUNT_MAX )
+    maxthreadcount = MD_THREAD_COUNT_MAX;
+  if( maxthreadcount == 0 )
+    maxthreadcount = 1;
+  if( threadcount <= 0 )
+  {
+    threadcount = mmcore.cpuavailcount;
+    if( threadcount <= 0 )
+      threadcount = MD_THREAD_COUNT_DEFAULT;
+  }
+  if( threadcount > maxthreadcount )
+    threadcount = maxthreadcount;
+
+  state = mdMeshDecimationInit( operation, threadcount, flags );
+  if( !state )
+    return 0;
+  state->threadlaunchcount = threadcount;
+  for( threadindex = 0 ; threadindex < threadcount ; threadindex++ )
+  {
+    state->threadlaunch[threadindex].state = state;
+    state->threadlaunch[threadindex].threadindex = threadindex;
+    mtThreadCreate( &state->thread[threadindex], mdMeshDecimationThreadMain, &state->threadlaunch[threadindex], MT_THREAD_FLAGS_JOINABLE );
+  }
+
+  return state;
+}
+
+/* Poll an asynchronous decimation, return non-zero once all threads are done */
+int mdMeshDecimationPoll( mdState *state, mdStatus *status )
+{
+  int finishcount;
+  mdMesh *mesh;
+  mesh = &state->mesh;
+  mtMutexLock( &mesh->finishmutex );
+  finishcount = mesh->finishcount;
+  if( status )
+    mdUpdateStatus( mesh, state->threadinit, status );
+  mtMutexUnlock( &mesh->finishmutex );
+  return ( finishcount == 0 );
+}
+
+/* Wait for an asynchronous decimation to complete, write out the mesh and free the state */
+int mdMeshDecimationWait( mdState *state )
+{
+  int threadindex, retval;
+  mdOperation *operation;
+  operation = state->operation;
+  retval = mdMeshDecimationStore( state );
+  for( threadindex = 0 ; threadindex < state->threadlaunchcount ; threadindex++ )
+    mtThreadJoin( &state->thread[threadindex] );
+  mdMeshDecimationFree( state );
+  /* Store total processing time */
+  operation->msecs = mmGetMillisecondsTime() - operation->msecs;
+  return retval;
+}
+
+int mdMeshDecimation( mdOperation *operation, int threadcount, int flags )
+{
+  mdState *state;
+  state = mdMeshDecimationStart( operation, threadcount, flags );
+  if( !state )
+    return 0;
+  return mdMeshDecimationWait( state );
+}
+
+
+
+
+////
+
+
+/* Geometric error measurement between two meshes : a BVH is built in parallel over the triangles of both meshes,
+ * area-weighted surface samples and the vertices of each mesh are then projected on the other surface */
+
+#define MD_ERROR_BVH_LEAF_SIZE (4)
+/* Median splits bound the tree depth to log2(tricount), a traversal stack pushes at most one node per level */
+#define MD_ERROR_BVH_STACK_SIZE (128)
+/* Minimum count of top-level subtrees built by each thread */
+#define MD_ERROR_BVH_TASKS_PER_THREAD (4)
+/* Default minimum count of surface samples per direction */
+#define MD_ERROR_SAMPLE_COUNT_MIN (65536)
+
+typedef struct
+{
+  mdf min[3];
+  mdf max[3];
+  /* For interior nodes, index of the second child node, the first child immediately follows the node */
+  /* For leaves, base index in the trilist */
+  mdi index;
+  /* For leaves, count of triangles ; zero for interior nodes, -1 for top-level nodes pending a refit */
+  int tricount;
+} mdErrorNode;
+
+typedef struct
+{
+  mdi nodeindex;
+  mdi base;
+  mdi count;
+} mdErrorTask;
+
+typedef struct
+{
+  /* User input */
+  size_t vertexcount;
+  void *vertex;
+  int vertexformat;
+  size_t vertexstride;
+  size_t tricount;
+  void *indices;
+  int indicesformat;
+  size_t indicesstride;
+  void (*indicesUserToNative)( mdi *dst, void *src );
+  void (*vertexUserToNative)( mdf *dst, void *src, mdf factor );
+
+  /* Native data */
+  mdf *point;
+  mdi *indices3;
+  char *vertexused;
+  mdf *centroid;
+  /* Prefix sum of triangle areas, tricount+1 entries */
+  mdf *areasum;
+
+  /* BVH */
+  mdi *trilist;
+  mdErrorNode *node;
+  mdErrorTask *tasklist;
+  int taskcount;
+} mdErrorMesh;
+
+typedef struct mdErrorState mdErrorState;
+
+typedef struct
+{
+  mdErrorState *state;
+  int threadindex;
+  int invalidflag;
+  mdf areasum[2];
+  /* Per direction, distances of area samples and of vertex samples */
+  double maxdistance[2];
+  double sum[2];
+  double sumsq[2];
+  size_t count[2];
+  double vertexsum[2];
+  double vertexsumsq[2];
+  size_t vertexcount[2];
+} mdErrorThread;
+
+struct mdErrorState
+{
+  int threadcount;
+  int taskdepth;
+  size_t samplecount;
+  /* [0] is the reference mesh, [1] the measured mesh */
+  mdErrorMesh mesh[2];
+  mdBarrier barrier;
+  mdErrorThread thread[MD_THREAD_COUNT_MAX];
+};
+
+
+static inline void mdErrorTriangle( mdErrorMesh *mesh, mdi triindex, mdf **p0, mdf **p1, mdf **p2 )
+{
+  mdi *tri;
+  tri = &mesh->indices3[ 3 * (size_t)triindex ];
+  *p0 = &mesh->point[ 3 * (size_t)tri[0] ];
+  *p1 = &mesh->point[ 3 * (size_t)tri[1] ];
+  *p2 = &mesh->point[ 3 * (size_t)tri[2] ];
+  return;
+}
+
+/* Place the triangle with the median centroid along axis at trilist[mid], lower ones before and higher ones after */
+static void mdErrorSelectMedian( mdErrorMesh *mesh, mdi *trilist, mdi count, mdi mid, int axis )
+{
+  mdi left, right, i, j, t;
+  mdf pivot, a, b, c;
+  left = 0;
+  right = count - 1;
+  while( right > left )
+  {
+    a = mesh->centroid[ 3 * (size_t)trilist[left] + axis ];
+    b = mesh->centroid[ 3 * (size_t)trilist[(left+right)>>1] + axis ];
+    c = mesh->centroid[ 3 * (size_t)trilist[right] + axis ];
+    pivot = mdfmax( mdfmin( a, b ), mdfmin( mdfmax( a, b ), c ) );
+    i = left;
+    j = right;
+    for( ; ; )
+    {
+      while( mesh->centroid[ 3 * (size_t)trilist[i] + axis ] < pivot )
+        i++;
+      while( mesh->centroid[ 3 * (size_t)trilist[j] + axis ] > pivot )
+        j--;
+      if( i > j )
+        break;
+      t = trilist[i];
+      trilist[i] = trilist[j];
+      trilist[j] = t;
+      i++;
+      j--;
+      if( i > j )
+        break;
+    }
+    if( mid <= j )
+      right = j;
+    else if( mid >= i )
+      left = i;
+    else
+      break;
+  }
+  return;
+}
+
+/* Pick the split axis as the largest extent of the triangle centroids */
+static int mdErrorSplitAxis( mdErrorMesh *mesh, mdi base, mdi count )
+{
+  int axis;
+  mdi index;
+  mdf *c;
+  mdf cmin[3], cmax[3];
+  c = &mesh->centroid[ 3 * (size_t)mesh->trilist[base] ];
+  cmin[0] = cmax[0] = c[0];
+  cmin[1] = cmax[1] = c[1];
+  cmin[2] = cmax[2] = c[2];
+  for( index = base + 1 ; index < base + count ; index++ )
+  {
+    c = &mesh->centroid[ 3 * (size_t)mesh->trilist[index] ];
+    cmin[0] = mdfmin( cmin[0], c[0] );
+    cmin[1] = mdfmin( cmin[1], c[1] );
+    cmin[2] = mdfmin( cmin[2], c[2] );
+    cmax[0] = mdfmax( cmax[0], c[0] );
+    cmax[1] = mdfmax( cmax[1], c[1] );
+    cmax[2] = mdfmax( cmax[2], c[2] );
+  }
+  axis = 0;
+  if( ( cmax[1] - cmin[1] ) > ( cmax[axis] - cmin[axis] ) )
+    axis = 1;
+  if( ( cmax[2] - cmin[2] ) > ( cmax[axis] - cmin[axis] ) )
+    axis = 2;
+  return axis;
+}
+
+/* Build the subtree for trilist[base,base+count), which uses at most 2*count-1 nodes starting at nodeindex */
+static void mdErrorBuildTree( mdErrorMesh *mesh, mdi nodeindex, mdi base, mdi count )
+{
+  int axis;
+  mdi index, mid;
+  mdf *p0, *p1, *p2;
+  mdErrorNode *node;
+
+  node = &mesh->node[nodeindex];
+  if( count <= MD_ERROR_BVH_LEAF_SIZE )
+  {
+    node->min[0] = node->min[1] = node->min[2] = FLT_MAX;
+    node->max[0] = node->max[1] = node->max[2] = -FLT_MAX;
+    for( index = base ; index < base + count ; index++ )
+    {
+      mdErrorTriangle( mesh, mesh->trilist[index], &p0, &p1, &p2 );
+      node->min[0] = mdfmin( node->min[0], mdfmin( p0[0], mdfmin( p1[0], p2[0] ) ) );
+      node->min[1] = mdfmin( node->min[1], mdfmin( p0[1], mdfmin( p1[1], p2[1] ) ) );
+      node->min[2] = mdfmin( node->min[2], mdfmin( p0[2], mdfmin( p1[2], p2[2] ) ) );
+      node->max[0] = mdfmax( node->max[0], mdfmax( p0[0], mdfmax( p1[0], p2[0] ) ) );
+      node->max[1] = mdfmax( node->max[1], mdfmax( p0[1], mdfmax( p1[1], p2[1] ) ) );
+      node->max[2] = mdfmax( node->max[2], mdfmax( p0[2], mdfmax( p1[2], p2[2] ) ) );
+    }
+    node->index = base;
+    node->tricount = (int)count;
+    return;
+  }
+
+  axis = mdErrorSplitAxis( mesh, base, count );
+  mid = count >> 1;
+  mdErrorSelectMedian( mesh, &mesh->trilist[base], count, mid, axis );
+  node->index = nodeindex + 2 * mid;
+  node->tricount = 0;
+  mdErrorBuildTree( mesh, nodeindex + 1, base, mid );
+  mdErrorBuildTree( mesh, node->index, base + mid, count - mid );
+
+  node->min[0] = mdfmin( mesh->node[nodeindex+1].min[0], mesh->node[node->index].min[0] );
+  node->min[1] = mdfmin( mesh->node[nodeindex+1].min[1], mesh->node[node->index].min[1] );
+  node->min[2] = mdfmin( mesh->node[nodeindex+1].min[2], mesh->node[node->index].min[2] );
+  node->max[0] = mdfmax( mesh->node[nodeindex+1].max[0], mesh->node[node->index].max[0] );
+  node->max[1] = mdfmax( mesh->node[nodeindex+1].max[1], mesh->node[node->index].max[1] );
+  node->max[2] = mdfmax( mesh->node[nodeindex+1].max[2], mesh->node[node->index].max[2] );
+  return;
+}
+
+/* Split the top levels of the tree, leaving subtrees of near identical sizes as tasks for all threads */
+static void mdErrorBuildTop( mdErrorMesh *mesh, mdi nodeindex, mdi base, mdi count, int depth )
+{
+  int axis;
+  mdi mid;
+  mdErrorNode *node;
+  mdErrorTask *task;
+
+  if( ( depth <= 0 ) || ( count <= MD_ERROR_BVH_LEAF_SIZE ) )
+  {
+    task = &mesh->tasklist[ mesh->taskcount++ ];
+    task->nodeindex = nodeindex;
+    task->base = base;
+    task->count = count;
+    return;
+  }
+  node = &mesh->node[nodeindex];
+  axis = mdErrorSplitAxis( mesh, base, count );
+  mid = count >> 1;
+  mdErrorSelectMedian( mesh, &mesh->trilist[base], count, mid, axis );
+  node->index = nodeindex + 2 * mid;
+  node->tricount = -1;
+  mdErrorBuildTop( mesh, nodeindex + 1, base, mid, depth - 1 );
+  mdErrorBuildTop( mesh, node->index, base + mid, count - mid, depth - 1 );
+  return;
+}
+
+static void mdErrorRefitTop( mdErrorMesh *mesh, mdi nodeindex )
+{
+  mdErrorNode *node, *child0, *child1;
+  node = &mesh->node[nodeindex];
+  if( node->tricount != -1 )
+    return;
+  mdErrorRefitTop( mesh, nodeindex + 1 );
+  mdErrorRefitTop( mesh, node->index );
+  child0 = &mesh->node[nodeindex+1];
+  child1 = &mesh->node[node->index];
+  node->min[0] = mdfmin( child0->min[0], child1->min[0] );
+  node->min[1] = mdfmin( child0->min[1], child1->min[1] );
+  node->min[2] = mdfmin( child0->min[2], child1->min[2] );
+  node->max[0] = mdfmax( child0->max[0], child1->max[0] );
+  node->max[1] = mdfmax( child0->max[1], child1->max[1] );
+  node->max[2] = mdfmax( child0->max[2], child1->max[2] );
+  node->tricount = 0;
+  return;
+}
+
+
+////
+
+
+static inline mdf mdErrorBoxDistance2( mdErrorNode *node, mdf *point )
+{
+  mdf d, dist2;
+  dist2 = 0.0;
+  d = mdfmax( node->min[0] - point[0], mdfmax( (mdf)0.0, point[0] - node->max[0] ) );
+  dist2 += d * d;
+  d = mdfmax( node->min[1] - point[1], mdfmax( (mdf)0.0, point[1] - node->max[1] ) );
+  dist2 += d * d;
+  d = mdfmax( node->min[2] - point[2], mdfmax( (mdf)0.0, point[2] - node->max[2] ) );
+  dist2 += d * d;
+  return dist2;
+}
+
+/* Squared distance from point to the closest point on triangle, by Voronoi regions of the triangle */
+static mdf mdErrorTriangleDistance2( mdf *point, mdf *a, mdf *b, mdf *c )
+{
+  mdf ab[3], ac[3], ap[3], bp[3], cp[3], closest[3], delta[3];
+  mdf d1, d2, d3, d4, d5, d6, va, vb, vc, v, w, denom;
+
+  MD_VectorSubStore( ab, b, a );
+  MD_VectorSubStore( ac, c, a );
+  MD_VectorSubStore( ap, point, a );
+  d1 = MD_VectorDotProduct( ab, ap );
+  d2 = MD_VectorDotProduct( ac, ap );
+  if( ( d1 <= 0.0 ) && ( d2 <= 0.0 ) )
+  {
+    MD_VectorCopy( closest, a );
+    goto done;
+  }
+  MD_VectorSubStore( bp, point, b );
+  d3 = MD_VectorDotProduct( ab, bp );
+  d4 = MD_VectorDotProduct( ac, bp );
+  if( ( d3 >= 0.0 ) && ( d4 <= d3 ) )
+  {
+    MD_VectorCopy( closest, b );
+    goto done;
+  }
+  vc = ( d1 * d4 ) - ( d3 * d2 );
+  if( ( vc <= 0.0 ) && ( d1 >= 0.0 ) && ( d3 <= 0.0 ) )
+  {
+    v = d1 / ( d1 - d3 );
+    closest[0] = a[0] + ( v * ab[0] );
+    closest[1] = a[1] + ( v * ab[1] );
+    closest[2] = a[2] + ( v * ab[2] );
+    goto done;
+  }
+  MD_VectorSubStore( cp, point, c );
+  d5 = MD_VectorDotProduct( ab, cp );
+  d6 = MD_VectorDotProduct( ac, cp );
+  if( ( d6 >= 0.0 ) && ( d5 <= d6 ) )
+  {
+    MD_VectorCopy( closest, c );
+    goto done;
+  }
+  vb = ( d5 * d2 ) - ( d1 * d6 );
+  if( ( vb <= 0.0 ) && ( d2 >= 0.0 ) && ( d6 <= 0.0 ) )
+  {
+    w = d2 / ( d2 - d6 );
+    closest[0] = a[0] + ( w * ac[0] );
+    closest[1] = a[1] + ( w * ac[1] );
+    closest[2] = a[2] + ( w * ac[2] );
+    goto done;
+  }
+  va = ( d3 * d6 ) - ( d5 * d4 );
+  if( ( va <= 0.0 ) && ( ( d4 - d3 ) >= 0.0 ) && ( ( d5 - d6 ) >= 0.0 ) )
+  {
+    w = ( d4 - d3 ) / ( ( d4 - d3 ) + ( d5 - d6 ) );
+    closest[0] = b[0] + ( w * ( c[0] - b[0] ) );
+    closest[1] = b[1] + ( w * ( c[1] - b[1] ) );
+    closest[2] = b[2] + ( w * ( c[2] - b[2] ) );
+    goto done;
+  }
+  denom = va + vb + vc;
+  /* Degenerate triangle, fall back to the nearest vertex */
+  if( !( denom > 0.0 ) )
+  {
+    MD_VectorSubStore( delta, point, a );
+    d1 = MD_VectorDotProduct( delta, delta );
+    MD_VectorSubStore( delta, point, b );
+    d1 = mdfmin( d1, MD_VectorDotProduct( delta, delta ) );
+    MD_VectorSubStore( delta, point, c );
+    return mdfmin( d1, MD_VectorDotProduct( delta, delta ) );
+  }
+  denom = 1.0 / denom;
+  v = vb * denom;
+  w = vc * denom;
+  closest[0] = a[0] + ( ab[0] * v ) + ( ac[0] * w );
+  closest[1] = a[1] + ( ab[1] * v ) + ( ac[1] * w );
+  closest[2] = a[2] + ( ab[2] * v ) + ( ac[2] * w );
+
+  done:
+  MD_VectorSubStore( delta, point, closest );
+  return MD_VectorDotProduct( delta, delta );
+}
+
+/* Return the distance from point to the closest triangle of mesh, hint is the previous closest triangle or -1 */
+static mdf mdErrorClosestDistance( mdErrorMesh *mesh, mdf *point, mdi *hint )
+{
+  int stackdepth;
+  mdi index, nodeindex, near, far;
+  mdf best, dist2, neardist2, fardist2;
+  mdf *p0, *p1, *p2;
+  mdErrorNode *node;
+  mdi stacknode[MD_ERROR_BVH_STACK_SIZE];
+  mdf stackdist2[MD_ERROR_BVH_STACK_SIZE];
+
+  best = FLT_MAX;
+  if( *hint >= 0 )
+  {
+    mdErrorTriangle( mesh, *hint, &p0, &p1, &p2 );
+    best = mdErrorTriangleDistance2( point, p0, p1, p2 );
+  }
+
+  stacknode[0] = 0;
+  stackdist2[0] = 0.0;
+  stackdepth = 1;
+  while( stackdepth )
+  {
+    stackdepth--;
+    if( stackdist2[stackdepth] >= best )
+      continue;
+    nodeindex = stacknode[stackdepth];
+    for( ; ; )
+    {
+      node = &mesh->node[nodeindex];
+      if( node->tricount )
+      {
+        for( index = node->index ; index < node->index + node->tricount ; index++ )
+        {
+          mdErrorTriangle( mesh, mesh->trilist[index], &p0, &p1, &p2 );
+          dist2 = mdErrorTriangleDistance2( point, p0, p1, p2 );
+          if( dist2 < best )
+          {
+            best = dist2;
+            *hint = mesh->trilist[index];
+          }
+        }
+        break;
+      }
+      near = nodeindex + 1;
+      far = node->index;
+      neardist2 = mdErrorBoxDistance2( &mesh->node[near], point );
+      fardist2 = mdErrorBoxDistance2( &mesh->node[far], point );
+      if( fardist2 < neardist2 )
+      {
+        near = node->index;
+        far = nodeindex + 1;
+        dist2 = neardist2;
+        neardist2 = fardist2;
+        fardist2 = dist2;
+      }
+      if( neardist2 >= best )
+        break;
+      if( fardist2 < best )
+      {
+        stacknode[stackdepth] = far;
+        stackdist2[stackdepth] = fardist2;
+        stackdepth++;
+      }
+      nodeindex = near;
+    }
+  }
+
+  return mdfsqrt( best );
+}
 
-  /* Synchronization */
-  mdBarrierInit( &mesh->workbarrier, threadcount );
 
-  /* Determine update buffer shift required, find the count of updatebuffers */
-  for( mesh->updatebuffershift = 0 ; ( threadcount >> mesh->updatebuffershift ) > MD_THREAD_UPDATE_BUFFER_COUNTMAX ; mesh->updatebuffershift++ );
-  mesh->updatebuffercount = ( ( threadcount - 1 ) >> mesh->updatebuffershift ) + 1;
+////
 
-  /* Runtime picking of collapse penalty computation path */
-  mesh->collapsepenalty = mdEdgeCollapsePenaltyTriangle;
-#if CPU_SSE_SUPPORT && 1
- #if !MD_CONF_DOUBLE_PRECISION
-  #if CPU_SSE4_1_SUPPORT
-    mesh->collapsepenalty = mdEdgeCollapsePenaltyTriangleSSE4p1f;
-  #elif CPU_SSE3_SUPPORT
-    mesh->collapsepenalty = mdEdgeCollapsePenaltyTriangleSSE3f;
-  #elif CPU_SSE2_SUPPORT
-    mesh->collapsepenalty = mdEdgeCollapsePenaltyTriangleSSE2f;
-  #endif
- #else
-  #if CPU_SSE4_1_SUPPORT
-    mesh->collapsepenalty = mdEdgeCollapsePenaltyTriangleSSE4p1d;
-  #elif CPU_SSE3_SUPPORT
-    mesh->collapsepenalty = mdEdgeCollapsePenaltyTriangleSSE3d;
-  #elif CPU_SSE2_SUPPORT
-    mesh->collapsepenalty = mdEdgeCollapsePenaltyTriangleSSE2d;
-  #endif
- #endif
-#endif
 
-  /* Finish status tracking */
-  mesh->finishcount = threadcount;
-  mtMutexInit( &mesh->finishmutex );
-  mtSignalInit( &mesh->finishsignal );
+static void mdErrorMeshPrepare( mdErrorThread *thread, mdErrorMesh *mesh, int meshindex )
+{
+  int threadindex, threadcount;
+  mdi triindex, triend, vertexindex, vertexend;
+  mdi *tri;
 
-  /* Initialize entire mesh storage */
-  mesh->vertexalloc = operation->vertexalloc;
-  if( mesh->vertexalloc < mesh->vertexcount )
-    mesh->vertexalloc = mesh->vertexcount;
-  if( !( mdMeshInit( mesh, operation->maxmemoryusage ) ) )
-  {
-    mdMeshDecimationFree( state );
-    return 0;
-  }
+  threadindex = thread->threadindex;
+  threadcount = thread->state->threadcount;
 
-  /* Initialize thread init data */
-  for( threadindex = 0 ; threadindex < mesh->threadcount ; threadindex++ )
+  vertexindex = (mdi)( ( mesh->vertexcount * threadindex ) / threadcount );
+  vertexend = (mdi)( ( mesh->vertexcount * ( threadindex + 1 ) ) / threadcount );
+  if( vertexindex < vertexend )
   {
-    tinit = &state->threadinit[threadindex];
-    tinit->threadid = threadindex;
-    tinit->mesh = mesh;
-    tinit->stage = MD_STATUS_STAGE_INIT;
-    tinit->tdata = 0;
+    mdVertexBlockUserToNative( &mesh->point[ 3 * (size_t)vertexindex ], ADDRESS( mesh->vertex, vertexindex * mesh->vertexstride ), mesh->vertexstride, vertexend - vertexindex, 1.0, mesh->vertexformat, mesh->vertexUserToNative );
+    memset( &mesh->vertexused[vertexindex], 0, vertexend - vertexindex );
   }
 
-  /* Status update */
-  mesh->updatestatusflag = 0;
-  status->progress = 0.0;
-  status->stage = MD_STATUS_STAGE_INIT;
-  status->trianglecount = mesh->tricount;
-  if( operation->statuscallback )
+  thread->areasum[meshindex] = 0.0;
+  triindex = (mdi)( ( mesh->tricount * threadindex ) / threadcount );
+  triend = (mdi)( ( mesh->tricount * ( threadindex + 1 ) ) / threadcount );
+  if( triindex < triend )
+    mdIndicesBlockUserToNative( &mesh->indices3[ 3 * (size_t)triindex ], ADDRESS( mesh->indices, triindex * mesh->indicesstride ), mesh->indicesstride, triend - triindex, mesh->indicesformat, mesh->indicesUserToNative );
+  for( ; triindex < triend ; triindex++ )
   {
-    mesh->updatestatusflag = 1;
-    mdUpdateStatus( mesh, state->threadinit, status );
-    operation->statuscallback( operation->statuscontext, status );
+    tri = &mesh->indices3[ 3 * (size_t)triindex ];
+    mesh->trilist[triindex] = triindex;
+    if( ( (size_t)tri[0] >= mesh->vertexcount ) || ( (size_t)tri[1] >= mesh->vertexcount ) || ( (size_t)tri[2] >= mesh->vertexcount ) || ( tri[0] < 0 ) || ( tri[1] < 0 ) || ( tri[2] < 0 ) )
+    {
+      thread->invalidflag = 1;
+      tri[0] = tri[1] = tri[2] = 0;
+    }
   }
+  return;
+}
 
-  return state;
-
-  /* Free all global data */
-  error:
-  free( state );
-  return 0;
+/* Second pass over triangles, once all vertices have been converted */
+static void mdErrorMeshTriangles( mdErrorThread *thread, mdErrorMesh *mesh, int meshindex )
+{
+  int threadindex, threadcount;
+  mdi triindex, triend;
+  mdf area, areasum;
+  mdf *p0, *p1, *p2, *c;
+  mdf e0[3], e1[3], normal[3];
+
+  threadindex = thread->threadindex;
+  threadcount = thread->state->threadcount;
+
+  areasum = 0.0;
+  triindex = (mdi)( ( mesh->tricount * threadindex ) / threadcount );
+  triend = (mdi)( ( mesh->tricount * ( threadindex + 1 ) ) / threadcount );
+  for( ; triindex < triend ; triindex++ )
+  {
+    mdErrorTriangle( mesh, triindex, &p0, &p1, &p2 );
+    c = &mesh->centroid[ 3 * (size_t)triindex ];
+    c[0] = ( p0[0] + p1[0] + p2[0] ) * (1.0/3.0);
+    c[1] = ( p0[1] + p1[1] + p2[1] ) * (1.0/3.0);
+    c[2] = ( p0[2] + p1[2] + p2[2] ) * (1.0/3.0);
+    MD_VectorSubStore( e0, p1, p0 );
+    MD_VectorSubStore( e1, p2, p0 );
+    MD_VectorCrossProduct( normal, e0, e1 );
+    area = 0.5 * mdfsqrt( MD_VectorDotProduct( normal, normal ) );
+    areasum += area;
+    mesh->areasum[triindex+1] = area;
+  }
+  thread->areasum[meshindex] = areasum;
+  return;
 }
 
-/* Perform the work for specified thread, must be called synchronously for all threadcount */
-void mdMeshDecimationThread( mdState *state, int threadindex )
+/* Turn the per-triangle areas into a prefix sum, offset by the sums of preceding threads */
+static void mdErrorMeshAreaPrefix( mdErrorThread *thread, mdErrorMesh *mesh, int meshindex )
 {
-  mdMesh *mesh;
-  mdThreadInit *tinit;
-  mesh = &state->mesh;
-  if( threadindex < mesh->threadcount )
+  int threadindex, threadcount, index;
+  mdi triindex, triend;
+  mdf areasum;
+  mdErrorState *state;
+
+  state = thread->state;
+  threadindex = thread->threadindex;
+  threadcount = state->threadcount;
+
+  areasum = 0.0;
+  for( index = 0 ; index < threadindex ; index++ )
+    areasum += state->thread[index].areasum[meshindex];
+  if( !( threadindex ) )
+    mesh->areasum[0] = 0.0;
+  triindex = (mdi)( ( mesh->tricount * threadindex ) / threadcount );
+  triend = (mdi)( ( mesh->tricount * ( threadindex + 1 ) ) / threadcount );
+  for( ; triindex < triend ; triindex++ )
   {
-    tinit = &state->threadinit[threadindex];
-    tinit->threadid = threadindex;
-    tinit->mesh = mesh;
-    tinit->stage = MD_STATUS_STAGE_INIT;
-    tinit->tdata = 0;
-    mdThreadMain( tinit );
+    areasum += mesh->areasum[triindex+1];
+    mesh->areasum[triindex+1] = areasum;
   }
   return;
 }
 
-/* Wait until the work has completed */
-void mdMeshDecimationEnd( mdState *state )
+/* Sample the surface of mesh, measuring distances to the surface of target */
+static void mdErrorSampleMesh( mdErrorThread *thread, mdErrorMesh *mesh, mdErrorMesh *target, int direction )
 {
-  int threadid, threadcount;
-  long statuswait;
-  mdOperation *operation;
-  mdMesh *mesh;
-  mdThreadInit *threadinit;
-  mdStatus *status;
-  mdThreadInit *tinit;
+  int threadindex, threadcount;
+  mdi lo, hi, mid, hint;
+  size_t sampleindex, sampleend, samplecount, vertexindex, vertexend;
+  mdf totalarea, position, u, v, dist;
+  mdf *p0, *p1, *p2;
+  mdf point[3];
+  double maxdistance, sum, sumsq;
 
-  operation = state->operation;
-  mesh = &state->mesh;
-  threadinit = state->threadinit;
-  status = &state->status;
+  threadindex = thread->threadindex;
+  threadcount = thread->state->threadcount;
 
-  threadcount = mesh->threadcount;
-  statuswait = ( operation->statusmilliseconds > 2 ? operation->statusmilliseconds : 2 );
+  hint = -1;
+  maxdistance = 0.0;
 
-  /* Wait for all threads to complete */
-#if MD_CONF_ENABLE_PROGRESS
-  if( !( mesh->updatestatusflag ) )
+  /* Vertices, they only contribute to the maximum distance unless the surface has no area */
+  sum = 0.0;
+  sumsq = 0.0;
+  vertexindex = ( mesh->vertexcount * threadindex ) / threadcount;
+  vertexend = ( mesh->vertexcount * ( threadindex + 1 ) ) / threadcount;
+  for( ; vertexindex < vertexend ; vertexindex++ )
   {
-    mtMutexLock( &mesh->finishmutex );
-    while( mesh->finishcount )
-      mtSignalWait( &mesh->finishsignal, &mesh->finishmutex );
-    mtMutexUnlock( &mesh->finishmutex );
-  }
-  else
+    if( !( mesh->vertexused[vertexindex] ) )
+      continue;
+    dist = mdErrorClosestDistance( target, &mesh->point[ 3 * vertexindex ], &hint );
+    maxdistance = fmax( maxdistance, dist );
+    sum += dist;
+    sumsq += dist * dist;
+    thread->vertexcount[direction]++;
+  }
+  thread->vertexsum[direction] = sum;
+  thread->vertexsumsq[direction] = sumsq;
+
+  /* Stratified area-weighted samples, barycentric coordinates from the R2 low-discrepancy sequence */
+  sum = 0.0;
+  sumsq = 0.0;
+  totalarea = mesh->areasum[mesh->tricount];
+  samplecount = ( totalarea > 0.0 ? thread->state->samplecount : 0 );
+  sampleindex = ( samplecount * threadindex ) / threadcount;
+  sampleend = ( samplecount * ( threadindex + 1 ) ) / threadcount;
+  for( ; sampleindex < sampleend ; sampleindex++ )
+  {
+    position = ( ( (mdf)sampleindex + 0.5 ) / (mdf)samplecount ) * totalarea;
+    lo = 0;
+    hi = (mdi)mesh->tricount - 1;
+    while( lo < hi )
+    {
+      mid = ( lo + hi + 1 ) >> 1;
+      if( mesh->areasum[mid] <= position )
+        lo = mid;
+      else
+        hi = mid - 1;
+    }
+    u = 0.5 + ( (mdf)sampleindex * 0.7548776662466927 );
+    v = 0.5 + ( (mdf)sampleindex * 0.5698402909980532 );
+    u -= mdffloor( u );
+    v -= mdffloor( v );
+    if( ( u + v ) > 1.0 )
+    {
+      u = 1.0 - u;
+      v = 1.0 - v;
+    }
+    mdErrorTriangle( mesh, lo, &p0, &p1, &p2 );
+    point[0] = p0[0] + ( u * ( p1[0] - p0[0] ) ) + ( v * ( p2[0] - p0[0] ) );
+    point[1] = p0[1] + ( u * ( p1[1] - p0[1] ) ) + ( v * ( p2[1] - p0[1] ) );
+    point[2] = p0[2] + ( u * ( p1[2] - p0[2] ) ) + ( v * ( p2[2] - p0[2] ) );
+    dist = mdErrorClosestDistance( target, point, &hint );
+    maxdistance = fmax( maxdistance, dist );
+    sum += dist;
+    sumsq += dist * dist;
+  }
+  thread->maxdistance[direction] = maxdistance;
+  thread->sum[direction] = sum;
+  thread->sumsq[direction] = sumsq;
+  thread->count[direction] = sampleend - ( ( samplecount * threadindex ) / threadcount );
+
+  return;
+}
+
+static void *mdErrorThreadMain( void *value )
+{
+  int index, meshindex, threadindex, threadcount, invalidflag;
+  mdi *tri;
+  mdi triindex;
+  mdErrorThread *thread;
+  mdErrorState *state;
+  mdErrorMesh *mesh;
+  mdErrorTask *task;
+
+  thread = (mdErrorThread *)value;
+  state = thread->state;
+  threadindex = thread->threadindex;
+  threadcount = state->threadcount;
+
+  /* Convert user data to native */
+  for( meshindex = 0 ; meshindex < 2 ; meshindex++ )
+    mdErrorMeshPrepare( thread, &state->mesh[meshindex], meshindex );
+  mdBarrierSync( &state->barrier );
+  invalidflag = 0;
+  for( index = 0 ; index < threadcount ; index++ )
+    invalidflag |= state->thread[index].invalidflag;
+  if( invalidflag )
+    return 0;
+
+  /* Centroids and areas of triangles */
+  for( meshindex = 0 ; meshindex < 2 ; meshindex++ )
+    mdErrorMeshTriangles( thread, &state->mesh[meshindex], meshindex );
+  mdBarrierSync( &state->barrier );
+
+  /* Area prefix sums ; one thread splits the top of the trees and flags the used vertices */
+  for( meshindex = 0 ; meshindex < 2 ; meshindex++ )
+    mdErrorMeshAreaPrefix( thread, &state->mesh[meshindex], meshindex );
+  if( !( threadindex ) )
   {
-    mtMutexLock( &mesh->finishmutex );
-    while( mesh->finishcount )
+    for( meshindex = 0 ; meshindex < 2 ; meshindex++ )
     {
-      mdUpdateStatus( mesh, threadinit, status );
-      operation->statuscallback( operation->statuscontext, status );
-      mtSignalWaitTimeout( &mesh->finishsignal, &mesh->finishmutex, statuswait );
+      mesh = &state->mesh[meshindex];
+      mdErrorBuildTop( mesh, 0, 0, (mdi)mesh->tricount, state->taskdepth );
+      tri = mesh->indices3;
+      for( triindex = 0 ; triindex < (mdi)mesh->tricount ; triindex++, tri += 3 )
+      {
+        mesh->vertexused[tri[0]] = 1;
+        mesh->vertexused[tri[1]] = 1;
+        mesh->vertexused[tri[2]] = 1;
+      }
     }
-    mtMutexUnlock( &mesh->finishmutex );
   }
-#else
-  mtMutexLock( &mesh->finishmutex );
-  while( mesh->finishcount )
-    mtSignalWait( &barrier->signal, &barrier->mutex );
-  mtMutexUnlock( &mesh->finishmutex );
-#endif
+  mdBarrierSync( &state->barrier );
 
-  /* Count sums of all threads */
-  operation->decimationcount = 0;
-  operation->collisioncount = 0;
-  tinit = threadinit;
-  for( threadid = 0 ; threadid < threadcount ; threadid++, tinit++ )
+  /* Build subtrees, median splits keep all tasks of similar sizes */
+  for( meshindex = 0 ; meshindex < 2 ; meshindex++ )
   {
-    operation->decimationcount += tinit->decimationcount;
-    operation->collisioncount += tinit->collisioncount;
+    mesh = &state->mesh[meshindex];
+    for( index = threadindex ; index < mesh->taskcount ; index += threadcount )
+    {
+      task = &mesh->tasklist[index];
+      mdErrorBuildTree( mesh, task->nodeindex, task->base, task->count );
+    }
   }
-
-  if( mesh->updatestatusflag )
+  mdBarrierSync( &state->barrier );
+  if( !( threadindex ) )
   {
-    threadinit->stage = MD_STATUS_STAGE_STORE;
-    mdUpdateStatus( mesh, threadinit, status );
-    operation->statuscallback( operation->statuscontext, status );
+    mdErrorRefitTop( &state->mesh[0], 0 );
+    mdErrorRefitTop( &state->mesh[1], 0 );
   }
+  mdBarrierSync( &state->barrier );
 
-  /* Write out the final mesh */
-  if( ( mesh->normalbase ) && ( mesh->writenormal ) )
-    mdMeshWriteVerticesAndNormals( mesh );
-  else
-    mdMeshWriteVertices( mesh );
-  mdMeshWriteIndices( mesh );
-  operation->vertexcount = mesh->vertexpackcount;
-  operation->tricount = mesh->tripackcount;
+  /* Forward : measured mesh to reference ; backward : reference to measured mesh */
+  mdErrorSampleMesh( thread, &state->mesh[1], &state->mesh[0], 0 );
+  mdErrorSampleMesh( thread, &state->mesh[0], &state->mesh[1], 1 );
 
-  if( mesh->updatestatusflag )
-  {
-    threadinit->stage = MD_STATUS_STAGE_DONE;
-    mdUpdateStatus( mesh, state->threadinit, status );
-    operation->statuscallback( operation->statuscontext, status );
-  }
+  return 0;
+}
 
-  /* Requires mmhash.c compiled with MM_HASH_DEBUG_STATISTICS */
-#if MM_HASH_DEBUG_STATISTICS
-  mmHashPrintStatistics( mesh->edgehashtable );
-#endif
+static int mdErrorMeshInit( mdErrorMesh *mesh, size_t vertexcount, void *vertex, int vertexformat, size_t vertexstride, size_t tricount, void *indices, int indicesformat, size_t indicesstride, int tasklimit )
+{
+  void (*indicesNativeToUser)( void *dst, mdi *src );
+  void (*vertexNativeToUser)( void *dst, mdf *src, mdf factor );
 
-  mdMeshDecimationFree( state );
-  /* Store total processing time */
-  operation->msecs = mmGetMillisecondsTime() - operation->msecs;
+  memset( mesh, 0, sizeof(mdErrorMesh) );
+  if( !( vertexcount ) || !( tricount ) || !( vertex ) || !( indices ) )
+    return 0;
+  if( !( mdIndicesFormatFunctions( indicesformat, &mesh->indicesUserToNative, &indicesNativeToUser ) ) )
+    return 0;
+  if( !( mdVertexFormatFunctions( vertexformat, &mesh->vertexUserToNative, &vertexNativeToUser ) ) )
+    return 0;
+  mesh->vertexcount = vertexcount;
+  mesh->vertex = vertex;
+  mesh->vertexformat = vertexformat;
+  mesh->vertexstride = vertexstride;
+  mesh->tricount = tricount;
+  mesh->indices = indices;
+  mesh->indicesformat = indicesformat;
+  mesh->indicesstride = indicesstride;
+  mesh->point = malloc( 3 * vertexcount * sizeof(mdf) );
+  mesh->vertexused = malloc( vertexcount * sizeof(char) );
+  mesh->indices3 = malloc( 3 * tricount * sizeof(mdi) );
+  mesh->centroid = malloc( 3 * tricount * sizeof(mdf) );
+  mesh->areasum = malloc( ( tricount + 1 ) * sizeof(mdf) );
+  mesh->trilist = malloc( tricount * sizeof(mdi) );
+  mesh->node = malloc( 2 * tricount * sizeof(mdErrorNode) );
+  mesh->tasklist = malloc( tasklimit * sizeof(mdErrorTask) );
+  mesh->taskcount = 0;
+  if( !( mesh->point ) || !( mesh->vertexused ) || !( mesh->indices3 ) || !( mesh->centroid ) || !( mesh->areasum ) || !( mesh->trilist ) || !( mesh->node ) || !( mesh->tasklist ) )
+    return 0;
+  return 1;
+}
 
+static void mdErrorMeshFree( mdErrorMesh *mesh )
+{
+  free( mesh->point );
+  free( mesh->vertexused );
+  free( mesh->indices3 );
+  free( mesh->centroid );
+  free( mesh->areasum );
+  free( mesh->trilist );
+  free( mesh->node );
+  free( mesh->tasklist );
   return;
 }
 
@@ -6444,55 +11473,166 @@ void mdMeshDecimationEnd( mdState *state )
 ////
 
 
-typedef struct
+void mdErrorOperationInit( mdErrorOperation *errop )
 {
-  mdState *state;
-  int threadindex;
-} mdMeshDecimationThreadLaunch;
+  memset( errop, 0, sizeof(mdErrorOperation) );
+  mmInit();
+  return;
+}
 
-static void *mdMeshDecimationThreadMain( void *value )
+void mdErrorOperationReference( mdErrorOperation *errop, size_t vertexcount, void *vertex, int vertexformat, size_t vertexstride, size_t tricount, void *indices, int indicesformat, size_t indicesstride )
 {
-  mdMeshDecimationThreadLaunch *threadlaunch;
-  threadlaunch = (mdMeshDecimationThreadLaunch *)value;
-  mdMeshDecimationThread( threadlaunch->state, threadlaunch->threadindex );
-  return 0;
+  errop->refvertexcount = vertexcount;
+  errop->refvertex = vertex;
+  errop->refvertexformat = vertexformat;
+  errop->refvertexstride = vertexstride;
+  errop->reftricount = tricount;
+  errop->refindices = indices;
+  errop->refindicesformat = indicesformat;
+  errop->refindicesstride = indicesstride;
+  return;
 }
 
-int mdMeshDecimation( mdOperation *operation, int threadcount, int flags )
+void mdErrorOperationData( mdErrorOperation *errop, size_t vertexcount, void *vertex, int vertexformat, size_t vertexstride, size_t tricount, void *indices, int indicesformat, size_t indicesstride )
 {
-  int threadindex, maxthreadcount;
-  mdState *state;
-  mtThread thread[MD_THREAD_COUNT_MAX];
-  mdMeshDecimationThreadLaunch threadlaunch[MD_THREAD_COUNT_MAX];
+  errop->vertexcount = vertexcount;
+  errop->vertex = vertex;
+  errop->vertexformat = vertexformat;
+  errop->vertexstride = vertexstride;
+  errop->tricount = tricount;
+  errop->indices = indices;
+  errop->indicesformat = indicesformat;
+  errop->indicesstride = indicesstride;
+  return;
+}
 
-  maxthreadcount = operation->tricount / 128;
-  if( maxthreadcount > MD_THREAD_COUNT_MAX )
-    maxthreadcount = MD_THREAD_COUNT_MAX;
-  if( maxthreadcount == 0 )
-    maxthreadcount = 1;
+int mdMeasureError( mdErrorOperation *errop, int threadcount, int flags )
+{
+  int threadindex, direction, tasklimit, retval;
+  size_t mintricount, count, vertexcount, totalcount;
+  double sum, sumsq, vertexsum, vertexsumsq, maxdistance;
+  double totalsum, totalsumsq;
+  mdErrorState *state;
+  mdErrorThread *thread;
+  mtThread threadid[MD_THREAD_COUNT_MAX];
+
+  errop->msecs = mmGetMillisecondsTime();
+  retval = 0;
+
+  mintricount = errop->tricount;
+  if( errop->reftricount < mintricount )
+    mintricount = errop->reftricount;
   if( threadcount <= 0 )
   {
-    threadcount = mmcore.cpucount;
+    threadcount = mmcore.cpuavailcount;
     if( threadcount <= 0 )
       threadcount = MD_THREAD_COUNT_DEFAULT;
   }
-  if( threadcount > maxthreadcount )
-    threadcount = maxthreadcount;
+  if( threadcount > MD_THREAD_COUNT_MAX )
+    threadcount = MD_THREAD_COUNT_MAX;
+  if( (size_t)threadcount > ( mintricount / 128 ) )
+    threadcount = ( mintricount >= 128 ? (int)( mintricount / 128 ) : 1 );
 
-  state = mdMeshDecimationInit( operation, threadcount, flags );
-  if( !state )
+  state = malloc( sizeof(mdErrorState) );
+  if( !( state ) )
     return 0;
+  memset( state, 0, sizeof(mdErrorState) );
+  state->threadcount = threadcount;
+  state->taskdepth = 0;
+  if( threadcount > 1 )
+  {
+    for( ; ( 1 << state->taskdepth ) < ( MD_ERROR_BVH_TASKS_PER_THREAD * threadcount ) ; )
+      state->taskdepth++;
+  }
+  tasklimit = 1 << state->taskdepth;
+  state->samplecount = errop->samplecount;
+  if( !( state->samplecount ) )
+  {
+    state->samplecount = ( errop->tricount > errop->reftricount ? errop->tricount : errop->reftricount );
+    if( state->samplecount < MD_ERROR_SAMPLE_COUNT_MIN )
+      state->samplecount = MD_ERROR_SAMPLE_COUNT_MIN;
+  }
+  if( !( mdErrorMeshInit( &state->mesh[0], errop->refvertexcount, errop->refvertex, errop->refvertexformat, errop->refvertexstride, errop->reftricount, errop->refindices, errop->refindicesformat, errop->refindicesstride, tasklimit ) ) )
+    goto end;
+  if( !( mdErrorMeshInit( &state->mesh[1], errop->vertexcount, errop->vertex, errop->vertexformat, errop->vertexstride, errop->tricount, errop->indices, errop->indicesformat, errop->indicesstride, tasklimit ) ) )
+    goto end;
+
+  mdBarrierInit( &state->barrier, threadcount );
   for( threadindex = 0 ; threadindex < threadcount ; threadindex++ )
   {
-    threadlaunch[threadindex].state = state;
-    threadlaunch[threadindex].threadindex = threadindex;
-    mtThreadCreate( &thread[threadindex], mdMeshDecimationThreadMain, &threadlaunch[threadindex], MT_THREAD_FLAGS_JOINABLE );
+    thread = &state->thread[threadindex];
+    thread->state = state;
+    thread->threadindex = threadindex;
+    mtThreadCreate( &threadid[threadindex], mdErrorThreadMain, thread, MT_THREAD_FLAGS_JOINABLE );
   }
-  mdMeshDecimationEnd( state );
   for( threadindex = 0 ; threadindex < threadcount ; threadindex++ )
-    mtThreadJoin( &thread[threadindex] );
-
-  return 1;
-}
+    mtThreadJoin( &threadid[threadindex] );
+  mdBarrierDestroy( &state->barrier );
 
+  for( threadindex = 0 ; threadindex < threadcount ; threadindex++ )
+  {
+    if( state->thread[threadindex].invalidflag )
+      goto end;
+  }
+
+  /* Reduce in thread order */
+  totalsum = 0.0;
+  totalsumsq = 0.0;
+  totalcount = 0;
+  errop->maxdistance = 0.0;
+  for( direction = 0 ; direction < 2 ; direction++ )
+  {
+    maxdistance = 0.0;
+    sum = 0.0;
+    sumsq = 0.0;
+    count = 0;
+    vertexsum = 0.0;
+    vertexsumsq = 0.0;
+    vertexcount = 0;
+    for( threadindex = 0 ; threadindex < threadcount ; threadindex++ )
+    {
+      thread = &state->thread[threadindex];
+      maxdistance = fmax( maxdistance, thread->maxdistance[direction] );
+      sum += thread->sum[direction];
+      sumsq += thread->sumsq[direction];
+      count += thread->count[direction];
+      vertexsum += thread->vertexsum[direction];
+      vertexsumsq += thread->vertexsumsq[direction];
+      vertexcount += thread->vertexcount[direction];
+    }
+    /* Surfaces without area only have vertex samples */
+    if( !( count ) )
+    {
+      sum = vertexsum;
+      sumsq = vertexsumsq;
+      count = vertexcount;
+    }
+    if( !( direction ) )
+    {
+      errop->forwardmax = maxdistance;
+      errop->forwardmean = ( count ? sum / (double)count : 0.0 );
+      errop->forwardrms = ( count ? sqrt( sumsq / (double)count ) : 0.0 );
+    }
+    else
+    {
+      errop->backwardmax = maxdistance;
+      errop->backwardmean = ( count ? sum / (double)count : 0.0 );
+      errop->backwardrms = ( count ? sqrt( sumsq / (double)count ) : 0.0 );
+    }
+    errop->maxdistance = fmax( errop->maxdistance, maxdistance );
+    totalsum += sum;
+    totalsumsq += sumsq;
+    totalcount += count;
+  }
+  errop->meandistance = ( totalcount ? totalsum / (double)totalcount : 0.0 );
+  errop->rmsdistance = ( totalcount ? sqrt( totalsumsq / (double)totalcount ) : 0.0 );
+  errop->samplecount = state->samplecount;
+  retval = 1;
 
+  end:
+  mdErrorMeshFree( &state->mesh[0] );
+  mdErrorMeshFree( &state->mesh[1] );
+  free( state );
+  errop->msecs = mmGetMillisecondsTime() - errop->msecs;
+  return retval;
+}
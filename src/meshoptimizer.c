@@ -37,6 +37,7 @@
 #include "mmthread.h"
 
 #include "mmatomic.h"
+#include "mmtrace.h"
 
 #include "meshoptimizer.h"
 
@@ -48,6 +49,11 @@
  #define MO_CONFIG_ATOMIC_SUPPORT (0)
 #endif
 
+#if __SSE2__ || _M_X64 || _M_IX86_FP >= 2  || CPU_ENABLE_SSE2
+ #include <emmintrin.h>
+ #define CPU_SSE2_SUPPORT (1)
+#endif
+
 
 
 #define MO_DEBUG (0)
@@ -73,6 +79,9 @@
 
 #define MO_TRIANGLE_PER_THREAD_MINIMUM (1024)
 
+/* Count of triangles converted at once between user indices and native indices */
+#define MO_CONVERT_BLOCK_SIZE (256)
+
 
 ////
 
@@ -157,6 +166,7 @@ struct moMesh
   uint32_t operationflags;
 
   void *indices;
+  int indiceswidth;
   size_t indicesstride;
   void (*indicesUserToNative)( moi *dst, void *src );
   void (*indicesNativeToUser)( void *dst, moi *src );
@@ -188,6 +198,9 @@ struct moMesh
   mtMutex finishmutex;
   mtSignal finishsignal;
 
+  /* Timeline trace of the run, null if no trace is active */
+  mmTraceRun *tracerun;
+
   moThreadInit threadinit[MO_THREAD_COUNT_MAX];
 };
 
@@ -269,6 +282,93 @@ static void moIndicesNativeToInt64( void *dst, moi *src )
 }
 
 
+static void moConvertUint16ToNative( moi *dst, uint16_t *src, size_t count )
+{
+  size_t index;
+#if CPU_SSE2_SUPPORT
+  __m128i vsrc, vzero;
+#endif
+  index = 0;
+#if CPU_SSE2_SUPPORT
+  vzero = _mm_setzero_si128();
+  for( ; index < ( count & ~(size_t)7 ) ; index += 8 )
+  {
+    vsrc = _mm_loadu_si128( (__m128i *)&src[index] );
+    _mm_storeu_si128( (__m128i *)&dst[index+0], _mm_unpacklo_epi16( vsrc, vzero ) );
+    _mm_storeu_si128( (__m128i *)&dst[index+4], _mm_unpackhi_epi16( vsrc, vzero ) );
+  }
+#endif
+  for( ; index < count ; index++ )
+    dst[index] = src[index];
+  return;
+}
+
+static void moConvertNativeToUint16( uint16_t *dst, moi *src, size_t count )
+{
+  size_t index;
+#if CPU_SSE2_SUPPORT
+  __m128i vbias32, vbias16, vlow, vhigh;
+#endif
+  index = 0;
+#if CPU_SSE2_SUPPORT
+  /* No unsigned saturation before SSE4.1, bias into the signed range and back */
+  vbias32 = _mm_set1_epi32( 32768 );
+  vbias16 = _mm_set1_epi16( (short)0x8000 );
+  for( ; index < ( count & ~(size_t)7 ) ; index += 8 )
+  {
+    vlow = _mm_sub_epi32( _mm_loadu_si128( (__m128i *)&src[index+0] ), vbias32 );
+    vhigh = _mm_sub_epi32( _mm_loadu_si128( (__m128i *)&src[index+4] ), vbias32 );
+    _mm_storeu_si128( (__m128i *)&dst[index], _mm_add_epi16( _mm_packs_epi32( vlow, vhigh ), vbias16 ) );
+  }
+#endif
+  for( ; index < count ; index++ )
+    dst[index] = (uint16_t)src[index];
+  return;
+}
+
+/* Convert count triangles from user indices of any stride to a tight native array */
+static void moIndicesBlockUserToNative( moi *dst, void *src, size_t srcstride, size_t count, int indiceswidth, void (*usertonative)( moi *dst, void *src ) )
+{
+  size_t index;
+  if( ( indiceswidth == sizeof(uint16_t) ) && ( srcstride == 3*sizeof(uint16_t) ) )
+    moConvertUint16ToNative( dst, src, 3*count );
+  else if( ( indiceswidth == sizeof(uint32_t) ) && ( srcstride == 3*sizeof(uint32_t) ) )
+    memcpy( dst, src, 3*count*sizeof(uint32_t) );
+  else if( indiceswidth == sizeof(uint32_t) )
+  {
+    for( index = 0 ; index < count ; index++, dst += 3, src = ADDRESS( src, srcstride ) )
+      moIndicesInt32ToNative( dst, src );
+  }
+  else
+  {
+    for( index = 0 ; index < count ; index++, dst += 3, src = ADDRESS( src, srcstride ) )
+      usertonative( dst, src );
+  }
+  return;
+}
+
+/* Convert count triangles from a tight native array to user indices of any stride */
+static void moIndicesBlockNativeToUser( void *dst, size_t dststride, moi *src, size_t count, int indiceswidth, void (*nativetouser)( void *dst, moi *src ) )
+{
+  size_t index;
+  if( ( indiceswidth == sizeof(uint16_t) ) && ( dststride == 3*sizeof(uint16_t) ) )
+    moConvertNativeToUint16( dst, src, 3*count );
+  else if( ( indiceswidth == sizeof(uint32_t) ) && ( dststride == 3*sizeof(uint32_t) ) )
+    memcpy( dst, src, 3*count*sizeof(uint32_t) );
+  else if( indiceswidth == sizeof(uint32_t) )
+  {
+    for( index = 0 ; index < count ; index++, src += 3, dst = ADDRESS( dst, dststride ) )
+      moIndicesNativeToInt32( dst, src );
+  }
+  else
+  {
+    for( index = 0 ; index < count ; index++, src += 3, dst = ADDRESS( dst, dststride ) )
+      nativetouser( dst, src );
+  }
+  return;
+}
+
+
 ////
 
 
@@ -305,10 +405,11 @@ static void moMeshInitVertices( moMesh *mesh, moThreadData *tdata, int threadcou
 /* Mesh init step 2, initialize triangles, threaded */
 static void moMeshInitTriangles( moMesh *mesh, moThreadData *tdata, int threadcount )
 {
-  int i, triperthread, triindex, triindexmax;
+  int i, triperthread, triindex, triindexmax, blockindex, blockcount;
   void *indices;
   moTriangle *tri;
   moVertex *vertex;
+  moi nativeindices[3*MO_CONVERT_BLOCK_SIZE];
 
   triperthread = ( mesh->tricount / threadcount ) + 1;
   triindex = tdata->threadid * triperthread;
@@ -319,9 +420,22 @@ static void moMeshInitTriangles( moMesh *mesh, moThreadData *tdata, int threadco
   /* Initialize triangles */
   indices = ADDRESS( mesh->indices, triindex * mesh->indicesstride );
   tri = &mesh->trilist[triindex];
-  for( ; triindex < triindexmax ; triindex++, indices = ADDRESS( indices, mesh->indicesstride ), tri++ )
+  blockindex = 0;
+  blockcount = 0;
+  for( ; triindex < triindexmax ; triindex++, blockindex++, tri++ )
   {
-    mesh->indicesUserToNative( tri->v, indices );
+    if( blockindex == blockcount )
+    {
+      blockindex = 0;
+      blockcount = triindexmax - triindex;
+      if( blockcount > MO_CONVERT_BLOCK_SIZE )
+        blockcount = MO_CONVERT_BLOCK_SIZE;
+      moIndicesBlockUserToNative( nativeindices, indices, mesh->indicesstride, blockcount, mesh->indiceswidth, mesh->indicesUserToNative );
+      indices = ADDRESS( indices, blockcount * mesh->indicesstride );
+    }
+    tri->v[0] = nativeindices[3*blockindex+0];
+    tri->v[1] = nativeindices[3*blockindex+1];
+    tri->v[2] = nativeindices[3*blockindex+2];
 #if MO_CONFIG_ATOMIC_SUPPORT
     mmAtomicWrite32( &tri->atomictrinext, MO_TRINEXT_PENDING );
 #else
@@ -1200,9 +1314,21 @@ static void moRebuildMesh( moMesh *mesh, moThreadData *tdata, moi seedindex )
 ////
 
 
+/* Record a trace span named after the step that began at steptime, returns the time at which the next step begins */
+static uint64_t moTraceStep( moMesh *mesh, int threadindex, const char *name, uint64_t steptime )
+{
+  uint64_t endtime;
+  if( !( mesh->tracerun ) )
+    return 0;
+  endtime = mmTraceGetTime();
+  mmTraceSpan( mesh->tracerun, threadindex, name, 0, 0, steptime, endtime );
+  return endtime;
+}
+
 static void *moThreadMain( void *value )
 {
   moi seedindex;
+  uint64_t steptime;
   moMesh *mesh;
   moThreadInit *tinit;
   moThreadData tdata;
@@ -1227,26 +1353,40 @@ static void *moThreadMain( void *value )
   ccQuickRand32Seed( &tdata.randstate, tdata.threadid );
 #endif
 
+  steptime = moTraceStep( mesh, tdata.threadid, "Initializing", ( mesh->tracerun ? mmTraceGetTime() : 0 ) );
+
   /* Step 1 */
   moMeshInitVertices( mesh, &tdata, mesh->threadcount );
+  steptime = moTraceStep( mesh, tdata.threadid, "Building Vertices", steptime );
   mtSleepBarrierSync( &mesh->workbarrier );
+  steptime = moTraceStep( mesh, tdata.threadid, "Barrier Wait", steptime );
 
   /* Step 2 */
   moMeshInitTriangles( mesh, &tdata, mesh->threadcount );
+  steptime = moTraceStep( mesh, tdata.threadid, "Building Triangles", steptime );
   mtSleepBarrierSync( &mesh->workbarrier );
+  steptime = moTraceStep( mesh, tdata.threadid, "Barrier Wait", steptime );
 
   /* Step 3 is done by a single thread */
   if( tdata.threadid == 0 )
+  {
     moMeshInitTrirefs( mesh );
+    steptime = moTraceStep( mesh, tdata.threadid, "Initializing Trirefs", steptime );
+  }
   mtSleepBarrierSync( &mesh->workbarrier );
+  steptime = moTraceStep( mesh, tdata.threadid, "Barrier Wait", steptime );
 
   /* Step 4 */
   seedindex = moMeshBuildTrirefs( mesh, &tdata, mesh->threadcount );
+  steptime = moTraceStep( mesh, tdata.threadid, "Building Trirefs", steptime );
   mtSleepBarrierSync( &mesh->workbarrier );
+  steptime = moTraceStep( mesh, tdata.threadid, "Barrier Wait", steptime );
 
   /* Step 5, threads rebuild the mesh */
   moRebuildMesh( mesh, &tdata, seedindex );
+  steptime = moTraceStep( mesh, tdata.threadid, "Rebuilding Mesh", steptime );
   mtSleepBarrierSync( &mesh->workbarrier );
+  moTraceStep( mesh, tdata.threadid, "Barrier Wait", steptime );
 
   /* Set the linked list's first item for main thread to access */
   tinit->trifirst = tdata.trifirst;
@@ -1268,12 +1408,15 @@ static void *moThreadMain( void *value )
 static void moWriteIndices( moMesh *mesh, moThreadInit *threadinit )
 {
   int threadindex;
+  size_t blockcount;
   moi triindex, trinext;
   moThreadInit *tinit;
   moTriangle *tri;
   void *indices;
+  moi nativeindices[3*MO_CONVERT_BLOCK_SIZE];
 
   indices = mesh->indices;
+  blockcount = 0;
   for( threadindex = 0 ; threadindex < mesh->threadcount ; threadindex++ )
   {
     tinit = &threadinit[threadindex];
@@ -1290,10 +1433,18 @@ static void moWriteIndices( moMesh *mesh, moThreadInit *threadinit )
       printf( "Tri %d,%d,%d\n", tri->v[0], tri->v[1], tri->v[2] );
 #endif
 
-      mesh->indicesNativeToUser( indices, tri->v );
-      indices = ADDRESS( indices, mesh->indicesstride );
+      nativeindices[3*blockcount+0] = tri->v[0];
+      nativeindices[3*blockcount+1] = tri->v[1];
+      nativeindices[3*blockcount+2] = tri->v[2];
+      if( ++blockcount == MO_CONVERT_BLOCK_SIZE )
+      {
+        moIndicesBlockNativeToUser( indices, mesh->indicesstride, nativeindices, blockcount, mesh->indiceswidth, mesh->indicesNativeToUser );
+        indices = ADDRESS( indices, blockcount * mesh->indicesstride );
+        blockcount = 0;
+      }
     }
   }
+  moIndicesBlockNativeToUser( indices, mesh->indicesstride, nativeindices, blockcount, mesh->indiceswidth, mesh->indicesNativeToUser );
 
   return;
 }
@@ -1347,14 +1498,17 @@ static void moBuildRedirection( moMesh *mesh, moThreadInit *threadinit )
 static void moWriteRedirectIndices( moMesh *mesh, moThreadInit *threadinit )
 {
   int threadindex;
-  moi triindices[3];
+  size_t blockcount;
+  moi *triindices;
   moi triindex, trinext;
   moThreadInit *tinit;
   moVertex *vertex;
   moTriangle *tri;
   void *indices;
+  moi nativeindices[3*MO_CONVERT_BLOCK_SIZE];
 
   indices = mesh->indices;
+  blockcount = 0;
   for( threadindex = 0 ; threadindex < mesh->threadcount ; threadindex++ )
   {
     tinit = &threadinit[threadindex];
@@ -1366,16 +1520,22 @@ static void moWriteRedirectIndices( moMesh *mesh, moThreadInit *threadinit )
 #else
       trinext = tri->trinext;
 #endif
+      triindices = &nativeindices[3*blockcount];
       vertex = &mesh->vertexlist[tri->v[0]];
       triindices[0] = vertex->redirectindex;
       vertex = &mesh->vertexlist[tri->v[1]];
       triindices[1] = vertex->redirectindex;
       vertex = &mesh->vertexlist[tri->v[2]];
       triindices[2] = vertex->redirectindex;
-      mesh->indicesNativeToUser( indices, triindices );
-      indices = ADDRESS( indices, mesh->indicesstride );
+      if( ++blockcount == MO_CONVERT_BLOCK_SIZE )
+      {
+        moIndicesBlockNativeToUser( indices, mesh->indicesstride, nativeindices, blockcount, mesh->indiceswidth, mesh->indicesNativeToUser );
+        indices = ADDRESS( indices, blockcount * mesh->indicesstride );
+        blockcount = 0;
+      }
     }
   }
+  moIndicesBlockNativeToUser( indices, mesh->indicesstride, nativeindices, blockcount, mesh->indiceswidth, mesh->indicesNativeToUser );
 
   return;
 }
@@ -1409,6 +1569,7 @@ moMesh *moMeshOptimizationInit( size_t vertexcount, size_t tricount, void *indic
   mesh->vertexcount = vertexcount;
   mesh->tricount = tricount;
   mesh->indices = indices;
+  mesh->indiceswidth = indiceswidth;
   switch( indiceswidth )
   {
     case sizeof(uint8_t):
@@ -1492,6 +1653,8 @@ moMesh *moMeshOptimizationInit( size_t vertexcount, size_t tricount, void *indic
   mesh->trirefcount = 0;
   mesh->trireflist = malloc( 3 * mesh->tricount * sizeof(moi) );
 
+  mesh->tracerun = mmTraceRunBegin( "moOptimizeMesh", threadcount );
+
   return mesh;
 }
 
@@ -1512,6 +1675,8 @@ void moMeshOptimizationThread( moMesh *mesh, int threadindex )
 /* Wait until the work has completed */
 void moMeshOptimizationEnd( moMesh *mesh )
 {
+  uint64_t writetime;
+
   /* Wait for all threads to be done */
   mtMutexLock( &mesh->finishmutex );
   while( mesh->finishcount )
@@ -1519,6 +1684,7 @@ void moMeshOptimizationEnd( moMesh *mesh )
   mtMutexUnlock( &mesh->finishmutex );
 
   /* Read the linked list of each thread and rebuild the new indices */
+  writetime = ( mesh->tracerun ? mmTraceGetTime() : 0 );
   if( !( mesh->shufflecallback ) )
     moWriteIndices( mesh, mesh->threadinit );
   else
@@ -1526,6 +1692,8 @@ void moMeshOptimizationEnd( moMesh *mesh )
     moBuildRedirection( mesh, mesh->threadinit );
     moWriteRedirectIndices( mesh, mesh->threadinit );
   }
+  moTraceStep( mesh, mesh->threadcount, "Write Indices", writetime );
+  mmTraceRunEnd( mesh->tracerun );
 
   /* Free all global data */
   free( mesh->vertexlist );
@@ -1641,10 +1809,11 @@ ACMR is the sum of vertex cache miss divided by the number of triangles in the m
 double moEvaluateMesh( size_t tricount, void *indices, int indiceswidth, size_t indicesstride, int vertexcachesize, int flags )
 {
   int cacheindex, cachemiss;
-  moi triindex;
+  size_t triindex, blockindex, blockcount;
   void (*indicesUserToNative)( moi *dst, void *src );
   moi vertexcache[MO_EVAL_VERTEX_CACHE_MAX];
-  moi triv[3];
+  moi nativeindices[3*MO_CONVERT_BLOCK_SIZE];
+  moi *triv;
 
   switch( indiceswidth )
   {
@@ -1670,10 +1839,20 @@ double moEvaluateMesh( size_t tricount, void *indices, int indiceswidth, size_t
     vertexcache[cacheindex] = -1;
 
   cachemiss = 0;
-  for( triindex = 0 ; triindex < tricount ; triindex++ )
+  blockindex = 0;
+  blockcount = 0;
+  for( triindex = 0 ; triindex < tricount ; triindex++, blockindex++ )
   {
-    indicesUserToNative( triv, indices );
-    indices = ADDRESS( indices, indicesstride );
+    if( blockindex == blockcount )
+    {
+      blockindex = 0;
+      blockcount = tricount - triindex;
+      if( blockcount > MO_CONVERT_BLOCK_SIZE )
+        blockcount = MO_CONVERT_BLOCK_SIZE;
+      moIndicesBlockUserToNative( nativeindices, indices, indicesstride, blockcount, indiceswidth, indicesUserToNative );
+      indices = ADDRESS( indices, blockcount * indicesstride );
+    }
+    triv = &nativeindices[3*blockindex];
     cachemiss += moEvalCacheInsert( vertexcache, vertexcachesize, triv[0] );
     cachemiss += moEvalCacheInsert( vertexcache, vertexcachesize, triv[1] );
     cachemiss += moEvalCacheInsert( vertexcache, vertexcachesize, triv[2] );
@@ -1308,6 +1308,93 @@ void MM_FUNC(BlockLockRelease)( mmBlockHead *head, void *v MM_PARAMS )
 }
 
 
+/**
+ * Initialize a per-thread cache of free chunks for the memory block head specified.
+ *
+ * Chunks are taken from and returned to the head in batches of half the cache
+ * size, the spin lock of the head is only acquired when the cache runs empty or
+ * full. The cache must be flushed before mmBlockFreeAll() is called on the head.
+ */
+void MM_FUNC(BlockCacheInit)( mmBlockCache *cache, mmBlockHead *head MM_PARAMS )
+{
+  cache->head = head;
+  cache->chunkcount = 0;
+  return;
+}
+
+
+/**
+ * Allocates a chunk of memory through the cache.
+ */
+void *MM_FUNC(BlockCacheAlloc)( mmBlockCache *cache MM_PARAMS )
+{
+  int a, refillcount;
+  void *chunk;
+  if( !( cache->chunkcount ) )
+  {
+    /* Fill the magazine from its top, chunks are handed out in the order of the free list of the head */
+    refillcount = MM_BLOCK_CACHE_SIZE >> 1;
+    mtSpinLock( &cache->head->spinlock );
+    for( a = refillcount - 1 ; a >= 0 ; a-- )
+    {
+      chunk = MM_FUNC(BlockAlloc)( cache->head MM_PASSPARAMS );
+      if( !( chunk ) )
+        break;
+      cache->chunk[a] = chunk;
+    }
+    mtSpinUnlock( &cache->head->spinlock );
+    cache->chunkcount = refillcount - ( a + 1 );
+    if( !( cache->chunkcount ) )
+      return 0;
+    if( a >= 0 )
+      memmove( &cache->chunk[0], &cache->chunk[a+1], cache->chunkcount * sizeof(void *) );
+  }
+  return cache->chunk[ --cache->chunkcount ];
+}
+
+
+/**
+ * Release a chunk of memory previously allocated by mmBlockCacheAlloc().
+ *
+ * When the cache is full, the oldest half of it is returned to the head
+ * through mmBlockFree(), allowing unused blocks to be freed.
+ */
+void MM_FUNC(BlockCacheRelease)( mmBlockCache *cache, void *v MM_PARAMS )
+{
+  int a, batchcount;
+  if( cache->chunkcount == MM_BLOCK_CACHE_SIZE )
+  {
+    batchcount = MM_BLOCK_CACHE_SIZE >> 1;
+    mtSpinLock( &cache->head->spinlock );
+    for( a = 0 ; a < batchcount ; a++ )
+      MM_FUNC(BlockFree)( cache->head, cache->chunk[a] MM_PASSPARAMS );
+    mtSpinUnlock( &cache->head->spinlock );
+    /* Keep the most recently released chunks, still warm in cache */
+    memmove( &cache->chunk[0], &cache->chunk[batchcount], ( MM_BLOCK_CACHE_SIZE - batchcount ) * sizeof(void *) );
+    cache->chunkcount -= batchcount;
+  }
+  cache->chunk[ cache->chunkcount++ ] = v;
+  return;
+}
+
+
+/**
+ * Return all chunks held by the cache to the head, to call when a thread goes idle.
+ */
+void MM_FUNC(BlockCacheFlush)( mmBlockCache *cache MM_PARAMS )
+{
+  int a;
+  if( !( cache->chunkcount ) )
+    return;
+  mtSpinLock( &cache->head->spinlock );
+  for( a = 0 ; a < cache->chunkcount ; a++ )
+    MM_FUNC(BlockFree)( cache->head, cache->chunk[a] MM_PASSPARAMS );
+  mtSpinUnlock( &cache->head->spinlock );
+  cache->chunkcount = 0;
+  return;
+}
+
+
 /**
  * Free all memory allocated by a block head.
  */
@@ -2948,6 +3035,30 @@ int mmGetTimeOfDay( struct timeval *tv )
 ////
 
 
+uint64_t mmGetThreadCpuMicrosecondsTime()
+{
+#if MM_WINDOWS
+  FILETIME createtime, exittime, kerneltime, usertime;
+  uint64_t kernel, user;
+  if( !( GetThreadTimes( GetCurrentThread(), &createtime, &exittime, &kerneltime, &usertime ) ) )
+    return 0;
+  kernel = ( (uint64_t)kerneltime.dwHighDateTime << 32 ) | (uint64_t)kerneltime.dwLowDateTime;
+  user = ( (uint64_t)usertime.dwHighDateTime << 32 ) | (uint64_t)usertime.dwLowDateTime;
+  return ( kernel + user ) / 10;
+#elif defined(CLOCK_THREAD_CPUTIME_ID)
+  struct timespec cputime;
+  if( clock_gettime( CLOCK_THREAD_CPUTIME_ID, &cputime ) )
+    return 0;
+  return ( (uint64_t)cputime.tv_sec * 1000000 ) + ( (uint64_t)cputime.tv_nsec / 1000 );
+#else
+  return 0;
+#endif
+}
+
+
+////
+
+
 #ifndef MAP_HUGE_2MB
  #define HUGETLB_FLAG_ENCODE_SHIFT 26
  #define HUGETLB_FLAG_ENCODE_2MB (21 << HUGETLB_FLAG_ENCODE_SHIFT)
@@ -2964,6 +3075,9 @@ int mmGetTimeOfDay( struct timeval *tv )
 void *mmMmapAlloc( size_t memsize, int trymmap, int trymlock, int tryhugepages, size_t *retmmapsize, int *retlockflag )
 {
   int mmapflags, hugepageflag;
+#if MM_LINUX && defined(MADV_HUGEPAGE)
+  size_t alignsize, headsize;
+#endif
   void *alloc;
   *retmmapsize = 0;
   if( retlockflag )
@@ -3027,6 +3141,26 @@ void *mmMmapAlloc( size_t memsize, int trymmap, int trymlock, int tryhugepages,
     }
 */
     mmapflags = MAP_PRIVATE | MAP_ANONYMOUS;
+ #if MM_LINUX && defined(MADV_HUGEPAGE)
+    /* No reserved huge pages, ask for transparent huge pages ; map 2MB more to align the chunk on a huge page boundary */
+    if( tryhugepages )
+    {
+      alignsize = (size_t)1 << 21;
+      alloc = mmap( 0x0, memsize + alignsize, PROT_READ | PROT_WRITE, mmapflags, -1, 0 );
+      if( alloc != MAP_FAILED )
+      {
+        headsize = ( ( (uintptr_t)alloc + ( alignsize - 1 ) ) & ~(uintptr_t)( alignsize - 1 ) ) - (uintptr_t)alloc;
+        if( headsize )
+          munmap( alloc, headsize );
+        if( headsize != alignsize )
+          munmap( ADDRESS( alloc, headsize + memsize ), alignsize - headsize );
+        alloc = ADDRESS( alloc, headsize );
+        madvise( alloc, memsize, MADV_HUGEPAGE );
+        *retmmapsize = memsize;
+        return alloc;
+      }
+    }
+ #endif
     alloc = mmap( 0x0, memsize, PROT_READ | PROT_WRITE, mmapflags, -1, 0 );
     if( alloc != MAP_FAILED )
     {
@@ -3039,6 +3173,21 @@ void *mmMmapAlloc( size_t memsize, int trymmap, int trymlock, int tryhugepages,
   return alloc;
 }
 
+/* Allocate a chunk of memory backed by huge pages, from reserved huge pages if available, else transparent huge pages */
+/* Returns null if the chunk could not be mapped, free with mmMmapFree( alloc, *retmmapsize ) */
+void *mmHugeAlloc( size_t memsize, size_t *retmmapsize )
+{
+#if MM_UNIX
+  void *alloc;
+  alloc = mmMmapAlloc( memsize, 1, 0, 1, retmmapsize, 0 );
+  if( *retmmapsize )
+    return alloc;
+  free( alloc );
+#endif
+  *retmmapsize = 0;
+  return 0;
+}
+
 void mmMmapFree( void *alloc, size_t mmapsize )
 {
 #if MM_UNIX || MM_LINUX
@@ -543,6 +543,29 @@ int MM_FUNC(BlockFreeCount)( mmBlockHead *head MM_PARAMS );
  #define mmBlockFreeCount(x) MM_FUNC(BlockProcessList)(x,__FILE__,__LINE__)
 #endif
 
+
+/* Per-thread magazine of free chunks, refilled from and returned to the shared head in batches under a single lock */
+#define MM_BLOCK_CACHE_SIZE (64)
+
+typedef struct
+{
+  mmBlockHead *head;
+  int chunkcount;
+  void *chunk[MM_BLOCK_CACHE_SIZE];
+} mmBlockCache;
+
+void MM_FUNC(BlockCacheInit)( mmBlockCache *cache, mmBlockHead *head MM_PARAMS );
+void *MM_FUNC(BlockCacheAlloc)( mmBlockCache *cache MM_PARAMS );
+void MM_FUNC(BlockCacheRelease)( mmBlockCache *cache, void *v MM_PARAMS );
+void MM_FUNC(BlockCacheFlush)( mmBlockCache *cache MM_PARAMS );
+
+#if MM_DEBUG
+ #define mmBlockCacheInit(x,y) MM_FUNC(BlockCacheInit)(x,y,__FILE__,__LINE__)
+ #define mmBlockCacheAlloc(x) MM_FUNC(BlockCacheAlloc)(x,__FILE__,__LINE__)
+ #define mmBlockCacheRelease(x,y) MM_FUNC(BlockCacheRelease)(x,y,__FILE__,__LINE__)
+ #define mmBlockCacheFlush(x) MM_FUNC(BlockCacheFlush)(x,__FILE__,__LINE__)
+#endif
+
 /*
 void mmBlockRelayByVolume( mmBlockHead *head, void *volumehead );
 void mmBlockRelayByZone( mmBlockHead *head, void *zonehead );
@@ -793,12 +816,16 @@ static inline uint64_t mmGetNanosecondsTime()
   return ( (uint64_t)lntime.tv_sec * 1000000000 ) + ( (uint64_t)lntime.tv_usec * 1000 );
 }
 
+/* CPU time consumed by the calling thread, returns zero if unsupported */
+uint64_t mmGetThreadCpuMicrosecondsTime();
+
 
 ////
 
 
 void *mmMmapAlloc( size_t memsize, int trymmap, int trymlock, int tryhugepages, size_t *retmmapsize, int *retlockflag );
 void mmMmapFree( void *alloc, size_t mmapsize );
+void *mmHugeAlloc( size_t memsize, size_t *retmmapsize );
 
 
 ////
@@ -93,6 +93,8 @@ static int (*mm_numa_run_on_node)(int node);
 static void *(*mm_numa_alloc_onnode)(size_t size, int node);
 static void (*mm_numa_free)(void *mem, size_t size);
 static void (*mm_numa_tonode_memory)(void *start, size_t size, int node);
+static void (*mm_numa_interleave_memory)(void *start, size_t size, void *nodemask);
+static void **mm_numa_all_nodes_ptr;
 static long (*mm_mbind)(void *addr, unsigned long len, int mode, const unsigned long *nodemask, unsigned long maxnode, unsigned flags);
 #define MPOL_BIND        2
 #define MPOL_MF_MOVE (1<<1)  /* Move pages owned by this process to conform to mapping */
@@ -116,6 +118,8 @@ static inline void mmNumaLoad()
     mm_numa_alloc_onnode = dlsym( mmNumaLib, "numa_alloc_onnode" );
     mm_numa_free = dlsym( mmNumaLib, "numa_free" );
     mm_numa_tonode_memory = dlsym( mmNumaLib, "numa_tonode_memory" );
+    mm_numa_interleave_memory = dlsym( mmNumaLib, "numa_interleave_memory" );
+    mm_numa_all_nodes_ptr = dlsym( mmNumaLib, "numa_all_nodes_ptr" );
     mm_mbind = dlsym( mmNumaLib, "mbind" );
   }
   if( ( mm_numa_alloc_onnode ) && ( mm_numa_free ) )
@@ -447,6 +451,159 @@ static void mmCoreInit()
 ////
 
 
+#if MM_LINUX && !MM_ANDROID
+
+/* Read the CPU quota of a cgroup v2 directory (cpu.max) or v1 directory (cpu.cfs_quota_us and cpu.cfs_period_us), return 0 if unlimited or not found */
+static int mmCgroupReadQuota( const char *dirpath, int v2flag )
+{
+  int cpucount;
+  long long quota, period;
+  char path[512];
+  FILE *file;
+
+  quota = -1;
+  period = 0;
+  if( v2flag )
+  {
+    snprintf( path, sizeof(path), "%s/cpu.max", dirpath );
+    if( !( file = fopen( path, "r" ) ) )
+      return 0;
+    /* The quota reads as "max" when unlimited */
+    if( fscanf( file, "%lld %lld", &quota, &period ) != 2 )
+      quota = -1;
+    fclose( file );
+  }
+  else
+  {
+    snprintf( path, sizeof(path), "%s/cpu.cfs_quota_us", dirpath );
+    if( !( file = fopen( path, "r" ) ) )
+      return 0;
+    if( fscanf( file, "%lld", &quota ) != 1 )
+      quota = -1;
+    fclose( file );
+    snprintf( path, sizeof(path), "%s/cpu.cfs_period_us", dirpath );
+    if( !( file = fopen( path, "r" ) ) )
+      return 0;
+    if( fscanf( file, "%lld", &period ) != 1 )
+      period = 0;
+    fclose( file );
+  }
+  if( ( quota <= 0 ) || ( period <= 0 ) )
+    return 0;
+  cpucount = (int)( ( quota + period - 1 ) / period );
+  return ( cpucount > 0 ? cpucount : 1 );
+}
+
+/* Controllers of a cgroup v1 hierarchy are a comma-separated list, such as "cpu,cpuacct" */
+static int mmCgroupHasController( const char *controllers, const char *name )
+{
+  size_t namelen;
+  const char *p;
+  namelen = strlen( name );
+  for( p = controllers ; ; p++ )
+  {
+    if( ( strncmp( p, name, namelen ) == 0 ) && ( ( p[namelen] == ',' ) || ( p[namelen] == 0 ) ) )
+      return 1;
+    if( !( p = strchr( p, ',' ) ) )
+      return 0;
+  }
+  return 0;
+}
+
+/* CPU quota of the cgroup of the process, from /proc/self/cgroup ; inside a cgroup namespace, the cgroup is mounted as the root */
+static int mmCgroupGetQuota()
+{
+  int cpucount, v2flag;
+  char line[512], dirpath[1024];
+  char *controllers, *cgpath, *newline;
+  FILE *file;
+
+  cpucount = 0;
+  file = fopen( "/proc/self/cgroup", "r" );
+  if( !( file ) )
+    return 0;
+  while( !( cpucount ) && ( fgets( line, sizeof(line), file ) ) )
+  {
+    /* Lines are "hierarchy:controllers:path", with empty controllers for cgroup v2 */
+    if( !( controllers = strchr( line, ':' ) ) )
+      continue;
+    controllers++;
+    if( !( cgpath = strchr( controllers, ':' ) ) )
+      continue;
+    *cgpath++ = 0;
+    if( ( newline = strchr( cgpath, '\n' ) ) )
+      *newline = 0;
+    v2flag = ( controllers[0] == 0 );
+    if( v2flag )
+    {
+      snprintf( dirpath, sizeof(dirpath), "/sys/fs/cgroup%s", cgpath );
+      cpucount = mmCgroupReadQuota( dirpath, 1 );
+      if( !( cpucount ) )
+        cpucount = mmCgroupReadQuota( "/sys/fs/cgroup", 1 );
+    }
+    else if( mmCgroupHasController( controllers, "cpu" ) )
+    {
+      snprintf( dirpath, sizeof(dirpath), "/sys/fs/cgroup/%s%s", controllers, cgpath );
+      cpucount = mmCgroupReadQuota( dirpath, 0 );
+      if( !( cpucount ) )
+      {
+        snprintf( dirpath, sizeof(dirpath), "/sys/fs/cgroup/cpu%s", cgpath );
+        cpucount = mmCgroupReadQuota( dirpath, 0 );
+      }
+      if( !( cpucount ) )
+        cpucount = mmCgroupReadQuota( "/sys/fs/cgroup/cpu", 0 );
+    }
+  }
+  fclose( file );
+  return cpucount;
+}
+
+static void mmCpuAvailableInit()
+{
+  int cpuindex, quotacount;
+  cpu_set_t cpuset;
+
+  mmcore.cpuallowedcount = 0;
+  if( sched_getaffinity( 0, sizeof(cpu_set_t), &cpuset ) == 0 )
+  {
+    for( cpuindex = 0 ; cpuindex < mmcore.cpucount ; cpuindex++ )
+    {
+      if( CPU_ISSET( cpuindex, &cpuset ) )
+        mmcore.cpuallowed[ mmcore.cpuallowedcount++ ] = cpuindex;
+    }
+  }
+  if( !( mmcore.cpuallowedcount ) )
+  {
+    for( cpuindex = 0 ; cpuindex < mmcore.cpucount ; cpuindex++ )
+      mmcore.cpuallowed[cpuindex] = cpuindex;
+    mmcore.cpuallowedcount = mmcore.cpucount;
+  }
+  mmcore.cpuavailcount = mmcore.cpuallowedcount;
+  /* A CFS quota below the allowed CPUs throttles the whole process, more threads than the quota would spin on each other's locks */
+  quotacount = mmCgroupGetQuota();
+  if( ( quotacount > 0 ) && ( quotacount < mmcore.cpuavailcount ) )
+    mmcore.cpuavailcount = quotacount;
+  return;
+}
+
+#else
+
+static void mmCpuAvailableInit()
+{
+  int cpuindex;
+  for( cpuindex = 0 ; cpuindex < mmcore.cpucount ; cpuindex++ )
+    mmcore.cpuallowed[cpuindex] = cpuindex;
+  mmcore.cpuallowedcount = mmcore.cpucount;
+  mmcore.cpuavailcount = mmcore.cpucount;
+  return;
+}
+
+#endif
+
+
+////
+
+
 static int mmGetCpuid( uint32_t level, uint32_t index, uint32_t *eax, uint32_t *ebx, uint32_t *ecx, uint32_t *edx )
 {
 #if defined(__GNUC__)
@@ -781,6 +938,7 @@ void mmInit()
   mmCoreInit();
   mmNumaLoad();
   mmNumaInit();
+  mmCpuAvailableInit();
   mmCpuidInit();
   mmCoreWorkInit();
   mmInitialized = 1;
@@ -816,6 +974,18 @@ int mmGetCpuCount()
   return mmcore.cpucount;
 }
 
+int mmGetCpuAvailableCount()
+{
+  return mmcore.cpuavailcount;
+}
+
+int mmGetCpuForThread( int threadindex )
+{
+  if( mmcore.cpuallowedcount <= 0 )
+    return threadindex;
+  return mmcore.cpuallowed[ threadindex % mmcore.cpuallowedcount ];
+}
+
 int mmGetNodeCount()
 {
   return mmcore.numa.nodecount;
@@ -1031,6 +1201,28 @@ int mmNumaMigrate( int nodeindex, void *start, size_t size )
 }
 
 
+/* Spread the pages of a range not yet touched round-robin over all nodes */
+int mmNumaInterleave( void *start, size_t size )
+{
+ #if MM_LINUX
+  uintptr_t pagemask, base, end;
+  if( ( mm_numa_interleave_memory ) && ( mm_numa_all_nodes_ptr ) && ( *mm_numa_all_nodes_ptr ) )
+  {
+    /* The policy applies to whole pages, skip the partial pages at both ends of the range */
+    pagemask = ( mmcore.pagesize > 0 ? (uintptr_t)mmcore.pagesize : 4096 ) - 1;
+    base = ( (uintptr_t)start + pagemask ) & ~pagemask;
+    end = ( (uintptr_t)start + size ) & ~pagemask;
+    if( end > base )
+      mm_numa_interleave_memory( (void *)base, end - base, *mm_numa_all_nodes_ptr );
+    return 1;
+  }
+ #elif MM_WIN32
+ #else
+ #endif
+  return 0;
+}
+
+
 ////
 
 
@@ -1039,6 +1231,7 @@ void mmPrintSystemTopology()
   int nodeindex, cpuindex, stageindex;
   char *stagestring;
   printf( "System has %d CPU cores\n", mmcore.cpucount );
+  printf( "  Available to process : %d (%d allowed by affinity)\n", mmcore.cpuavailcount, mmcore.cpuallowedcount );
   printf( "  System memory : %.2f MB\n", (double)mmcore.sysmemory / 1048576.0 );
   printf( "CPU \"%s\" by \"%s\"\n", mmcore.cpuid.identifier, mmcore.cpuid.vendorstring );
   printf( "  Sockets : %d\n", mmcore.cpuid.socketcount );
@@ -90,6 +90,11 @@ typedef struct
   int64_t sysmemory;
   /* Count of CPU cores, even offline ones ~ don't use externally ~ can we add CPU hot-plug support? */
   int cpuallcount;
+  /* Count of CPU cores the process should use, bounded by its affinity mask and its cgroup CPU quota ; default thread count */
+  int cpuavailcount;
+  /* CPU indices allowed by the affinity mask of the process, threads are bound round-robin over them */
+  int cpuallowedcount;
+  uint16_t cpuallowed[MM_CPU_COUNT_MAXIMUM];
 
   mmCoreNuma numa;
   mmCoreCpuid cpuid;
@@ -117,6 +122,12 @@ void mmEnd();
 
 int mmGetCpuCount();
 
+/* Count of CPU cores available to the process, the count of threads to launch by default */
+int mmGetCpuAvailableCount();
+
+/* CPU index to bind the thread of index threadindex to, within the CPUs allowed to the process */
+int mmGetCpuForThread( int threadindex );
+
 int mmGetNodeCount();
 
 uint64_t mmGetNodeSize( int nodeindex );
@@ -134,6 +145,7 @@ void mmBindThreadToNode( int nodeindex );
 void *mmNumaAlloc( int nodeindex, size_t size );
 void mmNumaFree( int nodeindex, void *v, size_t size );
 int mmNumaMigrate( int nodeindex, void *start, size_t size );
+int mmNumaInterleave( void *start, size_t size );
 
 
 void mmPrintSystemTopology();
@@ -47,6 +47,41 @@
 #define MM_HASH_DEFAULT_GROW_FACTOR (0.7)
 #define MM_HASH_DEFAULT_SHRINK_FACTOR (0.2)
 
+/* Count of entries hashed and prefetched ahead of their search by mmHashLockReadEntries() */
+#define MM_HASH_BATCH_SIZE (16)
+
+/* Key of cleared entries for MM_HASH_FLAGS_KEY64 tables */
+#define MM_HASH_KEY64_EMPTY (0xffffffffffffffffULL)
+
+
+/* Entry comparison and validity, inlined as an 8 bytes compare for MM_HASH_FLAGS_KEY64 tables */
+static inline CC_ALWAYSINLINE int mmHashEntryCmp( mmHashTable *table, const mmHashAccess *access, void *entry, void *entryref )
+{
+  uint64_t key, keyref;
+  if( table->flags & MM_HASH_FLAGS_KEY64 )
+  {
+    memcpy( &key, entry, sizeof(uint64_t) );
+    memcpy( &keyref, entryref, sizeof(uint64_t) );
+    if( key == keyref )
+      return MM_HASH_ENTRYCMP_FOUND;
+    if( key == MM_HASH_KEY64_EMPTY )
+      return MM_HASH_ENTRYCMP_INVALID;
+    return MM_HASH_ENTRYCMP_SKIP;
+  }
+  return access->entrycmp( table->context, entry, entryref );
+}
+
+static inline CC_ALWAYSINLINE int mmHashEntryValid( mmHashTable *table, const mmHashAccess *access, void *entry )
+{
+  uint64_t key;
+  if( table->flags & MM_HASH_FLAGS_KEY64 )
+  {
+    memcpy( &key, entry, sizeof(uint64_t) );
+    return ( key != MM_HASH_KEY64_EMPTY );
+  }
+  return access->entryvalid( table->context, entry );
+}
+
 
 static void mmHashSetBounds( mmHashTable *table )
 {
@@ -70,13 +105,15 @@ size_t mmHashRequiredSize( size_t entrysize, size_t hashsize, uint32_t pageshift
 
 void mmHashInit( void *hashtable, const mmHashAccess *access, size_t entrysize, size_t hashsize, uint32_t pageshift, uint32_t flags, void *context )
 {
+  int clearflag;
   uint32_t hashbits;
   mmHashIndex hashkey, pageindex;
   void *entry;
   mmHashTable *table;
   mmHashPage *page;
 
-  flags &= ~MM_HASH_FLAGS_HASHSIZE_ISPOW2;
+  clearflag = !( flags & MM_HASH_FLAGS_NO_CLEAR );
+  flags &= ~( MM_HASH_FLAGS_HASHSIZE_ISPOW2 | MM_HASH_FLAGS_NO_CLEAR );
 
   hashbits = ccLog2Int64( hashsize );
   table = hashtable;
@@ -113,11 +150,14 @@ void mmHashInit( void *hashtable, const mmHashAccess *access, size_t entrysize,
     table->flags |= MM_HASH_FLAGS_HASHSIZE_ISPOW2;
 
   /* Clear the table */
-  entry = MM_HASH_ENTRYLIST( table );
-  for( hashkey = 0 ; hashkey < table->hashsize ; hashkey++ )
+  if( clearflag )
   {
-    access->clearentry( table->context, entry );
-    entry = ADDRESS( entry, entrysize );
+    entry = MM_HASH_ENTRYLIST( table );
+    for( hashkey = 0 ; hashkey < table->hashsize ; hashkey++ )
+    {
+      access->clearentry( table->context, entry );
+      entry = ADDRESS( entry, entrysize );
+    }
   }
 
   /* Clear the lock pages */
@@ -176,6 +216,30 @@ void mmHashReset( void *hashtable, const mmHashAccess *access )
 }
 
 
+void mmHashClearPart( void *hashtable, const mmHashAccess *access, int partindex, int partcount )
+{
+  mmHashIndex hashkey, hashkeymax, partsize;
+  mmHashTable *table;
+  void *entry;
+
+  table = hashtable;
+  partsize = ( table->hashsize / partcount ) + 1;
+  hashkey = (mmHashIndex)partindex * partsize;
+  hashkeymax = hashkey + partsize;
+  if( hashkeymax > table->hashsize )
+    hashkeymax = table->hashsize;
+  if( hashkey >= hashkeymax )
+    return;
+  entry = ADDRESS( MM_HASH_ENTRYLIST( table ), hashkey * table->entrysize );
+  for( ; hashkey < hashkeymax ; hashkey++ )
+  {
+    access->clearentry( table->context, entry );
+    entry = ADDRESS( entry, table->entrysize );
+  }
+  return;
+}
+
+
 void mmHashSetResizeCriteria( void *hashtable, float shrinkfactor, float growfactor )
 {
   mmHashIndex entrycount;
@@ -224,7 +288,7 @@ void *mmHashDirectFindEntry( void *hashtable, const mmHashAccess *access, void *
   for( ; ; )
   {
     entry = MM_HASH_ENTRY( table, hashkey );
-    cmpvalue = access->entrycmp( table->context, entry, findentry );
+    cmpvalue = mmHashEntryCmp( table, access, entry, findentry );
     if( cmpvalue == MM_HASH_ENTRYCMP_INVALID )
       break;
     else if( cmpvalue == MM_HASH_ENTRYCMP_FOUND )
@@ -284,7 +348,7 @@ static int mmHashTryFindEntry( mmHashTable *table, const mmHashAccess *access, v
 
     /* Check for entry match */
     entry = MM_HASH_ENTRY( table, hashkey );
-    cmpvalue = access->entrycmp( table->context, entry, findentry );
+    cmpvalue = mmHashEntryCmp( table, access, entry, findentry );
     if( cmpvalue == MM_HASH_ENTRYCMP_INVALID )
     {
       retvalue = MM_HASH_FAILURE;
@@ -496,7 +560,7 @@ int mmHashDirectReadEntry( void *hashtable, const mmHashAccess *access, void *re
   for( ; ; )
   {
     entry = MM_HASH_ENTRY( table, hashkey );
-    cmpvalue = access->entrycmp( table->context, entry, readentry );
+    cmpvalue = mmHashEntryCmp( table, access, entry, readentry );
     if( cmpvalue == MM_HASH_ENTRYCMP_INVALID )
       break;
     else if( cmpvalue == MM_HASH_ENTRYCMP_FOUND )
@@ -516,15 +580,14 @@ int mmHashDirectReadEntry( void *hashtable, const mmHashAccess *access, void *re
 }
 
 
-static int mmHashTryReadEntry( mmHashTable *table, const mmHashAccess *access, void *readentry )
+/* The hash key of the entry is computed by the caller, once for all tries */
+static int mmHashTryReadEntry( mmHashTable *table, const mmHashAccess *access, void *readentry, mmHashIndex hashkey )
 {
-  mmHashIndex hashkey;
   mmHashIndex pageindex, pagestart, pagefinal;
   int cmpvalue, retvalue;
   void *entry;
 
   /* Hash key of entry */
-  hashkey = access->entrykey( table->context, readentry );
   if( table->flags & MM_HASH_FLAGS_HASHSIZE_ISPOW2 )
     hashkey &= table->hashmask;
   else
@@ -559,7 +622,7 @@ static int mmHashTryReadEntry( mmHashTable *table, const mmHashAccess *access, v
 
     /* Check for entry match */
     entry = MM_HASH_ENTRY( table, hashkey );
-    cmpvalue = access->entrycmp( table->context, entry, readentry );
+    cmpvalue = mmHashEntryCmp( table, access, entry, readentry );
     if( cmpvalue == MM_HASH_ENTRYCMP_INVALID )
     {
       retvalue = MM_HASH_FAILURE;
@@ -594,16 +657,18 @@ static int mmHashTryReadEntry( mmHashTable *table, const mmHashAccess *access, v
 int mmHashLockReadEntry( void *hashtable, const mmHashAccess *access, void *readentry )
 {
   int retvalue;
+  mmHashIndex hashkey;
   mmHashTable *table;
 
   table = hashtable;
-  retvalue = mmHashTryReadEntry( table, access, readentry );
+  hashkey = access->entrykey( table->context, readentry );
+  retvalue = mmHashTryReadEntry( table, access, readentry, hashkey );
   if( retvalue == MM_HASH_TRYAGAIN )
   {
     MM_HASH_GLOBAL_LOCK( table );
     do
     {
-      retvalue = mmHashTryReadEntry( table, access, readentry );
+      retvalue = mmHashTryReadEntry( table, access, readentry, hashkey );
     } while( retvalue == MM_HASH_TRYAGAIN );
     MM_HASH_GLOBAL_UNLOCK( table );
   }
@@ -612,6 +677,62 @@ int mmHashLockReadEntry( void *hashtable, const mmHashAccess *access, void *read
 }
 
 
+/* Hash keys of a batch are all computed and their first entries prefetched before any search, overlapping the cache misses */
+int mmHashLockReadEntries( void *hashtable, const mmHashAccess *access, void *readentries, int entrycount, int *retvalues )
+{
+  int index, batchbase, batchcount, retvalue, foundcount;
+  mmHashIndex hashkey, slotkey;
+  mmHashIndex keylist[MM_HASH_BATCH_SIZE];
+  void *readentry;
+  mmHashTable *table;
+
+  table = hashtable;
+
+  foundcount = 0;
+  for( batchbase = 0 ; batchbase < entrycount ; batchbase += MM_HASH_BATCH_SIZE )
+  {
+    batchcount = CC_MIN( entrycount - batchbase, MM_HASH_BATCH_SIZE );
+
+    /* Hash keys of the batch, prefetch the first entry and lock page of each */
+    readentry = ADDRESS( readentries, batchbase * table->entrysize );
+    for( index = 0 ; index < batchcount ; index++ )
+    {
+      hashkey = access->entrykey( table->context, readentry );
+      keylist[index] = hashkey;
+      if( table->flags & MM_HASH_FLAGS_HASHSIZE_ISPOW2 )
+        slotkey = hashkey & table->hashmask;
+      else
+        slotkey = hashkey % table->hashsize;
+      CC_PREFETCH( MM_HASH_ENTRY( table, slotkey ) );
+      CC_PREFETCH( &table->page[ slotkey >> table->pageshift ] );
+      readentry = ADDRESS( readentry, table->entrysize );
+    }
+
+    /* Resolve the batch */
+    readentry = ADDRESS( readentries, batchbase * table->entrysize );
+    for( index = 0 ; index < batchcount ; index++ )
+    {
+      retvalue = mmHashTryReadEntry( table, access, readentry, keylist[index] );
+      if( retvalue == MM_HASH_TRYAGAIN )
+      {
+        MM_HASH_GLOBAL_LOCK( table );
+        do
+        {
+          retvalue = mmHashTryReadEntry( table, access, readentry, keylist[index] );
+        } while( retvalue == MM_HASH_TRYAGAIN );
+        MM_HASH_GLOBAL_UNLOCK( table );
+      }
+      retvalues[ batchbase + index ] = retvalue;
+      if( retvalue == MM_HASH_SUCCESS )
+        foundcount++;
+      readentry = ADDRESS( readentry, table->entrysize );
+    }
+  }
+
+  return foundcount;
+}
+
+
 
 ////
 
@@ -641,7 +762,7 @@ int mmHashDirectCallEntry( void *hashtable, const mmHashAccess *access, void *ca
   for( ; ; )
   {
     entry = MM_HASH_ENTRY( table, hashkey );
-    cmpvalue = access->entrycmp( table->context, entry, callentry );
+    cmpvalue = mmHashEntryCmp( table, access, entry, callentry );
     if( cmpvalue == MM_HASH_ENTRYCMP_INVALID )
       break;
     else if( cmpvalue == MM_HASH_ENTRYCMP_FOUND )
@@ -726,7 +847,7 @@ static int mmHashTryCallEntry( mmHashTable *table, const mmHashAccess *access, v
 
     /* Check for entry available */
     entry = MM_HASH_ENTRY( table, hashkey );
-    cmpvalue = access->entrycmp( table->context, entry, callentry );
+    cmpvalue = mmHashEntryCmp( table, access, entry, callentry );
     if( cmpvalue == MM_HASH_ENTRYCMP_INVALID )
       break;
     else if( cmpvalue == MM_HASH_ENTRYCMP_FOUND )
@@ -833,7 +954,7 @@ int mmHashDirectReplaceEntry( void *hashtable, const mmHashAccess *access, void
   for( ; ; )
   {
     entry = MM_HASH_ENTRY( table, hashkey );
-    cmpvalue = access->entrycmp( table->context, entry, replaceentry );
+    cmpvalue = mmHashEntryCmp( table, access, entry, replaceentry );
     if( cmpvalue == MM_HASH_ENTRYCMP_INVALID )
       break;
     else if( cmpvalue == MM_HASH_ENTRYCMP_FOUND )
@@ -917,7 +1038,7 @@ static int mmHashTryReplaceEntry( mmHashTable *table, const mmHashAccess *access
 
     /* Check for entry available */
     entry = MM_HASH_ENTRY( table, hashkey );
-    cmpvalue = access->entrycmp( table->context, entry, replaceentry );
+    cmpvalue = mmHashEntryCmp( table, access, entry, replaceentry );
     if( cmpvalue == MM_HASH_ENTRYCMP_INVALID )
       break;
     else if( cmpvalue == MM_HASH_ENTRYCMP_FOUND )
@@ -1026,7 +1147,7 @@ int mmHashDirectAddEntry( void *hashtable, const mmHashAccess *access, void *add
     /* Do we allow duplicate entries? */
     if( nodupflag )
     {
-      cmpvalue = access->entrycmp( table->context, entry, addentry );
+      cmpvalue = mmHashEntryCmp( table, access, entry, addentry );
       if( cmpvalue == MM_HASH_ENTRYCMP_INVALID )
         break;
       else if( cmpvalue == MM_HASH_ENTRYCMP_FOUND )
@@ -1034,7 +1155,7 @@ int mmHashDirectAddEntry( void *hashtable, const mmHashAccess *access, void *add
     }
     else
     {
-      if( !( access->entryvalid( table->context, entry ) ) )
+      if( !( mmHashEntryValid( table, access, entry ) ) )
         break;
     }
 #if MM_HASH_DEBUG_STATISTICS
@@ -1113,7 +1234,7 @@ static int mmHashTryAddEntry( mmHashTable *table, const mmHashAccess *access, vo
     /* Do we allow duplicate entries? */
     if( nodupflag )
     {
-      cmpvalue = access->entrycmp( table->context, entry, addentry );
+      cmpvalue = mmHashEntryCmp( table, access, entry, addentry );
       if( cmpvalue == MM_HASH_ENTRYCMP_INVALID )
         break;
       else if( cmpvalue == MM_HASH_ENTRYCMP_FOUND )
@@ -1124,7 +1245,7 @@ static int mmHashTryAddEntry( mmHashTable *table, const mmHashAccess *access, vo
     }
     else
     {
-      if( !( access->entryvalid( table->context, entry ) ) )
+      if( !( mmHashEntryValid( table, access, entry ) ) )
         break;
     }
 #if MM_HASH_DEBUG_STATISTICS
@@ -1220,7 +1341,7 @@ int mmHashDirectReadOrAddEntry( void *hashtable, const mmHashAccess *access, voi
   for( ; ; )
   {
     entry = MM_HASH_ENTRY( table, hashkey );
-    cmpvalue = access->entrycmp( table->context, entry, readaddentry );
+    cmpvalue = mmHashEntryCmp( table, access, entry, readaddentry );
     if( cmpvalue == MM_HASH_ENTRYCMP_INVALID )
       break;
     else if( cmpvalue == MM_HASH_ENTRYCMP_FOUND )
@@ -1304,7 +1425,7 @@ static int mmHashTryReadOrAddEntry( mmHashTable *table, const mmHashAccess *acce
     /* Check for entry available */
     entry = MM_HASH_ENTRY( table, hashkey );
 
-    cmpvalue = access->entrycmp( table->context, entry, readaddentry );
+    cmpvalue = mmHashEntryCmp( table, access, entry, readaddentry );
     if( cmpvalue == MM_HASH_ENTRYCMP_INVALID )
       break;
     else if( cmpvalue == MM_HASH_ENTRYCMP_FOUND )
@@ -1407,7 +1528,7 @@ int mmHashDirectDeleteEntry( void *hashtable, const mmHashAccess *access, void *
   for( ; ; )
   {
     entry = MM_HASH_ENTRY( table, hashkey );
-    cmpvalue = access->entrycmp( table->context, entry, deleteentry );
+    cmpvalue = mmHashEntryCmp( table, access, entry, deleteentry );
     if( cmpvalue == MM_HASH_ENTRYCMP_INVALID )
       return MM_HASH_FAILURE;
     else if( cmpvalue == MM_HASH_ENTRYCMP_FOUND )
@@ -1432,7 +1553,7 @@ int mmHashDirectDeleteEntry( void *hashtable, const mmHashAccess *access, void *
     if( delbase == 0 )
       delbase = table->hashsize;
     delbase--;
-    if( !( access->entryvalid( table->context, MM_HASH_ENTRY( table, delbase ) ) ) )
+    if( !( mmHashEntryValid( table, access, MM_HASH_ENTRY( table, delbase ) ) ) )
       break;
 #if MM_HASH_DEBUG_STATISTICS
     mmAtomicAddL( &table->statdelrewindcount, 1 );
@@ -1456,7 +1577,7 @@ int mmHashDirectDeleteEntry( void *hashtable, const mmHashAccess *access, void *
 
       /* Try next entry */
       srcentry = MM_HASH_ENTRY( table, srcpos );
-      if( !( access->entryvalid( table->context, srcentry ) ) )
+      if( !( mmHashEntryValid( table, access, srcentry ) ) )
         break;
       srckey = access->entrykey( table->context, srcentry );
       if( table->flags & MM_HASH_FLAGS_HASHSIZE_ISPOW2 )
@@ -1555,7 +1676,7 @@ static int mmHashTryDeleteEntry( mmHashTable *table, const mmHashAccess *access,
 
     /* Check for entry match */
     entry = MM_HASH_ENTRY( table, hashkey );
-    cmpvalue = access->entrycmp( table->context, entry, deleteentry );
+    cmpvalue = mmHashEntryCmp( table, access, entry, deleteentry );
     if( cmpvalue == MM_HASH_ENTRYCMP_INVALID )
     {
       retvalue = MM_HASH_FAILURE;
@@ -1583,7 +1704,7 @@ static int mmHashTryDeleteEntry( mmHashTable *table, const mmHashAccess *access,
     if( delbase == 0 )
       delbase = table->hashsize;
     delbase--;
-    if( !( access->entryvalid( table->context, MM_HASH_ENTRY( table, delbase ) ) ) )
+    if( !( mmHashEntryValid( table, access, MM_HASH_ENTRY( table, delbase ) ) ) )
       break;
 #if MM_HASH_DEBUG_STATISTICS
     mmAtomicAddL( &table->statdelrewindcount, 1 );
@@ -1614,7 +1735,7 @@ static int mmHashTryDeleteEntry( mmHashTable *table, const mmHashAccess *access,
 
     /* Check for valid entry */
     srcentry = MM_HASH_ENTRY( table, srcend );
-    if( !( access->entryvalid( table->context, srcentry ) ) )
+    if( !( mmHashEntryValid( table, access, srcentry ) ) )
       break;
   }
 
@@ -1981,7 +2102,7 @@ static int mmHashLockRangeTry( mmHashTable *table, const mmHashAccess *access, m
 
     /* Check for valid entry */
     srcentry = MM_HASH_ENTRY( table, srckey );
-    if( !( access->entryvalid( table->context, srcentry ) ) )
+    if( !( mmHashEntryValid( table, access, srcentry ) ) )
     {
       if( --newcount <= 0 )
         break;
@@ -2177,7 +2298,7 @@ void mmHashDirectDebugDuplicate( void *hashtable, const mmHashAccess *access, vo
       if( hashkey == table->hashsize )
         hashkey = 0;
       entry = MM_HASH_ENTRY( table, hashkey );
-      if( !( access->entryvalid( table->context, entry ) ) )
+      if( !( mmHashEntryValid( table, access, entry ) ) )
         break;
       if( access->entrycmp( table->context, entry, baseentry ) )
         callback( opaque, entry, baseentry );
@@ -2323,7 +2444,7 @@ double mmHashGetHealthScore( void *hashtable, const mmHashAccess *access )
   entry = MM_HASH_ENTRYLIST( table );
   for( hashkey = 0 ; hashkey < table->hashsize ; hashkey++ )
   {
-    if( access->entryvalid( table->context, entry ) )
+    if( mmHashEntryValid( table, access, entry ) )
     {
       totalentrycount++;
       busysequence++;
@@ -2388,7 +2509,7 @@ void mmHashPrintHealth( void *hashtable, const mmHashAccess *access )
   entry = MM_HASH_ENTRYLIST( table );
   for( hashkey = 0 ; hashkey < table->hashsize ; hashkey++ )
   {
-    if( access->entryvalid( table->context, entry ) )
+    if( mmHashEntryValid( table, access, entry ) )
     {
       totalentrycount++;
       entryhashkey = access->entrykey( table->context, entry ) % table->hashsize;
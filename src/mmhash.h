@@ -88,6 +88,15 @@ typedef struct
 /* Internal only: table->hashsize is a power of two, table->hashbits and table->hashmask are usable */
 #define MM_HASH_FLAGS_HASHSIZE_ISPOW2 (0x2)
 
+/* The first 8 bytes of each entry are its whole key, compared inline instead of calling entrycmp() and entryvalid() */
+/* The clearentry() callback must set these 8 bytes to all ones, a key that valid entries never hold */
+#define MM_HASH_FLAGS_KEY64 (0x4)
+
+
+/* Only for mmHashInit(), leave the entries uncleared ; mmHashClearPart() must then be called for all parts before the table is used */
+/* Lets the threads that will access each range of the table first touch its memory, placing it on their NUMA nodes */
+#define MM_HASH_FLAGS_NO_CLEAR (0x8)
+
 
 size_t mmHashRequiredSize( size_t entrysize, size_t hashsize, uint32_t pageshift );
 void mmHashInit( void *hashtable, const mmHashAccess *access, size_t entrysize, size_t hashsize, uint32_t pageshift, uint32_t flags, void *context );
@@ -98,6 +107,9 @@ int mmHashGetStatus( void *hashtable, size_t *rethashsize );
 /* Clear/empty the hash table */
 void mmHashReset( void *hashtable, const mmHashAccess *access );
 
+/* Clear part partindex of partcount equal ranges of entries, used after mmHashInit() with MM_HASH_FLAGS_NO_CLEAR */
+void mmHashClearPart( void *hashtable, const mmHashAccess *access, int partindex, int partcount );
+
 /* Hash status will be MM_HASH_STATUS_MUSTGROW if entrycount >= maxcount*grow */
 /* Hash status will be MM_HASH_STATUS_MUSTSHRINK if entrycount < maxcount*shrink */
 void mmHashSetResizeCriteria( void *hashtable, float shrinkfactor, float growfactor );
@@ -119,6 +131,8 @@ void mmHashLockListEntry( void *hashtable, const mmHashAccess *access, void *lis
 
 int mmHashDirectReadEntry( void *hashtable, const mmHashAccess *access, void *readentry );
 int mmHashLockReadEntry( void *hashtable, const mmHashAccess *access, void *readentry );
+/* Read entrycount consecutive entries of entrysize bytes, retvalues receives MM_HASH_SUCCESS or MM_HASH_FAILURE for each ; returns the count of entries found */
+int mmHashLockReadEntries( void *hashtable, const mmHashAccess *access, void *readentries, int entrycount, int *retvalues );
 
 int mmHashDirectCallEntry( void *hashtable, const mmHashAccess *access, void *callentry, void (*callback)( void *opaque, void *entry, int newflag ), void *opaque, int addflag );
 int mmHashLockCallEntry( void *hashtable, const mmHashAccess *access, void *callentry, void (*callback)( void *opaque, void *entry, int newflag ), void *opaque, int addflag );
@@ -0,0 +1,274 @@
+/* *****************************************************************************
+ *
+ * Copyright (c) 2012-2023 Alexis Naveros.
+ * Portions developed under contract to the SURVICE Engineering Company.
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ * claim that you wrote the original software. If you use this software
+ * in a product, an acknowledgment in the product documentation would be
+ * appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ * misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ *
+ * *****************************************************************************
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+
+
+#include "cc.h"
+#include "mm.h"
+
+#include "mmradixheap.h"
+
+
+////
+
+
+/* Keys are split in 4 digits of 8 bits, items differing from the last minimum at the same highest digit share a level of 256 buckets */
+/* Wider digits mean fewer moves of each item down the levels, DIGIT_BITS must divide 32 */
+#define MM_RADIXHEAP_DIGIT_BITS (8)
+#define MM_RADIXHEAP_DIGIT_COUNT (32/MM_RADIXHEAP_DIGIT_BITS)
+#define MM_RADIXHEAP_LEVEL_BUCKET_COUNT (1<<MM_RADIXHEAP_DIGIT_BITS)
+#define MM_RADIXHEAP_BUCKET_COUNT (MM_RADIXHEAP_DIGIT_COUNT*MM_RADIXHEAP_LEVEL_BUCKET_COUNT)
+#define MM_RADIXHEAP_MASK_COUNT ((MM_RADIXHEAP_BUCKET_COUNT+63)>>6)
+
+
+struct mmRadixHeap
+{
+  int numanodeindex;
+  size_t itemlistoffset;
+
+  /* Callback to user code to obtain the value of an item */
+  double (*itemvalue)( void *item );
+
+  /* Key of the last minimum extracted */
+  uint32_t last;
+
+  /* Items at or below the last minimum */
+  void *first;
+
+  /* Buckets in increasing order of keys, bits of buckets that may hold items ; removals leave bits set until the next scan */
+  uint64_t bucketmask[MM_RADIXHEAP_MASK_COUNT];
+  void *bucket[MM_RADIXHEAP_BUCKET_COUNT];
+  /* Lowest key added to each bucket since it was last emptied, at or below the minimum of its items */
+  uint32_t bucketmin[MM_RADIXHEAP_BUCKET_COUNT];
+};
+
+
+////
+
+
+/* Order-preserving integer form of a float, values are compared at the same precision as mmBinSort */
+static inline uint32_t mmRadixHeapKey( double value )
+{
+  float f;
+  uint32_t key;
+  f = (float)value;
+  memcpy( &key, &f, sizeof(uint32_t) );
+  if( key & 0x80000000 )
+    key = ~key;
+  else
+    key |= 0x80000000;
+  return key;
+}
+
+static inline int mmRadixHeapHighBit( uint32_t v )
+{
+#if defined(__GNUC__)
+  return 31 - __builtin_clz( v );
+#else
+  return (int)ccLog2Int32( v );
+#endif
+}
+
+static inline int mmRadixHeapLowBit( uint64_t v )
+{
+#if defined(__GNUC__)
+  return __builtin_ctzll( v );
+#else
+  int bit;
+  for( bit = 0 ; !( v & 0x1 ) ; bit++ )
+    v >>= 1;
+  return bit;
+#endif
+}
+
+/* Add item to the first list or to the bucket of the highest digit differing from the last minimum */
+static inline void mmRadixHeapInsert( mmRadixHeap *radixheap, void *item, uint32_t key )
+{
+  int digit, bucketindex;
+  if( key <= radixheap->last )
+  {
+    mmListAdd( &radixheap->first, item, radixheap->itemlistoffset );
+    return;
+  }
+  digit = mmRadixHeapHighBit( key ^ radixheap->last ) / MM_RADIXHEAP_DIGIT_BITS;
+  bucketindex = ( digit * MM_RADIXHEAP_LEVEL_BUCKET_COUNT ) + ( ( key >> ( digit * MM_RADIXHEAP_DIGIT_BITS ) ) & ( MM_RADIXHEAP_LEVEL_BUCKET_COUNT - 1 ) );
+  mmListAdd( &radixheap->bucket[bucketindex], item, radixheap->itemlistoffset );
+  radixheap->bucketmask[ bucketindex >> 6 ] |= ((uint64_t)1) << ( bucketindex & 63 );
+  if( key < radixheap->bucketmin[bucketindex] )
+    radixheap->bucketmin[bucketindex] = key;
+  return;
+}
+
+static inline void mmRadixHeapClearBucket( mmRadixHeap *radixheap, int bucketindex )
+{
+  radixheap->bucketmask[ bucketindex >> 6 ] &= ~( ((uint64_t)1) << ( bucketindex & 63 ) );
+  radixheap->bucketmin[bucketindex] = 0xffffffff;
+  return;
+}
+
+
+////
+
+
+mmRadixHeap *mmRadixHeapInit( size_t itemlistoffset, double (*itemvaluecallback)( void *item ), int numanodeindex )
+{
+  int bucketindex;
+  mmRadixHeap *radixheap;
+
+  if( numanodeindex >= 0 )
+    radixheap = mmNumaAlloc( numanodeindex, sizeof(mmRadixHeap) );
+  else
+    radixheap = malloc( sizeof(mmRadixHeap) );
+  radixheap->numanodeindex = numanodeindex;
+  radixheap->itemlistoffset = itemlistoffset;
+  radixheap->itemvalue = itemvaluecallback;
+  radixheap->last = 0;
+  radixheap->first = 0;
+  for( bucketindex = 0 ; bucketindex < MM_RADIXHEAP_MASK_COUNT ; bucketindex++ )
+    radixheap->bucketmask[bucketindex] = 0;
+  for( bucketindex = 0 ; bucketindex < MM_RADIXHEAP_BUCKET_COUNT ; bucketindex++ )
+  {
+    radixheap->bucket[bucketindex] = 0;
+    radixheap->bucketmin[bucketindex] = 0xffffffff;
+  }
+
+  return radixheap;
+}
+
+
+void mmRadixHeapFree( mmRadixHeap *radixheap )
+{
+  if( radixheap->numanodeindex >= 0 )
+    mmNumaFree( radixheap->numanodeindex, radixheap, sizeof(mmRadixHeap) );
+  else
+    free( radixheap );
+  return;
+}
+
+
+////
+
+
+void mmRadixHeapAdd( mmRadixHeap *radixheap, void *item, double itemvalue )
+{
+  mmRadixHeapInsert( radixheap, item, mmRadixHeapKey( itemvalue ) );
+  return;
+}
+
+/* Items are unlinked from their bucket list, the value is not needed ; kept for the same interface as mmBinSort */
+void mmRadixHeapRemove( mmRadixHeap *radixheap, void *item, double itemvalue )
+{
+  (void)itemvalue;
+  mmListRemove( item, radixheap->itemlistoffset );
+  return;
+}
+
+void mmRadixHeapUpdate( mmRadixHeap *radixheap, void *item, double olditemvalue, double newitemvalue )
+{
+  (void)olditemvalue;
+  mmListRemove( item, radixheap->itemlistoffset );
+  mmRadixHeapAdd( radixheap, item, newitemvalue );
+  return;
+}
+
+
+////
+
+
+/* Find the minimum, redistributing the first non-empty bucket when no item is at or below the last minimum */
+static void *mmRadixHeapFindFirst( mmRadixHeap *radixheap, double failmax )
+{
+  int maskindex, bucketindex;
+  uint32_t failkey;
+  uint64_t mask;
+  void *item, *itemnext;
+
+  failkey = mmRadixHeapKey( failmax );
+  for( ; ; )
+  {
+    item = radixheap->first;
+    if( item )
+    {
+      /* Items of the first list are at or below the last minimum, only above failmax if failmax was lowered */
+      if( mmRadixHeapKey( radixheap->itemvalue( item ) ) > failkey )
+        return 0;
+      return item;
+    }
+
+    /* Find the first non-empty bucket, clearing bits of buckets emptied by removals */
+    for( maskindex = 0 ; maskindex < MM_RADIXHEAP_MASK_COUNT ; maskindex++ )
+    {
+      for( mask = radixheap->bucketmask[maskindex] ; mask ; mask &= mask - 1 )
+      {
+        bucketindex = ( maskindex << 6 ) + mmRadixHeapLowBit( mask );
+        if( radixheap->bucket[bucketindex] )
+          goto found;
+        mmRadixHeapClearBucket( radixheap, bucketindex );
+      }
+    }
+    return 0;
+
+    found:
+    /* Leave the heap untouched, the last minimum must never rise above failmax */
+    if( radixheap->bucketmin[bucketindex] > failkey )
+      return 0;
+
+    /* All items of the bucket move to the first list or to lower buckets ; with a stale bucket minimum, the first list may remain empty */
+    radixheap->last = radixheap->bucketmin[bucketindex];
+    item = radixheap->bucket[bucketindex];
+    radixheap->bucket[bucketindex] = 0;
+    mmRadixHeapClearBucket( radixheap, bucketindex );
+    for( ; item ; item = itemnext )
+    {
+      itemnext = ((mmListNode *)ADDRESS( item, radixheap->itemlistoffset ))->next;
+      mmRadixHeapInsert( radixheap, item, mmRadixHeapKey( radixheap->itemvalue( item ) ) );
+    }
+  }
+
+  return 0;
+}
+
+
+void *mmRadixHeapGetFirst( mmRadixHeap *radixheap, double failmax )
+{
+  return mmRadixHeapFindFirst( radixheap, failmax );
+}
+
+
+void *mmRadixHeapGetRemoveFirst( mmRadixHeap *radixheap, double failmax )
+{
+  void *item;
+  item = mmRadixHeapFindFirst( radixheap, failmax );
+  if( item )
+    mmListRemove( item, radixheap->itemlistoffset );
+  return item;
+}
+
@@ -0,0 +1,293 @@
+/* *****************************************************************************
+ *
+ * Copyright (c) 2012-2023 Alexis Naveros.
+ * Portions developed under contract to the SURVICE Engineering Company.
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ * claim that you wrote the original software. If you use this software
+ * in a product, an acknowledgment in the product documentation would be
+ * appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ * misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ *
+ * *****************************************************************************
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+
+
+#include "cc.h"
+#include "mm.h"
+#include "mmthread.h"
+#include "mmatomic.h"
+
+#include "mmtrace.h"
+#include "meshtrace.h"
+
+
+////
+
+
+typedef struct
+{
+  /* Read without the mutex by mmTraceRunBegin() to skip it when no trace is active, written with it held */
+  mmAtomic32 activeflag;
+  size_t eventcount;
+  uint64_t basetime;
+  int runcount;
+  /* Count of runs begun and not yet ended, mmTraceEnd() waits for it to drop to zero */
+  int activeruncount;
+  mmTraceRun *runlist;
+  /* Initialized by the first mmTraceBegin() */
+  int signalinitflag;
+  mtSignal runsignal;
+} mmTraceState;
+
+static mtMutex mmTraceMutex = MT_MUTEX_INITIALIZER;
+static mmTraceState mmTrace;
+
+
+////
+
+
+int mmTraceBegin( size_t eventcount )
+{
+  size_t roundcount;
+  mtMutexLock( &mmTraceMutex );
+  if( mmAtomicRead32( &mmTrace.activeflag ) )
+  {
+    mtMutexUnlock( &mmTraceMutex );
+    return 0;
+  }
+  if( !( mmTrace.signalinitflag ) )
+  {
+    mtSignalInit( &mmTrace.runsignal );
+    mmTrace.signalinitflag = 1;
+  }
+  for( roundcount = 256 ; roundcount < eventcount ; roundcount <<= 1 );
+  mmTrace.eventcount = roundcount;
+  mmTrace.basetime = mmGetMicrosecondsTime();
+  mmTrace.runcount = 0;
+  mmTrace.activeruncount = 0;
+  mmTrace.runlist = 0;
+  mmAtomicWrite32( &mmTrace.activeflag, 1 );
+  mtMutexUnlock( &mmTraceMutex );
+  return 1;
+}
+
+
+static void mmTraceRunRelease()
+{
+  mtMutexLock( &mmTraceMutex );
+  if( !( --mmTrace.activeruncount ) )
+    mtSignalBroadcast( &mmTrace.runsignal );
+  mtMutexUnlock( &mmTraceMutex );
+  return;
+}
+
+
+uint64_t mmTraceGetTime()
+{
+  return mmGetMicrosecondsTime();
+}
+
+
+mmTraceRun *mmTraceRunBegin( const char *name, int threadcount )
+{
+  int threadindex;
+  size_t eventcount;
+  mmTraceRun *run;
+  mmTraceBuffer *buffer;
+
+  if( !( mmAtomicRead32( &mmTrace.activeflag ) ) )
+    return 0;
+  /* Count the run as active right away, mmTraceEnd() then waits for it even before it's registered */
+  mtMutexLock( &mmTraceMutex );
+  if( !( mmAtomicRead32( &mmTrace.activeflag ) ) )
+  {
+    mtMutexUnlock( &mmTraceMutex );
+    return 0;
+  }
+  eventcount = mmTrace.eventcount;
+  mmTrace.activeruncount++;
+  mtMutexUnlock( &mmTraceMutex );
+
+  run = malloc( sizeof(mmTraceRun) );
+  if( !( run ) )
+    goto error;
+  run->name = name;
+  run->threadcount = threadcount;
+  run->bufferlist = malloc( ( threadcount + 1 ) * sizeof(mmTraceBuffer) );
+  if( !( run->bufferlist ) )
+  {
+    free( run );
+    goto error;
+  }
+  for( threadindex = 0 ; threadindex <= threadcount ; threadindex++ )
+  {
+    buffer = &run->bufferlist[threadindex];
+    buffer->eventlist = malloc( eventcount * sizeof(mmTraceEvent) );
+    buffer->eventmask = eventcount - 1;
+    buffer->writeindex = 0;
+    if( !( buffer->eventlist ) )
+    {
+      for( ; threadindex >= 0 ; threadindex-- )
+        free( run->bufferlist[threadindex].eventlist );
+      free( run->bufferlist );
+      free( run );
+      goto error;
+    }
+  }
+
+  /* The trace can't end while the run is counted as active */
+  mtMutexLock( &mmTraceMutex );
+  run->runindex = ++mmTrace.runcount;
+  run->next = mmTrace.runlist;
+  mmTrace.runlist = run;
+  mtMutexUnlock( &mmTraceMutex );
+
+  return run;
+
+  error:
+  mmTraceRunRelease();
+  return 0;
+}
+
+
+void mmTraceRunEnd( mmTraceRun *run )
+{
+  if( run )
+    mmTraceRunRelease();
+  return;
+}
+
+
+////
+
+
+static void mmTraceWriteString( FILE *file, const char *string )
+{
+  fputc( '"', file );
+  for( ; *string ; string++ )
+  {
+    if( ( *string == '"' ) || ( *string == '\\' ) )
+      fputc( '\\', file );
+    if( (unsigned char)*string >= 0x20 )
+      fputc( *string, file );
+  }
+  fputc( '"', file );
+  return;
+}
+
+static void mmTraceWriteRun( FILE *file, mmTraceRun *run, uint64_t basetime, int *firstflag )
+{
+  int threadindex;
+  size_t index, first;
+  uint64_t begintime;
+  mmTraceBuffer *buffer;
+  mmTraceEvent *event;
+
+  fprintf( file, "%s\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":0,\"args\":{\"name\":", ( *firstflag ? "" : "," ), run->runindex );
+  *firstflag = 0;
+  mmTraceWriteString( file, run->name );
+  fprintf( file, "}}" );
+  for( threadindex = 0 ; threadindex <= run->threadcount ; threadindex++ )
+  {
+    buffer = &run->bufferlist[threadindex];
+    if( threadindex < run->threadcount )
+      fprintf( file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"Thread %d\"}}", run->runindex, threadindex, threadindex );
+    else
+      fprintf( file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"Caller\"}}", run->runindex, threadindex );
+    first = 0;
+    if( buffer->writeindex > buffer->eventmask )
+      first = buffer->writeindex - ( buffer->eventmask + 1 );
+    for( index = first ; index < buffer->writeindex ; index++ )
+    {
+      event = &buffer->eventlist[ index & buffer->eventmask ];
+      fprintf( file, ",\n{\"name\":" );
+      mmTraceWriteString( file, event->name );
+      begintime = ( event->begintime > basetime ? event->begintime - basetime : 0 );
+      fprintf( file, ",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"ts\":%llu,\"dur\":%llu", run->runindex, threadindex, (unsigned long long)begintime, (unsigned long long)( event->endtime - event->begintime ) );
+      if( event->argname )
+      {
+        fprintf( file, ",\"args\":{" );
+        mmTraceWriteString( file, event->argname );
+        fprintf( file, ":%lld}", (long long)event->arg );
+      }
+      fprintf( file, "}" );
+    }
+  }
+
+  return;
+}
+
+
+int mmTraceEnd( const char *filename )
+{
+  int threadindex, firstflag, retval;
+  mmTraceRun *run, *runnext, *runreverse;
+  FILE *file;
+
+  mtMutexLock( &mmTraceMutex );
+  if( !( mmAtomicRead32( &mmTrace.activeflag ) ) )
+  {
+    mtMutexUnlock( &mmTraceMutex );
+    return 0;
+  }
+  /* No new run can begin, wait for the runs in progress to end before writing and freeing their buffers */
+  mmAtomicWrite32( &mmTrace.activeflag, 0 );
+  while( mmTrace.activeruncount )
+    mtSignalWait( &mmTrace.runsignal, &mmTraceMutex );
+  mtMutexUnlock( &mmTraceMutex );
+
+  /* Runs were prepended as they began, reverse the list to write them in order */
+  runreverse = 0;
+  for( run = mmTrace.runlist ; run ; run = runnext )
+  {
+    runnext = run->next;
+    run->next = runreverse;
+    runreverse = run;
+  }
+
+  retval = 0;
+  file = 0;
+  if( filename )
+    file = fopen( filename, "w" );
+  if( file )
+  {
+    fprintf( file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[" );
+    firstflag = 1;
+    for( run = runreverse ; run ; run = run->next )
+      mmTraceWriteRun( file, run, mmTrace.basetime, &firstflag );
+    fprintf( file, "\n]}\n" );
+    retval = ( fclose( file ) == 0 );
+  }
+
+  for( run = runreverse ; run ; run = runnext )
+  {
+    runnext = run->next;
+    for( threadindex = 0 ; threadindex <= run->threadcount ; threadindex++ )
+      free( run->bufferlist[threadindex].eventlist );
+    free( run->bufferlist );
+    free( run );
+  }
+  mmTrace.runlist = 0;
+
+  return retval;
+}
+
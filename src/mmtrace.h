@@ -0,0 +1,91 @@
+/* *****************************************************************************
+ *
+ * Copyright (c) 2012-2023 Alexis Naveros.
+ * Portions developed under contract to the SURVICE Engineering Company.
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ * claim that you wrote the original software. If you use this software
+ * in a product, an acknowledgment in the product documentation would be
+ * appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ * misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ *
+ * *****************************************************************************
+ */
+
+#ifndef MMTRACE_H
+#define MMTRACE_H
+
+
+////
+
+
+typedef struct
+{
+  const char *name;
+  const char *argname;
+  int64_t arg;
+  uint64_t begintime;
+  uint64_t endtime;
+} mmTraceEvent;
+
+/* Ring buffer of events, only ever written by the thread that owns it */
+typedef struct
+{
+  mmTraceEvent *eventlist;
+  size_t eventmask;
+  size_t writeindex;
+  char padding[64];
+} mmTraceBuffer;
+
+typedef struct mmTraceRun
+{
+  const char *name;
+  int runindex;
+  int threadcount;
+  /* One buffer per thread, plus a last one for the caller's thread performing initialization and output */
+  mmTraceBuffer *bufferlist;
+  struct mmTraceRun *next;
+} mmTraceRun;
+
+
+/* Register a new run of threadcount threads, returns null when no trace is active */
+mmTraceRun *mmTraceRunBegin( const char *name, int threadcount );
+
+/* Done recording spans for the run, mmTraceEnd() waits for all runs to end ; run can be null */
+void mmTraceRunEnd( mmTraceRun *run );
+
+/* Current time in microseconds, for modules not otherwise using mm.h ; spans are written relative to mmTraceBegin() */
+uint64_t mmTraceGetTime();
+
+
+/* Record a span for threadindex, use threadindex==threadcount for the caller's thread */
+static inline void mmTraceSpan( mmTraceRun *run, int threadindex, const char *name, const char *argname, int64_t arg, uint64_t begintime, uint64_t endtime )
+{
+  mmTraceBuffer *buffer;
+  mmTraceEvent *event;
+  buffer = &run->bufferlist[ threadindex ];
+  event = &buffer->eventlist[ buffer->writeindex & buffer->eventmask ];
+  event->name = name;
+  event->argname = argname;
+  event->arg = arg;
+  event->begintime = begintime;
+  event->endtime = endtime;
+  buffer->writeindex++;
+  return;
+}
+
+
+////
+
+
+#endif